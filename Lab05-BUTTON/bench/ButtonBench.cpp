@@ -0,0 +1,655 @@
+/*******************************************************************************
+ * ButtonBench.cpp -- host benchmarks for ButtonNode.cpp ([env:native] only)
+ *
+ *   pio run -e native && .pio/build/native/program [messages]
+ *
+ * Runs the node's setup() against the Arduino/WiFi/PubSubClient stand-ins
+ * in Lab05-Common/native, then pushes synthetic ledStatus messages through
+ * processMQTTMessage_B() (via the stand-in client, so the payload sits in
+ * the client buffer exactly as it would on the ESP32) and reports
+ * ns/message, heap allocations per message and p50/p99/p99.9 latency,
+ * for JSON payloads and for the MessagePack ones the LED node sends in
+ * answer to MessagePack commands.
+ *
+ * Then checks the interrupt-driven button capture:
+ *  - edge-replay: recorded-style bouncy edge traces (presses, long
+ *    presses, double presses on both buttons) replayed through an
+ *    EdgeQueue into ButtonClassifiers; every gesture must be classified
+ *    exactly as scripted.
+ *  - edge-flood: a second thread drives the "on" button through
+ *    shim::setPinInput() (so the node's own ISR runs there, as on another
+ *    core) in bursts of back-to-back edges while the main thread runs
+ *    loop(); every edge must reach the node with none dropped.
+ *
+ * And the round-trip tracing:
+ *  - histogram: a million latencies (a log-uniform spread from 100us to
+ *    10s) into LatencyHistogram; its p50/p99/p99.9 must be within one
+ *    bucket (1/32) above the exact percentiles of the same samples.
+ *  - rtt: the node sends ledCommands, the bench answers each as the LED
+ *    node would (echoing seq/ts) after a known simulated delay, skipping
+ *    one reply and repeating another, then fires the stats timer; the
+ *    published btnNodeXX/stats must count every reply, the skipped and
+ *    the repeated one, and report the RTT percentiles of those delays.
+ *    The node's metrics must count the same commands and replies.
+ *  - coalesce: a burst of alternating presses inside COMMAND_COALESCE_MS
+ *    must go out as the first press and the net intent only; presses
+ *    beyond COMMAND_MAX_IN_FLIGHT unanswered commands must wait for a
+ *    reply, which answers its command and every earlier one by seq; the
+ *    rest must be counted lost after COMMAND_ACK_TIMEOUT_MS, and the
+ *    stats message must report the lost and coalesced counts.
+ *
+ * retained-state delivers the LED node's retained <led>/state and
+ * <led>/availability messages, as the broker does on subscribing; the
+ * node must take the LED state from them before any command is sent,
+ * and follow later changes and the "offline" last will.
+ *
+ * network-stall presses the "on" button every 100 ms while every ledCommand
+ * publish stalls for kStallMs (a congested broker), and reports the time
+ * from each press's edge to the node acting on it. Every press must still
+ * be acted on, and none sent again while the first "on" is in flight;
+ * with DUAL_CORE (pio run -e native_dualcore) only that one must go out,
+ * and the p99 must stay under 10 ms, since the presses no longer wait
+ * behind the publishes.
+ * That build runs only the edge, histogram and network-stall checks: the
+ * others drive psClient from the bench thread, which belongs to the
+ * network task there.
+ * Exits with status 1 if any check fails.
+ ******************************************************************************/
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <ButtonClassifier.h>
+#include <EdgeQueue.h>
+#include <JsonScan.h>
+#include <LatencyHistogram.h>
+#include <NativeBench.h>
+#include <NativeShim.h>
+#include <PubSubClient.h>
+
+#include <math.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "ButtonNode.h"
+
+// the sketch's node and entry points (ButtonNode.cpp)
+extern ButtonNode buttonNode;
+void setup();
+void loop();
+
+namespace {
+
+// the parts of the node the benchmarks drive
+PubSubClient& psClient = buttonNode.psClient;
+const char* const buttonClientID = buttonNode.buttonClientID;
+EdgeQueue& buttonEdges = buttonNode.buttonEdges;
+ButtonClassifier& onButton = buttonNode.onButton;
+ButtonClassifier& offButton = buttonNode.offButton;
+LatencyHistogram& pressLatency = buttonNode.pressLatency;
+
+struct Payload {
+  char text[96];
+  unsigned int length;
+};
+
+// JSON on/off, then MessagePack on/off
+Payload payloads[4];
+
+void buildPayloads() {
+  payloads[0].length =
+      snprintf(payloads[0].text, sizeof(payloads[0].text),
+               "{\"ledStatus\":\"on\",\"msg\":\"I've seen the light!\"}");
+  payloads[1].length = snprintf(
+      payloads[1].text, sizeof(payloads[1].text),
+      "{\"ledStatus\":\"off\",\"msg\":\"And darkness fell upon the land...\"}");
+
+  JsonDocument doc;
+  for (int i = 0; i < 2; i++) {
+    doc.clear();
+    doc["ledStatus"] = i ? "off" : "on";
+    payloads[2 + i].length = serializeMsgPack(doc, payloads[2 + i].text);
+  }
+}
+
+#ifndef DUAL_CORE  // the DUAL_CORE build does not time the callback
+void benchLedStatus(const char* name, const Payload* payloads,
+                    long messages) {
+  char topic[64];
+  snprintf(topic, sizeof(topic), "%s/ledStatus", buttonClientID);
+
+  for (int i = 0; i < 1000; i++) {
+    const Payload& p = payloads[i & 1];
+    psClient.deliver(topic, (const uint8_t*)p.text, p.length);
+  }
+
+  bench::LatencyStats stats(messages);
+  uint64_t allocsBefore = bench::allocCount();
+  for (long i = 0; i < messages; i++) {
+    const Payload& p = payloads[i & 1];
+    uint64_t start = bench::nowNanos();
+    psClient.deliver(topic, (const uint8_t*)p.text, p.length);
+    stats.add(bench::nowNanos() - start);
+  }
+  bench::printRow(name, stats, bench::allocCount() - allocsBefore);
+}
+#endif
+
+// ---- edge-replay ---------------------------------------------------------
+
+// the node's timings (ButtonNode.h); the traces below are scripted for them
+const uint32_t kDebounceMs = 10;
+const uint32_t kLongPressMs = 800;
+const uint32_t kDoublePressMs = 300;
+
+struct TraceEdge {
+  uint32_t micros;
+  uint8_t pin;
+  uint8_t level;
+};
+
+struct Expected {
+  uint32_t presses, longPresses, doublePresses;
+};
+
+uint32_t traceRandom = 12345;
+uint32_t nextRandom(uint32_t range) {
+  traceRandom = traceRandom * 1103515245u + 12345u;
+  return (traceRandom >> 8) % range;
+}
+
+// One contact change on an active-low button: the new level, then a few
+// bounces 50-800us apart, always ending at the new level.
+void addContact(std::vector<TraceEdge>& trace, uint8_t pin, uint32_t& t,
+                uint8_t level) {
+  trace.push_back({t, pin, level});
+  int bounces = nextRandom(4) * 2;
+  for (int i = 0; i < bounces; i++) {
+    t += 50 + nextRandom(750);
+    trace.push_back({t, pin, (uint8_t)((i & 1) ? level : !level)});
+  }
+}
+
+void addPress(std::vector<TraceEdge>& trace, uint8_t pin, uint32_t& t,
+              uint32_t holdMs) {
+  uint32_t pressedAt = t;
+  addContact(trace, pin, t, LOW);
+  t = pressedAt + holdMs * 1000;
+  addContact(trace, pin, t, HIGH);
+}
+
+// A scripted session on one button; pins interleave in time.
+void buildTrace(std::vector<TraceEdge>& trace, uint8_t pin, uint32_t start,
+                int rounds, Expected& expected) {
+  uint32_t t = start;
+  for (int r = 0; r < rounds; r++) {
+    addPress(trace, pin, t, 60 + nextRandom(200));  // press
+    t += 500000 + nextRandom(500000);
+    addPress(trace, pin, t, 1000 + nextRandom(500));  // long press
+    t += 500000 + nextRandom(500000);
+    addPress(trace, pin, t, 60 + nextRandom(60));  // double press
+    t += 100000 + nextRandom(100000);
+    addPress(trace, pin, t, 60 + nextRandom(60));
+    t += 500000 + nextRandom(500000);
+  }
+  expected.presses += rounds * 4;
+  expected.longPresses += rounds;
+  expected.doublePresses += rounds;
+}
+
+bool benchEdgeReplay(int rounds) {
+  std::vector<TraceEdge> trace;
+  Expected expected[2] = {};
+  uint8_t pins[2] = {onButton.pin(), offButton.pin()};
+  buildTrace(trace, pins[0], 1000000, rounds, expected[0]);
+  buildTrace(trace, pins[1], 1333000, rounds, expected[1]);
+  std::stable_sort(trace.begin(), trace.end(),
+                   [](const TraceEdge& a, const TraceEdge& b) {
+                     return (int32_t)(a.micros - b.micros) < 0;
+                   });
+
+  EdgeQueue queue;
+  ButtonClassifier buttons[2] = {
+      ButtonClassifier(pins[0], true, nullptr, nullptr, kDebounceMs,
+                       kLongPressMs, kDoublePressMs),
+      ButtonClassifier(pins[1], true, nullptr, nullptr, kDebounceMs,
+                       kLongPressMs, kDoublePressMs)};
+  buttons[0].begin(HIGH, 0);
+  buttons[1].begin(HIGH, 0);
+
+  // a loop() pass every 2ms of trace time: queue the edges that happened
+  // since the last pass (the interrupts), then drain and poll
+  uint64_t start = bench::nowNanos();
+  size_t next = 0;
+  uint32_t end = trace.back().micros + 2000000;
+  for (uint32_t now = 0; now < end; now += 2000) {
+    while (next < trace.size() && trace[next].micros <= now) {
+      queue.push(trace[next].pin, trace[next].level, trace[next].micros);
+      next++;
+    }
+    ButtonEdge edge;
+    while (queue.pop(edge)) buttons[edge.pin == pins[0] ? 0 : 1].edge(edge);
+    buttons[0].poll(now);
+    buttons[1].poll(now);
+  }
+  uint64_t elapsed = bench::nowNanos() - start;
+
+  bool ok = queue.dropped() == 0;
+  for (int i = 0; i < 2; i++) {
+    ok = ok && buttons[i].presses() == expected[i].presses &&
+         buttons[i].longPresses() == expected[i].longPresses &&
+         buttons[i].doublePresses() == expected[i].doublePresses;
+    printf("  pin %2u: %u/%u presses, %u/%u long, %u/%u double, "
+           "%u bounces ignored\n",
+           buttons[i].pin(), buttons[i].presses(), expected[i].presses,
+           buttons[i].longPresses(), expected[i].longPresses,
+           buttons[i].doublePresses(), expected[i].doublePresses,
+           buttons[i].bounces());
+  }
+  printf("edge-replay: %zu edges, %.1f ns/edge (incl. polling)  %s\n",
+         trace.size(), (double)elapsed / trace.size(), ok ? "ok" : "FAIL");
+  return ok;
+}
+
+// ---- edge-flood ----------------------------------------------------------
+
+// The producer fires edges in back-to-back bursts (a contact bouncing at
+// full speed) with a short pause between them, rather than at an even
+// rate: on a single-core host an evenly paced busy-waiting producer keeps
+// loop() off the CPU for a whole scheduler slice, which no interrupt
+// source on the ESP32 can do.
+bool benchEdgeFlood(uint32_t edges, uint32_t burst, uint32_t pauseUs) {
+  uint32_t pushedBefore = buttonEdges.pushed();
+  std::atomic<bool> done{false};
+  uint64_t loops = 0;
+
+  std::thread producer([&] {
+    for (uint32_t i = 0; i < edges; i++) {
+      shim::setPinInput(onButton.pin(), (i & 1) ? HIGH : LOW);
+      if (i % burst == burst - 1) {
+        std::this_thread::sleep_for(std::chrono::microseconds(pauseUs));
+      }
+    }
+    done = true;
+  });
+
+  uint64_t start = bench::nowNanos();
+  while (!done) {
+    loop();
+    loops++;
+  }
+  producer.join();
+  uint64_t elapsed = bench::nowNanos() - start;
+  loop();  // picks up whatever arrived during the last pass
+
+  uint32_t pushed = buttonEdges.pushed() - pushedBefore;
+  bool ok = pushed == edges && buttonEdges.dropped() == 0 &&
+            buttonEdges.depth() == 0;
+  printf("edge-flood: %u edges at %.0fk edges/s, %u queued, %u dropped, "
+         "%u left, %llu loop() passes  %s\n",
+         edges, edges / (elapsed / 1e9) / 1000.0, pushed,
+         buttonEdges.dropped(), buttonEdges.depth(),
+         (unsigned long long)loops, ok ? "ok" : "FAIL");
+  return ok;
+}
+
+// ---- histogram -----------------------------------------------------------
+
+bool benchHistogram(int samples) {
+  std::vector<uint32_t> values(samples);
+  uint32_t seed = 777;
+  for (int i = 0; i < samples; i++) {
+    seed = seed * 1103515245u + 12345u;
+    // log-uniform between 100us and 10s
+    values[i] = (uint32_t)(100.0 * pow(1e5, (seed >> 8) / 16777216.0));
+  }
+
+  LatencyHistogram histogram;
+  uint64_t start = bench::nowNanos();
+  for (int i = 0; i < samples; i++) histogram.record(values[i]);
+  uint64_t elapsed = bench::nowNanos() - start;
+
+  std::sort(values.begin(), values.end());
+  bool ok = histogram.count() == (uint32_t)samples &&
+            histogram.min() == values.front() &&
+            histogram.max() == values.back();
+  const double percents[] = {50, 99, 99.9};
+  for (double percent : percents) {
+    uint32_t exact = values[(size_t)ceil(percent / 100.0 * samples) - 1];
+    uint32_t got = histogram.percentile(percent);
+    bool close = got >= exact && got <= exact + exact / 32 + 1;
+    ok = ok && close;
+    printf("  p%-5g exact %9u  histogram %9u  %s\n", percent, exact, got,
+           close ? "" : "<- off by more than a bucket");
+  }
+  printf("histogram: %d samples, %.1f ns/record, %u bytes  %s\n", samples,
+         (double)elapsed / samples, (unsigned)sizeof(LatencyHistogram),
+         ok ? "ok" : "FAIL");
+  return ok;
+}
+
+#ifndef DUAL_CORE  // rtt, coalesce and retained-state are single-core only
+// ---- rtt -----------------------------------------------------------------
+
+// the ledCommand the node published last (as the LED node receives it),
+// and its stats message
+char commandPayload[320];
+unsigned int commandLength = 0;
+char statsPayload[320];
+unsigned int statsLength = 0;
+
+void capturePublish(const char* topic, const uint8_t* payload,
+                    unsigned int length, bool retained) {
+  bool stats = strstr(topic, "/stats") != nullptr;
+  char* to = stats ? statsPayload : commandPayload;
+  if (length >= sizeof(commandPayload)) length = sizeof(commandPayload) - 1;
+  memcpy(to, payload, length);
+  to[length] = '\0';
+  (stats ? statsLength : commandLength) = length;
+}
+
+// Answers the last ledCommand the way the LED node does: the status plus
+// the command's seq and ts, copied as they are.
+void answerCommand(const char* topic) {
+  JsonField fields[6];
+  int n = jsonScan(commandPayload, commandLength, fields, 6);
+  uint32_t seq = 0, ts = 0;
+  jsonFieldUint(fields, n, "seq", &seq);
+  jsonFieldUint(fields, n, "ts", &ts);
+  char reply[128];
+  int length = snprintf(reply, sizeof(reply),
+                        "{\"ledStatus\":\"%s\",\"msg\":\"rtt\",\"seq\":%u,"
+                        "\"ts\":%u}",
+                        jsonFieldString(fields, n, "cmd"), seq, ts);
+  psClient.deliver(topic, (const uint8_t*)reply, length);
+}
+
+uint32_t statsValue(const JsonField* fields, int n, const char* key) {
+  uint32_t value = UINT32_MAX;
+  jsonFieldUint(fields, n, key, &value);
+  return value;
+}
+
+bool benchRoundTrip(int commands) {
+  char topic[64];
+  snprintf(topic, sizeof(topic), "%s/ledStatus", buttonClientID);
+  psClient.setPublishHook(capturePublish);
+
+  // one answered command first (the network-stall press went unanswered:
+  // let it time out), then start from a fresh interval
+  shim::advance((COMMAND_ACK_TIMEOUT_MS + COMMAND_COALESCE_MS) * 1000000ULL);
+  buttonNode.network_pass();
+  buttonNode.send_led_command("on");
+  answerCommand(topic);
+  buttonNode.publish_stats();
+  buttonNode.metrics.reset(millis());
+
+  std::vector<uint32_t> delays;
+  uint32_t seed = 99;
+  for (int i = 0; i < commands; i++) {
+    // outside the coalescing window, so every press is sent
+    shim::advance(COMMAND_COALESCE_MS * 1000000ULL);
+    buttonNode.send_led_command((i & 1) ? "off" : "on");
+    // 2-50 ms, with one in 50 replies slowed to 200-400 ms
+    seed = seed * 1103515245u + 12345u;
+    uint32_t delayUs = 2000 + (seed >> 8) % 48000;
+    if (i % 50 == 49) delayUs = 200000 + (seed >> 8) % 200000;
+    shim::advance(delayUs * 1000ULL);
+    if (i == commands / 2) continue;  // this reply coalesced away
+    answerCommand(topic);
+    delays.push_back(delayUs);
+  }
+  answerCommand(topic);  // the last reply again: a duplicate
+
+  statsLength = 0;
+  buttonNode.publish_stats();
+  psClient.setPublishHook(nullptr);
+  if (statsLength == 0) {
+    printf("rtt: no stats message published  FAIL\n");
+    return false;
+  }
+  printf("  %s\n", statsPayload);
+
+  JsonField fields[16];
+  int n = jsonScan(statsPayload, statsLength, fields, 16);
+  std::sort(delays.begin(), delays.end());
+  bool ok = n > 0 && statsValue(fields, n, "sent") == (uint32_t)commands &&
+            statsValue(fields, n, "replies") == delays.size() &&
+            statsValue(fields, n, "unanswered") == 1 &&
+            statsValue(fields, n, "stale") == 1;
+  // the duplicate reply is a message received all the same
+  const NodeMetrics& metrics = buttonNode.metrics;
+  ok = ok &&
+       metrics.sentCount(ButtonNode::METRIC_OUT_COMMAND) ==
+           (uint32_t)commands &&
+       metrics.sentCount(ButtonNode::METRIC_OUT_STATS) == 1 &&
+       metrics.receivedCount(ButtonNode::METRIC_IN_STATUS) ==
+           delays.size() + 1 &&
+       metrics.parseFailures() == 0;
+  // measured = simulated delay + the real time the bench itself took
+  const char* keys[] = {"p50", "p99", "p999"};
+  const double percents[] = {50, 99, 99.9};
+  for (int i = 0; i < 3; i++) {
+    uint32_t exact =
+        delays[(size_t)ceil(percents[i] / 100.0 * delays.size()) - 1];
+    uint32_t got = statsValue(fields, n, keys[i]);
+    ok = ok && got >= exact && got <= exact + exact / 32 + 1000;
+  }
+  printf("rtt: %d commands, %zu timed replies  %s\n", commands,
+         delays.size(), ok ? "ok" : "FAIL");
+  return ok;
+}
+
+// ---- coalesce -----------------------------------------------------------
+
+int coalescePublished = 0;
+
+void countPublish(const char* topic, const uint8_t* payload,
+                  unsigned int length, bool retained) {
+  if (strstr(topic, "/ledCommand") != nullptr) coalescePublished++;
+  capturePublish(topic, payload, length, retained);
+}
+
+// Answers the ledCommand with this seq, as the LED node would.
+void answerSeq(const char* topic, uint32_t seq, const char* status) {
+  char reply[128];
+  int length = snprintf(reply, sizeof(reply),
+                        "{\"ledStatus\":\"%s\",\"msg\":\"ack\",\"seq\":%u}",
+                        status, seq);
+  psClient.deliver(topic, (const uint8_t*)reply, length);
+}
+
+// Presses 10 ms apart, or one after the coalescing window.
+void press(const char* cmd, uint32_t afterMs = 10) {
+  shim::advance(afterMs * 1000000ULL);
+  buttonNode.network_pass();  // runs the window's timer once it is due
+  buttonNode.send_led_command(cmd);
+}
+
+bool checkCoalesce() {
+  char topic[64];
+  snprintf(topic, sizeof(topic), "%s/ledStatus", buttonClientID);
+  psClient.setPublishHook(countPublish);
+  buttonNode.publish_stats();  // a fresh interval
+  coalescePublished = 0;
+
+  // on, off, on, off inside one window: "on" now, "off" when it ends
+  press("on", COMMAND_COALESCE_MS);
+  press("off");
+  press("on");
+  press("off");
+  bool ok = coalescePublished == 1;
+  // nets to what is in flight: dropped when its window ends
+  press("off", COMMAND_COALESCE_MS);
+  ok = ok && coalescePublished == 2 && buttonNode.inFlightCount == 2 &&
+       buttonNode.ledState == LED_OFF;
+  int burst = coalescePublished;
+
+  // fill the pipeline; the next press waits for a reply
+  press("on", COMMAND_COALESCE_MS);
+  press("off", COMMAND_COALESCE_MS);
+  uint32_t secondSeq = buttonNode.commandSeq - 2;
+  press("on", COMMAND_COALESCE_MS);
+  buttonNode.network_pass();
+  ok = ok && coalescePublished == 4 &&
+       buttonNode.inFlightCount == COMMAND_MAX_IN_FLIGHT;
+  // the second reply answers the first two; the waiting press goes out
+  answerSeq(topic, secondSeq, "off");
+  ok = ok && coalescePublished == 5 && buttonNode.inFlightCount == 3 &&
+       buttonNode.ledState == LED_ON;
+
+  // the rest are never answered
+  shim::advance(COMMAND_ACK_TIMEOUT_MS * 1000000ULL);
+  buttonNode.network_pass();
+  ok = ok && buttonNode.inFlightCount == 0 &&
+       buttonNode.ledState == LED_UNKNOWN;
+
+  statsLength = 0;
+  buttonNode.publish_stats();
+  psClient.setPublishHook(nullptr);
+  printf("  %s\n", statsPayload);
+  JsonField fields[20];
+  int n = jsonScan(statsPayload, statsLength, fields, 20);
+  ok = ok && n > 0 && statsValue(fields, n, "sent") == 5 &&
+       statsValue(fields, n, "inFlight") == 0 &&
+       statsValue(fields, n, "lost") == 3 &&
+       statsValue(fields, n, "coalesced") == 3;
+  printf("coalesce: 4-press burst -> %d commands, %d published in all  %s\n",
+         burst, coalescePublished, ok ? "ok" : "FAIL");
+  return ok;
+}
+
+// ---- retained-state ------------------------------------------------------
+
+bool checkRetainedState() {
+  char stateTopic[64], availabilityTopic[64];
+  snprintf(stateTopic, sizeof(stateTopic), "%s/state",
+           buttonNode.ledClientID);
+  snprintf(availabilityTopic, sizeof(availabilityTopic), "%s/availability",
+           buttonNode.ledClientID);
+  bool subscribed = false;
+  for (int i = 0; i < psClient.subscriptionCount(); i++) {
+    if (strcmp(psClient.subscription(i), stateTopic) == 0) subscribed = true;
+  }
+
+  const char* on = "{\"ledStatus\":\"on\"}";
+  const char* off = "{\"ledStatus\":\"off\"}";
+  psClient.deliver(stateTopic, (const uint8_t*)on, strlen(on));
+  bool ok = subscribed && buttonNode.ledState == LED_ON;
+  psClient.deliver(stateTopic, (const uint8_t*)off, strlen(off));
+  ok = ok && buttonNode.ledState == LED_OFF;
+  psClient.deliver(availabilityTopic, (const uint8_t*)"offline", 7);
+  ok = ok && !buttonNode.ledOnline;
+  psClient.deliver(availabilityTopic, (const uint8_t*)"online", 6);
+  ok = ok && buttonNode.ledOnline;
+  printf("retained-state: %s  %s\n",
+         subscribed ? "subscribed" : "NOT SUBSCRIBED", ok ? "ok" : "FAIL");
+  return ok;
+}
+#endif
+
+// ---- network-stall -------------------------------------------------------
+
+const uint32_t kStallMs = 150;
+const uint32_t kMaxPressP99Us = 10000;  // DUAL_CORE only
+std::atomic<uint32_t> stalledCommands{0};
+std::atomic<uint32_t> sentOverInFlight{0};  // "on" while "on" unanswered
+
+// runs wherever psClient.publish() does: loop() or the network task
+void stallPublish(const char* topic, const uint8_t* payload,
+                  unsigned int length, bool retained) {
+  if (strstr(topic, "/ledCommand") == nullptr) return;
+  if (buttonNode.inFlightCount > 0) sentOverInFlight++;
+  std::this_thread::sleep_for(std::chrono::milliseconds(kStallMs));
+  stalledCommands++;
+}
+
+bool benchNetworkStall(uint32_t presses) {
+  // let the unanswered edge-flood command time out first (the network
+  // task's next pass, with DUAL_CORE)
+  shim::advance((COMMAND_ACK_TIMEOUT_MS + COMMAND_COALESCE_MS) * 1000000ULL);
+  uint64_t settled = bench::nowNanos() + 2 * IDLE_MAX_WAIT_MS * 1000000ULL;
+  while (bench::nowNanos() < settled) loop();
+  psClient.setPublishHook(stallPublish);
+  stalledCommands = 0;
+  sentOverInFlight = 0;
+  pressLatency.reset();
+  std::atomic<bool> done{false};
+
+  // clean presses (no bounce): 30 ms down, 70 ms up, in real time
+  std::thread producer([&] {
+    for (uint32_t i = 0; i < presses; i++) {
+      shim::setPinInput(onButton.pin(), LOW);
+      std::this_thread::sleep_for(std::chrono::milliseconds(30));
+      shim::setPinInput(onButton.pin(), HIGH);
+      std::this_thread::sleep_for(std::chrono::milliseconds(70));
+    }
+    done = true;
+  });
+
+  // then give the stalled publish time to finish. Every press asks for
+  // "on", which the first command is still taking the LED to, so that
+  // one command is all that goes out; without DUAL_CORE the idle sleeps
+  // run the simulated clock ahead, and a later press sends it again once
+  // it has been given up on, but never while it is still in flight
+  while (!done) loop();
+  producer.join();
+  uint64_t deadline = bench::nowNanos() + 2 * kStallMs * 1000000ULL;
+  while (bench::nowNanos() < deadline) loop();
+  psClient.setPublishHook(nullptr);
+
+  bool ok = pressLatency.count() == presses && stalledCommands >= 1 &&
+            sentOverInFlight == 0;
+#ifdef DUAL_CORE
+  ok = ok && stalledCommands == 1 &&
+       pressLatency.percentile(99) < kMaxPressP99Us;
+#endif
+  printf("network-stall: %u presses, %u published, edge->press p50 %u us "
+         "p99 %u us max %u us  %s\n",
+         pressLatency.count(), stalledCommands.load(),
+         pressLatency.percentile(50), pressLatency.percentile(99),
+         pressLatency.max(), ok ? "ok" : "FAIL");
+  return ok;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  shim::setSerialEcho(false);
+  setup();
+  // setup() only starts connecting; loop() finishes the job
+  while (!psClient.connected()) loop();
+  buildPayloads();
+
+#ifndef DUAL_CORE
+  long messages = argc > 1 ? atol(argv[1]) : 1000000;
+
+  // first, before any command: the state comes from the retained message
+  bool stateOk = checkRetainedState();
+  bench::printHeader();
+  benchLedStatus("ledStatus", &payloads[0], messages);
+  benchLedStatus("ledStatus-msgpack", &payloads[2], messages);
+  printf("\n");
+#endif
+
+  bool ok = benchEdgeReplay(200);
+  ok = benchEdgeFlood(200000, EDGE_QUEUE_SIZE / 4, 100) && ok;
+  ok = benchHistogram(1000000) && ok;
+  ok = benchNetworkStall(12) && ok;
+#ifdef DUAL_CORE
+  shim::setSerialEcho(true);
+  buttonNode.report_tasks();
+  // the network task never returns: leave without running destructors
+  // under it
+  fflush(stdout);
+  _exit(ok ? 0 : 1);
+#else
+  ok = benchRoundTrip(1000) && stateOk && ok;
+  ok = checkCoalesce() && ok;
+  return ok ? 0 : 1;
+#endif
+}
@@ -7,7 +7,7 @@
  *         Platform: Adafruit Huzza32 Feather ESP32 board.
  *    Additional HW: Two n/o pushbuttons connected to D5 ("On") and D6 ("Off")
  * Additional files: mqtt_btnNode_starter_code.h
- *  Req'd libraries: WiFi, PubSubClient, ArduinoJson, Bounce2
+ *  Req'd libraries: WiFi, PubSubClient, ArduinoJson
  *
  * Changes:
  *   5/22/23:  Updated for ESP32 board.
@@ -23,12 +23,44 @@
  *   Sends:
  *      Topic: "ledNodeXX/ledCommand"
  *      Usage: To instruct ledNodeXX to turn on/off its LED
- *    Payload: {"senderID":"btnNodeXX","cmd":"on" | "off"}
+ *    Payload: {"senderID":"btnNodeXX","cmd":"on" | "off","seq":n,"ts":us}
+ *             seq numbers the commands (one up each, from a random
+ *             start) and ts is micros() when sent; the LED node echoes
+ *             both, which times the round trip, and drops a command
+ *             whose seq it has already seen or passed.
+ *
+ *      Topic: "btnNodeXX/stats"
+ *      Usage: Round-trip times of the last STATS_INTERVAL_MS, in us
+ *    Payload: {"senderID":"btnNodeXX","intervalMs":60000,"sent":n,
+ *              "replies":n,"unanswered":n,"stale":n,"min":us,"p50":us,
+ *              "p99":us,"p999":us,"max":us,"mean":us,"inFlight":n,
+ *              "lost":n,"coalesced":n}
+ *             inFlight is the commands awaiting their ledStatus now;
+ *             lost and coalesced count commands never answered and
+ *             presses folded into another command (see note 8).
+ *
+ *      Topic: "btnNodeXX/metrics"
+ *      Usage: The node's health, every METRICS_INTERVAL_MS (see note 9)
+ *    Payload: {"up":s,"ms":60000,"in":{"status":n,"state":n,"avail":n},
+ *              "out":{"cmd":n,"stats":n},"bad":n,"conn":n,"loops":n,
+ *              "loopMax":us,"loopAvg":us,"heap":bytes,"heapMin":bytes,
+ *              "block":bytes,"rssi":dBm}
  *
  *   Receives:
  *      Topic: "btnNodeXX/ledStatus"
  *      Usage: Reports the current status of ledNodeXX's LED
- *    Payload: {"ledStatus":"on" | "off", "msg":"some message text"}
+ *    Payload: {"ledStatus":"on" | "off", "msg":"some message text",
+ *              "seq":n,"ts":us}
+ *
+ *      Topic: "ledNodeXX/state" (retained)
+ *      Usage: ledNodeXX's LED status, published whenever it changes; the
+ *             broker sends the last one as soon as this node subscribes,
+ *             so the state is known before any button is pressed
+ *    Payload: {"ledStatus":"on" | "off"}
+ *
+ *      Topic: "ledNodeXX/availability" (retained)
+ *      Usage: Whether ledNodeXX is connected; "offline" is its last will
+ *    Payload: online | offline
  *
  * This program also displays status messages on a serial terminal (115200N81)
  * along with the message text contained in a received ledStatus message.
@@ -40,43 +72,88 @@
  * DEVELOPER NOTES:
  * This program uses the public domain PubSubClient library to perform MQTT
  * messaging functions, and all message payloads are encoded in JSON format.
- *  1. Default message size, including header, is only 128 bytes (rather small).
- *  2. Increase/decrease by changing MQTT_MAX_PACKET_SIZE inside PubSubClient.h.
+ *  1. Default message size, including header, is only 256 bytes (rather small).
+ *  2. Increase/decrease by changing mqttBufferSize in ButtonNode.h; setup()
+ *     applies it at runtime with psClient.setBufferSize().
  *  3. Recommended size is 512 bytes.
+ *  4. ledStatus payloads may also arrive as MessagePack (same keys, no
+ *     "msg"), when the LED node is answering a MessagePack command.
+ *  5. The pushbuttons switch their pins to ground (internal pull-ups on).
+ *     A GPIO interrupt records every edge into a lock-free queue, and
+ *     loop() debounces and classifies them (see ButtonClassifier.h), so
+ *     no press is lost while loop() is busy with the network.
+ *  6. With DUAL_CORE (ButtonNode.h) the network runs in a FreeRTOS task
+ *     on core 0 and loop() on core 1 only handles the buttons, woken by
+ *     the edge interrupts; send_led_command() hands each ledCommand to
+ *     the network task through an SpscQueue. CPU time per task, hand-off
+ *     latency and edge-to-press latency are printed every
+ *     TASK_STATS_INTERVAL_MS.
+ *  7. All of the node's state lives in a ButtonNode object (ButtonNode.h)
+ *     with its own client ID and LED node ID, and setup()/loop() below
+ *     run the one the sketch needs. The fleet simulator (../Lab05-FLEET)
+ *     runs hundreds of them in one process.
+ *  8. A burst of presses sends the net intent, not a command per press:
+ *     the first goes out at once and the rest are folded into at most one
+ *     more per COMMAND_COALESCE_MS, dropped altogether if a command in
+ *     flight already asks for that state. Each command is tracked by its
+ *     seq until a ledStatus with that seq (or a later one: the LED node
+ *     coalesces replies too) comes back; at most COMMAND_MAX_IN_FLIGHT are
+ *     outstanding, and one unanswered for COMMAND_ACK_TIMEOUT_MS is lost.
+ *     Meanwhile ledState is what the last command asked for; state
+ *     messages overwrite it only once nothing is in flight.
+ *  9. The metrics message lets a sluggish node be spotted from the broker
+ *     rather than the serial console: messages per topic, payloads that
+ *     failed to parse, broker connection attempts, how long
+ *     network_pass() takes (the network task's, with DUAL_CORE), heap and
+ *     RSSI. Collecting costs a counter increment per message and two
+ *     micros() calls per pass; the text is built only when it is
+ *     published. See NodeMetrics.h.
  *
  ******************************************************************************/
-
 // included configuration file and support libraries
-#include <ArduinoJson.h>   // MQTT payloads are in JSON format
-#include <Bounce2.h>       // pushbutton debouncer library
+#include <BootTimeline.h>  // when each boot stage was reached
 #include <Esp.h>           // Esp32 support
-#include <PubSubClient.h>  // MQTT client
-#include <WiFi.h>          // wi-fi support
-#include "ButtonNode.h"  // this project's .h file
+#include <MsgPackScan.h>   // isMsgPack(): tell MessagePack from JSON
+#include "ButtonNode.h"  // this project's .h file (and the ButtonNode class)
 
-WiFiClient wfClient;              // create a wifi client
-PubSubClient psClient(wfClient);  // create a pub-sub object (must be
-                                  // associated with a wifi client)
+#ifndef NATIVE_FLEET  // the fleet simulator creates its own nodes
+// this sketch's one button node, and the LED node it drives
+ButtonNode buttonNode(BUTTON_CLIENT_ID, LED_CLIENT_ID);
 
-// char buffer to store incoming/outgoing messages
-char json_msgBuffer[200];
+void setup() { buttonNode.setup(); }
 
-// buffer to store sprintf formatted strings for printing
-char sbuf[80];
+void loop() { buttonNode.loop(); }
+#endif
 
-// Button debouncing variables
-// ProjH suggests using Bounce2 for your buttons, but also
-// good to leverage something else you have working.
-// Bounce2::Button OnButton = Bounce2::Button();
-// Bounce2::Button OffButton = Bounce2::Button();
+// names of the topics in the metrics message (ButtonNode::MetricIn/Out)
+static const char* const metricsIn[ButtonNode::METRIC_IN_TOPICS] = {
+    "status", "state", "avail"};
+static const char* const metricsOut[ButtonNode::METRIC_OUT_TOPICS] = {
+    "cmd", "stats"};
 
-// protype functions
-void connect_wifi();
-void processMQTTMessage_B(char* topic, byte* json_payload, unsigned int length);
-void register_myself();
-void reconnect();
+ButtonNode::ButtonNode(const char* clientID, const char* ledID)
+    : psClient(wfClient),
+      topicRouter(this),
+      commandDoc(&commandArena),
+      statsDoc(&statsArena),
+      netLink(LinkHooks{call<void, &ButtonNode::start_wifi>,
+                        call<bool, &ButtonNode::wifi_ready>,
+                        call<void, &ButtonNode::report_wifi>,
+                        call<bool, &ButtonNode::connect_mqtt>,
+                        call<bool, &ButtonNode::mqtt_ready>,
+                        call<void, &ButtonNode::link_up>,
+                        call<void, &ButtonNode::link_down>, this}),
+      metrics(metricsIn, METRIC_IN_TOPICS, metricsOut, METRIC_OUT_TOPICS),
+      onButton(PB_ON, true, on_gesture, this, DEBOUNCE_INTERVAL, LONG_PRESS_MS,
+               DOUBLE_PRESS_MS),
+      offButton(PB_OFF, true, on_gesture, this, DEBOUNCE_INTERVAL,
+                LONG_PRESS_MS, DOUBLE_PRESS_MS) {
+  snprintf(buttonClientID, sizeof(buttonClientID), "%s", clientID);
+  snprintf(ledClientID, sizeof(ledClientID), "%s", ledID);
+}
 
-void setup() {
+void ButtonNode::setup() {
+  bootMark(BOOT_SETUP);
   Serial.begin(115200);
   while (!Serial) {
     // wait for serial connection
@@ -84,94 +161,225 @@ void setup() {
   }
   Serial.println("Serial ready!");
 
-  // setup Wifi connection
+  // in an attempt to remove the annoying garbled text on
+  // startup, print a couple of blank lines
+  Serial.println();
+  Serial.println();
   Serial.print("\nSetting up network for IP => ");
   Serial.println(mqttBroker);
-  connect_wifi();
 
   // specify MQTT broker's domain name (or IP address) and port number
   psClient.setServer(mqttBroker, mqttPort);
 
-  // Specify callback function to process messages from broker
-  psClient.setCallback(processMQTTMessage_B);
-
-  // connect to MQTT broker
-  if (!psClient.connected()) {
-    Serial.println(
-        "In Setup and appear to have lost connection...reconnecting");
-    reconnect();
+  // size the client's packet buffer (largest message in or out)
+  if (!psClient.setBufferSize(mqttBufferSize)) {
+    Serial.println("Could not allocate MQTT buffer, keeping default size");
   }
 
+  // Specify callback function to process messages from broker, and the
+  // topics it routes to handlers
+  psClient.setCallback([this](char* topic, byte* payload,
+                               unsigned int length) {
+    processMQTTMessage_B(topic, payload, length);
+  });
+  build_routes();
+
+  // buttons: take the starting levels, then record every edge from here
+  // on, whatever loop() is doing at the time
+#ifdef DUAL_CORE
+  executorTask = xTaskGetCurrentTaskHandle();  // the edges wake loop()
+#endif
+  pinMode(PB_ON, INPUT_PULLUP);
+  pinMode(PB_OFF, INPUT_PULLUP);
+  onButton.begin(digitalRead(PB_ON), micros());
+  offButton.begin(digitalRead(PB_OFF), micros());
+  attachInterruptArg(digitalPinToInterrupt(PB_ON), on_button_edge, this,
+                     CHANGE);
+  attachInterruptArg(digitalPinToInterrupt(PB_OFF), off_button_edge, this,
+                     CHANGE);
+
+  // number the ledCommands from a random start: after a reset they must
+  // not look like repeats of the last ones to the LED node, which drops
+  // a seq it has seen before (see its CommandWindow)
+  commandSeq = lastReplySeq = (uint32_t)random(1, 0x7fffffff);
+
+  // report round-trip times every STATS_INTERVAL_MS
+  statsSince = millis();
+  timers.schedule(millis(), STATS_INTERVAL_MS,
+                  call<void, &ButtonNode::publish_stats>, this,
+                  STATS_INTERVAL_MS);
+
+  // and the node's health every METRICS_INTERVAL_MS
+  metrics.reset(millis());
+  timers.schedule(millis(), METRICS_INTERVAL_MS,
+                  call<void, &ButtonNode::publish_metrics>, this,
+                  METRICS_INTERVAL_MS);
+
+  // start connecting to WiFi and then the MQTT broker. This carries on in
+  // the background: loop() calls netLink.tick(), which never blocks. Seed
+  // the retry jitter from the hardware RNG so nodes spread out.
+  netLink.backoff().seed(random(1, 0x7fffffff));
+  netLink.tick(millis());
+
   // finally, flash the on-board LED five times to let user know
-  // that the NodeMCU board has been initialized and ready to go
+  // that the NodeMCU board has been initialized. The flashes are run by
+  // timers from loop(), so they no longer hold up the first message.
   pinMode(LED_BUILTIN, OUTPUT);
-  for (int i = 0; i < 5; i++) {
-    digitalWrite(LED_BUILTIN, 1);  // active high
-    delay(200);
-    digitalWrite(LED_BUILTIN, 0);
-    delay(150);
-  }
+  blinkStepsLeft = 10;
+  blink_step();
+
+#ifdef DUAL_CORE
+  // hand the network over to its own task on core 0 (timers included);
+  // loop() keeps core 1 for the buttons
+  tasksReportedAt = millis();
+  xTaskCreatePinnedToCore(network_task, "network", NETWORK_TASK_STACK, this,
+                          NETWORK_TASK_PRIORITY, &networkTask,
+                          NETWORK_TASK_CORE);
+#endif
 }
 
-void loop() {
+void ButtonNode::loop() {
+#ifdef DUAL_CORE
+  // core 1: debounce and classify the edges the interrupts record
+  run_buttons();
+#else
+  // nothing left to do after a pass: yield the CPU until a packet
+  // arrives, the next timer is due or the link needs attention
+  waitForWork(wfClient, network_pass());
+#endif
+}
+
+uint32_t ButtonNode::network_pass() {
   // This is largely a reactive program, and as such only uses
-  // the main loop to maintain the MQTT broker connection and
-  // periodically call the psClient.loop() code to ensure the
-  // client stays active
+  // the main loop to maintain the MQTT broker connection, service the
+  // psClient as soon as messages arrive, and run timers. There is no
+  // fixed delay(): the caller only sleeps, for as long as this returns,
+  // when there is nothing to do.
+  uint32_t passStart = micros();
+
+  // keep the WiFi/MQTT link up (or bring it back); returns immediately
+  netLink.tick(millis());
+
+#ifdef DUAL_CORE
+  // publish the ledCommands the executor has asked for
+  send_requested_commands();
+#else
+  // act on button presses recorded since the last pass
+  process_buttons();
+#endif
+
+  // give up on commands the LED node never answered
+  expire_in_flight();
 
-  // reconnect to MQTT server if connection lost
-  if (!psClient.connected()) {
-    Serial.print("psClient.connected() returns => ");  // Debugging
-    Serial.println(psClient.connected());              // Debugging
-    Serial.println(
-        "In Loop and appear to have lost connection...reconnecting");  // Debugging
-    reconnect();
+  // service the MQTT client as soon as data is waiting. psClient.loop()
+  // handles at most one packet per call (and keeps the connection alive),
+  // so drain whatever has arrived, up to MAX_PACKETS_PER_LOOP so timers
+  // still get a turn during a flood
+  if (netLink.isUp()) {
+    int packets = 0;
+    do {
+      psClient.loop();
+    } while (wfClient.available() > 0 && ++packets < MAX_PACKETS_PER_LOOP);
   }
 
-  psClient.loop();  // call periodically to keep client alive and well
+  // run any timers whose deadline has passed; these keep running while
+  // the link is down
+  timers.runDue(millis());
 
-  delay(10);  // May need to tweak this delay, may not be needed
+  // how long the caller may sleep: until the next timer is due or the
+  // link needs attention (whichever comes first)
+  uint32_t idleMs = timers.msUntilNext(millis());
+  uint32_t linkMs = netLink.msUntilNextAction(millis());
+  if (linkMs < idleMs) idleMs = linkMs;
+  if (inFlightCount > 0) {
+    uint32_t age = millis() - inFlight[0].sentAt;
+    uint32_t ackMs = age < COMMAND_ACK_TIMEOUT_MS
+                         ? COMMAND_ACK_TIMEOUT_MS - age : 0;
+    if (ackMs < idleMs) idleMs = ackMs;
+  }
+  if (idleMs > IDLE_MAX_WAIT_MS) idleMs = IDLE_MAX_WAIT_MS;
+#ifndef DUAL_CORE
+  uint32_t buttonMs = onButton.msUntilNext(micros());
+  uint32_t offMs = offButton.msUntilNext(micros());
+  if (offMs < buttonMs) buttonMs = offMs;
+  if (buttonMs < idleMs) idleMs = buttonMs;
+  // an interrupt cannot cut the sleep short, so keep it short enough for
+  // a press to be acted on promptly
+  if (idleMs > BUTTON_MAX_WAIT_MS) idleMs = BUTTON_MAX_WAIT_MS;
+#endif
+
+  // nothing else to do: print what has been logged, as much as the UART
+  // takes without blocking, and come back soon if some is left
+  if (idleMs > 0) logDrain(Serial, Serial.availableForWrite());
+  if (logQueued() > 0 && idleMs > LOG_DRAIN_INTERVAL_MS) {
+    idleMs = LOG_DRAIN_INTERVAL_MS;
+  }
+  metrics.loopTime(micros() - passStart);
+  return idleMs;
 }
 
 /**********************************************************
  * Helper functions
  *********************************************************/
-void connect_wifi() {
-  // in an attempt to remove the annoying garbled text on
-  // startup, print a couple of blank lines (with delay)
-  Serial.println();
-  delay(100);
-  Serial.println();
-  delay(100);
-
-  // attempt to connect to the WiFi network
-  Serial.print("Connecting to ");
-  Serial.print(ssid);
-  Serial.print(" network");
-  delay(10);
-#ifdef LIPSCOMB
-  WiFi.begin(ssid);  // Lipscomb WiFi does NOT require a password
-#elif defined(ETHERNET)
-  WiFi.begin(ssid);
-#else
-  WiFi.begin(ssid, password);  // For WiFi networks that DO require a password
+void ButtonNode::start_wifi() {
+  // start associating with the WiFi network; netLink.tick() polls
+  // wifi_ready() until it is up (or times out and calls this again)
+  bootMark(BOOT_WIFI_START);
+  WiFi.disconnect();
+#ifdef FAST_BOOT
+  // try the channel, BSSID and IP that worked last time first: no scan
+  // and no DHCP
+  wifiFromCache = wifiCacheLoad(wifiCache, ssid);
 #endif
+  LOG_INFO("Connecting to %s network%s", ssid,
+           wifiFromCache ? " (cached settings)" : "");
+  begin_wifi(wifiFromCache ? &wifiCache : nullptr);
+}
+
+void ButtonNode::begin_wifi(const WifiCache* cache) {
+  // with a cache: static IP and straight to the known AP; without: DHCP
+  // and a full scan
+  wifiCacheApply(cache);
+  const int32_t channel = cache ? cache->channel : 0;
+  const uint8_t* bssid = cache ? cache->bssid : nullptr;
+  wifiStartedAt = millis();
+  // password is nullptr for an open network (Lipscomb's)
+  WiFi.begin(ssid, password, channel, bssid);
+}
 
-  // advance a "dot-dot-dot" indicator until connected to WiFi network
-  while (WiFi.status() != WL_CONNECTED) {
-    delay(300);
-    Serial.print(".");
+bool ButtonNode::wifi_ready() {
+  wl_status_t status = WiFi.status();
+  if (status == WL_CONNECTED) return true;
+
+  // the cached AP is gone (moved channel, replaced, out of range):
+  // forget it and fall back to a full scan with DHCP
+  if (wifiFromCache &&
+      (status == WL_NO_SSID_AVAIL ||
+       millis() - wifiStartedAt >= FAST_BOOT_WIFI_TIMEOUT_MS)) {
+    LOG_WARN("Cached WiFi settings failed, scanning");
+    wifiFromCache = false;
+    wifiCacheClear();
+    WiFi.disconnect();
+    begin_wifi(nullptr);
   }
+  return false;
+}
+
+void ButtonNode::report_wifi() {
+  bootMark(BOOT_WIFI_UP);
+#ifdef FAST_BOOT
+  // remember this connection for the next boot (writes flash only if
+  // something changed)
+  wifiCacheStore(ssid);
+#endif
 
   // report to console that WiFi is connected and print IP address
-  Serial.print("MAC address = ");
-  Serial.print(WiFi.macAddress());
-  Serial.print(", connected as ");
-  Serial.println(WiFi.localIP());
+  LOG_INFO("MAC address = %s, connected as %s", WiFi.macAddress().c_str(),
+           WiFi.localIP().toString().c_str());
 }
 
-void processMQTTMessage_B(char* topic, byte* json_payload,
-                          unsigned int length) {
+void ButtonNode::processMQTTMessage_B(char* topic, byte* json_payload,
+                                      unsigned int length) {
   // This code is called whenever a message previously registered for is
   // RECEIVED from the broker. Incoming messages are selected by topic,
   // then the payload is parsed and appropriate action taken. (NB: If only
@@ -191,41 +399,461 @@ void processMQTTMessage_B(char* topic, byte* json_payload,
   // message sent by the ledNode02 node
   // ------------------------------------------------------------------
 
-  if (strcmp(topic, ...) == 0) {
-    compileErrorHere();  // Remove when this code updated.
+  // The topics this node handles, and the handler for each, are listed
+  // once in build_routes().
+
+  // process messages by topic
+  if (!topicRouter.dispatch(topic, json_payload, length)) {
+    // topic was registered with broker, but no processing code in place... :(
+    LOG_WARN("Topic: \"%s\" unhandled", topic);
   }
 }
 
-void register_myself() {
+void ButtonNode::handleLedStatus(char* topic, byte* json_payload,
+                                 unsigned int length) {
+  // received "ledStatus" message, so parse payload into an object tree
+  // example payload: {"ledStatus":"on","msg":"I've seen the light!"}
+  // The LED node answers in the format the command was sent in, so the
+  // payload may also be MessagePack (without the msg text).
+  metrics.received(METRIC_IN_STATUS);
+  JsonDocument jsonDoc;
+  auto error = isMsgPack(json_payload, length)
+                   ? deserializeMsgPack(jsonDoc, json_payload, length)
+                   : deserializeJson(jsonDoc, json_payload, length);
+
+  if (!error) {
+    // extract values associated with the names "ledStatus" and "msg"
+    const char* ledStatus = jsonDoc["ledStatus"] | "?";
+    const char* msg = jsonDoc["msg"];
+    if (msg) {
+      LOG_INFO("LED is %s (%s)", ledStatus, msg);
+    } else {
+      LOG_INFO("LED is %s", ledStatus);
+    }
+    acknowledge(jsonDoc["seq"].is<uint32_t>(),
+                jsonDoc["seq"].as<uint32_t>(), ledStatus);
+    record_round_trip(jsonDoc);
+
+    // time from reset to the first ledStatus, printed once
+    if (bootMark(BOOT_FIRST_MESSAGE)) bootReport(Serial);
+  } else {
+    // parse failed so print a console message and return to caller
+    LOG_WARN("failed to parse payload (topic: %s)", topic);
+    metrics.parseFailed();
+    return;
+  }
+}
+
+void ButtonNode::handleLedState(char* topic, byte* json_payload,
+                                unsigned int length) {
+  // the LED node's retained state: arrives on (re)subscribing and on every
+  // change, whoever commanded it
+  // example payload: {"ledStatus":"on"}
+  metrics.received(METRIC_IN_STATE);
+  JsonDocument jsonDoc;
+  if (deserializeJson(jsonDoc, json_payload, length)) {
+    LOG_WARN("failed to parse payload (topic: %s)", topic);
+    metrics.parseFailed();
+    return;
+  }
+  const char* ledStatus = jsonDoc["ledStatus"] | "?";
+  LOG_INFO("LED node reports LED %s", ledStatus);
+  // while our own commands are in flight, ledState is where they take it
+  if (inFlightCount == 0) note_led_state(ledStatus);
+}
+
+void ButtonNode::handleLedAvailability(char* topic, byte* json_payload,
+                                       unsigned int length) {
+  // "online" from the LED node itself, "offline" from the broker (its last
+  // will) when it dropped off
+  metrics.received(METRIC_IN_AVAILABILITY);
+  ledOnline = !(length == 7 && memcmp(json_payload, "offline", 7) == 0);
+  LOG_INFO("LED node is %s", ledOnline ? "online" : "offline");
+}
+
+void ButtonNode::note_led_state(const char* ledStatus) {
+  if (strcmp(ledStatus, "on") == 0) {
+    ledState = LED_ON;
+  } else if (strcmp(ledStatus, "off") == 0) {
+    ledState = LED_OFF;
+  } else if (strcmp(ledStatus, "pattern") == 0) {
+    ledState = LED_PATTERN;
+  }
+}
+
+void ButtonNode::build_routes() {
+  // list every topic this node handles, once; register_myself()
+  // subscribes from this table and processMQTTMessage_B() dispatches
+  // through it
+  topicRouter.clear();
+  TopicName<TOPIC_SIZE(TOPIC_AVAILABILITY)> topic;  // the longest of them
+  topic.set(buttonClientID, TOPIC_LED_STATUS);
+  topicRouter.add(topic, route<&ButtonNode::handleLedStatus>);
+  topic.set(ledClientID, TOPIC_STATE);
+  topicRouter.add(topic, route<&ButtonNode::handleLedState>);
+  topic.set(ledClientID, TOPIC_AVAILABILITY);
+  topicRouter.add(topic, route<&ButtonNode::handleLedAvailability>);
+
+  // and the one topic it publishes to
+  commandTopic.set(ledClientID, TOPIC_LED_COMMAND);
+  statsTopic.set(buttonClientID, TOPIC_STATS);
+  metricsTopic.set(buttonClientID, TOPIC_METRICS);
+}
+
+void ButtonNode::register_myself() {
   // register with MQTT broker for topics of interest to this node
-  compileErrorHere();  // Remove this when code is added
-}
-
-void reconnect() {
-  // Loop until the pub-sub client connects to the MQTT broker
-  while (!psClient.connected()) {
-    // attempt to connect to MQTT broker
-    Serial.print("Connecting to MQTT broker (");
-    Serial.print(mqttBroker);
-    Serial.print(") as ");
-    Serial.print(buttonClientID);
-    Serial.print("...");
-    if (psClient.connect(buttonClientID.c_str())) {
-      Serial.println(" connected");
-      // clientID MUST BE UNIQUE for all connected clients
-      // can also include username, password if broker requires it
-      // (e.g. psClient.connect(clientID, username, password)
-
-      // once connected, register for topics of interest
-      register_myself();
-      sprintf(sbuf, "MQTT initialization complete\r\nReady!\r\n\r\n");
-      Serial.print(sbuf);
+  topicRouter.subscribeAll(psClient);
+  LOG_INFO("Registered for topics");
+}
+
+bool ButtonNode::connect_mqtt() {
+  // make ONE attempt to connect to the MQTT broker; on failure
+  // netLink.tick() waits out a jittered, growing backoff and calls again
+  // clientID MUST BE UNIQUE for all connected clients
+  // can also include username, password if broker requires it
+  // (e.g. psClient.connect(clientID, username, password)
+  metrics.connectAttempt();
+  if (psClient.connect(buttonClientID)) {
+    LOG_INFO("Connected to MQTT broker (%s) as %s", mqttBroker,
+             buttonClientID);
+    return true;
+  }
+  LOG_WARN("Connecting to MQTT broker (%s) as %s failed. "
+           "(Is processor whitelisted?)",
+           mqttBroker, buttonClientID);
+  return false;
+}
+
+bool ButtonNode::mqtt_ready() { return psClient.connected(); }
+
+void ButtonNode::link_up() {
+  // once connected, register for topics of interest
+  register_myself();
+  bootMark(BOOT_MQTT_UP);
+  LOG_INFO("MQTT initialization complete");
+  LOG_INFO("Ready!");
+}
+
+void ButtonNode::link_down() {
+  LOG_WARN("Lost connection to MQTT broker...reconnecting");
+}
+
+void ButtonNode::blink_step() {
+  // one half of a boot flash: on for 200 ms, off for 150 ms
+  bool lit = blinkStepsLeft % 2 == 0;
+  digitalWrite(LED_BUILTIN, lit ? 1 : 0);  // active high
+  if (--blinkStepsLeft > 0) {
+    timers.schedule(millis(), lit ? 200 : 150,
+                    call<void, &ButtonNode::blink_step>, this);
+  }
+}
+
+void IRAM_ATTR ButtonNode::on_button_edge(void* node) {
+  ButtonNode* self = (ButtonNode*)node;
+  self->buttonEdges.push(PB_ON, digitalRead(PB_ON), micros());
+#ifdef DUAL_CORE
+  BaseType_t woken = pdFALSE;
+  vTaskNotifyGiveFromISR(self->executorTask, &woken);
+  portYIELD_FROM_ISR(woken);
+#endif
+}
+
+void IRAM_ATTR ButtonNode::off_button_edge(void* node) {
+  ButtonNode* self = (ButtonNode*)node;
+  self->buttonEdges.push(PB_OFF, digitalRead(PB_OFF), micros());
+#ifdef DUAL_CORE
+  BaseType_t woken = pdFALSE;
+  vTaskNotifyGiveFromISR(self->executorTask, &woken);
+  portYIELD_FROM_ISR(woken);
+#endif
+}
+
+void ButtonNode::process_buttons() {
+  // hand each recorded edge to its button, in order, then let both act
+  // on the time that has passed (bounces settling, long presses)
+  ButtonEdge edge;
+  while (buttonEdges.pop(edge)) {
+    if (edge.pin == PB_ON) {
+      onButton.edge(edge);
     } else {
-      // reconnect failed so print a console message, wait, and try again
-      Serial.println(" failed.");
-      Serial.println("Trying again in 5 sec. (Is processor whitelisted?)");
-      // wait 5 seconds before retrying
-      delay(5000);
+      offButton.edge(edge);
+    }
+  }
+  uint32_t now = micros();
+  onButton.poll(now);
+  offButton.poll(now);
+
+  if (buttonEdges.dropped() != reportedDrops) {
+    reportedDrops = buttonEdges.dropped();
+    LOG_ERROR("Button edge queue overflowed (%u edges lost)",
+              (unsigned)reportedDrops);
+  }
+}
+
+void ButtonNode::handle_gesture(uint8_t pin, ButtonGesture gesture,
+                                uint32_t atMicros) {
+  const char* name = pin == PB_ON ? "On" : "Off";
+  switch (gesture) {
+    case BUTTON_PRESS:
+      pressLatency.record(micros() - atMicros);
+      LOG_INFO("%s button pressed", name);
+      send_led_command(pin == PB_ON ? cmdOn : cmdOff);
+      break;
+    case BUTTON_LONG_PRESS:
+      LOG_INFO("%s button long press", name);
+      break;
+    case BUTTON_DOUBLE_PRESS:
+      LOG_INFO("%s button double press", name);
+      break;
+  }
+}
+
+void ButtonNode::send_led_command(const char* cmd) {
+#ifdef DUAL_CORE
+  // on the executor: the network task publishes it
+  CommandRequest request;
+  snprintf(request.cmd, sizeof(request.cmd), "%s", cmd);
+  if (!commandRequests.push(request)) {
+    LOG_ERROR("ledCommand dropped, network task queue full");
+    return;
+  }
+  networkWaker.wake();
+#else
+  request_command(cmd);
+#endif
+}
+
+void ButtonNode::request_command(const char* cmd) {
+  // a press, on the network side: it replaces any press still waiting
+  if (pendingLevel != LED_UNKNOWN) pressesCoalesced++;
+  pendingLevel = strcmp(cmd, cmdOn) == 0 ? LED_ON : LED_OFF;
+  if (pendingTimer != 0) return;  // goes when the window is over
+
+  uint32_t sinceLast = millis() - lastCommandAt;
+  if (sinceLast >= COMMAND_COALESCE_MS) {
+    send_pending();
+  } else {
+    pendingTimer = timers.schedule(millis(), COMMAND_COALESCE_MS - sinceLast,
+                                   call<void, &ButtonNode::send_pending>,
+                                   this);
+    if (pendingTimer == 0) send_pending();  // no timer free: now
+  }
+}
+
+void ButtonNode::send_pending() {
+  // the window is over: send the waiting press, unless a command in
+  // flight already asks for the same state; with every slot taken it
+  // waits for a reply (acknowledge()) or a timeout (expire_in_flight())
+  pendingTimer = 0;
+  if (pendingLevel == LED_UNKNOWN) return;
+  if (inFlightCount > 0 && pendingLevel == ledState) {
+    pressesCoalesced++;
+    pendingLevel = LED_UNKNOWN;
+    return;
+  }
+  if (inFlightCount == COMMAND_MAX_IN_FLIGHT) return;
+  LedState level = pendingLevel;
+  pendingLevel = LED_UNKNOWN;
+  if (!publish_led_command(level == LED_ON ? cmdOn : cmdOff)) return;
+
+  CommandInFlight& command = inFlight[inFlightCount++];
+  command.seq = commandSeq;
+  command.sentAt = millis();
+  command.level = level;
+  ledState = level;  // optimistic, until the replies say otherwise
+  lastCommandAt = command.sentAt;
+}
+
+void ButtonNode::acknowledge(bool hasSeq, uint32_t seq,
+                             const char* ledStatus) {
+  // a ledStatus answers the command with its seq and every one before it
+  // (the LED node coalesces replies); without a seq (MQTT-Spy, an older
+  // LED node) it can only be taken to answer the oldest
+  int answered = 0;
+  if (hasSeq) {
+    while (answered < inFlightCount &&
+           (int32_t)(inFlight[answered].seq - seq) <= 0) {
+      answered++;
     }
+  } else if (inFlightCount > 0) {
+    answered = 1;
   }
-}
\ No newline at end of file
+  if (answered > 0) {
+    inFlightCount -= answered;
+    memmove(inFlight, inFlight + answered,
+            inFlightCount * sizeof(inFlight[0]));
+  }
+  // the LED's state is known again once nothing is in flight
+  if (inFlightCount == 0) note_led_state(ledStatus);
+  if (pendingLevel != LED_UNKNOWN && pendingTimer == 0) send_pending();
+}
+
+void ButtonNode::expire_in_flight() {
+  int expired = 0;
+  while (expired < inFlightCount &&
+         millis() - inFlight[expired].sentAt >= COMMAND_ACK_TIMEOUT_MS) {
+    expired++;
+  }
+  if (expired == 0) return;
+  commandsLost += expired;
+  inFlightCount -= expired;
+  memmove(inFlight, inFlight + expired, inFlightCount * sizeof(inFlight[0]));
+  LOG_WARN("%d ledCommand(s) unanswered, %d still in flight", expired,
+           inFlightCount);
+  // nothing heard back: the LED could be either way
+  if (inFlightCount == 0) ledState = LED_UNKNOWN;
+  if (pendingLevel != LED_UNKNOWN && pendingTimer == 0) send_pending();
+}
+
+bool ButtonNode::publish_led_command(const char* cmd) {
+  // example payload: {"senderID":"btnNode14","cmd":"on","seq":7,"ts":912345}
+  if (!netLink.isUp()) {
+    LOG_WARN("Not connected to the broker, ledCommand not sent");
+    return false;
+  }
+  commandDoc.clear();
+  commandDoc["senderID"] = buttonClientID;
+  commandDoc["cmd"] = cmd;
+  commandDoc["seq"] = ++commandSeq;
+  commandDoc["ts"] = (uint32_t)micros();
+#ifdef COMMAND_MSGPACK
+  size_t length = serializeMsgPack(commandDoc, json_msgBuffer);
+#else
+  size_t length = serializeJson(commandDoc, json_msgBuffer);
+#endif
+  if (!psClient.publish(commandTopic, (const uint8_t*)json_msgBuffer,
+                        length)) {
+    return false;
+  }
+  commandsSent++;
+  metrics.sent(METRIC_OUT_COMMAND);
+  return true;
+}
+
+void ButtonNode::record_round_trip(JsonDocument& status) {
+  // only replies that echo our trace fields can be timed (MQTT-Spy or an
+  // older LED node may answer without them)
+  if (!status["seq"].is<uint32_t>() || !status["ts"].is<uint32_t>()) return;
+  uint32_t seq = status["seq"].as<uint32_t>();
+  uint32_t sentAt = status["ts"].as<uint32_t>();
+
+  if ((int32_t)(seq - lastReplySeq) <= 0) {
+    repliesStale++;
+    return;
+  }
+  // the LED node coalesces replies to commands that arrive together, so
+  // the commands in between get no reply of their own
+  repliesUnanswered += seq - lastReplySeq - 1;
+  lastReplySeq = seq;
+  uint32_t rtt = micros() - sentAt;
+  rttHistogram.record(rtt);
+  if (rttAlso) rttAlso->record(rtt);
+}
+
+void ButtonNode::publish_stats() {
+  // example payload: {"senderID":"btnNode14","intervalMs":60000,"sent":9,
+  // "replies":9,"unanswered":0,"stale":0,"min":6210,"p50":8191,...}
+  // Keep collecting while the link is down; the next report covers it.
+  if (!netLink.isUp()) return;
+
+  statsDoc.clear();
+  statsDoc["senderID"] = buttonClientID;
+  statsDoc["intervalMs"] = (uint32_t)(millis() - statsSince);
+  statsDoc["sent"] = commandsSent;
+  statsDoc["replies"] = rttHistogram.count();
+  statsDoc["unanswered"] = repliesUnanswered;
+  statsDoc["stale"] = repliesStale;
+  statsDoc["min"] = rttHistogram.min();
+  statsDoc["p50"] = rttHistogram.percentile(50);
+  statsDoc["p99"] = rttHistogram.percentile(99);
+  statsDoc["p999"] = rttHistogram.percentile(99.9);
+  statsDoc["max"] = rttHistogram.max();
+  statsDoc["mean"] = rttHistogram.mean();
+  statsDoc["inFlight"] = inFlightCount;
+  statsDoc["lost"] = commandsLost;
+  statsDoc["coalesced"] = pressesCoalesced;
+  size_t length = serializeJson(statsDoc, json_msgBuffer);
+  if (!psClient.publish(statsTopic, (const uint8_t*)json_msgBuffer, length)) {
+    return;
+  }
+  metrics.sent(METRIC_OUT_STATS);
+
+  // start the next interval
+  rttHistogram.reset();
+  commandsSent = 0;
+  repliesUnanswered = 0;
+  repliesStale = 0;
+  commandsLost = 0;
+  pressesCoalesced = 0;
+  statsSince = millis();
+}
+
+void ButtonNode::publish_metrics() {
+  // Keep counting while the link is down; the next message covers it.
+  if (!netLink.isUp()) return;
+  size_t length = metrics.format(metricsBuffer, sizeof(metricsBuffer),
+                                 millis());
+  if (length == 0 ||
+      !psClient.publish(metricsTopic, (const uint8_t*)metricsBuffer,
+                        length)) {
+    LOG_WARN("Metrics not published");
+    return;
+  }
+  // start the next interval
+  metrics.reset(millis());
+}
+
+#ifdef DUAL_CORE
+void ButtonNode::network_task(void* node) {
+  // core 0: the network side of loop(), waking for a packet, a timer, the
+  // link, or a ledCommand request (through networkWaker)
+  ButtonNode* self = (ButtonNode*)node;
+  for (;;) {
+    self->networkClock.start();
+    if (self->networkWaker.fd() < 0) {
+      self->networkWaker.begin();  // once the stack is up
+    }
+    uint32_t idleMs = self->network_pass();
+    self->networkClock.stop();
+    waitForWork(self->wfClient, idleMs, &self->networkWaker);
+  }
+}
+
+void ButtonNode::run_buttons() {
+  // sleep until an edge interrupt, or until a button has something timed
+  // to do (a bounce settling, a long press)
+  uint32_t waitMs = onButton.msUntilNext(micros());
+  uint32_t offMs = offButton.msUntilNext(micros());
+  if (offMs < waitMs) waitMs = offMs;
+  if (waitMs > EXECUTOR_MAX_WAIT_MS) waitMs = EXECUTOR_MAX_WAIT_MS;
+  if (waitMs > 0) ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(waitMs));
+
+  executorClock.start();
+  process_buttons();
+  executorClock.stop();
+
+  // printed from here, since this task owns pressLatency
+  if (millis() - tasksReportedAt >= TASK_STATS_INTERVAL_MS) {
+    tasksReportedAt = millis();
+    report_tasks();
+  }
+}
+
+void ButtonNode::send_requested_commands() {
+  CommandRequest request;
+  while (commandRequests.pop(request)) request_command(request.cmd);
+}
+
+void ButtonNode::report_tasks() {
+  Serial.println("Task CPU time and hand-off latency:");
+  networkClock.report(Serial);
+  executorClock.report(Serial);
+  commandRequests.report(Serial, "ledCommands");
+  sprintf(sbuf, "  %-12s %6u presses, p50 %u us p99 %u us max %u us\r\n",
+          "edge->press", (unsigned)pressLatency.count(),
+          (unsigned)pressLatency.percentile(50),
+          (unsigned)pressLatency.percentile(99), (unsigned)pressLatency.max());
+  Serial.print(sbuf);
+  pressLatency.reset();
+}
+#endif
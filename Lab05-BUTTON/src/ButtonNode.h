@@ -1,41 +1,311 @@
 // This file accompanies the mqtt_btnNode_starter_code.ino v2.0 program
+#pragma once
+
+#include <NodeConfig.h>  // network, client IDs, topics, command tokens
 
 // system defines
 #define DEBOUNCE_INTERVAL 10  // 5mS works well for circuit-mount PBs
 #define PB_ON 21   // pin connected to led "on" switch (ESP32 IO21/Pin 21)
 #define PB_OFF 17  // pin connected to led "off" switch (ESP32 IO17/Pin 17)
+#define LONG_PRESS_MS 800    // held at least this long: long press
+#define DOUBLE_PRESS_MS 300  // pressed again within this: double press
+
+// Presses become ledCommands as their net intent. The first press after
+// a quiet spell goes out at once; more within COMMAND_COALESCE_MS of the
+// last command sent fold into one command at the end of the window (the
+// last button pressed wins), or into none if a command still waiting for
+// its reply already takes the LED there. At most COMMAND_MAX_IN_FLIGHT
+// commands wait for their ledStatus (matched by seq) at a time; a press
+// beyond that waits for a reply. A command unanswered after
+// COMMAND_ACK_TIMEOUT_MS is counted lost.
+#define COMMAND_COALESCE_MS 100
+#define COMMAND_MAX_IN_FLIGHT 4
+#define COMMAND_ACK_TIMEOUT_MS 2000
+
+// main loop tuning
+#define MAX_PACKETS_PER_LOOP 8  // MQTT packets handled before timers run
+#define IDLE_MAX_WAIT_MS 100    // longest single sleep when idle
+#define BUTTON_MAX_WAIT_MS 10   // ...and longest a button press can wait
+#define LOG_DRAIN_INTERVAL_MS 5 // longest sleep while log lines wait
+
+// Console logging. Messages go into a ring (NodeLog) and reach Serial only
+// when loop() is idle, so printing never holds up a button press. Levels
+// above LOG_LEVEL are compiled out: LOG_LEVEL_NONE, _ERROR, _WARN, _INFO
+// (presses, LED status and connection messages) or _DEBUG.
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+// FreeRTOS dual-core mode: WiFi, MQTT and the stats run in their own task
+// on core 0 (next to the WiFi stack), and loop() on core 1 only debounces
+// and classifies button presses, woken by the edge interrupts. Presses
+// are handed to the network task as ledCommand requests through a
+// lock-free queue, so a slow broker or a reconnect never holds up button
+// processing. Uncomment to enable; the native_dualcore env defines it for
+// the host build.
+// #define DUAL_CORE
+#define NETWORK_TASK_CORE 0
+#define NETWORK_TASK_STACK 8192       // bytes
+#define NETWORK_TASK_PRIORITY 1       // same as loop()
+#define COMMAND_QUEUE_SLOTS 8         // ledCommands waiting to be published
+#define EXECUTOR_MAX_WAIT_MS 100      // longest loop() sleep between checks
+#define TASK_STATS_INTERVAL_MS 60000  // CPU/queue counters printed this often
+
+// The network, broker, client IDs, topics and command tokens are in
+// NodeConfig.h (Lab05-Common), shared with the other node: set them with
+// build flags (NODE_NETWORK, LED_CLIENT_ID, BUTTON_CLIENT_ID).
+
+// fast boot: reconnect with the WiFi channel, BSSID and IP saved in NVS
+// after the last good connection, falling back to a full scan and DHCP
+// if they stop working. Comment out to always scan.
+#define FAST_BOOT
+
+// PubSubClient packet buffer size in bytes (header + topic + payload).
+// Applied at runtime in setup() with psClient.setBufferSize().
+const int mqttBufferSize = 512;
+
+// ledCommand payloads are JSON, which MQTT-Spy can show. Uncomment to
+// send MessagePack instead: smaller, for high-rate links. The LED node
+// replies in the same format.
+// #define COMMAND_MSGPACK
+
+// Bytes reserved for each JSON document (ledCommand, stats).
+#define JSON_ARENA_SIZE 1024
+
+// Round-trip times of ledCommand -> ledStatus are collected in a histogram
+// and published to btnNodeXX/stats this often, then start over.
+#define STATS_INTERVAL_MS 60000
+
+// Health metrics (see NodeMetrics.h): messages in and out per topic, parse
+// failures, broker connection attempts, network_pass() times, heap and
+// RSSI, published to <buttonClientID>/metrics this often and then counted
+// afresh.
+#define METRICS_INTERVAL_MS 60000
+/**********************************************************
+ * The node itself
+ *********************************************************/
+#include <ArduinoJson.h>       // MQTT payloads are in JSON format
+#include <ButtonClassifier.h>  // debounced presses from edge events
+#include <EventLoop.h>         // sleep until a packet or timer is due
+#include <JsonArena.h>         // fixed-size memory for the JSON documents
+#include <LatencyHistogram.h>  // round-trip time percentiles
+#include <LinkManager.h>       // non-blocking WiFi/MQTT (re)connection
+#include <NodeLog.h>           // console output, printed when idle
+#include <NodeMetrics.h>       // health counters, published now and then
+#include <PubSubClient.h>      // MQTT client
+#include <TopicRouter.h>       // topic -> handler table
+#include <TimerQueue.h>        // deadline-ordered timers run from loop()
+#include <WiFi.h>              // wi-fi support
+#include <WifiCache.h>         // last good WiFi channel/BSSID/IP (NVS)
+#ifdef DUAL_CORE
+#include <SpscQueue.h>  // lock-free hand-off between the two tasks
+#include <TaskClock.h>  // CPU time per task
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+// A ledCommand the executor (loop(), core 1) wants sent, on its way to
+// the network task.
+struct CommandRequest {
+  char cmd[8];
+};
+#endif
+
+// What this node knows of its LED node's LED: nothing yet, or the last
+// state it heard (the retained <ledClientID>/state, or a ledStatus reply),
+// or that the LED node is playing a pattern (blink, fade, seq). While its
+// own commands are in flight, the state the last of them asked for.
+enum LedState { LED_UNKNOWN, LED_OFF, LED_ON, LED_PATTERN };
+
+// A ledCommand sent and not yet answered: its seq (which the ledStatus
+// echoes), when it went, and the state it asked for.
+struct CommandInFlight {
+  uint32_t seq;
+  uint32_t sentAt;  // millis()
+  LedState level;
+};
+
+// Everything one button node owns: its client ID and its LED node's,
+// connection, buffers, buttons and timers. The sketch runs one
+// (buttonNode, in ButtonNode.cpp); the fleet simulator runs hundreds in
+// one process, feeding each one's buttonEdges itself. The state is public
+// so the benchmarks and the simulator can inspect it.
+class ButtonNode {
+ public:
+  ButtonNode(const char* clientID, const char* ledID);
+
+  void setup();  // called from the sketch's setup()
+  void loop();   // called from the sketch's loop()
+
+  // The network side of loop(), without the wait: returns how long the
+  // caller may sleep (ms) before calling again, unless wfClient has data.
+  uint32_t network_pass();
+
+  // what a press of the on/off button does, and the stats message timer
+  void send_led_command(const char* cmd);
+  void publish_stats();
+  void publish_metrics();
 
-// uncomment for Lipscomb broker, comment out for "brokerX"
-// #define LIPSCOMB
-#define ETHERNET
-// #define HUTTONHOME
-
-// Network and MQTT broker credentials
-#ifdef LIPSCOMB
-const char* mqttBroker = "10.51.97.101";  // ECE mosquitto server (wlan0)
-const char* ssid = "LipscombGuest";  // no PW needed for Lipscomb guest wifi
-#elif defined(ETHERNET)
-const char* mqttBroker = "10.200.97.100";  // Wired ECE mosquitto server (eth0)
-const char* ssid = "LipscombGuest";        // same as straight WiFi
-#elif defined(HUTTONHOME)
-const char* mqttBroker = "192.168.0.251";  // address of brokerX
-const char* ssid = "HuttonWireless2-4G";   // ssid of brokerX's network
-const char* password = "Testing01";        // password for brokerX's network
-#else
-const char* mqttBroker = "1.1.1.1";
-const char* ssid = "";
-const char* password = "password";  // password for brokerX's network
+#ifdef DUAL_CORE
+  void report_tasks();
 #endif
 
-int mqttPort = 1883;
+  // the topics metrics counts messages on (their names are in
+  // ButtonNode.cpp)
+  enum MetricIn {
+    METRIC_IN_STATUS,
+    METRIC_IN_STATE,
+    METRIC_IN_AVAILABILITY,
+    METRIC_IN_TOPICS
+  };
+  enum MetricOut { METRIC_OUT_COMMAND, METRIC_OUT_STATS, METRIC_OUT_TOPICS };
 
-// Client ID of this LED controller
-String buttonClientID = "btnNodeXX";  // Change XX to your two-digit ID
+  char buttonClientID[CLIENT_ID_SIZE];
+  char ledClientID[CLIENT_ID_SIZE];
 
-// ID of the remote LED node
-String ledClientID = "ledNodeXX";  // Change XX to your two-digit ID
-compileErrorHere();  // Remove this line once you fix the "XX" above.
+  WiFiClient wfClient;    // create a wifi client
+  PubSubClient psClient;  // create a pub-sub object (must be
+                          // associated with a wifi client)
+
+  // char buffer to store incoming/outgoing messages
+  char json_msgBuffer[320];
+
+  // buffer to store sprintf formatted strings for printing
+  char sbuf[80];
+
+  // topics this node subscribes to, and the function that handles each
+  TopicRouter topicRouter;
+
+  // work scheduled for later, run from loop() when due
+  TimerQueue timers;
+
+  // WiFi settings saved after the last good connection (fast boot), and
+  // whether the current attempt is using them
+  WifiCache wifiCache;
+  bool wifiFromCache = false;
+  uint32_t wifiStartedAt = 0;
+
+  // on-board LED flashes still to go after reset (run from timers)
+  int blinkStepsLeft = 0;
+
+  // pushbutton edges, recorded by the GPIO interrupts and consumed by
+  // loop(), and how many overflows have been reported
+  EdgeQueue buttonEdges;
+  uint32_t reportedDrops = 0;
+
+  // ledCommand document (fixed memory, see JsonArena.h) and topic, which
+  // is built once in build_routes()
+  JsonArena<JSON_ARENA_SIZE> commandArena;
+  JsonDocument commandDoc;
+  TopicName<TOPIC_SIZE(TOPIC_LED_COMMAND)> commandTopic;
+
+  // round-trip tracing: the sequence number of the last ledCommand sent
+  // (counting from a random start, see setup()) and of the last one
+  // answered, and what goes into the next stats message (published from a
+  // timer to statsTopic)
+  uint32_t commandSeq = 0;
+  uint32_t lastReplySeq = 0;
+  LatencyHistogram rttHistogram;
+  uint32_t commandsSent = 0;
+  uint32_t repliesUnanswered = 0;  // commands the reply skipped over
+  uint32_t repliesStale = 0;       // duplicate or out-of-order replies
+  uint32_t pressesCoalesced = 0;   // presses folded into another command
+  uint32_t commandsLost = 0;       // no reply in COMMAND_ACK_TIMEOUT_MS
+  uint32_t statsSince = 0;
+  JsonArena<JSON_ARENA_SIZE> statsArena;
+  JsonDocument statsDoc;
+  TopicName<TOPIC_SIZE(TOPIC_STATS)> statsTopic;
+
+  // commands sent and not yet answered, oldest first; and the press
+  // waiting for the coalescing window (or a free slot) to end, if any
+  CommandInFlight inFlight[COMMAND_MAX_IN_FLIGHT];
+  int inFlightCount = 0;
+  LedState pendingLevel = LED_UNKNOWN;  // LED_UNKNOWN: none waiting
+  uint16_t pendingTimer = 0;
+  uint32_t lastCommandAt = 0;
+
+  // if set, every round trip is also recorded here, which the stats
+  // message never resets (the fleet simulator's totals)
+  LatencyHistogram* rttAlso = nullptr;
+
+  // time from a button edge to the press being acted on (us)
+  LatencyHistogram pressLatency;
+
+  // the LED node's last known state, and whether it is online (its
+  // retained availability; assumed until it says otherwise)
+  LedState ledState = LED_UNKNOWN;
+  bool ledOnline = true;
+
+  // brings WiFi and the broker connection up, and back up, without blocking
+  LinkManager netLink;
+
+  // health counters, and where they go every METRICS_INTERVAL_MS
+  NodeMetrics metrics;
+  TopicName<TOPIC_SIZE(TOPIC_METRICS)> metricsTopic;
+  char metricsBuffer[METRICS_PAYLOAD_SIZE];
+
+  // debouncing and press/long-press/double-press detection, per button
+  ButtonClassifier onButton;
+  ButtonClassifier offButton;
+
+#ifdef DUAL_CORE
+  SpscQueue<CommandRequest, COMMAND_QUEUE_SLOTS> commandRequests;
+  TaskHandle_t networkTask = nullptr;
+  TaskHandle_t executorTask = nullptr;
+  LoopWaker networkWaker;  // lets the executor wake the network's select()
+  TaskClock networkClock{"network"};
+  TaskClock executorClock{"executor"};
+  uint32_t tasksReportedAt = 0;
+#endif
+
+ private:
+  void start_wifi();
+  void begin_wifi(const WifiCache* cache);
+  bool wifi_ready();
+  void report_wifi();
+  bool connect_mqtt();
+  bool mqtt_ready();
+  void link_up();
+  void link_down();
+  void blink_step();
+  static void on_button_edge(void* node);
+  static void off_button_edge(void* node);
+  void process_buttons();
+  void handle_gesture(uint8_t pin, ButtonGesture gesture, uint32_t atMicros);
+  void request_command(const char* cmd);
+  void send_pending();
+  bool publish_led_command(const char* cmd);
+  void acknowledge(bool hasSeq, uint32_t seq, const char* ledStatus);
+  void expire_in_flight();
+#ifdef DUAL_CORE
+  static void network_task(void* node);
+  void run_buttons();
+  void send_requested_commands();
+#endif
+  void record_round_trip(JsonDocument& status);
+  void processMQTTMessage_B(char* topic, byte* json_payload,
+                            unsigned int length);
+  void handleLedStatus(char* topic, byte* json_payload, unsigned int length);
+  void handleLedState(char* topic, byte* json_payload, unsigned int length);
+  void handleLedAvailability(char* topic, byte* json_payload,
+                             unsigned int length);
+  void note_led_state(const char* ledStatus);
+  void build_routes();
+  void register_myself();
 
-// Commands
-String cmdOn = "on";
-String cmdOff = "off";
\ No newline at end of file
+  // LinkManager, TimerQueue, TopicRouter and ButtonClassifier call plain
+  // functions with a context pointer; these pass the call on to the node
+  // it points at
+  template <typename R, R (ButtonNode::*method)()>
+  static R call(void* node) {
+    return (((ButtonNode*)node)->*method)();
+  }
+  template <void (ButtonNode::*handler)(char*, byte*, unsigned int)>
+  static void route(void* node, char* topic, uint8_t* payload,
+                    unsigned int length) {
+    (((ButtonNode*)node)->*handler)(topic, payload, length);
+  }
+  static void on_gesture(void* node, uint8_t pin, ButtonGesture gesture,
+                         uint32_t atMicros) {
+    ((ButtonNode*)node)->handle_gesture(pin, gesture, atMicros);
+  }
+};
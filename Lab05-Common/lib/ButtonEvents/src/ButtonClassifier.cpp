@@ -0,0 +1,85 @@
+// Turns one button's raw edges into debounced presses and gestures. See
+// ButtonClassifier.h.
+#include "ButtonClassifier.h"
+
+ButtonClassifier::ButtonClassifier(uint8_t pin, bool activeLow,
+                                   GestureHandler handler, void* context,
+                                   uint32_t debounceMs, uint32_t longPressMs,
+                                   uint32_t doublePressMs)
+    : pin_(pin),
+      activeLow_(activeLow),
+      handler_(handler),
+      context_(context),
+      debounceUs_(debounceMs * 1000),
+      longPressUs_(longPressMs * 1000),
+      doublePressUs_(doublePressMs * 1000) {}
+
+void ButtonClassifier::begin(uint8_t level, uint32_t nowMicros) {
+  raw_ = stable_ = (level == LOW) == activeLow_;
+  rawAt_ = nowMicros;
+  // steady from the start, so the first real edge is accepted at once
+  changedAt_ = nowMicros - debounceUs_;
+  released_ = false;
+  longReported_ = stable_;  // held since before startup: not a long press
+}
+
+void ButtonClassifier::edge(const ButtonEdge& edge) {
+  raw_ = (edge.level == LOW) == activeLow_;
+  rawAt_ = edge.micros;
+  if (raw_ != stable_ && edge.micros - changedAt_ >= debounceUs_) {
+    accept(raw_, edge.micros);
+  } else {
+    bounces_++;
+  }
+}
+
+void ButtonClassifier::poll(uint32_t nowMicros) {
+  // bouncing ended at a different level than the one accepted
+  if (raw_ != stable_ && nowMicros - changedAt_ >= debounceUs_) {
+    accept(raw_, rawAt_);
+  }
+  if (stable_ && !longReported_ && nowMicros - changedAt_ >= longPressUs_) {
+    longReported_ = true;
+    longPresses_++;
+    if (handler_) {
+      handler_(context_, pin_, BUTTON_LONG_PRESS, changedAt_ + longPressUs_);
+    }
+  }
+}
+
+uint32_t ButtonClassifier::msUntilNext(uint32_t nowMicros) const {
+  uint32_t due;
+  if (raw_ != stable_) {
+    due = changedAt_ + debounceUs_;
+  } else if (stable_ && !longReported_) {
+    due = changedAt_ + longPressUs_;
+  } else {
+    return UINT32_MAX;
+  }
+  int32_t waitUs = (int32_t)(due - nowMicros);
+  return waitUs > 0 ? (waitUs + 999) / 1000 : 0;
+}
+
+void ButtonClassifier::accept(bool pressed, uint32_t at) {
+  // a settled level can be older than the change it replaces when the
+  // window closes; time never runs backwards for the gestures
+  if ((int32_t)(at - changedAt_) < 0) at = changedAt_;
+  stable_ = pressed;
+  changedAt_ = at;
+  if (!pressed) {
+    releasedAt_ = at;
+    released_ = true;
+    return;
+  }
+
+  presses_++;
+  longReported_ = false;
+  bool isDouble =
+      released_ && !wasDouble_ && at - releasedAt_ <= doublePressUs_;
+  wasDouble_ = isDouble;
+  if (handler_) handler_(context_, pin_, BUTTON_PRESS, at);
+  if (isDouble) {
+    doublePresses_++;
+    if (handler_) handler_(context_, pin_, BUTTON_DOUBLE_PRESS, at);
+  }
+}
@@ -0,0 +1,84 @@
+// Turns one button's raw edges into debounced presses and gestures.
+//
+// Fed from loop() with the edges an interrupt recorded (see EdgeQueue.h)
+// and polled for the time-based parts, it reports:
+//
+//   BUTTON_PRESS         every debounced press, as soon as it happens
+//   BUTTON_LONG_PRESS    the button has been held for longPressMs
+//   BUTTON_DOUBLE_PRESS  a press within doublePressMs of the last release
+//
+// Gestures are reported in addition to the press itself, so acting on
+// BUTTON_PRESS never waits to see whether a double press follows.
+//
+// Debouncing works on the edge timestamps: a change is accepted at once
+// if the button has been steady for debounceMs, and edges inside that
+// window (contact bounce) are ignored. If the bouncing leaves the pin at
+// a different level, poll() accepts that level once the window closes.
+//
+//   ButtonClassifier onButton(PB_ON, true, handleGesture, this);
+//   ...
+//   onButton.edge(edge);         // for each queued edge on PB_ON
+//   onButton.poll(micros());     // every pass through loop()
+#pragma once
+
+#include <stdint.h>
+
+#include "EdgeQueue.h"
+
+enum ButtonGesture { BUTTON_PRESS, BUTTON_LONG_PRESS, BUTTON_DOUBLE_PRESS };
+
+typedef void (*GestureHandler)(void* context, uint8_t pin,
+                               ButtonGesture gesture, uint32_t atMicros);
+
+class ButtonClassifier {
+ public:
+  // activeLow: the pin reads LOW while pressed (switch to ground with a
+  // pull-up). The handler is passed context with every gesture.
+  ButtonClassifier(uint8_t pin, bool activeLow, GestureHandler handler,
+                   void* context = nullptr, uint32_t debounceMs = 10,
+                   uint32_t longPressMs = 800, uint32_t doublePressMs = 300);
+
+  // Sets the starting level (read the pin once at startup).
+  void begin(uint8_t level, uint32_t nowMicros);
+
+  // Feeds one edge for this button's pin, in the order they happened.
+  void edge(const ButtonEdge& edge);
+
+  // Accepts a level that settled after bouncing and reports long presses.
+  void poll(uint32_t nowMicros);
+
+  // How long loop() may sleep before poll() has something to do.
+  uint32_t msUntilNext(uint32_t nowMicros) const;
+
+  uint8_t pin() const { return pin_; }
+  bool pressed() const { return stable_; }
+  uint32_t presses() const { return presses_; }
+  uint32_t longPresses() const { return longPresses_; }
+  uint32_t doublePresses() const { return doublePresses_; }
+  uint32_t bounces() const { return bounces_; }  // edges ignored
+
+ private:
+  void accept(bool pressed, uint32_t at);
+
+  uint8_t pin_;
+  bool activeLow_;
+  GestureHandler handler_;
+  void* context_;
+  uint32_t debounceUs_;
+  uint32_t longPressUs_;
+  uint32_t doublePressUs_;
+
+  bool raw_ = false;     // level of the latest edge (true = pressed)
+  uint32_t rawAt_ = 0;
+  bool stable_ = false;  // debounced state
+  uint32_t changedAt_ = 0;
+  uint32_t releasedAt_ = 0;
+  bool released_ = false;      // releasedAt_ is valid
+  bool wasDouble_ = false;     // last press completed a double press
+  bool longReported_ = false;  // for the current press
+
+  uint32_t presses_ = 0;
+  uint32_t longPresses_ = 0;
+  uint32_t doublePresses_ = 0;
+  uint32_t bounces_ = 0;
+};
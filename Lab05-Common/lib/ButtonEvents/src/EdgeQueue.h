@@ -0,0 +1,82 @@
+// Lock-free queue of button edges from GPIO interrupts to loop().
+//
+// Polling the buttons from loop() misses or delays presses whenever
+// loop() is busy elsewhere (servicing the MQTT client, connecting). An
+// interrupt on each edge instead records the pin, its new level and the
+// time, and loop() works through the recorded edges when it gets there:
+//
+//   void IRAM_ATTR onButtonEdge() {                  // CHANGE interrupt
+//     buttonEdges.push(PB_ON, digitalRead(PB_ON), micros());
+//   }
+//   ...
+//   ButtonEdge edge;
+//   while (buttonEdges.pop(edge)) { ... }            // in loop()
+//
+// There is exactly one producer (interrupt context) and one consumer
+// (loop()), so a ring with a head index written only by push() and a
+// tail index written only by pop() needs no lock; the atomics' acquire /
+// release ordering makes an edge's contents visible before its slot is
+// published, on either ESP32 core. When the ring is full push() drops
+// the edge and counts it, since an interrupt cannot wait.
+#pragma once
+
+#include <Arduino.h>
+#include <stdint.h>
+
+#include <atomic>
+
+#ifndef EDGE_QUEUE_SIZE
+#define EDGE_QUEUE_SIZE 64  // must be a power of two
+#endif
+
+struct ButtonEdge {
+  uint32_t micros;  // when the interrupt ran
+  uint8_t pin;
+  uint8_t level;  // pin level after the edge
+};
+
+class EdgeQueue {
+ public:
+  // Interrupt side. Returns false (and counts a drop) if the queue is full.
+  bool IRAM_ATTR push(uint8_t pin, uint8_t level, uint32_t micros) {
+    uint32_t head = head_.load(std::memory_order_relaxed);
+    if (head - tail_.load(std::memory_order_acquire) == EDGE_QUEUE_SIZE) {
+      dropped_.store(dropped_.load(std::memory_order_relaxed) + 1,
+                     std::memory_order_relaxed);
+      return false;
+    }
+    ButtonEdge& slot = slots_[head & (EDGE_QUEUE_SIZE - 1)];
+    slot.micros = micros;
+    slot.pin = pin;
+    slot.level = level;
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // loop() side. Returns false if there is nothing queued.
+  bool pop(ButtonEdge& edge) {
+    uint32_t tail = tail_.load(std::memory_order_relaxed);
+    if (head_.load(std::memory_order_acquire) == tail) return false;
+    edge = slots_[tail & (EDGE_QUEUE_SIZE - 1)];
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  uint32_t depth() const {
+    return head_.load(std::memory_order_acquire) -
+           tail_.load(std::memory_order_acquire);
+  }
+  uint32_t pushed() const { return head_.load(std::memory_order_acquire); }
+  uint32_t dropped() const {
+    return dropped_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  static_assert((EDGE_QUEUE_SIZE & (EDGE_QUEUE_SIZE - 1)) == 0,
+                "EDGE_QUEUE_SIZE must be a power of two");
+
+  ButtonEdge slots_[EDGE_QUEUE_SIZE];
+  std::atomic<uint32_t> head_{0};  // next slot push() fills
+  std::atomic<uint32_t> tail_{0};  // next slot pop() reads
+  std::atomic<uint32_t> dropped_{0};
+};
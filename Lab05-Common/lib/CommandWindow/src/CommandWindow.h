@@ -0,0 +1,185 @@
+// Per-sender sequence window: drops repeated and out-of-order commands.
+//
+// Over QoS 1 the broker may hand the node a command twice (a redelivery
+// after a lost PUBACK) or, across a reconnect, after a newer one from the
+// same sender. Carried out again, an old "on" would undo a newer "off"
+// and earn a second ledStatus. Senders number their commands ("seq", one
+// up per command), and the node asks the window about each before doing
+// anything with it, and records it once it has been carried out:
+//
+//   CommandWindow<512> window;
+//   CommandWindow<512>::Ticket ticket;
+//   if (!window.check(senderID, seq, ticket)) return;  // seen already
+//   if (carry_out(command)) window.commit(ticket);
+//
+// A command that could not be carried out (refused, or dropped for lack
+// of room) is never committed, so its redelivery gets another try.
+// Nothing else may use the window between check() and commit().
+//
+// A command is new only if its seq is newer than every one committed
+// from that sender so far. Anything else is dropped: a duplicate if that
+// seq was already carried out (the last COMMAND_WINDOW_BITS are
+// remembered), or stale if a newer command overtook it. A seq more than
+// COMMAND_WINDOW_SPAN behind the newest is taken as the sender having
+// restarted its count and is new. Senders start counting from a random
+// seq, so a restarted one almost always lands there, or ahead.
+//
+// Storage is N entries of 16 bytes (N a power of two, four to a cache
+// line): the sender's ID hash (FNV-1a), its newest seq, a bitmap of the
+// COMMAND_WINDOW_BITS seqs before it, and when it was last used. A sender
+// lives at its hash's slot or one of the next COMMAND_WINDOW_PROBES, so a
+// lookup is one pass over the ID and at most that many key compares in
+// adjacent memory (almost always the first), whatever the number of
+// senders. A new sender whose slots are all taken replaces the least
+// recently used of them; if that sender comes back, its next command is
+// accepted as new. Keep N at twice the senders expected: much fuller
+// than that, runs of taken slots grow long enough for live senders to be
+// evicted now and then. Two IDs with the same 32-bit hash
+// would share an entry (about 1 in 130000 for 256 senders).
+//
+// Not thread-safe: call from one task (the network task, with DUAL_CORE).
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define COMMAND_WINDOW_BITS 32     // seqs remembered below the newest
+#define COMMAND_WINDOW_SPAN 1024   // further behind than this: a restart
+#define COMMAND_WINDOW_PROBES 16   // slots a sender may live in
+
+template <uint32_t N>
+class CommandWindow {
+  static_assert(N >= COMMAND_WINDOW_PROBES && (N & (N - 1)) == 0,
+                "CommandWindow size must be a power of two");
+  static_assert(COMMAND_WINDOW_BITS <= 32, "the seen bitmap is 32 bits");
+
+ public:
+  CommandWindow() { clear(); }
+
+  // Forgets every sender.
+  void clear() {
+    memset(entries_, 0, sizeof(entries_));
+    clock_ = 0;
+    senders_ = 0;
+  }
+
+  // A command check() found new, for commit().
+  struct Ticket {
+    uint32_t sender;  // hash of the ID
+    uint32_t seq;
+    uint32_t slot;    // its sender's entry, or the one it will take
+  };
+
+  // true if the command numbered seq from senderID is new and should be
+  // carried out; false for a duplicate or a stale command. Records
+  // nothing but the counters: commit(ticket) once it has been done.
+  bool check(const char* senderID, uint32_t seq, Ticket& ticket) {
+    uint32_t key = hash(senderID);
+    uint32_t home = key & (N - 1);
+    uint32_t victim = N;
+    ticket.sender = key;
+    ticket.seq = seq;
+    for (uint32_t i = 0; i < COMMAND_WINDOW_PROBES; i++) {
+      uint32_t slot = (home + i) & (N - 1);
+      const Entry& e = entries_[slot];
+      if (e.sender == key) {
+        ticket.slot = slot;
+        return fresh(e, seq);
+      }
+      if (e.sender == 0) {  // the end of this run: a new sender
+        victim = slot;
+        break;
+      }
+      if (victim == N ||
+          clock_ - e.used > clock_ - entries_[victim].used) {
+        victim = slot;
+      }
+    }
+    ticket.slot = victim;
+    return true;
+  }
+
+  // Records the command check() gave ticket for as carried out.
+  void commit(const Ticket& ticket) {
+    Entry& e = entries_[ticket.slot];
+    clock_++;
+    e.used = clock_;
+    if (e.sender != ticket.sender) {  // a new sender
+      if (e.sender != 0) {
+        evictions_++;
+      } else {
+        senders_++;
+      }
+      e.sender = ticket.sender;
+      e.newest = ticket.seq;
+      e.seen = 0;
+      return;
+    }
+    int32_t ahead = (int32_t)(ticket.seq - e.newest);
+    if (ahead <= 0) {  // far behind: the sender has restarted
+      restarts_++;
+      e.newest = ticket.seq;
+      e.seen = 0;
+      return;
+    }
+    // slide the window up to seq; the old newest is now ahead - 1 below
+    e.seen = ahead > COMMAND_WINDOW_BITS
+                 ? 0
+                 : ((uint32_t)((uint64_t)e.seen << ahead) |
+                    (1UL << (ahead - 1)));
+    e.newest = ticket.seq;
+  }
+
+  // check() and commit() in one, for a command that cannot fail
+  bool accept(const char* senderID, uint32_t seq) {
+    Ticket ticket;
+    if (!check(senderID, seq, ticket)) return false;
+    commit(ticket);
+    return true;
+  }
+
+  uint32_t senders() const { return senders_; }  // entries in use
+  uint32_t duplicates() const { return duplicates_; }
+  uint32_t stale() const { return stale_; }
+  uint32_t restarts() const { return restarts_; }
+  uint32_t evictions() const { return evictions_; }
+
+ private:
+  struct Entry {
+    uint32_t sender;  // hash of the ID; 0 = free
+    uint32_t newest;  // highest seq accepted
+    uint32_t seen;    // bit i: newest - 1 - i has arrived
+    uint32_t used;    // clock_ when last committed
+  };
+
+  static uint32_t hash(const char* id) {
+    uint32_t h = 2166136261u;
+    for (const char* c = id; *c; c++) h = (h ^ (uint8_t)*c) * 16777619u;
+    return h ? h : 1;  // 0 marks a free entry
+  }
+
+  // true if seq is new for e: ahead of its newest, or so far behind
+  // that the sender must have restarted
+  bool fresh(const Entry& e, uint32_t seq) {
+    int32_t ahead = (int32_t)(seq - e.newest);
+    if (ahead > 0) return true;
+    uint32_t behind = 0u - (uint32_t)ahead;
+    if (behind > COMMAND_WINDOW_SPAN) return true;
+    if (behind == 0 || (behind <= COMMAND_WINDOW_BITS &&
+                        (e.seen & (1UL << (behind - 1))))) {
+      duplicates_++;
+      return false;
+    }
+    stale_++;
+    return false;
+  }
+
+  Entry entries_[N];
+  uint32_t clock_;
+  uint32_t senders_;
+  uint32_t duplicates_ = 0;
+  uint32_t stale_ = 0;
+  uint32_t restarts_ = 0;
+  uint32_t evictions_ = 0;
+};
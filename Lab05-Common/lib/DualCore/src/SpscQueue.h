@@ -0,0 +1,114 @@
+// Lock-free hand-off queue between two FreeRTOS tasks.
+//
+// In dual-core mode the network task and the executor (loop()) run on
+// different cores and pass work both ways through these: commands one
+// way, results back the other.
+//
+//   SpscQueue<LedAction, 8> ledActions;
+//   ledActions.push(action);                  // network task
+//   xTaskNotifyGive(executorTask);            // ...and wake the executor
+//   ...
+//   while (ledActions.pop(action)) { ... }    // executor
+//
+// Each queue has exactly one producer task and one consumer task, so as
+// in EdgeQueue.h the head index is only written by push() and the tail
+// index only by pop(), and acquire/release ordering makes an item visible
+// before its slot is published; no lock, no blocking, and a task on the
+// other core is never held up by a slow one. The queue does not wake the
+// consumer; pair it with a task notification or a LoopWaker.
+//
+// Every item is stamped with micros() when pushed, so pop() can count how
+// long items waited to be picked up: the queue latency that report()
+// prints. A full queue rejects the item (push() returns false) and counts
+// a drop.
+#pragma once
+
+#include <Arduino.h>
+#include <stdint.h>
+
+#include <atomic>
+
+template <typename T, uint32_t N>
+class SpscQueue {
+ public:
+  // Producer side. Returns false (and counts a drop) if the queue is full.
+  bool push(const T& item) {
+    uint32_t head = head_.load(std::memory_order_relaxed);
+    if (head - tail_.load(std::memory_order_acquire) == N) {
+      dropped_.store(dropped_.load(std::memory_order_relaxed) + 1,
+                     std::memory_order_relaxed);
+      return false;
+    }
+    Slot& slot = slots_[head % N];
+    slot.item = item;
+    slot.pushedAt = micros();
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side. Returns false if there is nothing queued.
+  bool pop(T& item) {
+    uint32_t tail = tail_.load(std::memory_order_relaxed);
+    if (head_.load(std::memory_order_acquire) == tail) return false;
+    const Slot& slot = slots_[tail % N];
+    item = slot.item;
+    uint32_t waited = micros() - slot.pushedAt;
+    waitTotal_.store(waitTotal_.load(std::memory_order_relaxed) + waited,
+                     std::memory_order_relaxed);
+    if (waited > waitMax_.load(std::memory_order_relaxed)) {
+      waitMax_.store(waited, std::memory_order_relaxed);
+    }
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  uint32_t depth() const {
+    return head_.load(std::memory_order_acquire) -
+           tail_.load(std::memory_order_acquire);
+  }
+  uint32_t pushed() const { return head_.load(std::memory_order_acquire); }
+  uint32_t popped() const { return tail_.load(std::memory_order_acquire); }
+  uint32_t dropped() const {
+    return dropped_.load(std::memory_order_relaxed);
+  }
+  // longest wait since the last report() (or ever, if never reported)
+  uint32_t waitMaxMicros() const {
+    return waitMax_.load(std::memory_order_relaxed);
+  }
+
+  // Prints one line for the items popped since the last call, e.g.
+  //   ledActions    12 handed over, wait avg 9 us max 31 us, 0 dropped
+  // and starts the next interval. Call from one task only.
+  void report(Print& out, const char* name) {
+    uint32_t popped = this->popped();
+    uint32_t total = waitTotal_.load(std::memory_order_relaxed);
+    uint32_t items = popped - reportedPopped_;
+    uint32_t waited = total - reportedWait_;
+    out.printf("  %-12s %6u handed over, wait avg %u us max %u us, "
+               "%u dropped, %u queued\r\n",
+               name, (unsigned)items, (unsigned)(items ? waited / items : 0),
+               (unsigned)waitMax_.exchange(0, std::memory_order_relaxed),
+               (unsigned)(dropped() - reportedDropped_), (unsigned)depth());
+    reportedPopped_ = popped;
+    reportedWait_ = total;
+    reportedDropped_ = dropped();
+  }
+
+ private:
+  struct Slot {
+    T item;
+    uint32_t pushedAt;
+  };
+
+  Slot slots_[N];
+  std::atomic<uint32_t> head_{0};  // next slot push() fills
+  std::atomic<uint32_t> tail_{0};  // next slot pop() reads
+  std::atomic<uint32_t> dropped_{0};
+  std::atomic<uint32_t> waitTotal_{0};  // us, wraps; only deltas are used
+  std::atomic<uint32_t> waitMax_{0};
+
+  // what the last report() covered
+  uint32_t reportedPopped_ = 0;
+  uint32_t reportedWait_ = 0;
+  uint32_t reportedDropped_ = 0;
+};
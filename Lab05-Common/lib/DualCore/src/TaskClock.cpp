@@ -0,0 +1,28 @@
+// CPU time a task spends working. See TaskClock.h.
+#include "TaskClock.h"
+
+void TaskClock::stop() {
+  uint32_t pass = micros() - passStart_;
+  busy_.store(busy_.load(std::memory_order_relaxed) + pass,
+              std::memory_order_relaxed);
+  passes_.store(passes_.load(std::memory_order_relaxed) + 1,
+                std::memory_order_relaxed);
+  if (pass > longest_.load(std::memory_order_relaxed)) {
+    longest_.store(pass, std::memory_order_relaxed);
+  }
+}
+
+void TaskClock::report(Print& out) {
+  uint32_t now = micros();
+  uint32_t busy = busyMicros();
+  uint32_t passes = this->passes();
+  uint32_t window = now - reportedAt_;
+  double share = window ? (double)(busy - reportedBusy_) / window : 0;
+  out.printf("  %-12s busy %5.2f%% (%.1f ms/s), %u passes, longest %.2f ms\r\n",
+             name_, share * 100, share * 1000,
+             (unsigned)(passes - reportedPasses_),
+             longest_.exchange(0, std::memory_order_relaxed) / 1000.0);
+  reportedAt_ = now;
+  reportedBusy_ = busy;
+  reportedPasses_ = passes;
+}
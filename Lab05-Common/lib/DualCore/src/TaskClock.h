@@ -0,0 +1,58 @@
+// How much CPU time a task spends working, as opposed to blocked waiting
+// for work.
+//
+// FreeRTOS can keep per-task run-time statistics, but the Arduino-ESP32
+// build does not enable them. Each task's main loop is a wait followed by
+// a pass of work, so timing the passes gives the same answer:
+//
+//   TaskClock networkClock("network");
+//   for (;;) {
+//     waitForWork(...);       // blocked: not counted
+//     networkClock.start();
+//     ...                     // the pass
+//     networkClock.stop();
+//   }
+//   ...
+//   networkClock.report(Serial);   // from any task, now and then
+//
+// The counters are 32-bit microseconds that wrap after 71 minutes; only
+// the difference between reports is used, so they need reporting more
+// often than that.
+#pragma once
+
+#include <Arduino.h>
+#include <stdint.h>
+
+#include <atomic>
+
+class TaskClock {
+ public:
+  explicit TaskClock(const char* name) : name_(name) {}
+
+  // Around one pass of work, on the task being measured.
+  void start() { passStart_ = micros(); }
+  void stop();
+
+  // Prints the busy time, passes and longest pass since the last report,
+  // e.g. "network     busy  1.84% (18.4 ms/s), 2301 passes, longest
+  // 2.10 ms", and starts the next interval. Call from one task only.
+  void report(Print& out);
+
+  const char* name() const { return name_; }
+  uint32_t busyMicros() const {
+    return busy_.load(std::memory_order_relaxed);
+  }
+  uint32_t passes() const { return passes_.load(std::memory_order_relaxed); }
+
+ private:
+  const char* name_;
+  uint32_t passStart_ = 0;
+  std::atomic<uint32_t> busy_{0};
+  std::atomic<uint32_t> passes_{0};
+  std::atomic<uint32_t> longest_{0};
+
+  // what the last report() covered
+  uint32_t reportedAt_ = 0;
+  uint32_t reportedBusy_ = 0;
+  uint32_t reportedPasses_ = 0;
+};
@@ -0,0 +1,66 @@
+// Idle handling for an event-driven Arduino loop(). See EventLoop.h.
+#include "EventLoop.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+bool LoopWaker::begin() {
+  if (fd_ >= 0) return true;
+  fd_ = socket(AF_INET, SOCK_DGRAM, 0);
+  if (fd_ < 0) return false;
+
+  // bind to any free loopback port, then "connect" to that same port so
+  // wake() can just send()
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = 0;
+  socklen_t length = sizeof(addr);
+  if (bind(fd_, (struct sockaddr*)&addr, length) != 0 ||
+      getsockname(fd_, (struct sockaddr*)&addr, &length) != 0 ||
+      connect(fd_, (struct sockaddr*)&addr, length) != 0) {
+    close(fd_);
+    fd_ = -1;
+    return false;
+  }
+  return true;
+}
+
+void LoopWaker::wake() {
+  // if the socket buffer is full a wake-up is already pending, so a
+  // failed send is fine
+  if (fd_ >= 0) send(fd_, "w", 1, MSG_DONTWAIT);
+}
+
+void LoopWaker::clear() {
+  char drain[16];
+  while (fd_ >= 0 && recv(fd_, drain, sizeof(drain), MSG_DONTWAIT) > 0) {
+  }
+}
+
+void waitForWork(WiFiClient& client, uint32_t timeoutMs, LoopWaker* waker) {
+  if (timeoutMs == 0 || client.available() > 0) return;
+
+  int fd = client.fd();
+  int wakeFd = waker ? waker->fd() : -1;
+  if (fd < 0 && wakeFd < 0) {
+    delay(1);
+    return;
+  }
+
+  fd_set readable;
+  FD_ZERO(&readable);
+  if (fd >= 0) FD_SET(fd, &readable);
+  if (wakeFd >= 0) FD_SET(wakeFd, &readable);
+  struct timeval tv;
+  tv.tv_sec = timeoutMs / 1000;
+  tv.tv_usec = (timeoutMs % 1000) * 1000;
+  int ready = select((fd > wakeFd ? fd : wakeFd) + 1, &readable, nullptr,
+                     nullptr, &tv);
+  if (ready > 0 && wakeFd >= 0 && FD_ISSET(wakeFd, &readable)) {
+    waker->clear();
+  }
+}
@@ -0,0 +1,37 @@
+// Idle handling for an event-driven Arduino loop().
+//
+// loop() services the MQTT client and runs due timers on every pass, and
+// only when neither has anything to do does it call waitForWork(), which
+// blocks until the socket becomes readable or the timeout (normally the
+// time to the next timer) expires. Blocking in select() lets FreeRTOS run
+// other tasks, yet a packet is picked up the moment it arrives instead of
+// after a fixed delay().
+#pragma once
+
+#include <WiFi.h>
+#include <stdint.h>
+
+// Lets another task cut a waitForWork() short, for a loop() that also
+// waits on work handed over from another core (see SpscQueue.h). It is a
+// UDP socket bound to the loopback interface that sends to itself: wake()
+// makes it readable, so the same select() that waits for the MQTT socket
+// returns at once. Call wake() from a task, never from an ISR.
+class LoopWaker {
+ public:
+  // Opens the socket; needs the network stack up (after WiFi.begin()).
+  // Returns false if it could not, in which case wake() does nothing.
+  bool begin();
+  void wake();
+  void clear();  // reads away pending wake-ups; waitForWork() does this
+  int fd() const { return fd_; }
+
+ private:
+  int fd_ = -1;
+};
+
+// Waits up to timeoutMs for client to have data, or for waker (if given)
+// to be woken. Returns immediately if timeoutMs is 0 or data is already
+// waiting. When the client has no socket (not connected) and there is no
+// waker, sleeps for a single millisecond instead.
+void waitForWork(WiFiClient& client, uint32_t timeoutMs,
+                 LoopWaker* waker = nullptr);
@@ -0,0 +1,90 @@
+// Deadline-ordered queue of timers. See TimerQueue.h.
+#include "TimerQueue.h"
+
+uint16_t TimerQueue::schedule(uint32_t now, uint32_t delayMs,
+                              TimerCallback cb, void* arg,
+                              uint32_t periodMs) {
+  if (count_ == TIMER_QUEUE_SIZE || cb == nullptr) return 0;
+  uint16_t id = nextId_++;
+  if (nextId_ == 0) nextId_ = 1;
+  heap_[count_] = {now + delayMs, periodMs, cb, arg, id};
+  siftUp(count_++);
+  return id;
+}
+
+bool TimerQueue::cancel(uint16_t id) {
+  for (int i = 0; i < count_; i++) {
+    if (heap_[i].id == id) {
+      removeAt(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+int TimerQueue::runDue(uint32_t now) {
+  int ran = 0;
+  // only run timers that were due on entry, so a periodic timer with a
+  // zero period (or a callback that reschedules itself for "now") cannot
+  // keep this loop going forever
+  int budget = count_;
+  while (count_ > 0 && budget-- > 0 &&
+         (int32_t)(heap_[0].deadline - now) <= 0) {
+    Timer t = heap_[0];
+    if (t.period != 0) {
+      // reschedule before running so the callback can cancel it
+      heap_[0].deadline += t.period;
+      if ((int32_t)(heap_[0].deadline - now) <= 0) {
+        heap_[0].deadline = now + t.period;  // fell behind; don't burst
+      }
+      siftDown(0);
+    } else {
+      removeAt(0);
+    }
+    t.cb(t.arg);
+    ran++;
+  }
+  return ran;
+}
+
+uint32_t TimerQueue::msUntilNext(uint32_t now) const {
+  if (count_ == 0) return UINT32_MAX;
+  int32_t wait = (int32_t)(heap_[0].deadline - now);
+  return wait > 0 ? (uint32_t)wait : 0;
+}
+
+void TimerQueue::removeAt(int i) {
+  heap_[i] = heap_[--count_];
+  if (i < count_) {
+    siftUp(i);
+    siftDown(i);
+  }
+}
+
+void TimerQueue::siftUp(int i) {
+  while (i > 0) {
+    int parent = (i - 1) / 2;
+    if (!before(heap_[i], heap_[parent])) break;
+    Timer t = heap_[i];
+    heap_[i] = heap_[parent];
+    heap_[parent] = t;
+    i = parent;
+  }
+}
+
+void TimerQueue::siftDown(int i) {
+  for (;;) {
+    int smallest = i;
+    int left = 2 * i + 1;
+    int right = left + 1;
+    if (left < count_ && before(heap_[left], heap_[smallest])) smallest = left;
+    if (right < count_ && before(heap_[right], heap_[smallest])) {
+      smallest = right;
+    }
+    if (smallest == i) break;
+    Timer t = heap_[i];
+    heap_[i] = heap_[smallest];
+    heap_[smallest] = t;
+    i = smallest;
+  }
+}
@@ -0,0 +1,67 @@
+// Deadline-ordered queue of one-shot and periodic timers.
+//
+// Instead of sleeping in loop() until "something" might need doing, work
+// that has to happen later is scheduled here and loop() runs whatever is
+// due:
+//
+//   timers.schedule(millis(), 200, blinkStep);       // once, in 200 ms
+//   timers.schedule(millis(), 0, sendStats, nullptr, 10000);  // every 10 s
+//   ...
+//   timers.runDue(millis());                         // in loop()
+//   uint32_t idle = timers.msUntilNext(millis());    // how long to wait
+//
+// Timers are kept in a fixed-size binary heap ordered by deadline, so
+// finding the next one is O(1) and adding/removing one is O(log n).
+// Deadlines are compared with wrap-around arithmetic, so millis()
+// rolling over after 49 days is harmless.
+#pragma once
+
+#include <stdint.h>
+
+#ifndef TIMER_QUEUE_SIZE
+#define TIMER_QUEUE_SIZE 16
+#endif
+
+typedef void (*TimerCallback)(void* arg);
+
+class TimerQueue {
+ public:
+  // Runs cb(arg) delayMs after now, then every periodMs if that is not
+  // zero. Returns a non-zero timer id, or 0 if the queue is full.
+  uint16_t schedule(uint32_t now, uint32_t delayMs, TimerCallback cb,
+                    void* arg = nullptr, uint32_t periodMs = 0);
+
+  // Removes a pending timer. Returns false if it had already run (or was
+  // never scheduled).
+  bool cancel(uint16_t id);
+
+  // Runs every timer whose deadline is at or before now and returns how
+  // many ran. Callbacks may schedule or cancel timers.
+  int runDue(uint32_t now);
+
+  // Milliseconds until the next deadline: 0 if one is already due,
+  // UINT32_MAX if nothing is scheduled.
+  uint32_t msUntilNext(uint32_t now) const;
+
+  int pending() const { return count_; }
+
+ private:
+  struct Timer {
+    uint32_t deadline;
+    uint32_t period;
+    TimerCallback cb;
+    void* arg;
+    uint16_t id;
+  };
+
+  static bool before(const Timer& a, const Timer& b) {
+    return (int32_t)(a.deadline - b.deadline) < 0;
+  }
+  void siftUp(int i);
+  void siftDown(int i);
+  void removeAt(int i);
+
+  Timer heap_[TIMER_QUEUE_SIZE];
+  int count_ = 0;
+  uint16_t nextId_ = 1;
+};
@@ -0,0 +1,45 @@
+// Timestamps of the stages a node goes through after reset. See
+// BootTimeline.h.
+#include "BootTimeline.h"
+
+#include <Arduino.h>
+
+#include <atomic>
+
+namespace {
+
+// one timeline per device: with several nodes in a process (the fleet
+// simulator) the first node to reach a stage marks it
+std::atomic<uint32_t> reachedAt[BOOT_PHASES];
+std::atomic<bool> reached[BOOT_PHASES];
+
+const char* kPhaseNames[BOOT_PHASES] = {"setup", "wifi start", "wifi up",
+                                        "mqtt up", "first message"};
+
+}  // namespace
+
+bool bootMark(BootPhase phase) {
+  if (reached[phase]) return false;
+  uint32_t now = micros();
+  if (reached[phase].exchange(true)) return false;
+  reachedAt[phase] = now;
+  return true;
+}
+
+bool bootReached(BootPhase phase) { return reached[phase]; }
+
+uint32_t bootMicros(BootPhase phase) {
+  return reached[phase] ? reachedAt[phase].load() : 0;
+}
+
+void bootReport(Print& out) {
+  uint32_t previous = 0;
+  out.println("Boot timeline (ms since reset, +ms since previous):");
+  for (int i = 0; i < BOOT_PHASES; i++) {
+    if (!reached[i]) continue;
+    uint32_t at = reachedAt[i];
+    out.printf("  %-14s %8.1f  +%.1f\r\n", kPhaseNames[i], at / 1000.0,
+               (at - previous) / 1000.0);
+    previous = at;
+  }
+}
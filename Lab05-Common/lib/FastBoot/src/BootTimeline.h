@@ -0,0 +1,36 @@
+// Timestamps of the stages a node goes through after reset.
+//
+// Each stage is marked once, with micros() (time since reset), the first
+// time the node reaches it; later calls are ignored, so the marks can sit
+// on paths that run over and over:
+//
+//   bootMark(BOOT_SETUP);                      // top of setup()
+//   ...
+//   if (bootMark(BOOT_FIRST_MESSAGE)) bootReport(Serial);
+//
+// bootReport() prints when each stage was reached and how long it took
+// after the one before, which is where time-to-first-message goes.
+#pragma once
+
+#include <Print.h>
+#include <stdint.h>
+
+enum BootPhase {
+  BOOT_SETUP,          // setup() entered
+  BOOT_WIFI_START,     // first WiFi.begin()
+  BOOT_WIFI_UP,        // WL_CONNECTED
+  BOOT_MQTT_UP,        // connected to the broker and subscribed
+  BOOT_FIRST_MESSAGE,  // first application message sent or received
+  BOOT_PHASES
+};
+
+// Records the current time for phase if it has not been reached before.
+// Returns true the first time only.
+bool bootMark(BootPhase phase);
+
+bool bootReached(BootPhase phase);
+
+// micros() when phase was reached, or 0 if it has not been
+uint32_t bootMicros(BootPhase phase);
+
+void bootReport(Print& out);
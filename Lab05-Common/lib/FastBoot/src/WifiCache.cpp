@@ -0,0 +1,72 @@
+// Last good WiFi connection, kept in NVS. See WifiCache.h.
+#include "WifiCache.h"
+
+#include <Preferences.h>
+#include <WiFi.h>
+#include <string.h>
+
+namespace {
+
+const char* kNamespace = "fastboot";
+const char* kKey = "wifi";
+const uint8_t kVersion = 1;
+
+uint32_t hashSsid(const char* ssid) {
+  uint32_t hash = 2166136261u;
+  while (*ssid != '\0') hash = (hash ^ (uint8_t)*ssid++) * 16777619u;
+  return hash;
+}
+
+}  // namespace
+
+bool wifiCacheLoad(WifiCache& cache, const char* ssid) {
+  Preferences prefs;
+  if (!prefs.begin(kNamespace, true)) return false;
+  size_t length = prefs.getBytes(kKey, &cache, sizeof(cache));
+  prefs.end();
+  return length == sizeof(cache) && cache.version == kVersion &&
+         cache.ssidHash == hashSsid(ssid) && cache.channel != 0 &&
+         cache.ip != 0;
+}
+
+void wifiCacheApply(const WifiCache* cache) {
+  if (cache) {
+    WiFi.config(IPAddress(cache->ip), IPAddress(cache->gateway),
+                IPAddress(cache->subnet), IPAddress(cache->dns));
+  } else {
+    WiFi.config(IPAddress(), IPAddress(), IPAddress());
+  }
+}
+
+bool wifiCacheStore(const char* ssid) {
+  const uint8_t* bssid = WiFi.BSSID();
+  if (WiFi.status() != WL_CONNECTED || bssid == nullptr) return false;
+
+  WifiCache cache;
+  memset(&cache, 0, sizeof(cache));
+  cache.version = kVersion;
+  cache.channel = (uint8_t)WiFi.channel();
+  memcpy(cache.bssid, bssid, sizeof(cache.bssid));
+  cache.ssidHash = hashSsid(ssid);
+  cache.ip = WiFi.localIP();
+  cache.gateway = WiFi.gatewayIP();
+  cache.subnet = WiFi.subnetMask();
+  cache.dns = WiFi.dnsIP();
+
+  // flash wears out: only write when something changed
+  WifiCache saved;
+  if (wifiCacheLoad(saved, ssid) && memcmp(&saved, &cache, sizeof(cache)) == 0)
+    return true;
+  Preferences prefs;
+  if (!prefs.begin(kNamespace, false)) return false;
+  bool ok = prefs.putBytes(kKey, &cache, sizeof(cache)) == sizeof(cache);
+  prefs.end();
+  return ok;
+}
+
+void wifiCacheClear() {
+  Preferences prefs;
+  if (!prefs.begin(kNamespace, false)) return;
+  prefs.remove(kKey);
+  prefs.end();
+}
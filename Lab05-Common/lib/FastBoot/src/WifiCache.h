@@ -0,0 +1,54 @@
+// Last good WiFi connection, kept in NVS for a fast reconnect after reset.
+//
+// A cold WiFi.begin() scans every channel for the SSID and then waits for
+// a DHCP lease, which together take seconds. Given the channel and BSSID
+// of the access point it can skip the scan, and with a static IP it can
+// skip DHCP, so the node saves those after each successful connection and
+// tries them first on the next boot:
+//
+//   WifiCache cache;
+//   if (wifiCacheLoad(cache, ssid)) {
+//     wifiCacheApply(&cache);     // static IP from the old lease
+//     WiFi.begin(ssid, password, cache.channel, cache.bssid);
+//   } else {
+//     wifiCacheApply(nullptr);    // DHCP
+//     WiFi.begin(ssid, password);
+//   }
+//   ...
+//   wifiCacheStore(ssid);         // once WL_CONNECTED
+//
+// If the cached attempt has not connected within FAST_BOOT_WIFI_TIMEOUT_MS
+// (the AP moved channel or was replaced), call wifiCacheClear() and start
+// again with a full scan and DHCP.
+#pragma once
+
+#include <stdint.h>
+
+#ifndef FAST_BOOT_WIFI_TIMEOUT_MS
+#define FAST_BOOT_WIFI_TIMEOUT_MS 1500  // then fall back to a full scan
+#endif
+
+struct WifiCache {
+  uint8_t version;
+  uint8_t channel;
+  uint8_t bssid[6];
+  uint32_t ssidHash;  // cache is only valid for the SSID it was made on
+  uint32_t ip;
+  uint32_t gateway;
+  uint32_t subnet;
+  uint32_t dns;
+};
+
+// Reads the cache for ssid from NVS. Returns false if there is none, or
+// it was saved for another SSID or by an older layout.
+bool wifiCacheLoad(WifiCache& cache, const char* ssid);
+
+// Sets a static IP from cache, or with nullptr goes back to DHCP. Call
+// before WiFi.begin().
+void wifiCacheApply(const WifiCache* cache);
+
+// Saves the current connection's channel, BSSID and addresses, writing
+// NVS only if they changed. Returns false if WiFi is not connected.
+bool wifiCacheStore(const char* ssid);
+
+void wifiCacheClear();
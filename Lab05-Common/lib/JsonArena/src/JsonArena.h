@@ -0,0 +1,93 @@
+// Fixed-size memory for ArduinoJson documents.
+//
+// By default every JsonDocument takes its memory from the heap, which on
+// the ESP32 means a malloc()/free() pair (or several) per MQTT message and
+// a slowly fragmenting heap under command bursts. A JsonArena is a static
+// block of N bytes that a document carves its memory from instead:
+//
+//   JsonArena<2048> cmdArena;
+//   JsonDocument jsonDoc(&cmdArena);
+//
+// Allocation is a pointer bump. The arena rewinds to empty whenever the
+// document has released everything it holds (deserializeJson() and
+// clear() both do), so a document that is reused for every message never
+// touches the heap. If a message needs more than N bytes the allocation
+// fails, ArduinoJson reports NoMemory, and overflows() is incremented.
+#pragma once
+
+#include <ArduinoJson.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+template <size_t N>
+class JsonArena : public ArduinoJson::Allocator {
+ public:
+  void* allocate(size_t size) override {
+    size_t need = sizeof(Header) + align(size);
+    if (used_ + need > N) {
+      overflows_++;
+      return nullptr;
+    }
+    Header* block = reinterpret_cast<Header*>(pool_ + used_);
+    block->size = align(size);
+    last_ = used_;
+    used_ += need;
+    if (used_ > highWater_) highWater_ = used_;
+    live_++;
+    return block + 1;
+  }
+
+  void deallocate(void* ptr) override {
+    if (ptr == nullptr) return;
+    if (--live_ == 0) used_ = last_ = 0;
+  }
+
+  void* reallocate(void* ptr, size_t newSize) override {
+    if (ptr == nullptr) return allocate(newSize);
+    Header* block = reinterpret_cast<Header*>(ptr) - 1;
+    size_t offset = reinterpret_cast<uint8_t*>(block) - pool_;
+
+    // the most recent block can grow or shrink in place
+    if (offset == last_) {
+      size_t end = offset + sizeof(Header) + align(newSize);
+      if (end > N) {
+        overflows_++;
+        return nullptr;
+      }
+      block->size = align(newSize);
+      used_ = end;
+      if (used_ > highWater_) highWater_ = used_;
+      return ptr;
+    }
+
+    // older blocks can only shrink in place; growing means a copy
+    if (newSize <= block->size) return ptr;
+    void* moved = allocate(newSize);
+    if (moved == nullptr) return nullptr;
+    memcpy(moved, ptr, block->size);
+    deallocate(ptr);
+    return moved;
+  }
+
+  size_t capacity() const { return N; }
+  size_t used() const { return used_; }
+  size_t highWater() const { return highWater_; }
+  uint32_t overflows() const { return overflows_; }
+
+ private:
+  struct alignas(max_align_t) Header {
+    size_t size;
+  };
+
+  static size_t align(size_t size) {
+    return (size + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1);
+  }
+
+  alignas(max_align_t) uint8_t pool_[N];
+  size_t used_ = 0;
+  size_t last_ = 0;
+  size_t highWater_ = 0;
+  size_t live_ = 0;
+  uint32_t overflows_ = 0;
+};
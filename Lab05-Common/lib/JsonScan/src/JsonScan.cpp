@@ -0,0 +1,215 @@
+// In-place parser for flat JSON objects. See JsonScan.h.
+#include "JsonScan.h"
+
+#include <string.h>
+
+namespace {
+
+struct Cursor {
+  char* p;
+  char* end;
+};
+
+void skipSpace(Cursor& c) {
+  while (c.p < c.end &&
+         (*c.p == ' ' || *c.p == '\t' || *c.p == '\r' || *c.p == '\n')) {
+    c.p++;
+  }
+}
+
+int hexDigit(char ch) {
+  if (ch >= '0' && ch <= '9') return ch - '0';
+  if (ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+  if (ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
+  return -1;
+}
+
+// Writes code point cp as UTF-8 at out; returns the number of bytes.
+int putUtf8(char* out, uint32_t cp) {
+  if (cp < 0x80) {
+    out[0] = (char)cp;
+    return 1;
+  }
+  if (cp < 0x800) {
+    out[0] = (char)(0xc0 | (cp >> 6));
+    out[1] = (char)(0x80 | (cp & 0x3f));
+    return 2;
+  }
+  out[0] = (char)(0xe0 | (cp >> 12));
+  out[1] = (char)(0x80 | ((cp >> 6) & 0x3f));
+  out[2] = (char)(0x80 | (cp & 0x3f));
+  return 3;
+}
+
+// Parses the string starting at the opening quote under the cursor,
+// unescaping it over itself and terminating it where the closing quote
+// was. The unescaped text is never longer than the escaped text, so the
+// writes stay behind the reads.
+int scanString(Cursor& c, const char** out, uint16_t* outLength) {
+  char* start = ++c.p;  // past the opening quote
+  char* w = start;
+  while (c.p < c.end) {
+    char ch = *c.p++;
+    if (ch == '"') {
+      *w = '\0';  // overwrites the closing quote (or an escape's tail)
+      *out = start;
+      *outLength = (uint16_t)(w - start);
+      return 0;
+    }
+    if ((unsigned char)ch < 0x20) return JSON_SCAN_INVALID;
+    if (ch != '\\') {
+      *w++ = ch;
+      continue;
+    }
+    if (c.p >= c.end) return JSON_SCAN_INCOMPLETE;
+    switch (*c.p++) {
+      case '"': *w++ = '"'; break;
+      case '\\': *w++ = '\\'; break;
+      case '/': *w++ = '/'; break;
+      case 'b': *w++ = '\b'; break;
+      case 'f': *w++ = '\f'; break;
+      case 'n': *w++ = '\n'; break;
+      case 'r': *w++ = '\r'; break;
+      case 't': *w++ = '\t'; break;
+      case 'u': {
+        if (c.end - c.p < 4) return JSON_SCAN_INCOMPLETE;
+        uint32_t cp = 0;
+        for (int i = 0; i < 4; i++) {
+          int d = hexDigit(*c.p++);
+          if (d < 0) return JSON_SCAN_INVALID;
+          cp = (cp << 4) | d;
+        }
+        w += putUtf8(w, cp);
+        break;
+      }
+      default:
+        return JSON_SCAN_INVALID;
+    }
+  }
+  return JSON_SCAN_INCOMPLETE;
+}
+
+// Numbers and the literals true/false/null are left as written; the byte
+// after them (a delimiter) is only overwritten once it has been checked.
+int scanBareValue(Cursor& c, const char** out, uint16_t* outLength,
+                  char* delimiter) {
+  char* start = c.p;
+  while (c.p < c.end && *c.p != ',' && *c.p != '}' && *c.p != ' ' &&
+         *c.p != '\t' && *c.p != '\r' && *c.p != '\n') {
+    char ch = *c.p;
+    bool ok = (ch >= '0' && ch <= '9') || (ch >= 'a' && ch <= 'z') ||
+              ch == '-' || ch == '+' || ch == '.' || ch == 'E';
+    if (!ok) return JSON_SCAN_INVALID;
+    c.p++;
+  }
+  if (c.p == start) return JSON_SCAN_INVALID;
+  if (c.p >= c.end) return JSON_SCAN_INCOMPLETE;
+  *delimiter = *c.p;
+  *c.p = '\0';
+  *out = start;
+  *outLength = (uint16_t)(c.p - start);
+  c.p++;
+  return 0;
+}
+
+// Sets isUint/uintValue for a bare value that is a plain run of digits
+// no larger than UINT32_MAX.
+void decodeUint(JsonField& field) {
+  uint64_t n = 0;
+  field.isUint = field.length > 0 && field.length <= 10;
+  for (uint16_t i = 0; field.isUint && i < field.length; i++) {
+    char ch = field.value[i];
+    field.isUint = ch >= '0' && ch <= '9';
+    n = n * 10 + (ch - '0');
+  }
+  field.isUint = field.isUint && n <= UINT32_MAX;
+  field.uintValue = field.isUint ? (uint32_t)n : 0;
+}
+
+}  // namespace
+
+int jsonScan(char* json, size_t length, JsonField* fields, int maxFields) {
+  Cursor c = {json, json + length};
+  skipSpace(c);
+  if (c.p >= c.end) return JSON_SCAN_EMPTY;
+  if (*c.p++ != '{') return JSON_SCAN_INVALID;
+
+  int count = 0;
+  skipSpace(c);
+  if (c.p < c.end && *c.p == '}') return 0;
+
+  for (;;) {
+    skipSpace(c);
+    if (c.p >= c.end) return JSON_SCAN_INCOMPLETE;
+    if (*c.p != '"') return JSON_SCAN_INVALID;
+    if (count == maxFields) return JSON_SCAN_TOO_MANY;
+    JsonField& field = fields[count];
+    uint16_t keyLength;
+    int err = scanString(c, &field.key, &keyLength);
+    if (err) return err;
+
+    skipSpace(c);
+    if (c.p >= c.end) return JSON_SCAN_INCOMPLETE;
+    if (*c.p++ != ':') return JSON_SCAN_INVALID;
+    skipSpace(c);
+    if (c.p >= c.end) return JSON_SCAN_INCOMPLETE;
+
+    char delimiter = 0;
+    field.isUint = false;
+    if (*c.p == '"') {
+      field.isString = true;
+      err = scanString(c, &field.value, &field.length);
+    } else if (*c.p == '{' || *c.p == '[') {
+      return JSON_SCAN_INVALID;
+    } else {
+      field.isString = false;
+      err = scanBareValue(c, &field.value, &field.length, &delimiter);
+      if (!err) decodeUint(field);
+    }
+    if (err) return err;
+    count++;
+
+    // a bare value has already consumed (and terminated over) the
+    // delimiter that followed it
+    if (delimiter == 0 || delimiter == ' ' || delimiter == '\t' ||
+        delimiter == '\r' || delimiter == '\n') {
+      skipSpace(c);
+      if (c.p >= c.end) return JSON_SCAN_INCOMPLETE;
+      delimiter = *c.p++;
+    }
+    if (delimiter == '}') return count;
+    if (delimiter != ',') return JSON_SCAN_INVALID;
+  }
+}
+
+const JsonField* jsonFindField(const JsonField* fields, int count,
+                               const char* key) {
+  for (int i = 0; i < count; i++) {
+    if (strcmp(fields[i].key, key) == 0) return &fields[i];
+  }
+  return nullptr;
+}
+
+const char* jsonFieldString(const JsonField* fields, int count,
+                            const char* key) {
+  const JsonField* field = jsonFindField(fields, count, key);
+  return field && field->isString ? field->value : nullptr;
+}
+
+bool jsonFieldUint(const JsonField* fields, int count, const char* key,
+                   uint32_t* out) {
+  const JsonField* field = jsonFindField(fields, count, key);
+  if (!field || !field->isUint) return false;
+  *out = field->uintValue;
+  return true;
+}
+
+const char* jsonScanErrorString(int error) {
+  switch (error) {
+    case JSON_SCAN_EMPTY: return "EmptyInput";
+    case JSON_SCAN_INVALID: return "InvalidInput";
+    case JSON_SCAN_INCOMPLETE: return "IncompleteInput";
+    case JSON_SCAN_TOO_MANY: return "TooManyFields";
+    default: return "Ok";
+  }
+}
@@ -0,0 +1,59 @@
+// In-place parser for flat JSON objects such as MQTT command payloads.
+//
+// PubSubClient hands its callback a pointer into its own receive buffer
+// plus a length; the payload is not NUL-terminated. jsonScan() parses
+// exactly `length` bytes of that buffer and never reads past them. Keys
+// and string values are unescaped and NUL-terminated where they lie (each
+// closing quote is overwritten), so the fields it returns are zero-copy
+// views into the payload:
+//
+//   JsonField fields[4];
+//   int n = jsonScan((char*)payload, length, fields, 4);
+//   const char* cmd = jsonFieldString(fields, n, "cmd");
+//
+// The views are only valid while the buffer is: PubSubClient reuses the
+// same buffer for publish(), so copy anything you need before publishing.
+//
+// Only flat objects are accepted. Values may be strings, numbers, true,
+// false or null; nested objects and arrays are rejected. Unsigned integers
+// that fit in 32 bits are also decoded (see jsonFieldUint()).
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct JsonField {
+  const char* key;
+  const char* value;  // NUL-terminated; numbers/literals as written
+  uint16_t length;    // length of value, excluding the terminator
+  bool isString;
+  bool isUint;         // an unsigned integer that fits in 32 bits...
+  uint32_t uintValue;  // ...with this value
+};
+
+enum JsonScanError {
+  JSON_SCAN_EMPTY = -1,       // no object in the input
+  JSON_SCAN_INVALID = -2,     // malformed or not a flat object
+  JSON_SCAN_INCOMPLETE = -3,  // input ended inside the object
+  JSON_SCAN_TOO_MANY = -4     // more members than maxFields
+};
+
+// Parses a flat JSON object in place. Returns the number of fields stored
+// in `fields`, or a negative JsonScanError.
+int jsonScan(char* json, size_t length, JsonField* fields, int maxFields);
+
+// Returns the string value of `key`, or nullptr if it is missing or not a
+// string.
+const char* jsonFieldString(const JsonField* fields, int count,
+                            const char* key);
+
+// Stores the value of `key` in *out and returns true if it is present and
+// an unsigned 32-bit integer; otherwise leaves *out alone.
+bool jsonFieldUint(const JsonField* fields, int count, const char* key,
+                   uint32_t* out);
+
+// Returns the field named `key`, or nullptr.
+const JsonField* jsonFindField(const JsonField* fields, int count,
+                               const char* key);
+
+const char* jsonScanErrorString(int error);
@@ -0,0 +1,139 @@
+// In-place parser for flat MessagePack maps. See MsgPackScan.h.
+#include "MsgPackScan.h"
+
+#include <string.h>
+
+namespace {
+
+struct Cursor {
+  uint8_t* p;
+  uint8_t* end;
+};
+
+// Reads a big-endian length of `bytes` bytes.
+bool readLength(Cursor& c, int bytes, uint32_t* out) {
+  if (c.end - c.p < bytes) return false;
+  uint32_t n = 0;
+  for (int i = 0; i < bytes; i++) n = (n << 8) | *c.p++;
+  *out = n;
+  return true;
+}
+
+// Parses the string under the cursor. Its bytes are moved back over the
+// type header and terminated in the byte after them, which is still
+// inside this string's encoding since the header is at least one byte.
+int scanString(Cursor& c, const char** out, uint16_t* outLength) {
+  uint8_t* header = c.p;
+  uint8_t type = *c.p++;
+  uint32_t n;
+  if ((type & 0xe0) == 0xa0) {
+    n = type & 0x1f;  // fixstr
+  } else if (type == 0xd9) {
+    if (!readLength(c, 1, &n)) return JSON_SCAN_INCOMPLETE;
+  } else if (type == 0xda) {
+    if (!readLength(c, 2, &n)) return JSON_SCAN_INCOMPLETE;
+  } else {
+    return JSON_SCAN_INVALID;
+  }
+  if (n > 0xffff) return JSON_SCAN_INVALID;
+  if ((uint32_t)(c.end - c.p) < n) return JSON_SCAN_INCOMPLETE;
+  memmove(header, c.p, n);
+  header[n] = '\0';
+  c.p += n;
+  *out = (const char*)header;
+  *outLength = (uint16_t)n;
+  return 0;
+}
+
+// Parses the integer under the cursor if it is one that fits in a
+// uint32_t. Returns 1 if the cursor is not on an integer at all.
+int scanUint(Cursor& c, uint32_t* out) {
+  uint8_t type = *c.p;
+  int bytes;
+  bool isSigned = false;
+  if (type < 0x80) {
+    c.p++;
+    *out = type;  // positive fixint
+    return 0;
+  } else if (type >= 0xcc && type <= 0xce) {
+    bytes = 1 << (type - 0xcc);  // uint 8/16/32
+  } else if (type >= 0xd0 && type <= 0xd2) {
+    bytes = 1 << (type - 0xd0);  // int 8/16/32: only non-negative values
+    isSigned = true;
+  } else if (type == 0xcf || type == 0xd3 || type >= 0xe0) {
+    return JSON_SCAN_INVALID;  // 64-bit or negative fixint
+  } else {
+    return 1;
+  }
+  c.p++;
+  if (!readLength(c, bytes, out)) return JSON_SCAN_INCOMPLETE;
+  if (isSigned && (*out >> (8 * bytes - 1)) != 0) return JSON_SCAN_INVALID;
+  return 0;
+}
+
+}  // namespace
+
+bool isMsgPack(const uint8_t* payload, size_t length) {
+  if (length == 0) return false;
+  uint8_t type = payload[0];
+  return (type & 0xf0) == 0x80 || type == 0xde || type == 0xdf;
+}
+
+int msgpackScan(uint8_t* data, size_t length, JsonField* fields,
+                int maxFields) {
+  Cursor c = {data, data + length};
+  if (c.p >= c.end) return JSON_SCAN_EMPTY;
+
+  uint8_t type = *c.p++;
+  uint32_t members;
+  if ((type & 0xf0) == 0x80) {
+    members = type & 0x0f;  // fixmap
+  } else if (type == 0xde) {
+    if (!readLength(c, 2, &members)) return JSON_SCAN_INCOMPLETE;
+  } else if (type == 0xdf) {
+    if (!readLength(c, 4, &members)) return JSON_SCAN_INCOMPLETE;
+  } else {
+    return JSON_SCAN_INVALID;
+  }
+  if (members > (uint32_t)maxFields) return JSON_SCAN_TOO_MANY;
+
+  for (uint32_t i = 0; i < members; i++) {
+    JsonField& field = fields[i];
+    uint16_t keyLength;
+    if (c.p >= c.end) return JSON_SCAN_INCOMPLETE;
+    int err = scanString(c, &field.key, &keyLength);
+    if (err) return err;
+
+    if (c.p >= c.end) return JSON_SCAN_INCOMPLETE;
+    field.isUint = false;
+    err = scanUint(c, &field.uintValue);
+    if (err <= 0) {
+      if (err) return err;
+      field.isString = false;
+      field.isUint = true;
+      field.value = "";
+      field.length = 0;
+      continue;
+    }
+    switch (*c.p) {
+      case 0xc0:
+        field.value = "null";
+        break;
+      case 0xc2:
+        field.value = "false";
+        break;
+      case 0xc3:
+        field.value = "true";
+        break;
+      default:
+        field.isString = true;
+        err = scanString(c, &field.value, &field.length);
+        if (err) return err;
+        continue;
+    }
+    c.p++;
+    field.isString = false;
+    field.length = (uint16_t)strlen(field.value);
+  }
+  return c.p == c.end ? (int)members : JSON_SCAN_INVALID;
+}
@@ -0,0 +1,40 @@
+// In-place parser for flat MessagePack maps: the binary counterpart of
+// jsonScan() for nodes that send compact payloads.
+//
+// The same {"senderID":"btnNode07","cmd":"on"} command is 27 bytes of
+// MessagePack instead of 35 of JSON, and needs no quoting or escaping.
+// msgpackScan() fills the same JsonField views as jsonScan(), so a
+// handler can take either format:
+//
+//   JsonField fields[4];
+//   int n = isMsgPack(payload, length)
+//               ? msgpackScan(payload, length, fields, 4)
+//               : jsonScan((char*)payload, length, fields, 4);
+//   const char* cmd = jsonFieldString(fields, n, "cmd");
+//
+// Keys and string values are NUL-terminated in place by sliding each one
+// back over its own type header, so they too are views into the payload
+// and are invalidated by the next publish().
+//
+// Only a flat map is accepted, with string keys and string, true, false,
+// nil or non-negative integer values. true/false/nil are given as the
+// text "true", "false", "null", as jsonScan() does. Integers up to
+// UINT32_MAX come back in uintValue (isUint set) with an empty value
+// text, since there is no room to write their digits in place. Negative
+// or larger numbers, floats, binary data and nested containers are
+// rejected, which is all the ledCommand/ledStatus messages need.
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "JsonScan.h"
+
+// True if the payload starts like a MessagePack map rather than a JSON
+// object (which starts with '{' or whitespace).
+bool isMsgPack(const uint8_t* payload, size_t length);
+
+// Parses a flat MessagePack map in place. Returns the number of fields
+// stored in `fields`, or a negative JsonScanError.
+int msgpackScan(uint8_t* data, size_t length, JsonField* fields,
+                int maxFields);
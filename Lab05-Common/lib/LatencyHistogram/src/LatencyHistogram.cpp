@@ -0,0 +1,79 @@
+// Fixed-size latency histogram with percentiles. See LatencyHistogram.h.
+#include "LatencyHistogram.h"
+
+#include <math.h>
+#include <string.h>
+
+namespace {
+
+const int kSubBits = LATENCY_HISTOGRAM_SUB_BITS;
+const uint32_t kSubBuckets = 1UL << kSubBits;
+const uint32_t kLinearTop = 2 * kSubBuckets;  // exact below this
+
+int highestBit(uint32_t value) { return 31 - __builtin_clz(value); }
+
+}  // namespace
+
+// Values below kLinearTop get a bucket each. Above that, a value whose
+// highest set bit is b is shifted right by b - kSubBits, leaving 32..63,
+// and each shift count has its own row of 32 buckets.
+int LatencyHistogram::bucketOf(uint32_t value) {
+  if (value < kLinearTop) return (int)value;
+  if (value >= LATENCY_HISTOGRAM_MAX) return LATENCY_HISTOGRAM_BUCKETS - 1;
+  int shift = highestBit(value) - kSubBits;
+  return (int)(((shift + 1) << kSubBits) + (value >> shift) - kSubBuckets);
+}
+
+uint32_t LatencyHistogram::bucketTop(int bucket) {
+  if ((uint32_t)bucket < kLinearTop) return (uint32_t)bucket;
+  int shift = (bucket >> kSubBits) - 1;
+  uint32_t sub = (bucket & (kSubBuckets - 1)) + kSubBuckets;
+  return ((sub + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(uint32_t value) {
+  buckets_[bucketOf(value)]++;
+  if (count_ == 0 || value < min_) min_ = value;
+  if (value > max_) max_ = value;
+  sum_ += value;
+  count_++;
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+  if (other.count_ == 0) return;
+  for (int i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++) {
+    buckets_[i] += other.buckets_[i];
+  }
+  if (count_ == 0 || other.min_ < min_) min_ = other.min_;
+  if (other.max_ > max_) max_ = other.max_;
+  sum_ += other.sum_;
+  count_ += other.count_;
+}
+
+void LatencyHistogram::reset() {
+  memset(buckets_, 0, sizeof(buckets_));
+  count_ = 0;
+  min_ = 0;
+  max_ = 0;
+  sum_ = 0;
+}
+
+uint32_t LatencyHistogram::percentile(double percent) const {
+  if (count_ == 0) return 0;
+  // the rank of the sample wanted, 1-based, rounded up
+  uint64_t rank = (uint64_t)ceil(percent / 100.0 * count_);
+  if (rank < 1) rank = 1;
+  if (rank > count_) rank = count_;
+
+  uint64_t seen = 0;
+  for (int i = 0; i < LATENCY_HISTOGRAM_BUCKETS; i++) {
+    seen += buckets_[i];
+    if (seen >= rank) {
+      // the top bucket also holds everything beyond the tracked range
+      if (i == LATENCY_HISTOGRAM_BUCKETS - 1) return max_;
+      uint32_t top = bucketTop(i);
+      return top < max_ ? top : max_;
+    }
+  }
+  return max_;
+}
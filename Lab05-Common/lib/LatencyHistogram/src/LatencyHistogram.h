@@ -0,0 +1,60 @@
+// Fixed-size latency histogram with percentiles, in the style of
+// HdrHistogram.
+//
+// Keeping every sample to sort later is not an option on a node that
+// runs for weeks. Instead each value lands in a bucket: exact below 64,
+// then 32 buckets per power of two, so a bucket is never wider than 1/32
+// (about 3%) of the values in it. That bounds the error of any percentile
+// regardless of how many samples were recorded, in a fixed 2.8 KB:
+//
+//   LatencyHistogram rtt;
+//   rtt.record(micros() - sentAt);      // per sample, O(1)
+//   ...
+//   uint32_t p99 = rtt.percentile(99);  // O(buckets)
+//   rtt.reset();                        // start the next interval
+//
+// Values are unit-less (the nodes use microseconds). Values of
+// LATENCY_HISTOGRAM_MAX or more are counted in the top bucket, and
+// max() still reports them exactly.
+#pragma once
+
+#include <stdint.h>
+
+#define LATENCY_HISTOGRAM_SUB_BITS 5  // 32 buckets per power of two
+#define LATENCY_HISTOGRAM_TOP_BIT 25  // tracks values below 2^26
+#define LATENCY_HISTOGRAM_MAX (1UL << (LATENCY_HISTOGRAM_TOP_BIT + 1))
+#define LATENCY_HISTOGRAM_BUCKETS                                   \
+  (((LATENCY_HISTOGRAM_TOP_BIT - LATENCY_HISTOGRAM_SUB_BITS) + 2) \
+   << LATENCY_HISTOGRAM_SUB_BITS)
+
+class LatencyHistogram {
+ public:
+  LatencyHistogram() { reset(); }
+
+  void record(uint32_t value);
+  void reset();
+
+  // Adds other's samples, as if they had been recorded here (to combine
+  // per-thread histograms, say).
+  void merge(const LatencyHistogram& other);
+
+  // The value at or below which `percent` of the samples fall, reported
+  // as the highest value its bucket can hold (so never an underestimate).
+  // 0 if nothing has been recorded.
+  uint32_t percentile(double percent) const;
+
+  uint32_t count() const { return count_; }
+  uint32_t min() const { return count_ ? min_ : 0; }
+  uint32_t max() const { return max_; }
+  uint32_t mean() const { return count_ ? (uint32_t)(sum_ / count_) : 0; }
+
+ private:
+  static int bucketOf(uint32_t value);
+  static uint32_t bucketTop(int bucket);
+
+  uint32_t buckets_[LATENCY_HISTOGRAM_BUCKETS];
+  uint32_t count_;
+  uint32_t min_;
+  uint32_t max_;
+  uint64_t sum_;
+};
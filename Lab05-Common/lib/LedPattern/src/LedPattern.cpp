@@ -0,0 +1,123 @@
+// Timer-driven LED patterns. See LedPattern.h.
+#include "LedPattern.h"
+
+#include <stdlib.h>
+
+LedPattern& LedPattern::operator=(const LedPattern& other) {
+  for (size_t i = 0; i < other.count_; i++) steps_[i] = other.steps_[i];
+  count_ = other.count_;
+  repeat_ = other.repeat_;
+  startDuty_ = other.startDuty_;
+  done_.store(true, std::memory_order_release);
+  return *this;
+}
+
+void LedPattern::clear() {
+  count_ = 0;
+  repeat_ = 1;
+  startDuty_ = -1;
+}
+
+bool LedPattern::addStep(uint8_t duty, uint16_t ticks, bool ramp) {
+  if (count_ == PATTERN_MAX_STEPS || ticks == 0) return false;
+  steps_[count_].duty = duty;
+  steps_[count_].ramp = ramp;
+  steps_[count_].ticks = ticks;
+  count_++;
+  return true;
+}
+
+bool LedPattern::parseSteps(const char* text) {
+  clear();
+  const char* p = text;
+  while (*p) {
+    bool ramp = *p == '~';
+    if (ramp) p++;
+    char* end;
+    unsigned long duty = strtoul(p, &end, 10);
+    if (end == p || *end != ':' || duty > 255) break;
+    p = end + 1;
+    unsigned long ticks = strtoul(p, &end, 10);
+    if (end == p || ticks > UINT16_MAX) break;
+    if (!addStep((uint8_t)duty, (uint16_t)ticks, ramp)) break;
+    p = end;
+    if (*p == ',') {
+      p++;
+    } else if (*p) {
+      break;
+    } else {
+      return true;
+    }
+  }
+  count_ = 0;
+  return false;
+}
+
+bool LedPattern::blink(uint32_t periodTicks, uint8_t percent, uint32_t count,
+                       uint8_t duty) {
+  clear();
+  uint32_t onTicks = periodTicks * percent / 100;
+  if (onTicks == 0 || onTicks >= periodTicks ||
+      periodTicks - onTicks > UINT16_MAX || onTicks > UINT16_MAX) {
+    return false;
+  }
+  addStep(duty, (uint16_t)onTicks);
+  addStep(0, (uint16_t)(periodTicks - onTicks));
+  repeat_ = count;
+  return true;
+}
+
+bool LedPattern::fade(int from, uint8_t to, uint32_t ticks) {
+  clear();
+  if (from > 255 || ticks > UINT16_MAX || !addStep(to, (uint16_t)ticks, true)) {
+    return false;
+  }
+  if (from >= 0) startDuty_ = (int16_t)from;
+  return true;
+}
+
+void LedPattern::start(uint8_t currentDuty) {
+  index_ = 0;
+  elapsed_ = 0;
+  rounds_ = 0;
+  from_ = startDuty_ >= 0 ? (uint8_t)startDuty_ : currentDuty;
+  duty_ = count_ > 0 && !steps_[0].ramp ? steps_[0].duty : from_;
+  done_.store(count_ == 0, std::memory_order_release);
+}
+
+bool LedPattern::tick() {
+  if (done_.load(std::memory_order_relaxed)) return false;
+  uint8_t before = duty_;
+  const PatternStep& step = steps_[index_];
+  if (++elapsed_ < step.ticks) {
+    if (step.ramp) {
+      duty_ = from_ + ((int)step.duty - from_) * (int)elapsed_ / step.ticks;
+    }
+    return duty_ != before;
+  }
+
+  // this step is over: on to the next, or the next round
+  from_ = step.duty;
+  elapsed_ = 0;
+  if (++index_ == count_) {
+    index_ = 0;
+    if (repeat_ != 0 && ++rounds_ >= repeat_) {
+      duty_ = step.duty;
+      done_.store(true, std::memory_order_release);
+      return duty_ != before;
+    }
+  }
+  const PatternStep& next = steps_[index_];
+  duty_ = next.ramp ? from_ : next.duty;
+  return duty_ != before;
+}
+
+uint32_t LedPattern::periodTicks() const {
+  uint32_t ticks = 0;
+  for (size_t i = 0; i < count_; i++) ticks += steps_[i].ticks;
+  return ticks;
+}
+
+uint32_t LedPattern::totalTicks() const {
+  return repeat_ == 0 ? 0 : periodTicks() * repeat_;
+}
@@ -0,0 +1,110 @@
+// A light pattern (blink, fade, a sequence of steps) played out by a
+// periodic timer interrupt, so one command can drive the LED for as long
+// as it likes without another message per change.
+//
+// A pattern is a list of steps, each a brightness (PWM duty, 0-255) and a
+// length in ticks (ms, with the 1 kHz tick LedNode uses). A step either
+// jumps to its brightness at its start or ramps linearly to it from the
+// previous one over its length. The list plays `repeat` times (0: until
+// replaced):
+//
+//   pattern.blink(1000, 25, 10, 255);       // 250 on / 750 off, 10 times
+//   pattern.fade(0, 255, 2000);             // one 2 s ramp up
+//   pattern.parseSteps("~255:500,~0:500");  // a breathing pulse...
+//   pattern.setRepeat(0);                   // ...for ever
+//   ...
+//   pattern.start(currentDuty);             // then, every tick:
+//   if (pattern.tick()) ledcWrite(channel, pattern.duty());
+//
+// The timing is counted in ticks, not read from a clock, so every change
+// lands exactly on a tick however busy the rest of the program is.
+//
+// tick() runs in interrupt context and touches nothing else; set up the
+// pattern and call start() only while the tick is stopped (or on the
+// core its interrupt runs on). finished() is safe to read from anywhere.
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+#ifndef PATTERN_MAX_STEPS
+#define PATTERN_MAX_STEPS 16
+#endif
+
+struct PatternStep {
+  uint8_t duty;  // brightness at the end of the step
+  bool ramp;     // ramp to duty over the step, rather than jump to it
+  uint16_t ticks;
+};
+
+class LedPattern {
+ public:
+  LedPattern() {}
+  // copies the steps and settings, not the play position (the copy has
+  // not been started)
+  LedPattern(const LedPattern& other) { *this = other; }
+  LedPattern& operator=(const LedPattern& other);
+
+  // Empties the pattern (no steps, repeat once, start from the current
+  // brightness).
+  void clear();
+
+  // Appends a step. Returns false if it is full or ticks is 0.
+  bool addStep(uint8_t duty, uint16_t ticks, bool ramp = false);
+
+  // Replaces the steps with a text list, "duty:ticks" separated by
+  // commas, a leading '~' marking a ramp: "255:200,0:100,~128:1000".
+  // Returns false (leaving the pattern empty) if it does not parse.
+  bool parseSteps(const char* text);
+
+  // Plays the steps this many times; 0 repeats until replaced.
+  void setRepeat(uint32_t times) { repeat_ = times; }
+
+  // Starts the first step from this brightness instead of the current one.
+  void setStartDuty(uint8_t duty) { startDuty_ = duty; }
+
+  // A blink: on at `duty` for percent of periodTicks, then off for the
+  // rest, count times (0: for ever). Returns false if either half would
+  // be shorter than a tick.
+  bool blink(uint32_t periodTicks, uint8_t percent, uint32_t count,
+             uint8_t duty);
+
+  // One ramp from `from` (if negative, the current brightness) to `to`
+  // over ticks.
+  bool fade(int from, uint8_t to, uint32_t ticks);
+
+  // Sets the output to where the pattern starts: its start duty if it has
+  // one, else currentDuty (the first step ramps from there).
+  void start(uint8_t currentDuty);
+
+  // Advances one tick. Returns true if duty() changed. Once the last
+  // repeat is over duty() stays at the last step's brightness and
+  // finished() turns true.
+  bool tick();
+
+  uint8_t duty() const { return duty_; }
+  bool finished() const { return done_.load(std::memory_order_acquire); }
+  size_t steps() const { return count_; }
+  uint32_t repeat() const { return repeat_; }
+
+  // Length of one run through the steps, and of the whole pattern (0 if
+  // it repeats for ever).
+  uint32_t periodTicks() const;
+  uint32_t totalTicks() const;
+
+ private:
+  PatternStep steps_[PATTERN_MAX_STEPS];
+  size_t count_ = 0;
+  uint32_t repeat_ = 1;
+  int16_t startDuty_ = -1;  // -1: start from the current brightness
+
+  // play position (tick() only, once started)
+  size_t index_ = 0;
+  uint16_t elapsed_ = 0;
+  uint32_t rounds_ = 0;
+  uint8_t from_ = 0;  // brightness the current step started at
+  uint8_t duty_ = 0;
+  std::atomic<bool> done_{true};
+};
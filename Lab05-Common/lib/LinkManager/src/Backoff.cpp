@@ -0,0 +1,20 @@
+// Jittered exponential backoff. See Backoff.h.
+#include "Backoff.h"
+
+uint32_t Backoff::next() {
+  uint32_t window = baseMs_;
+  for (uint16_t i = 0; i < failures_ && window < capMs_; i++) {
+    window *= 2;
+  }
+  if (window > capMs_) window = capMs_;
+  if (failures_ < UINT16_MAX) failures_++;
+  return minMs_ + random32() % (window + 1);
+}
+
+uint32_t Backoff::random32() {
+  uint32_t x = state_;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return state_ = x;
+}
@@ -0,0 +1,41 @@
+// Jittered exponential backoff for connection retries.
+//
+// Each call to next() returns how long to wait before the next attempt:
+//
+//   minMs + random(0 .. min(capMs, baseMs * 2^failures))
+//
+// minMs caps the retry rate, the window doubles with every consecutive
+// failure up to capMs, and the random part spreads a fleet of nodes that
+// lost the broker at the same moment so they do not all come back at the
+// same moment too. reset() after a successful connection.
+//
+// The generator is a small xorshift so simulations can seed it and get
+// repeatable runs; on hardware seed it from random() (which is the ESP32
+// hardware RNG).
+#pragma once
+
+#include <stdint.h>
+
+class Backoff {
+ public:
+  Backoff(uint32_t baseMs = 500, uint32_t capMs = 16000,
+          uint32_t minMs = 1000)
+      : baseMs_(baseMs), capMs_(capMs), minMs_(minMs) {}
+
+  void seed(uint32_t seed) { state_ = seed ? seed : 1; }
+  void reset() { failures_ = 0; }
+
+  // Delay before the next attempt; counts as one more failure.
+  uint32_t next();
+
+  uint16_t failures() const { return failures_; }
+
+ private:
+  uint32_t random32();
+
+  uint32_t baseMs_;
+  uint32_t capMs_;
+  uint32_t minMs_;
+  uint16_t failures_ = 0;
+  uint32_t state_ = 2463534242u;
+};
@@ -0,0 +1,77 @@
+// Non-blocking WiFi + MQTT connection state machine. See LinkManager.h.
+#include "LinkManager.h"
+
+void LinkManager::waitThenRetry(LinkState state, uint32_t now) {
+  state_ = state;
+  retryAt_ = now + backoff_.next();
+}
+
+void LinkManager::tick(uint32_t now) {
+  switch (state_) {
+    case LINK_WIFI_START:
+      hooks_.startWifi(hooks_.context);
+      state_ = LINK_WIFI_WAIT;
+      since_ = now;
+      break;
+
+    case LINK_WIFI_WAIT:
+      if (hooks_.wifiReady(hooks_.context)) {
+        if (hooks_.wifiUp) hooks_.wifiUp(hooks_.context);
+        // try the broker straight away
+        state_ = LINK_MQTT_BACKOFF;
+        retryAt_ = now;
+      } else if (now - since_ >= LINK_WIFI_TIMEOUT_MS) {
+        waitThenRetry(LINK_WIFI_BACKOFF, now);
+      }
+      break;
+
+    case LINK_WIFI_BACKOFF:
+      if ((int32_t)(now - retryAt_) >= 0) state_ = LINK_WIFI_START;
+      break;
+
+    case LINK_MQTT_BACKOFF:
+      if ((int32_t)(now - retryAt_) < 0) break;
+      if (!hooks_.wifiReady(hooks_.context)) {
+        state_ = LINK_WIFI_WAIT;
+        since_ = now;
+        break;
+      }
+      connectAttempts_++;
+      if (hooks_.connectMqtt(hooks_.context)) {
+        state_ = LINK_UP;
+        backoff_.reset();
+        if (hooks_.linkUp) hooks_.linkUp(hooks_.context);
+      } else {
+        connectFailures_++;
+        waitThenRetry(LINK_MQTT_BACKOFF, now);
+      }
+      break;
+
+    case LINK_UP:
+      if (!hooks_.mqttReady(hooks_.context)) {
+        drops_++;
+        if (hooks_.linkDown) hooks_.linkDown(hooks_.context);
+        // back off even before the first retry, so nodes that lost the
+        // broker together do not all hit it again in the same instant
+        waitThenRetry(LINK_MQTT_BACKOFF, now);
+      }
+      break;
+  }
+}
+
+uint32_t LinkManager::msUntilNextAction(uint32_t now) const {
+  switch (state_) {
+    case LINK_WIFI_START:
+      return 0;
+    case LINK_WIFI_WAIT:
+      return LINK_WIFI_POLL_MS;
+    case LINK_WIFI_BACKOFF:
+    case LINK_MQTT_BACKOFF: {
+      int32_t wait = (int32_t)(retryAt_ - now);
+      return wait > 0 ? (uint32_t)wait : 0;
+    }
+    case LINK_UP:
+    default:
+      return UINT32_MAX;
+  }
+}
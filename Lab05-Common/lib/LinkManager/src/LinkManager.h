@@ -0,0 +1,86 @@
+// Non-blocking WiFi + MQTT connection state machine.
+//
+// The old reconnect() looped (with delay(5000)) until the broker answered,
+// and connect_wifi() spun until the access point did, so a broker restart
+// froze the whole node. A LinkManager instead does at most one step per
+// tick() and returns: start WiFi, check whether it is up, make one MQTT
+// connect attempt, or wait out a backoff period. loop() calls tick() on
+// every pass and keeps doing its local work in between.
+//
+// The node supplies the actual operations as hooks, each passed the
+// hooks' context pointer:
+//
+//   LinkHooks hooks = {start_wifi, wifi_ready, report_wifi, connect_mqtt,
+//                      mqtt_ready, link_up, link_down, nullptr};
+//   LinkManager netLink(hooks);
+//   ...
+//   netLink.tick(millis());                  // in loop()
+//   if (netLink.isUp()) psClient.loop();
+//
+// Retries (of both WiFi and MQTT) are spaced by a jittered exponential
+// Backoff. A single connect attempt still blocks for as long as
+// psClient.connect() takes: immediate when the broker refuses, up to the
+// TCP connect timeout when it is unreachable.
+#pragma once
+
+#include <stdint.h>
+
+#include "Backoff.h"
+
+enum LinkState {
+  LINK_WIFI_START,    // WiFi needs (re)starting
+  LINK_WIFI_WAIT,     // waiting for WiFi to associate
+  LINK_WIFI_BACKOFF,  // WiFi timed out; waiting to restart it
+  LINK_MQTT_BACKOFF,  // waiting before the next broker connect attempt
+  LINK_UP             // WiFi and MQTT connected
+};
+
+struct LinkHooks {
+  void (*startWifi)(void* context);     // begin associating (WiFi.begin)
+  bool (*wifiReady)(void* context);     // WiFi.status() == WL_CONNECTED
+  void (*wifiUp)(void* context);        // optional: WiFi just came up
+  bool (*connectMqtt)(void* context);   // one psClient.connect() attempt
+  bool (*mqttReady)(void* context);     // psClient.connected()
+  void (*linkUp)(void* context);        // optional: subscribe etc.
+  void (*linkDown)(void* context);      // optional: connection lost
+  void* context;
+};
+
+#ifndef LINK_WIFI_TIMEOUT_MS
+#define LINK_WIFI_TIMEOUT_MS 15000  // restart WiFi if not up by then
+#endif
+#ifndef LINK_WIFI_POLL_MS
+#define LINK_WIFI_POLL_MS 50  // how often to check WiFi while waiting
+#endif
+
+class LinkManager {
+ public:
+  explicit LinkManager(const LinkHooks& hooks) : hooks_(hooks) {}
+
+  // Advances the state machine by at most one step.
+  void tick(uint32_t now);
+
+  bool isUp() const { return state_ == LINK_UP; }
+  LinkState state() const { return state_; }
+
+  // How long loop() may sleep before tick() has something to do.
+  uint32_t msUntilNextAction(uint32_t now) const;
+
+  Backoff& backoff() { return backoff_; }
+
+  uint32_t connectAttempts() const { return connectAttempts_; }
+  uint32_t connectFailures() const { return connectFailures_; }
+  uint32_t drops() const { return drops_; }
+
+ private:
+  void waitThenRetry(LinkState state, uint32_t now);
+
+  LinkHooks hooks_;
+  Backoff backoff_;
+  LinkState state_ = LINK_WIFI_START;
+  uint32_t since_ = 0;      // when WiFi was started
+  uint32_t retryAt_ = 0;    // end of the current backoff
+  uint32_t connectAttempts_ = 0;
+  uint32_t connectFailures_ = 0;
+  uint32_t drops_ = 0;
+};
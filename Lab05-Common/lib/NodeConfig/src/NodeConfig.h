@@ -0,0 +1,148 @@
+// Settings the LED node, the button node and the host tools share: the
+// network and broker, the client IDs, the topics and the command tokens.
+//
+// Everything here is fixed when the program is built. Change a setting
+// with a build flag in platformio.ini rather than by editing this file,
+// so both nodes of a pair are built alike:
+//
+//   build_flags =
+//     -DNODE_NETWORK=NETWORK_LIPSCOMB
+//     '-DLED_CLIENT_ID="ledNode07"'
+//     '-DBUTTON_CLIENT_ID="btnNode07"'
+//
+// Topics are a client ID plus a fixed suffix (TOPIC_LED_COMMAND...). Every
+// node, the sketches' included, is given its ID when it is constructed
+// (the fleet simulator makes hundreds), and keeps its topics in TopicName
+// buffers, sized at compile time and filled once by copying, with no
+// formatting:
+//
+//   TopicName<TOPIC_SIZE(TOPIC_STATE)> stateTopic;
+//   stateTopic.set(clientID, TOPIC_STATE);
+//   psClient.publish(stateTopic, payload);
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// ---- network and broker ---------------------------------------------------
+
+#define NETWORK_OTHER 0
+#define NETWORK_LIPSCOMB 1    // Lipscomb broker over WiFi
+#define NETWORK_ETHERNET 2    // Lipscomb broker on the wired ECE network
+#define NETWORK_HUTTONHOME 3  // "brokerX"
+#ifndef NODE_NETWORK
+#define NODE_NETWORK NETWORK_ETHERNET
+#endif
+
+// Network and MQTT broker credentials. A nullptr password joins an open
+// network.
+#if NODE_NETWORK == NETWORK_LIPSCOMB
+constexpr char mqttBroker[] = "10.51.97.101";  // ECE mosquitto server (wlan0)
+constexpr char ssid[] = "LipscombGuest";  // no PW needed for guest wifi
+constexpr const char* password = nullptr;
+#elif NODE_NETWORK == NETWORK_ETHERNET
+constexpr char mqttBroker[] = "10.200.97.100";  // wired ECE mosquitto (eth0)
+constexpr char ssid[] = "LipscombGuest";        // same as straight WiFi
+constexpr const char* password = nullptr;
+#elif NODE_NETWORK == NETWORK_HUTTONHOME
+constexpr char mqttBroker[] = "192.168.0.251";  // address of brokerX
+constexpr char ssid[] = "HuttonWireless2-4G";   // ssid of brokerX's network
+constexpr const char* password = "Testing01";   // brokerX's network password
+#else
+constexpr char mqttBroker[] = "1.1.1.1";
+constexpr char ssid[] = "";
+constexpr const char* password = "password";  // password for brokerX's network
+#endif
+
+constexpr uint16_t mqttPort = 1883;
+
+// ---- client IDs -----------------------------------------------------------
+
+// The pair's client IDs: the sketches' node objects use these (the fleet
+// simulator gives each of its nodes its own)
+#ifndef LED_CLIENT_ID
+#define LED_CLIENT_ID "ledNodeXX"  // Change XX to your two-digit ID
+#endif
+#ifndef BUTTON_CLIENT_ID
+#define BUTTON_CLIENT_ID "btnNodeXX"  // Change XX to your two-digit ID
+#endif
+#define CLIENT_ID_SIZE 24  // longest client ID + 1
+
+static_assert(sizeof(LED_CLIENT_ID) <= CLIENT_ID_SIZE &&
+                  sizeof(BUTTON_CLIENT_ID) <= CLIENT_ID_SIZE,
+              "client IDs are limited to CLIENT_ID_SIZE - 1 characters");
+
+// true if id still has the "XX" placeholder in it
+constexpr bool hasPlaceholderID(const char* id) {
+  return id[0] != '\0' &&
+         ((id[0] == 'X' && id[1] == 'X') || hasPlaceholderID(id + 1));
+}
+#ifndef NATIVE_BUILD  // host builds run with the placeholder IDs
+static_assert(!hasPlaceholderID(LED_CLIENT_ID) &&
+                  !hasPlaceholderID(BUTTON_CLIENT_ID),
+              "set LED_CLIENT_ID and BUTTON_CLIENT_ID to your two-digit ID");
+#endif
+
+// ---- topics ---------------------------------------------------------------
+
+// <led>/ledCommand, <button>/ledStatus, <led>/state (retained),
+// <led>/availability (retained), <button>/stats, each node's <id>/metrics,
+// and group commands on GROUP_TOPIC_PREFIX<group>TOPIC_LED_COMMAND
+#define TOPIC_LED_COMMAND "/ledCommand"
+#define TOPIC_LED_STATUS "/ledStatus"
+#define TOPIC_STATE "/state"
+#define TOPIC_AVAILABILITY "/availability"
+#define TOPIC_STATS "/stats"
+#define TOPIC_METRICS "/metrics"
+#define GROUP_TOPIC_PREFIX "ledGroup/"
+
+// Bytes for any client ID followed by suffix (a TOPIC_xxx literal)
+#define TOPIC_SIZE(suffix) (CLIENT_ID_SIZE - 1 + sizeof(suffix))
+
+// A topic held in a fixed buffer of N bytes and built from parts by
+// copying them. A topic that would not fit is left empty (and set()
+// returns false), never cut short: a shortened topic would be another
+// node's.
+template <size_t N>
+class TopicName {
+ public:
+  TopicName() { text_[0] = '\0'; }
+
+  // prefix (usually a client ID) + suffix
+  bool set(const char* prefix, const char* suffix) {
+    return set("", prefix, strlen(prefix), suffix);
+  }
+  // first + the length bytes at middle + last, e.g. a group's command topic:
+  // set(GROUP_TOPIC_PREFIX, name, nameLength, TOPIC_LED_COMMAND)
+  bool set(const char* first, const char* middle, size_t length,
+           const char* last) {
+    size_t firstLength = strlen(first);
+    size_t lastLength = strlen(last);
+    if (firstLength + length + lastLength >= N) {
+      text_[0] = '\0';
+      return false;
+    }
+    memcpy(text_, first, firstLength);
+    memcpy(text_ + firstLength, middle, length);
+    memcpy(text_ + firstLength + length, last, lastLength + 1);
+    return true;
+  }
+
+  const char* c_str() const { return text_; }
+  operator const char*() const { return text_; }
+  bool empty() const { return text_[0] == '\0'; }
+
+ private:
+  char text_[N];
+};
+
+// ---- commands -------------------------------------------------------------
+
+// The "cmd" of a ledCommand
+constexpr char cmdOn[] = "on";
+constexpr char cmdOff[] = "off";
+constexpr char cmdBlink[] = "blink";  // period, duty (%), count, level
+constexpr char cmdFade[] = "fade";    // from, to, ms
+constexpr char cmdSeq[] = "seq";      // steps, count
+constexpr char cmdSet[] = "set";      // on, off (bitmasks), levels
@@ -0,0 +1,143 @@
+#include "NodeLog.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+
+#ifndef LOG_SLOTS
+#define LOG_SLOTS 32  // a power of two
+#endif
+#ifndef LOG_LINE_SIZE
+#define LOG_LINE_SIZE 224  // room for a MAX_CMD_PAYLOAD dump
+#endif
+
+std::atomic<uint8_t> logThreshold{LOG_LEVEL_DEBUG};
+
+namespace {
+
+struct Slot {
+  // pos while free for the producer claiming position pos, pos + 1 once
+  // that producer has filled it
+  std::atomic<uint32_t> seq;
+  uint16_t length;
+  char text[LOG_LINE_SIZE];
+};
+
+Slot slots[LOG_SLOTS];
+std::atomic<uint32_t> tail{0};  // next position a producer claims
+std::atomic<uint32_t> head{0};  // next position logDrain() reads
+std::atomic<uint32_t> written{0};
+std::atomic<uint32_t> dropped{0};
+std::atomic<bool> draining{false};  // one logDrain() at a time
+uint32_t reportedDrops = 0;         // logDrain() only
+size_t headWritten = 0;             // of the head line, by logDrain()
+
+struct SlotInit {
+  SlotInit() {
+    for (uint32_t i = 0; i < LOG_SLOTS; i++) slots[i].seq = i;
+  }
+} slotInit;
+
+// Writes n bytes of slot's line, with its line ending, from byte from.
+void writePart(Print& out, const Slot& slot, size_t from, size_t n) {
+  if (from < slot.length) {
+    size_t text = slot.length - from < n ? slot.length - from : n;
+    out.write((const uint8_t*)slot.text + from, text);
+    from += text;
+    n -= text;
+  }
+  if (n > 0) out.write((const uint8_t*)"\r\n" + (from - slot.length), n);
+}
+
+}  // namespace
+
+bool logPrintf(const char* format, ...) {
+  // claim a position whose slot the drain has finished with
+  uint32_t pos = tail.load(std::memory_order_relaxed);
+  Slot* slot;
+  for (;;) {
+    slot = &slots[pos % LOG_SLOTS];
+    int32_t diff =
+        (int32_t)(slot->seq.load(std::memory_order_acquire) - pos);
+    if (diff == 0) {
+      if (tail.compare_exchange_weak(pos, pos + 1,
+                                     std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      dropped.fetch_add(1, std::memory_order_relaxed);  // full
+      return false;
+    } else {
+      pos = tail.load(std::memory_order_relaxed);  // another producer won
+    }
+  }
+
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(slot->text, LOG_LINE_SIZE, format, args);
+  va_end(args);
+  if (length < 0) length = 0;
+  if (length > LOG_LINE_SIZE - 1) length = LOG_LINE_SIZE - 1;
+  slot->length = (uint16_t)length;
+  slot->seq.store(pos + 1, std::memory_order_release);
+  written.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+void logSetLevel(uint8_t level) { logThreshold = level; }
+
+uint8_t logLevel() { return logThreshold; }
+
+size_t logDrain(Print& out, size_t maxBytes) {
+  // a second caller (another task, or the same one re-entered from out)
+  // goes away empty-handed rather than reading the slots twice
+  if (draining.exchange(true, std::memory_order_acquire)) return 0;
+  size_t bytes = 0;
+  char note[48];
+  uint32_t drops = dropped.load(std::memory_order_relaxed);
+  if (drops != reportedDrops) {
+    int length = snprintf(note, sizeof(note), "(%u log lines dropped)\r\n",
+                          (unsigned)(drops - reportedDrops));
+    if ((size_t)length > maxBytes) {
+      draining.store(false, std::memory_order_release);
+      return 0;
+    }
+    out.write((const uint8_t*)note, length);
+    bytes += length;
+    reportedDrops = drops;
+  }
+
+  uint32_t pos = head.load(std::memory_order_relaxed);
+  for (;;) {
+    Slot& slot = slots[pos % LOG_SLOTS];
+    if (slot.seq.load(std::memory_order_acquire) != pos + 1) break;
+    size_t left = slot.length + 2 - headWritten;
+    if (bytes + left > maxBytes) {
+      // only a drain that has written nothing else starts a line it
+      // cannot finish, and then fills maxBytes with it: a line longer
+      // than any one drain takes goes out over several, rather than
+      // holding up every line behind it for good
+      if (bytes > 0 || maxBytes == 0) break;
+      left = maxBytes;
+    }
+    writePart(out, slot, headWritten, left);
+    bytes += left;
+    headWritten += left;
+    if (headWritten < (size_t)slot.length + 2) break;
+    headWritten = 0;
+    // free for the producer that claims this slot next time round
+    slot.seq.store(pos + LOG_SLOTS, std::memory_order_release);
+    pos++;
+  }
+  head.store(pos, std::memory_order_relaxed);
+  draining.store(false, std::memory_order_release);
+  return bytes;
+}
+
+uint32_t logQueued() {
+  return tail.load(std::memory_order_relaxed) -
+         head.load(std::memory_order_relaxed);
+}
+
+uint32_t logWritten() { return written.load(std::memory_order_relaxed); }
+
+uint32_t logDropped() { return dropped.load(std::memory_order_relaxed); }
@@ -0,0 +1,105 @@
+// Console logging that never waits for the UART.
+//
+// At 115200 baud every character printed takes 87 us, and Serial.print()
+// blocks once the UART's small transmit FIFO is full, so a few lines per
+// message cost milliseconds on the path from the MQTT callback to the
+// reply. These macros format the line into a fixed ring of slots instead,
+// and loop() copies the ring to Serial only when it has nothing else to
+// do, and only as much as the FIFO takes without blocking:
+//
+//   LOG_INFO("Turning LED %s.", on ? "ON" : "OFF");     // anywhere
+//   LOG_DEBUG("%.*s", (int)length, payload);
+//   ...
+//   logDrain(Serial, Serial.availableForWrite());       // when idle
+//
+// Each call is one line; logDrain() adds the line ending. Levels are
+// removed at compile time: a LOG_xxx above LOG_LEVEL (define it before
+// including this header; default LOG_LEVEL_INFO) expands to nothing, and
+// its arguments are not evaluated. Below that, logSetLevel() can lower the
+// threshold at run time, which costs one comparison per call.
+//
+// Any task may log (the ring takes several producers, without a lock:
+// each slot carries a sequence number, as in Vyukov's bounded queue),
+// and any may drain; a drain that finds another under way returns at
+// once. When the ring is full the line is dropped and counted, never
+// waited for; the next drain reports how many were lost. Lines longer
+// than LOG_LINE_SIZE - 1 are cut short. Not for ISRs.
+#pragma once
+
+#include <Print.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+// the run-time threshold (logSetLevel()); read by the macros
+extern std::atomic<uint8_t> logThreshold;
+
+// Formats one line into the ring. Returns false if it was dropped (ring
+// full). Use the macros rather than calling this directly.
+bool logPrintf(const char* format, ...)
+    __attribute__((format(printf, 1, 2)));
+
+// Levels above this are skipped at run time (default: all that are
+// compiled in).
+void logSetLevel(uint8_t level);
+uint8_t logLevel();
+
+// Writes whole lines from the ring to out, oldest first, until it is
+// empty or the next line would take the total past maxBytes. A line that
+// does not fit in maxBytes at the start of a drain is written in pieces,
+// maxBytes per drain, so one longer than the UART FIFO still gets out.
+// Returns the bytes written; 0 if another task is draining.
+size_t logDrain(Print& out, size_t maxBytes);
+
+uint32_t logQueued();   // lines waiting to be drained
+uint32_t logWritten();  // lines put in the ring, ever
+uint32_t logDropped();  // lines lost to a full ring, ever
+
+#define LOG_AT(level, ...)                                                  \
+  do {                                                                      \
+    if ((level) <= logThreshold.load(std::memory_order_relaxed))            \
+      logPrintf(__VA_ARGS__);                                               \
+  } while (0)
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) \
+  do {                 \
+  } while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(...) LOG_AT(LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define LOG_WARN(...) \
+  do {                \
+  } while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(...) LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) \
+  do {                \
+  } while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) \
+  do {                 \
+  } while (0)
+#endif
@@ -0,0 +1,73 @@
+// Node health counters. See NodeMetrics.h.
+#include "NodeMetrics.h"
+
+#include <Esp.h>
+#include <WiFi.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+// Appends to out; once something has not fit, used stays at size or past.
+static void append(char* out, size_t size, size_t& used, const char* fmt,
+                   ...) {
+  if (used >= size) return;
+  va_list args;
+  va_start(args, fmt);
+  int n = vsnprintf(out + used, size - used, fmt, args);
+  va_end(args);
+  used = n < 0 ? size : used + n;
+}
+
+NodeMetrics::NodeMetrics(const char* const* inTopics, int inCount,
+                         const char* const* outTopics, int outCount)
+    : inTopics_(inTopics),
+      outTopics_(outTopics),
+      inCount_(inCount < METRICS_MAX_TOPICS ? inCount : METRICS_MAX_TOPICS),
+      outCount_(outCount < METRICS_MAX_TOPICS ? outCount
+                                              : METRICS_MAX_TOPICS) {
+  reset(0);
+}
+
+void NodeMetrics::reset(uint32_t nowMs) {
+  memset(in_, 0, sizeof(in_));
+  memset(out_, 0, sizeof(out_));
+  parseFailures_ = 0;
+  connectAttempts_ = 0;
+  loops_ = 0;
+  loopMaxUs_ = 0;
+  loopTotalUs_ = 0;
+  since_ = nowMs;
+}
+
+size_t NodeMetrics::format(char* out, size_t size, uint32_t nowMs) const {
+  size_t used = 0;
+  append(out, size, used, "{\"up\":%lu,\"ms\":%lu,\"in\":{",
+         (unsigned long)(nowMs / 1000), (unsigned long)(nowMs - since_));
+  for (int i = 0; i < inCount_; i++) {
+    append(out, size, used, i ? ",\"%s\":%lu" : "\"%s\":%lu", inTopics_[i],
+           (unsigned long)in_[i]);
+  }
+  append(out, size, used, "},\"out\":{");
+  for (int i = 0; i < outCount_; i++) {
+    append(out, size, used, i ? ",\"%s\":%lu" : "\"%s\":%lu", outTopics_[i],
+           (unsigned long)out_[i]);
+  }
+  append(out, size, used,
+         "},\"bad\":%lu,\"conn\":%lu,\"loops\":%lu,\"loopMax\":%lu,"
+         "\"loopAvg\":%lu,",
+         (unsigned long)parseFailures_, (unsigned long)connectAttempts_,
+         (unsigned long)loops_, (unsigned long)loopMaxUs_,
+         (unsigned long)(loops_ ? loopTotalUs_ / loops_ : 0));
+  // as they are now, not over the interval
+  if (hasOutbox_) {
+    append(out, size, used,
+           "\"outbox\":{\"depth\":%d,\"high\":%d,\"drops\":%lu},",
+           outboxDepth_, outboxHighWater_, (unsigned long)outboxDrops_);
+  }
+  append(out, size, used,
+         "\"heap\":%lu,\"heapMin\":%lu,\"block\":%lu,\"rssi\":%d}",
+         (unsigned long)ESP.getFreeHeap(), (unsigned long)ESP.getMinFreeHeap(),
+         (unsigned long)ESP.getMaxAllocHeap(),
+         WiFi.status() == WL_CONNECTED ? (int)WiFi.RSSI() : 0);
+  return used < size ? used : 0;
+}
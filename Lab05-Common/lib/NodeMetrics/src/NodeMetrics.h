@@ -0,0 +1,106 @@
+// Health counters for a node, published now and then as one small
+// message, so a node that has gone sluggish can be spotted from the
+// broker instead of from its serial console.
+//
+// Collecting is a counter increment per event, with no locking and no
+// formatting; the text is only built when the message goes out:
+//
+//   NodeMetrics metrics(inTopics, 2, outTopics, 3);
+//   metrics.received(METRIC_IN_COMMAND);  // per message handled
+//   metrics.sent(METRIC_OUT_STATUS);      // per message published
+//   metrics.parseFailed();                // a payload that would not parse
+//   metrics.connectAttempt();             // each try at the broker
+//   metrics.loopTime(micros() - start);   // per pass of loop()
+//   ...
+//   metrics.outbox(outbox.depth(), outbox.highWater(), outbox.drops());
+//   size_t length = metrics.format(buffer, sizeof(buffer), millis());
+//   psClient.publish(metricsTopic, buffer, length);
+//   metrics.reset(millis());              // start the next interval
+//
+// The message is JSON with short keys, e.g.
+//
+//   {"up":3600,"ms":60000,"in":{"cmd":120,"grp":4},
+//    "out":{"status":118,"state":60,"avail":0,"metrics":1},"bad":0,
+//    "conn":0,"loops":5210,"loopMax":812,"loopAvg":37,
+//    "outbox":{"depth":0,"high":5,"drops":0},"heap":201232,
+//    "heapMin":198004,"block":110592,"rssi":-61}
+//
+// up is seconds since boot; in/out count the messages per topic over the
+// last ms milliseconds; bad the payloads that failed to parse; conn the
+// broker connection attempts; loops, loopMax and loopAvg the passes of
+// loop() and how long they took (us). outbox, only there once outbox()
+// has been called, is the node's publish queue: messages waiting, the
+// most that have waited and those dropped, the last two since boot.
+// heap, heapMin (the lowest it has been since boot) and block (the
+// largest allocation that would succeed) are bytes, and rssi is dBm (0
+// while WiFi is down), all as of format().
+//
+// Counters are plain integers: call everything from one task (the
+// network task, with DUAL_CORE).
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define METRICS_MAX_TOPICS 6       // per direction
+#define METRICS_PAYLOAD_SIZE 384   // room for format() with every counter
+                                   // at its widest
+
+class NodeMetrics {
+ public:
+  // A short name for each topic counted, in the order of the indexes
+  // passed to received() and sent(). The names are not copied.
+  NodeMetrics(const char* const* inTopics, int inCount,
+              const char* const* outTopics, int outCount);
+
+  void received(int topic) { in_[topic]++; }
+  void sent(int topic) { out_[topic]++; }
+  void parseFailed() { parseFailures_++; }
+  void connectAttempt() { connectAttempts_++; }
+  void loopTime(uint32_t us) {
+    loops_++;
+    loopTotalUs_ += us;
+    if (us > loopMaxUs_) loopMaxUs_ = us;
+  }
+  // The outbound queue as it is now, for the next format(); reset() keeps
+  // it, as it is not counted over the interval.
+  void outbox(int depth, int highWater, uint32_t drops) {
+    hasOutbox_ = true;
+    outboxDepth_ = depth;
+    outboxHighWater_ = highWater;
+    outboxDrops_ = drops;
+  }
+
+  // Writes the message for the interval so far into out. Returns its
+  // length, or 0 if it does not fit in size bytes.
+  size_t format(char* out, size_t size, uint32_t nowMs) const;
+
+  // Zeroes the counters; the next interval starts at nowMs.
+  void reset(uint32_t nowMs);
+
+  uint32_t receivedCount(int topic) const { return in_[topic]; }
+  uint32_t sentCount(int topic) const { return out_[topic]; }
+  uint32_t parseFailures() const { return parseFailures_; }
+  uint32_t connectAttempts() const { return connectAttempts_; }
+  uint32_t loops() const { return loops_; }
+  uint32_t loopMaxUs() const { return loopMaxUs_; }
+
+ private:
+  const char* const* inTopics_;
+  const char* const* outTopics_;
+  int inCount_;
+  int outCount_;
+
+  uint32_t in_[METRICS_MAX_TOPICS];
+  uint32_t out_[METRICS_MAX_TOPICS];
+  uint32_t parseFailures_;
+  uint32_t connectAttempts_;
+  uint32_t loops_;
+  uint32_t loopMaxUs_;
+  uint64_t loopTotalUs_;
+  uint32_t since_;
+  bool hasOutbox_ = false;
+  int outboxDepth_ = 0;
+  int outboxHighWater_ = 0;
+  uint32_t outboxDrops_ = 0;
+};
@@ -0,0 +1,69 @@
+// Bounded queue of outgoing MQTT messages. See PublishQueue.h.
+#include "PublishQueue.h"
+
+#include <string.h>
+
+namespace {
+
+uint32_t hashTopic(const char* topic, size_t* length) {
+  uint32_t hash = 2166136261u;
+  const char* p = topic;
+  while (*p != '\0') hash = (hash ^ (uint8_t)*p++) * 16777619u;
+  *length = p - topic;
+  return hash;
+}
+
+}  // namespace
+
+bool PublishQueue::enqueue(const char* topic, const uint8_t* payload,
+                           size_t length, bool retained, bool coalesce) {
+  size_t topicLength;
+  uint32_t hash = hashTopic(topic, &topicLength);
+  if (topicLength >= PUBLISH_QUEUE_TOPIC_SIZE ||
+      length > PUBLISH_QUEUE_PAYLOAD_SIZE) {
+    drops_++;
+    return false;
+  }
+
+  Slot* slot = nullptr;
+  if (coalesce) {
+    for (int i = 0; i < count_; i++) {
+      Slot& s = slots_[(head_ + i) % PUBLISH_QUEUE_SLOTS];
+      if (s.topicHash == hash && strcmp(s.topic, topic) == 0) {
+        slot = &s;
+        coalesced_++;
+        break;
+      }
+    }
+  }
+  if (slot == nullptr) {
+    if (count_ == PUBLISH_QUEUE_SLOTS) {
+      drops_++;
+      return false;
+    }
+    slot = &slots_[(head_ + count_) % PUBLISH_QUEUE_SLOTS];
+    slot->topicHash = hash;
+    memcpy(slot->topic, topic, topicLength + 1);
+    if (++count_ > highWater_) highWater_ = count_;
+  }
+  memcpy(slot->payload, payload, length);
+  slot->length = (uint16_t)length;
+  slot->retained = retained;
+  return true;
+}
+
+bool PublishQueue::enqueue(const char* topic, const char* payload,
+                           bool retained, bool coalesce) {
+  return enqueue(topic, (const uint8_t*)payload, strlen(payload), retained,
+                 coalesce);
+}
+
+void PublishQueue::pop() {
+  head_ = (head_ + 1) % PUBLISH_QUEUE_SLOTS;
+  count_--;
+}
+
+void PublishQueue::clear() {
+  head_ = 0;
+  count_ = 0;
+}
@@ -0,0 +1,101 @@
+// Bounded queue of outgoing MQTT messages, drained from loop().
+//
+// Publishing straight from the MQTT callback means one blocking TCP write
+// per incoming message, in the middle of receiving. Instead the callback
+// queues the reply and loop() sends what is queued, a limited amount per
+// pass so a backlog cannot starve everything else:
+//
+//   outbox.enqueue(replyTopic, json_msgBuffer, length);  // in the callback
+//   outbox.drain(psClient, 4, 1024);                     // in loop()
+//
+// Messages that carry state (ledStatus) are coalesced: if a message for
+// the same topic is still waiting, the new payload replaces it in place,
+// so a burst of commands produces one status with the final state rather
+// than one per command. Messages for different topics keep their order.
+//
+// Storage is a fixed ring of PUBLISH_QUEUE_SLOTS messages: enough for a
+// reply to each of several senders at once plus the retained topics. When
+// it is full a new message (for a topic not already queued) is dropped and
+// counted.
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef PUBLISH_QUEUE_SLOTS
+#define PUBLISH_QUEUE_SLOTS 12
+#endif
+#ifndef PUBLISH_QUEUE_TOPIC_SIZE
+#define PUBLISH_QUEUE_TOPIC_SIZE 64
+#endif
+#ifndef PUBLISH_QUEUE_PAYLOAD_SIZE
+#define PUBLISH_QUEUE_PAYLOAD_SIZE 200
+#endif
+
+class PublishQueue {
+ public:
+  // Queues a copy of topic and payload. With coalesce, replaces the
+  // payload of a message already queued for the same topic instead.
+  // Returns false (and counts a drop) if the queue is full or the message
+  // does not fit in a slot.
+  bool enqueue(const char* topic, const uint8_t* payload, size_t length,
+               bool retained = false, bool coalesce = true);
+  bool enqueue(const char* topic, const char* payload, bool retained = false,
+               bool coalesce = true);
+
+  // Publishes queued messages, oldest first, through client (a
+  // PubSubClient) until the queue is empty, maxMessages have been sent or
+  // the next message would take the total past maxBytes (at least one is
+  // always sent). Stops, keeping the message, if the client is not
+  // connected; a message the client rejects while connected (too big for
+  // its buffer) is dropped. Returns the number published.
+  template <typename Client>
+  int drain(Client& client, int maxMessages, size_t maxBytes) {
+    int published = 0;
+    size_t bytes = 0;
+    while (count_ > 0 && published < maxMessages) {
+      Slot& s = slots_[head_];
+      if (published > 0 && bytes + s.length > maxBytes) break;
+      if (!client.publish(s.topic, s.payload, s.length, s.retained)) {
+        if (!client.connected()) break;
+        failures_++;
+      } else {
+        published++;
+        sent_++;
+      }
+      bytes += s.length;
+      pop();
+    }
+    return published;
+  }
+
+  // Discards everything queued.
+  void clear();
+
+  int depth() const { return count_; }
+  int highWater() const { return highWater_; }
+  uint32_t sent() const { return sent_; }
+  uint32_t coalesced() const { return coalesced_; }
+  uint32_t drops() const { return drops_; }        // queue full / too big
+  uint32_t failures() const { return failures_; }  // rejected by client
+
+ private:
+  struct Slot {
+    uint32_t topicHash;
+    char topic[PUBLISH_QUEUE_TOPIC_SIZE];
+    uint8_t payload[PUBLISH_QUEUE_PAYLOAD_SIZE];
+    uint16_t length;
+    bool retained;
+  };
+
+  void pop();
+
+  Slot slots_[PUBLISH_QUEUE_SLOTS];
+  int head_ = 0;
+  int count_ = 0;
+  int highWater_ = 0;
+  uint32_t sent_ = 0;
+  uint32_t coalesced_ = 0;
+  uint32_t drops_ = 0;
+  uint32_t failures_ = 0;
+};
@@ -0,0 +1,173 @@
+// Maps MQTT topics to handler functions. See TopicRouter.h.
+#include "TopicRouter.h"
+
+#include <string.h>
+
+namespace {
+
+// Hashes one topic level starting at p; sets *length to its length.
+uint32_t hashLevel(const char* p, uint16_t* length) {
+  uint32_t hash = 2166136261u;
+  const char* start = p;
+  while (*p != '\0' && *p != '/') {
+    hash = (hash ^ (uint8_t)*p++) * 16777619u;
+  }
+  *length = (uint16_t)(p - start);
+  return hash;
+}
+
+// '#' only as the last level, and wildcards only as a whole level
+bool validFilter(const char* filter) {
+  for (const char* level = filter;;) {
+    const char* end = strchr(level, '/');
+    size_t length = end ? (size_t)(end - level) : strlen(level);
+    bool wildcard = memchr(level, '+', length) || memchr(level, '#', length);
+    if (wildcard && length != 1) return false;
+    if (level[0] == '#' && end) return false;
+    if (!end) return true;
+    level = end + 1;
+  }
+}
+
+}  // namespace
+
+void TopicRouter::clear() {
+  nodeCount_ = 0;
+  poolUsed_ = 0;
+  routeCount_ = 0;
+  newNode(0, 0, 0);  // root
+}
+
+uint16_t TopicRouter::newNode(uint32_t hash, uint16_t text,
+                              uint16_t textLength) {
+  if (nodeCount_ == TOPIC_ROUTER_MAX_NODES) return kNone;
+  Node& n = nodes_[nodeCount_];
+  n.hash = hash;
+  n.text = text;
+  n.textLength = textLength;
+  n.firstChild = kNone;
+  n.nextSibling = kNone;
+  n.plusChild = kNone;
+  n.handler = nullptr;
+  n.hashHandler = nullptr;
+  return nodeCount_++;
+}
+
+uint16_t TopicRouter::findChild(uint16_t parent, uint32_t hash,
+                                const char* text,
+                                uint16_t textLength) const {
+  for (uint16_t c = nodes_[parent].firstChild; c != kNone;
+       c = nodes_[c].nextSibling) {
+    const Node& n = nodes_[c];
+    if (n.hash == hash && n.textLength == textLength &&
+        memcmp(pool_ + n.text, text, textLength) == 0) {
+      return c;
+    }
+  }
+  return kNone;
+}
+
+bool TopicRouter::add(const char* filter, TopicHandler handler) {
+  size_t filterLength = strlen(filter);
+  if (routeCount_ == TOPIC_ROUTER_MAX_ROUTES || filterLength == 0 ||
+      poolUsed_ + filterLength + 1 > TOPIC_ROUTER_POOL_SIZE ||
+      !validFilter(filter)) {
+    return false;
+  }
+
+  // keep a copy of the filter; trie nodes point at its levels, so the
+  // copy stays in the pool even if the node table fills up below
+  uint16_t base = poolUsed_;
+  memcpy(pool_ + base, filter, filterLength + 1);
+  poolUsed_ += filterLength + 1;
+
+  uint16_t node = 0;
+  const char* level = pool_ + base;
+  for (;;) {
+    uint16_t length;
+    uint32_t hash = hashLevel(level, &length);
+    bool last = level[length] == '\0';
+
+    if (length == 1 && level[0] == '#') {
+      nodes_[node].hashHandler = handler;
+      break;
+    }
+
+    uint16_t next;
+    if (length == 1 && level[0] == '+') {
+      next = nodes_[node].plusChild;
+      if (next == kNone) {
+        next = newNode(0, 0, 0);
+        if (next == kNone) return false;
+        nodes_[node].plusChild = next;
+      }
+    } else {
+      next = findChild(node, hash, level, length);
+      if (next == kNone) {
+        next = newNode(hash, (uint16_t)(level - pool_), length);
+        if (next == kNone) return false;
+        nodes_[next].nextSibling = nodes_[node].firstChild;
+        nodes_[node].firstChild = next;
+      }
+    }
+    node = next;
+    if (last) {
+      nodes_[node].handler = handler;
+      break;
+    }
+    level += length + 1;
+  }
+
+  routeFilter_[routeCount_++] = base;
+  return true;
+}
+
+TopicHandler TopicRouter::matchFrom(uint16_t node, const char* level) const {
+  uint16_t length;
+  uint32_t hash = hashLevel(level, &length);
+  bool last = level[length] == '\0';
+  const char* rest = level + length + 1;
+
+  uint16_t exact = findChild(node, hash, level, length);
+  if (exact != kNone) {
+    TopicHandler h = last ? endOfTopic(exact) : matchFrom(exact, rest);
+    if (h) return h;
+  }
+  uint16_t plus = nodes_[node].plusChild;
+  if (plus != kNone) {
+    TopicHandler h = last ? endOfTopic(plus) : matchFrom(plus, rest);
+    if (h) return h;
+  }
+  return nodes_[node].hashHandler;
+}
+
+// A topic that ends at node matches a route ending there, or a '#' route
+// one level down ("a/#" matches "a").
+TopicHandler TopicRouter::endOfTopic(uint16_t node) const {
+  return nodes_[node].handler ? nodes_[node].handler
+                              : nodes_[node].hashHandler;
+}
+
+TopicHandler TopicRouter::match(const char* topic) const {
+  if (topic == nullptr || *topic == '\0') return nullptr;
+
+  // per the MQTT spec, wildcards at the first level never match topics
+  // starting with '$' (e.g. $SYS/...)
+  if (topic[0] == '$') {
+    uint16_t length;
+    uint32_t hash = hashLevel(topic, &length);
+    uint16_t exact = findChild(0, hash, topic, length);
+    if (exact == kNone) return nullptr;
+    if (topic[length] == '\0') return endOfTopic(exact);
+    return matchFrom(exact, topic + length + 1);
+  }
+  return matchFrom(0, topic);
+}
+
+bool TopicRouter::dispatch(char* topic, uint8_t* payload,
+                           unsigned int length) const {
+  TopicHandler handler = match(topic);
+  if (handler == nullptr) return false;
+  handler(context_, topic, payload, length);
+  return true;
+}
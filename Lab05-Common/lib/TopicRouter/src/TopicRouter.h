@@ -0,0 +1,101 @@
+// Maps MQTT topics to handler functions.
+//
+// A node adds one route per topic filter it is interested in, once, and
+// then both subscribes from the table and dispatches incoming messages
+// through it. Handlers are passed the router's context pointer, so one
+// handler can serve several node objects:
+//
+//   TopicRouter topicRouter(this);
+//   topicRouter.add("ledNode07/ledCommand", handleLedCommand);
+//   topicRouter.add("ledGroup/+/ledCommand", handleGroupCommand);
+//   topicRouter.subscribeAll(psClient);           // in register_myself()
+//   topicRouter.dispatch(topic, payload, length);  // in the MQTT callback
+//
+// Filters may use the MQTT wildcards '+' (exactly one level) and '#' (any
+// remaining levels). They are stored as a trie with one node per topic
+// level, so a lookup walks the incoming topic once, hashing each level and
+// checking it against that node's children, rather than formatting and
+// comparing every filter in turn. When several filters match, an exact
+// level beats '+', which beats '#'.
+//
+// All storage is fixed-size; add() returns false when a table is full.
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef TOPIC_ROUTER_MAX_ROUTES
+#define TOPIC_ROUTER_MAX_ROUTES 16
+#endif
+#ifndef TOPIC_ROUTER_MAX_NODES
+#define TOPIC_ROUTER_MAX_NODES 64
+#endif
+#ifndef TOPIC_ROUTER_POOL_SIZE
+#define TOPIC_ROUTER_POOL_SIZE 1024
+#endif
+
+typedef void (*TopicHandler)(void* context, char* topic, uint8_t* payload,
+                             unsigned int length);
+
+class TopicRouter {
+ public:
+  explicit TopicRouter(void* context = nullptr) : context_(context) {
+    clear();
+  }
+
+  // Removes all routes.
+  void clear();
+
+  // Adds a route. The filter is copied. Returns false if the filter is
+  // malformed ('#' not last, wildcard mixed with text) or a table is full.
+  bool add(const char* filter, TopicHandler handler);
+
+  // Returns the handler for topic, or nullptr if no route matches.
+  TopicHandler match(const char* topic) const;
+
+  // Calls the matching handler with the context. Returns false if no
+  // route matched.
+  bool dispatch(char* topic, uint8_t* payload, unsigned int length) const;
+
+  int count() const { return routeCount_; }
+  const char* filter(int i) const { return pool_ + routeFilter_[i]; }
+
+  // Subscribes client (a PubSubClient) to every filter in the table.
+  // Returns false if any subscription failed.
+  template <typename Client>
+  bool subscribeAll(Client& client) const {
+    bool ok = true;
+    for (int i = 0; i < routeCount_; i++) {
+      ok = client.subscribe(filter(i)) && ok;
+    }
+    return ok;
+  }
+
+ private:
+  static const uint16_t kNone = 0xffff;
+
+  struct Node {
+    uint32_t hash;         // FNV-1a of this level's text
+    uint16_t text;         // offset of the level text in pool_
+    uint16_t textLength;
+    uint16_t firstChild;   // exact-text children
+    uint16_t nextSibling;
+    uint16_t plusChild;    // child for a '+' level
+    TopicHandler handler;  // route ending at this level
+    TopicHandler hashHandler;  // route ending in '#' below this level
+  };
+
+  uint16_t newNode(uint32_t hash, uint16_t text, uint16_t textLength);
+  uint16_t findChild(uint16_t parent, uint32_t hash, const char* text,
+                     uint16_t textLength) const;
+  TopicHandler matchFrom(uint16_t node, const char* level) const;
+  TopicHandler endOfTopic(uint16_t node) const;
+
+  void* context_;
+  Node nodes_[TOPIC_ROUTER_MAX_NODES];
+  uint16_t nodeCount_;
+  char pool_[TOPIC_ROUTER_POOL_SIZE];
+  uint16_t poolUsed_;
+  uint16_t routeFilter_[TOPIC_ROUTER_MAX_ROUTES];
+  int routeCount_;
+};
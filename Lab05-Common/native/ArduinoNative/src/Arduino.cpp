@@ -0,0 +1,352 @@
+// Host-side stand-in for the ESP32 Arduino core: GPIO, timing, random
+// numbers and the Serial port. See NativeShim.h for the inspection hooks.
+#include "Arduino.h"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <random>
+#include <thread>
+
+#include "Esp.h"
+#include "NativeShim.h"
+
+namespace {
+
+std::atomic<uint64_t> virtualOffsetNs{0};
+std::atomic<int> pinLevels[shim::kMaxPins];
+std::atomic<uint64_t> pinWriteTimes[shim::kMaxPins];
+std::atomic<uint64_t> gpioWriteCount{0};
+std::atomic<shim::GpioHook> gpioHook{nullptr};
+std::atomic<void (*)(void)> pinIsrs[shim::kMaxPins];
+std::atomic<void (*)(void*)> pinArgIsrs[shim::kMaxPins];
+std::atomic<void*> pinIsrArgs[shim::kMaxPins];
+std::atomic<int> pinIsrModes[shim::kMaxPins];
+// LEDC: channel + 1 each pin is attached to (0: none), duty per channel
+const int kLedcChannels = 16;
+std::atomic<uint8_t> pinLedcChannel[shim::kMaxPins];
+std::atomic<uint32_t> ledcDuty[kLedcChannels];
+std::atomic<uint64_t> pwmWriteCount{0};
+std::atomic<shim::PwmHook> pwmHook{nullptr};
+// set while runTimers() runs an interrupt: the time its alarm was due
+thread_local uint64_t isrTimeNs = 0;
+
+}  // namespace
+
+// The ESP32's four hardware timers. The fields are atomics because in
+// live mode a timer's own thread reads them while the node changes them.
+struct hw_timer_s {
+  std::atomic<uint16_t> divider{0};
+  std::atomic<void (*)(void)> isr{nullptr};
+  std::atomic<uint64_t> alarm{0};
+  std::atomic<bool> autoreload{false};
+  std::atomic<bool> enabled{false};
+  std::atomic<uint64_t> dueNs{0};       // when the next alarm fires
+  std::atomic<uint32_t> generation{0};  // bumped to retire a live thread
+  uint64_t periodNs() const {
+    // the counter runs at 80 MHz / divider: 12.5 ns * divider per count
+    return alarm * divider * 25 / 2;
+  }
+};
+
+namespace {
+
+const int kHwTimers = 4;
+hw_timer_s hwTimers[kHwTimers];
+
+// Runs one due alarm's interrupt, as if at the moment it was due.
+// Returns false once the timer has nothing more due.
+bool fireTimer(hw_timer_s& timer, uint64_t now) {
+  uint64_t due = timer.dueNs;
+  if (!timer.enabled || due > now) return false;
+  if (timer.autoreload && timer.periodNs() > 0) {
+    timer.dueNs = due + timer.periodNs();
+  } else {
+    timer.enabled = false;
+  }
+  void (*isr)(void) = timer.isr;
+  isrTimeNs = due;
+  if (isr) isr();
+  isrTimeNs = 0;
+  return true;
+}
+
+// live mode: a thread per enabled timer, retired when the generation moves
+void runLiveTimer(hw_timer_s* timer, uint32_t generation) {
+  while (timer->generation == generation && timer->enabled) {
+    uint64_t now = shim::nowNanos();
+    uint64_t due = timer->dueNs;
+    if (due > now) {
+      std::this_thread::sleep_for(std::chrono::nanoseconds(due - now));
+      continue;
+    }
+    fireTimer(*timer, due);
+  }
+}
+std::atomic<uint64_t> delayCallCount{0};
+std::atomic<uint64_t> delayedMs{0};
+std::atomic<uint64_t> serialByteCount{0};
+std::atomic<bool> serialEcho{false};
+// when the modelled UART will have sent everything written so far
+std::atomic<uint64_t> serialBusyUntilNs{0};
+const int kSerialFifo = 128;  // ESP32 UART transmit FIFO, bytes
+
+uint64_t hostNanos() {
+  static const auto start = std::chrono::steady_clock::now();
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+struct PinInit {
+  PinInit() {
+    for (int i = 0; i < shim::kMaxPins; i++) pinLevels[i] = -1;
+  }
+} pinInit;
+
+// nodes on several threads (dual-core, the fleet simulator) share it
+std::minstd_rand rng;
+std::mutex rngLock;
+
+}  // namespace
+
+HardwareSerial Serial;
+EspClass ESP;
+
+namespace shim {
+
+uint64_t nowNanos() { return hostNanos() + virtualOffsetNs.load(); }
+void advance(uint64_t ns) { virtualOffsetNs += ns; }
+
+int pinLevel(uint8_t pin) {
+  return pin < kMaxPins ? pinLevels[pin].load() : -1;
+}
+uint64_t pinWriteNanos(uint8_t pin) {
+  return pin < kMaxPins ? pinWriteTimes[pin].load() : 0;
+}
+uint64_t gpioWrites() { return gpioWriteCount; }
+void setGpioHook(GpioHook hook) { gpioHook = hook; }
+
+void setPinInput(uint8_t pin, int level) {
+  if (pin >= kMaxPins) return;
+  int old = pinLevels[pin].exchange(level);
+  if (old == level) return;
+  void (*isr)(void) = pinIsrs[pin];
+  void (*argIsr)(void*) = pinArgIsrs[pin];
+  int mode = pinIsrModes[pin];
+  bool rising = level == HIGH;
+  if (mode == CHANGE || (mode == RISING && rising) ||
+      (mode == FALLING && !rising)) {
+    if (isr) isr();
+    if (argIsr) argIsr(pinIsrArgs[pin]);
+  }
+}
+
+int pwmDuty(uint8_t pin) {
+  if (pin >= kMaxPins || pinLedcChannel[pin] == 0) return -1;
+  return ledcDuty[pinLedcChannel[pin] - 1];
+}
+uint64_t pwmWrites() { return pwmWriteCount; }
+void setPwmHook(PwmHook hook) { pwmHook = hook; }
+
+uint64_t delayCalls() { return delayCallCount; }
+uint64_t delayedMillis() { return delayedMs; }
+
+void setSerialEcho(bool echo) { serialEcho = echo; }
+uint64_t serialBytes() { return serialByteCount; }
+
+}  // namespace shim
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  // an input nobody drives reads high with the pull-up on
+  int undriven = -1;
+  if (mode == INPUT_PULLUP && pin < shim::kMaxPins) {
+    pinLevels[pin].compare_exchange_strong(undriven, HIGH);
+  }
+}
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+  uint64_t now = shim::nowNanos();
+  if (pin < shim::kMaxPins) {
+    pinLevels[pin] = val;
+    pinWriteTimes[pin] = now;
+  }
+  gpioWriteCount++;
+  shim::GpioHook hook = gpioHook;
+  if (hook) hook(pin, val, now);
+}
+
+int digitalRead(uint8_t pin) {
+  int level = shim::pinLevel(pin);
+  return level < 0 ? LOW : level;
+}
+
+void attachInterrupt(uint8_t pin, void (*isr)(void), int mode) {
+  if (pin >= shim::kMaxPins) return;
+  pinIsrModes[pin] = mode;
+  pinArgIsrs[pin] = nullptr;
+  pinIsrs[pin] = isr;
+}
+
+void attachInterruptArg(uint8_t pin, void (*isr)(void*), void* arg,
+                        int mode) {
+  if (pin >= shim::kMaxPins) return;
+  pinIsrModes[pin] = mode;
+  pinIsrs[pin] = nullptr;
+  pinIsrArgs[pin] = arg;
+  pinArgIsrs[pin] = isr;
+}
+
+void detachInterrupt(uint8_t pin) {
+  if (pin >= shim::kMaxPins) return;
+  pinIsrs[pin] = nullptr;
+  pinArgIsrs[pin] = nullptr;
+}
+
+uint32_t ledcSetup(uint8_t channel, uint32_t freq, uint8_t resolutionBits) {
+  return channel < kLedcChannels ? freq : 0;
+}
+
+void ledcAttachPin(uint8_t pin, uint8_t channel) {
+  if (pin < shim::kMaxPins && channel < kLedcChannels) {
+    pinLedcChannel[pin] = channel + 1;
+  }
+}
+
+void ledcDetachPin(uint8_t pin) {
+  if (pin < shim::kMaxPins) pinLedcChannel[pin] = 0;
+}
+
+void ledcWrite(uint8_t channel, uint32_t duty) {
+  if (channel >= kLedcChannels) return;
+  ledcDuty[channel] = duty;
+  pwmWriteCount++;
+  shim::PwmHook hook = pwmHook;
+  if (!hook) return;
+  uint64_t now = isrTimeNs ? isrTimeNs : shim::nowNanos();
+  for (int pin = 0; pin < shim::kMaxPins; pin++) {
+    if (pinLedcChannel[pin] == channel + 1) hook(pin, duty, now);
+  }
+}
+
+hw_timer_t* timerBegin(uint8_t num, uint16_t divider, bool countUp) {
+  if (num >= kHwTimers || divider < 2) return nullptr;
+  hwTimers[num].divider = divider;
+  return &hwTimers[num];
+}
+
+void timerEnd(hw_timer_t* timer) {
+  timerAlarmDisable(timer);
+  timerDetachInterrupt(timer);
+}
+
+void timerAttachInterrupt(hw_timer_t* timer, void (*isr)(void), bool edge) {
+  if (timer) timer->isr = isr;
+}
+
+void timerDetachInterrupt(hw_timer_t* timer) {
+  if (timer) timer->isr = nullptr;
+}
+
+void timerAlarmWrite(hw_timer_t* timer, uint64_t alarmValue,
+                     bool autoreload) {
+  if (!timer) return;
+  timer->alarm = alarmValue;
+  timer->autoreload = autoreload;
+}
+
+void timerAlarmEnable(hw_timer_t* timer) {
+  if (!timer || timer->enabled) return;
+  timer->dueNs = shim::nowNanos() + timer->periodNs();
+  timer->enabled = true;
+  if (shim::liveNetwork()) {
+    std::thread(runLiveTimer, timer, timer->generation.load()).detach();
+  }
+}
+
+void timerAlarmDisable(hw_timer_t* timer) {
+  if (!timer) return;
+  timer->enabled = false;
+  timer->generation++;
+}
+
+namespace shim {
+
+void runTimers() {
+  uint64_t now = nowNanos();
+  for (;;) {
+    // the earliest due alarm across all timers first
+    hw_timer_s* next = nullptr;
+    for (hw_timer_s& timer : hwTimers) {
+      if (timer.enabled && timer.dueNs <= now &&
+          (!next || timer.dueNs < next->dueNs)) {
+        next = &timer;
+      }
+    }
+    if (!next) return;
+    fireTimer(*next, now);
+  }
+}
+
+}  // namespace shim
+
+unsigned long millis() { return shim::nowNanos() / 1000000ULL; }
+unsigned long micros() { return shim::nowNanos() / 1000ULL; }
+
+void delay(uint32_t ms) {
+  delayCallCount++;
+  delayedMs += ms;
+  if (shim::liveNetwork()) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+  } else {
+    shim::advance(ms * 1000000ULL);
+  }
+}
+
+void delayMicroseconds(uint32_t us) { shim::advance(us * 1000ULL); }
+
+void yield() { std::this_thread::yield(); }
+
+long random(long howbig) {
+  if (howbig <= 0) return 0;
+  std::lock_guard<std::mutex> hold(rngLock);
+  return rng() % howbig;
+}
+
+long random(long howsmall, long howbig) {
+  if (howsmall >= howbig) return howsmall;
+  return howsmall + random(howbig - howsmall);
+}
+
+void randomSeed(unsigned long seed) {
+  std::lock_guard<std::mutex> hold(rngLock);
+  rng.seed(seed);
+}
+
+size_t HardwareSerial::write(uint8_t c) { return write(&c, 1); }
+
+int HardwareSerial::availableForWrite() {
+  if (baud_ == 0) return kSerialFifo;
+  uint64_t now = shim::nowNanos();
+  uint64_t busyUntil = serialBusyUntilNs;
+  if (busyUntil <= now) return kSerialFifo;
+  uint64_t charNs = 10000000000ULL / baud_;
+  uint64_t queued = (busyUntil - now + charNs - 1) / charNs;
+  return queued >= kSerialFifo ? 0 : kSerialFifo - (int)queued;
+}
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size) {
+  serialByteCount += size;
+  if (baud_) {
+    uint64_t now = shim::nowNanos();
+    uint64_t busyUntil = serialBusyUntilNs;
+    if (busyUntil < now) busyUntil = now;
+    serialBusyUntilNs = busyUntil + size * (10000000000ULL / baud_);
+  }
+  if (serialEcho) fwrite(buffer, 1, size, stdout);
+  return size;
+}
+
+void HardwareSerial::flush() {
+  if (serialEcho) fflush(stdout);
+}
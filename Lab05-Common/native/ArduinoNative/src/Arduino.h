@@ -0,0 +1,78 @@
+// Host-side stand-in for the ESP32 Arduino core. Only used by the
+// [env:native] builds of LedNode and ButtonNode.
+//
+// Provides just enough of the Arduino API for the node sources to compile
+// and run on a PC. Nothing here touches hardware: GPIO writes, delays and
+// serial output are recorded (see NativeShim.h) so the benchmarks can
+// inspect what the node did and when it did it.
+#pragma once
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 0x1
+#define LOW 0x0
+
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+
+// interrupt modes
+#define RISING 0x01
+#define FALLING 0x02
+#define CHANGE 0x03
+
+// places a function in IRAM on the ESP32; nothing to do on a PC
+#define IRAM_ATTR
+
+// Feather ESP32 on-board LED
+#define LED_BUILTIN 13
+
+#include "HardwareSerial.h"
+#include "IPAddress.h"
+#include "Print.h"
+#include "WString.h"
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+
+#define digitalPinToInterrupt(pin) (pin)
+void attachInterrupt(uint8_t pin, void (*isr)(void), int mode);
+void attachInterruptArg(uint8_t pin, void (*isr)(void*), void* arg, int mode);
+void detachInterrupt(uint8_t pin);
+
+// LEDC PWM (ESP32 Arduino core 2.x API): a channel has a frequency and
+// resolution; pins attached to it output its duty
+uint32_t ledcSetup(uint8_t channel, uint32_t freq, uint8_t resolutionBits);
+void ledcAttachPin(uint8_t pin, uint8_t channel);
+void ledcDetachPin(uint8_t pin);
+void ledcWrite(uint8_t channel, uint32_t duty);
+
+// hardware timers (core 2.x API): a counter at 80 MHz / divider raising
+// an interrupt when it reaches the alarm value. See shim::runTimers().
+typedef struct hw_timer_s hw_timer_t;
+hw_timer_t* timerBegin(uint8_t num, uint16_t divider, bool countUp);
+void timerEnd(hw_timer_t* timer);
+void timerAttachInterrupt(hw_timer_t* timer, void (*isr)(void), bool edge);
+void timerDetachInterrupt(hw_timer_t* timer);
+void timerAlarmWrite(hw_timer_t* timer, uint64_t alarmValue, bool autoreload);
+void timerAlarmEnable(hw_timer_t* timer);
+void timerAlarmDisable(hw_timer_t* timer);
+
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void yield();
+
+long random(long howbig);
+long random(long howsmall, long howbig);
+void randomSeed(unsigned long seed);
@@ -0,0 +1,17 @@
+// Host-side stand-in for the ESP32 EspClass (ESP.getFreeHeap() etc.).
+// Reports the Feather ESP32's nominal heap figures.
+#pragma once
+
+#include <stdint.h>
+
+class EspClass {
+ public:
+  uint32_t getHeapSize() { return 327680; }
+  uint32_t getFreeHeap() { return 294912; }
+  uint32_t getMinFreeHeap() { return 262144; }
+  uint32_t getMaxAllocHeap() { return 118784; }
+  uint32_t getCpuFreqMHz() { return 240; }
+  void restart() {}
+};
+
+extern EspClass ESP;
@@ -0,0 +1,76 @@
+// Host-side stand-in for the FreeRTOS task API. See freertos/task.h.
+#include "freertos/task.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+struct ShimTask {
+  const char* name;
+  BaseType_t core;
+  std::mutex lock;
+  std::condition_variable given;
+  uint32_t notifications = 0;
+};
+
+namespace {
+
+ShimTask loopTask{"loopTask", 1};
+thread_local ShimTask* currentTask = nullptr;
+
+}  // namespace
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t code, const char* name,
+                                   uint32_t stackDepth, void* arg,
+                                   UBaseType_t priority, TaskHandle_t* created,
+                                   BaseType_t core) {
+  (void)stackDepth;
+  (void)priority;
+  ShimTask* task = new ShimTask{name, core};
+  if (created) *created = task;
+  std::thread([task, code, arg] {
+    currentTask = task;
+    code(arg);
+  }).detach();
+  return pdPASS;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+  return currentTask ? currentTask : &loopTask;
+}
+
+BaseType_t xPortGetCoreID() { return xTaskGetCurrentTaskHandle()->core; }
+
+void vTaskDelay(TickType_t ticks) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ticks));
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+  {
+    std::lock_guard<std::mutex> hold(task->lock);
+    task->notifications++;
+  }
+  task->given.notify_one();
+  return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task,
+                            BaseType_t* higherPriorityWoken) {
+  xTaskNotifyGive(task);
+  if (higherPriorityWoken) *higherPriorityWoken = pdTRUE;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticksToWait) {
+  ShimTask* task = xTaskGetCurrentTaskHandle();
+  std::unique_lock<std::mutex> hold(task->lock);
+  auto given = [task] { return task->notifications > 0; };
+  if (ticksToWait == portMAX_DELAY) {
+    task->given.wait(hold, given);
+  } else {
+    task->given.wait_for(hold, std::chrono::milliseconds(ticksToWait), given);
+  }
+  uint32_t count = task->notifications;
+  if (count > 0) task->notifications = clearOnExit ? 0 : count - 1;
+  return count;
+}
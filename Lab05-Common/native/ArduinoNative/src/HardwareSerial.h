@@ -0,0 +1,31 @@
+// Host-side stand-in for the ESP32 HardwareSerial class. Output is counted
+// and, when echo is enabled (shim::setSerialEcho), copied to stdout.
+// availableForWrite() models the UART's 128-byte transmit FIFO emptying at
+// the baud rate given to begin() (10 bits a character), so code that only
+// writes what fits sees the same pacing as on the board; write() itself
+// never blocks.
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "Print.h"
+
+class HardwareSerial : public Print {
+ public:
+  void begin(unsigned long baud) { baud_ = baud; }
+  void end() {}
+  int available() { return 0; }
+  int read() { return -1; }
+  int availableForWrite();
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t* buffer, size_t size) override;
+  using Print::write;
+  void flush() override;
+  operator bool() const { return true; }
+
+ private:
+  unsigned long baud_ = 0;
+};
+
+extern HardwareSerial Serial;
@@ -0,0 +1,45 @@
+// Host-side stand-in for the Arduino IPAddress class.
+#pragma once
+
+#include <stdint.h>
+
+#include "Print.h"
+#include "WString.h"
+
+class IPAddress : public Printable {
+ public:
+  IPAddress() : IPAddress(0, 0, 0, 0) {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) {
+    bytes_[0] = a;
+    bytes_[1] = b;
+    bytes_[2] = c;
+    bytes_[3] = d;
+  }
+  explicit IPAddress(uint32_t address) {
+    for (int i = 0; i < 4; i++) bytes_[i] = (address >> (8 * i)) & 0xff;
+  }
+
+  operator uint32_t() const {
+    return bytes_[0] | (bytes_[1] << 8) | (bytes_[2] << 16) |
+           ((uint32_t)bytes_[3] << 24);
+  }
+  uint8_t operator[](int index) const { return bytes_[index]; }
+  uint8_t& operator[](int index) { return bytes_[index]; }
+  bool operator==(const IPAddress& rhs) const {
+    return (uint32_t)*this == (uint32_t)rhs;
+  }
+
+  size_t printTo(Print& p) const override {
+    return p.printf("%u.%u.%u.%u", bytes_[0], bytes_[1], bytes_[2],
+                    bytes_[3]);
+  }
+  String toString() const {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%u.%u.%u.%u", bytes_[0], bytes_[1],
+             bytes_[2], bytes_[3]);
+    return String(buf);
+  }
+
+ private:
+  uint8_t bytes_[4];
+};
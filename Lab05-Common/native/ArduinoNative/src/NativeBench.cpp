@@ -0,0 +1,96 @@
+// Timing, allocation counting and latency statistics for the native
+// benchmarks.
+#include "NativeBench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <new>
+
+namespace {
+
+std::atomic<uint64_t> allocs{0};
+std::atomic<uint64_t> frees{0};
+
+}  // namespace
+
+extern "C" {
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t n, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+void __real_free(void* ptr);
+
+void* __wrap_malloc(size_t size) {
+  allocs.fetch_add(1, std::memory_order_relaxed);
+  return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t n, size_t size) {
+  allocs.fetch_add(1, std::memory_order_relaxed);
+  return __real_calloc(n, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+  allocs.fetch_add(1, std::memory_order_relaxed);
+  return __real_realloc(ptr, size);
+}
+
+void __wrap_free(void* ptr) {
+  if (ptr) frees.fetch_add(1, std::memory_order_relaxed);
+  __real_free(ptr);
+}
+
+}  // extern "C"
+
+void* operator new(size_t size) {
+  void* p = malloc(size ? size : 1);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+
+namespace bench {
+
+uint64_t nowNanos() {
+  static const auto start = std::chrono::steady_clock::now();
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now() - start)
+      .count();
+}
+
+uint64_t allocCount() { return allocs.load(std::memory_order_relaxed); }
+uint64_t freeCount() { return frees.load(std::memory_order_relaxed); }
+
+uint32_t LatencyStats::percentile(double p) {
+  if (samples_.empty()) return 0;
+  size_t rank = (size_t)(p / 100.0 * (samples_.size() - 1) + 0.5);
+  std::nth_element(samples_.begin(), samples_.begin() + rank, samples_.end());
+  return samples_[rank];
+}
+
+void printHeader() {
+  printf("%-24s %10s %10s %10s %9s %9s %9s\n", "scenario", "msgs", "ns/msg",
+         "allocs/msg", "p50(ns)", "p99(ns)", "p999(ns)");
+}
+
+void printRow(const char* name, LatencyStats& stats, uint64_t allocations) {
+  size_t n = stats.count();
+  double allocsPerMsg = n ? (double)allocations / n : 0.0;
+  double mean = stats.mean();
+  uint32_t p50 = stats.percentile(50);
+  uint32_t p99 = stats.percentile(99);
+  uint32_t p999 = stats.percentile(99.9);
+  printf("%-24s %10zu %10.1f %10.2f %9u %9u %9u\n", name, n, mean,
+         allocsPerMsg, p50, p99, p999);
+}
+
+}  // namespace bench
@@ -0,0 +1,58 @@
+// Timing, allocation counting and latency statistics for the native
+// benchmarks.
+//
+// Allocation counting relies on the [env:native] link flags
+// -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free, which route
+// every heap call made by the node sources, ArduinoJson and the Arduino
+// stand-ins through the counters below. operator new/delete are routed to
+// malloc/free so C++ allocations are counted too.
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+namespace bench {
+
+// host monotonic clock, independent of the simulated Arduino clock
+uint64_t nowNanos();
+
+uint64_t allocCount();  // malloc + calloc + realloc calls so far
+uint64_t freeCount();
+
+// Collects one latency sample per message and reports percentiles.
+class LatencyStats {
+ public:
+  explicit LatencyStats(size_t expected = 0) { samples_.reserve(expected); }
+
+  void add(uint64_t ns) {
+    samples_.push_back(ns > UINT32_MAX ? UINT32_MAX : (uint32_t)ns);
+    total_ += ns;
+  }
+  void clear() {
+    samples_.clear();
+    total_ = 0;
+  }
+  size_t count() const { return samples_.size(); }
+  double mean() const {
+    return samples_.empty() ? 0.0 : (double)total_ / samples_.size();
+  }
+  uint64_t total() const { return total_; }
+
+  // p in [0, 100]; reorders the samples
+  uint32_t percentile(double p);
+
+ private:
+  std::vector<uint32_t> samples_;
+  uint64_t total_ = 0;
+};
+
+// Prints the column header used by printRow().
+void printHeader();
+
+// One result line: name, message count, mean ns/message, allocations per
+// message and latency percentiles.
+void printRow(const char* name, LatencyStats& stats, uint64_t allocs);
+
+}  // namespace bench
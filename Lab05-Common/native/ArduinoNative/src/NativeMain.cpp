@@ -0,0 +1,40 @@
+// main() for running a node's own setup()/loop() on the host against a
+// real MQTT broker ([env:native_live], which defines NATIVE_LIVE and
+// leaves bench/ out of the build):
+//
+//   .pio/build/native_live/program [broker[:port]]   (default localhost)
+//
+// The node connects to that broker whatever its mqttBroker setting says
+// (see shim::setLiveBroker()) and prints to stdout as it would to Serial.
+#ifdef NATIVE_LIVE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Arduino.h"
+#include "NativeShim.h"
+
+void setup();
+void loop();
+
+int main(int argc, char** argv) {
+  char host[128] = "localhost";
+  uint16_t port = 1883;
+  if (argc > 1) {
+    snprintf(host, sizeof(host), "%s", argv[1]);
+    char* colon = strrchr(host, ':');
+    if (colon) {
+      *colon = '\0';
+      port = (uint16_t)atoi(colon + 1);
+    }
+  }
+
+  setvbuf(stdout, nullptr, _IOLBF, 0);
+  shim::setLiveBroker(host, port);
+  shim::setSerialEcho(true);
+  setup();
+  for (;;) loop();
+}
+
+#endif  // NATIVE_LIVE
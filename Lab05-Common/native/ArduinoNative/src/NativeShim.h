@@ -0,0 +1,93 @@
+// Inspection hooks for the host-side Arduino stand-ins.
+//
+// The node sources never include this file; it is for the benchmarks in
+// each project's bench/ directory, which use it to read back what the
+// shims recorded (GPIO writes, delays, serial traffic) and to control the
+// simulated clock.
+#pragma once
+
+#include <stdint.h>
+
+namespace shim {
+
+// Simulated clock. Time is the host's monotonic clock plus everything the
+// node has "slept" through delay(), so delay() returns immediately but
+// millis()/micros() still move forward as if it had blocked (except on a
+// live network, see setLiveBroker()).
+uint64_t nowNanos();
+void advance(uint64_t ns);
+
+// GPIO recording
+const int kMaxPins = 40;
+int pinLevel(uint8_t pin);          // last value written (-1 if never)
+uint64_t pinWriteNanos(uint8_t pin);  // nowNanos() of the last write
+uint64_t gpioWrites();              // total digitalWrite() calls
+
+// Called on every digitalWrite() with the simulated timestamp. Pass
+// nullptr to remove.
+typedef void (*GpioHook)(uint8_t pin, uint8_t val, uint64_t ns);
+void setGpioHook(GpioHook hook);
+
+// Drives an input pin to level, as the outside world would. If an
+// interrupt is attached to the pin and the change matches its mode, the
+// ISR runs at once on the calling thread, so calling this from a second
+// thread models an interrupt arriving while loop() runs.
+void setPinInput(uint8_t pin, int level);
+
+// PWM (LEDC) recording: the duty last written to the channel the pin is
+// attached to, or -1 if it is not attached
+int pwmDuty(uint8_t pin);
+uint64_t pwmWrites();  // total ledcWrite() calls
+
+// Called for each pin a ledcWrite() reaches, with the simulated time (the
+// alarm's own time when written from a timer interrupt, see runTimers()).
+// Pass nullptr to remove.
+typedef void (*PwmHook)(uint8_t pin, uint32_t duty, uint64_t ns);
+void setPwmHook(PwmHook hook);
+
+// Hardware timers run on the simulated clock: runTimers() calls the
+// interrupt of every enabled timer once for each alarm due by nowNanos(),
+// oldest first, as if each had fired on time. The benchmarks call it as
+// they move the clock on. On a live network (setLiveBroker()) each enabled
+// timer instead gets a thread that sleeps until the alarm and runs the
+// interrupt there, as the hardware would.
+void runTimers();
+
+// delay() recording
+uint64_t delayCalls();
+uint64_t delayedMillis();
+
+// Serial output is counted, and copied to stdout only when echo is on
+void setSerialEcho(bool echo);
+uint64_t serialBytes();
+
+// Simulated WiFi network. WiFi.begin() reaches WL_CONNECTED after
+//   scanMs (unless given the AP's channel and BSSID) + assocMs
+//   + dhcpMs (unless WiFi.config() set a static IP)
+// and a begin() aimed at the wrong channel/BSSID reports WL_NO_SSID_AVAIL
+// after failMs. All times default to 0: WiFi.begin() connects at once.
+struct WifiModel {
+  uint8_t channel;
+  uint8_t bssid[6];
+  uint32_t scanMs;   // full scan of every channel
+  uint32_t assocMs;  // authenticate + associate on a known channel
+  uint32_t dhcpMs;   // obtain a DHCP lease
+  uint32_t failMs;   // give up on a channel/BSSID with no such AP
+};
+WifiModel& wifiModel();
+
+// Live network, for running a node against a real MQTT broker
+// ([env:native_live]) and for the load generator. Once set, WiFiClient
+// opens a real TCP connection to host:port -- whatever address the node
+// asks for, so its own mqttBroker setting can stay as it is -- and
+// PubSubClient speaks MQTT 3.1.1 over it instead of going through
+// inject()/deliver(). delay() then sleeps for real. Call before setup().
+void setLiveBroker(const char* host, uint16_t port);
+bool liveNetwork();
+
+// Backs the Preferences (NVS) stand-in with a file so its contents
+// survive into the next process, as flash survives a reboot. nullptr
+// returns to memory only (and empties it).
+void setNvsFile(const char* path);
+
+}  // namespace shim
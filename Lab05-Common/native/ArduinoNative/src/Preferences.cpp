@@ -0,0 +1,142 @@
+// Host-side stand-in for the ESP32 Preferences (NVS) library.
+#include "Preferences.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "NativeShim.h"
+
+namespace {
+
+// "namespace/key" -> value. One store per process, like the flash of one
+// ESP32, so nodes running on several threads (the fleet simulator) share
+// it under storeLock.
+std::map<std::string, std::vector<uint8_t>> store;
+std::string storeFile;
+std::mutex storeLock;
+
+// File format: repeated [u16 name length][name][u32 value length][value].
+void load() {
+  store.clear();
+  FILE* f = fopen(storeFile.c_str(), "rb");
+  if (!f) return;
+  for (;;) {
+    uint16_t nameLen;
+    uint32_t valueLen;
+    if (fread(&nameLen, sizeof(nameLen), 1, f) != 1) break;
+    std::string name(nameLen, '\0');
+    if (fread(&name[0], 1, nameLen, f) != nameLen) break;
+    if (fread(&valueLen, sizeof(valueLen), 1, f) != 1) break;
+    std::vector<uint8_t> value(valueLen);
+    if (fread(value.data(), 1, valueLen, f) != valueLen) break;
+    store[name] = value;
+  }
+  fclose(f);
+}
+
+void save() {
+  if (storeFile.empty()) return;
+  FILE* f = fopen(storeFile.c_str(), "wb");
+  if (!f) return;
+  for (const auto& entry : store) {
+    uint16_t nameLen = entry.first.size();
+    uint32_t valueLen = entry.second.size();
+    fwrite(&nameLen, sizeof(nameLen), 1, f);
+    fwrite(entry.first.data(), 1, nameLen, f);
+    fwrite(&valueLen, sizeof(valueLen), 1, f);
+    fwrite(entry.second.data(), 1, valueLen, f);
+  }
+  fclose(f);
+}
+
+std::string fullKey(const char* name, const char* key) {
+  return std::string(name) + "/" + key;
+}
+
+}  // namespace
+
+namespace shim {
+
+void setNvsFile(const char* path) {
+  std::lock_guard<std::mutex> hold(storeLock);
+  storeFile = path ? path : "";
+  if (storeFile.empty()) {
+    store.clear();
+  } else {
+    load();
+  }
+}
+
+}  // namespace shim
+
+bool Preferences::begin(const char* name, bool readOnly,
+                        const char* partitionLabel) {
+  (void)partitionLabel;
+  // NVS namespace names are limited to 15 characters
+  if (name == nullptr || strlen(name) >= sizeof(name_)) return false;
+  strcpy(name_, name);
+  readOnly_ = readOnly;
+  open_ = true;
+  return true;
+}
+
+void Preferences::end() { open_ = false; }
+
+bool Preferences::clear() {
+  std::lock_guard<std::mutex> hold(storeLock);
+  if (!open_ || readOnly_) return false;
+  std::string prefix = fullKey(name_, "");
+  for (auto it = store.begin(); it != store.end();) {
+    if (it->first.compare(0, prefix.size(), prefix) == 0) {
+      it = store.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  save();
+  return true;
+}
+
+bool Preferences::remove(const char* key) {
+  std::lock_guard<std::mutex> hold(storeLock);
+  if (!open_ || readOnly_) return false;
+  bool erased = store.erase(fullKey(name_, key)) != 0;
+  if (erased) save();
+  return erased;
+}
+
+bool Preferences::isKey(const char* key) {
+  std::lock_guard<std::mutex> hold(storeLock);
+  return open_ && store.count(fullKey(name_, key)) != 0;
+}
+
+size_t Preferences::putBytes(const char* key, const void* value, size_t len) {
+  std::lock_guard<std::mutex> hold(storeLock);
+  if (!open_ || readOnly_ || value == nullptr || len == 0) return 0;
+  const uint8_t* bytes = (const uint8_t*)value;
+  store[fullKey(name_, key)].assign(bytes, bytes + len);
+  save();
+  return len;
+}
+
+size_t Preferences::getBytesLength(const char* key) {
+  std::lock_guard<std::mutex> hold(storeLock);
+  if (!open_) return 0;
+  auto it = store.find(fullKey(name_, key));
+  return it == store.end() ? 0 : it->second.size();
+}
+
+size_t Preferences::getBytes(const char* key, void* buf, size_t maxLen) {
+  std::lock_guard<std::mutex> hold(storeLock);
+  if (!open_) return 0;
+  auto it = store.find(fullKey(name_, key));
+  // like the real library, refuse rather than truncate
+  if (it == store.end() || it->second.size() > maxLen) return 0;
+  memcpy(buf, it->second.data(), it->second.size());
+  return it->second.size();
+}
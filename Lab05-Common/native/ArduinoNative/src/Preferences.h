@@ -0,0 +1,30 @@
+// Host-side stand-in for the ESP32 Preferences (NVS) library.
+//
+// Keys live in memory, grouped by namespace as on the ESP32. To make them
+// survive a simulated reboot (a fresh process), point the shim at a file
+// with shim::setNvsFile(): it is loaded then, and rewritten after every
+// change, like flash.
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+class Preferences {
+ public:
+  bool begin(const char* name, bool readOnly = false,
+             const char* partitionLabel = nullptr);
+  void end();
+
+  bool clear();
+  bool remove(const char* key);
+  bool isKey(const char* key);
+
+  size_t putBytes(const char* key, const void* value, size_t len);
+  size_t getBytesLength(const char* key);
+  size_t getBytes(const char* key, void* buf, size_t maxLen);
+
+ private:
+  char name_[16] = "";
+  bool open_ = false;
+  bool readOnly_ = false;
+};
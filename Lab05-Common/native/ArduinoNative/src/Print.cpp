@@ -0,0 +1,94 @@
+// Host-side stand-in for the Arduino Print class.
+#include "Print.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "WString.h"
+
+size_t Print::write(const uint8_t* buffer, size_t size) {
+  size_t n = 0;
+  while (size--) {
+    n += write(*buffer++);
+  }
+  return n;
+}
+
+size_t Print::write(const char* str) {
+  if (str == nullptr) return 0;
+  return write((const uint8_t*)str, strlen(str));
+}
+
+size_t Print::printf(const char* format, ...) {
+  char buf[256];
+  va_list args;
+  va_start(args, format);
+  int len = vsnprintf(buf, sizeof(buf), format, args);
+  va_end(args);
+  if (len < 0) return 0;
+  if ((size_t)len >= sizeof(buf)) len = sizeof(buf) - 1;
+  return write((const uint8_t*)buf, len);
+}
+
+size_t Print::printNumber(unsigned long long n, int base, bool negative) {
+  char buf[8 * sizeof(n) + 2];
+  char* p = &buf[sizeof(buf) - 1];
+  *p = '\0';
+  if (base < 2) base = 10;
+  do {
+    int digit = n % base;
+    *--p = digit < 10 ? '0' + digit : 'A' + digit - 10;
+    n /= base;
+  } while (n);
+  if (negative) *--p = '-';
+  return write(p);
+}
+
+size_t Print::print(const char* str) { return write(str); }
+size_t Print::print(const String& str) {
+  return write((const uint8_t*)str.c_str(), str.length());
+}
+size_t Print::print(char c) { return write((uint8_t)c); }
+size_t Print::print(int n, int base) { return print((long long)n, base); }
+size_t Print::print(unsigned int n, int base) {
+  return printNumber(n, base, false);
+}
+size_t Print::print(long n, int base) { return print((long long)n, base); }
+size_t Print::print(unsigned long n, int base) {
+  return printNumber(n, base, false);
+}
+size_t Print::print(long long n, int base) {
+  if (base == DEC && n < 0) {
+    return printNumber(-(unsigned long long)n, base, true);
+  }
+  return printNumber((unsigned long long)n, base, false);
+}
+size_t Print::print(unsigned long long n, int base) {
+  return printNumber(n, base, false);
+}
+size_t Print::print(double n, int digits) { return printf("%.*f", digits, n); }
+size_t Print::print(const Printable& x) { return x.printTo(*this); }
+
+size_t Print::println() { return write("\r\n"); }
+size_t Print::println(const char* str) { return print(str) + println(); }
+size_t Print::println(const String& str) { return print(str) + println(); }
+size_t Print::println(char c) { return print(c) + println(); }
+size_t Print::println(int n, int base) { return print(n, base) + println(); }
+size_t Print::println(unsigned int n, int base) {
+  return print(n, base) + println();
+}
+size_t Print::println(long n, int base) { return print(n, base) + println(); }
+size_t Print::println(unsigned long n, int base) {
+  return print(n, base) + println();
+}
+size_t Print::println(long long n, int base) {
+  return print(n, base) + println();
+}
+size_t Print::println(unsigned long long n, int base) {
+  return print(n, base) + println();
+}
+size_t Print::println(double n, int digits) {
+  return print(n, digits) + println();
+}
+size_t Print::println(const Printable& x) { return print(x) + println(); }
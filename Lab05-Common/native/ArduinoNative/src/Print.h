@@ -0,0 +1,62 @@
+// Host-side stand-in for the Arduino Print/Printable classes.
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+class String;
+class Print;
+
+#define DEC 10
+#define HEX 16
+
+class Printable {
+ public:
+  virtual ~Printable() {}
+  virtual size_t printTo(Print& p) const = 0;
+};
+
+class Print {
+ public:
+  virtual ~Print() {}
+
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t* buffer, size_t size);
+  size_t write(const char* str);
+  size_t write(const char* buffer, size_t size) {
+    return write((const uint8_t*)buffer, size);
+  }
+
+  size_t printf(const char* format, ...)
+      __attribute__((format(printf, 2, 3)));
+
+  size_t print(const char* str);
+  size_t print(const String& str);
+  size_t print(char c);
+  size_t print(int n, int base = DEC);
+  size_t print(unsigned int n, int base = DEC);
+  size_t print(long n, int base = DEC);
+  size_t print(unsigned long n, int base = DEC);
+  size_t print(long long n, int base = DEC);
+  size_t print(unsigned long long n, int base = DEC);
+  size_t print(double n, int digits = 2);
+  size_t print(const Printable& x);
+
+  size_t println();
+  size_t println(const char* str);
+  size_t println(const String& str);
+  size_t println(char c);
+  size_t println(int n, int base = DEC);
+  size_t println(unsigned int n, int base = DEC);
+  size_t println(long n, int base = DEC);
+  size_t println(unsigned long n, int base = DEC);
+  size_t println(long long n, int base = DEC);
+  size_t println(unsigned long long n, int base = DEC);
+  size_t println(double n, int digits = 2);
+  size_t println(const Printable& x);
+
+  virtual void flush() {}
+
+ private:
+  size_t printNumber(unsigned long long n, int base, bool negative);
+};
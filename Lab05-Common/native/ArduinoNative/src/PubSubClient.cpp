@@ -0,0 +1,467 @@
+// Host-side stand-in for knolleary/PubSubClient 2.8.
+#include "PubSubClient.h"
+
+#include "NativeShim.h"
+#include "WiFi.h"
+
+namespace {
+
+// number of bytes the MQTT "remaining length" field needs for len
+unsigned int remainingLengthBytes(unsigned int len) {
+  unsigned int n = 1;
+  while (len > 127) {
+    len /= 128;
+    n++;
+  }
+  return n;
+}
+
+}  // namespace
+
+PubSubClient::PubSubClient() { setBufferSize(MQTT_MAX_PACKET_SIZE); }
+
+PubSubClient::PubSubClient(Client& client) : PubSubClient() {
+  setClient(client);
+}
+
+PubSubClient::~PubSubClient() { free(buffer_); }
+
+PubSubClient& PubSubClient::setServer(IPAddress ip, uint16_t port) {
+  snprintf(domain_, sizeof(domain_), "%u.%u.%u.%u", ip[0], ip[1], ip[2],
+           ip[3]);
+  port_ = port;
+  return *this;
+}
+
+PubSubClient& PubSubClient::setServer(const char* domain, uint16_t port) {
+  snprintf(domain_, sizeof(domain_), "%s", domain ? domain : "");
+  port_ = port;
+  return *this;
+}
+
+PubSubClient& PubSubClient::setCallback(
+    std::function<void(char*, uint8_t*, unsigned int)> cb) {
+  callback = cb;
+  return *this;
+}
+
+PubSubClient& PubSubClient::setClient(Client& client) {
+  client_ = &client;
+  return *this;
+}
+
+PubSubClient& PubSubClient::setKeepAlive(uint16_t keepAlive) {
+  keepAlive_ = keepAlive;
+  return *this;
+}
+
+PubSubClient& PubSubClient::setSocketTimeout(uint16_t timeout) {
+  socketTimeout_ = timeout;
+  return *this;
+}
+
+bool PubSubClient::setBufferSize(uint16_t size) {
+  if (size == 0) return false;
+  uint8_t* grown = (uint8_t*)realloc(buffer_, size);
+  if (!grown) return false;
+  buffer_ = grown;
+  bufferSize_ = size;
+  return true;
+}
+
+bool PubSubClient::connect(const char* id) {
+  return connect(id, nullptr, nullptr, nullptr, 0, false, nullptr, true);
+}
+
+bool PubSubClient::connect(const char* id, const char* user,
+                           const char* pass) {
+  return connect(id, user, pass, nullptr, 0, false, nullptr, true);
+}
+
+bool PubSubClient::connect(const char* id, const char* willTopic,
+                           uint8_t willQos, bool willRetain,
+                           const char* willMessage) {
+  return connect(id, nullptr, nullptr, willTopic, willQos, willRetain,
+                 willMessage, true);
+}
+
+bool PubSubClient::connect(const char* id, const char* user,
+                           const char* pass, const char* willTopic,
+                           uint8_t willQos, bool willRetain,
+                           const char* willMessage, bool cleanSession) {
+  snprintf(willTopic_, sizeof(willTopic_), "%s", willTopic ? willTopic : "");
+  snprintf(willMessage_, sizeof(willMessage_), "%s",
+           willTopic && willMessage ? willMessage : "");
+  willRetain_ = willTopic && willRetain;
+  if (shim::liveNetwork()) {
+    connectAttempts_++;
+    snprintf(clientId_, sizeof(clientId_), "%s", id ? id : "");
+    if (cleanSession) subscriptionCount_ = 0;
+    return connectLive(id, user, pass, willTopic, willQos, willRetain,
+                       willMessage, cleanSession);
+  }
+  (void)user;
+  (void)pass;
+  (void)willQos;
+  connectAttempts_++;
+  snprintf(clientId_, sizeof(clientId_), "%s", id ? id : "");
+  if (cleanSession) subscriptionCount_ = 0;
+  if (client_ && !client_->connect("localhost", 1883)) {
+    state_ = MQTT_CONNECT_FAILED;
+    return false;
+  }
+  state_ = MQTT_CONNECTED;
+  return true;
+}
+
+void PubSubClient::disconnect() {
+  if (shim::liveNetwork() && connected()) {
+    buffer_[0] = 0xe0;  // DISCONNECT
+    buffer_[1] = 0;
+    client_->write(buffer_, 2);
+  }
+  state_ = MQTT_DISCONNECTED;
+  if (client_) client_->stop();
+}
+
+bool PubSubClient::publish(const char* topic, const char* payload) {
+  return publish(topic, (const uint8_t*)payload,
+                 payload ? strlen(payload) : 0, false);
+}
+
+bool PubSubClient::publish(const char* topic, const char* payload,
+                           bool retained) {
+  return publish(topic, (const uint8_t*)payload,
+                 payload ? strlen(payload) : 0, retained);
+}
+
+bool PubSubClient::publish(const char* topic, const uint8_t* payload,
+                           unsigned int plength) {
+  return publish(topic, payload, plength, false);
+}
+
+bool PubSubClient::publish(const char* topic, const uint8_t* payload,
+                           unsigned int plength, bool retained) {
+  if (!connected()) return false;
+  size_t topicLen = strlen(topic);
+  if (bufferSize_ < MQTT_MAX_HEADER_SIZE + 2 + topicLen + plength) {
+    return false;
+  }
+
+  // build the packet in the shared buffer, as the real client does; any
+  // pointers a callback still holds into an inbound message are clobbered
+  size_t pos = MQTT_MAX_HEADER_SIZE;
+  buffer_[pos++] = (topicLen >> 8) & 0xff;
+  buffer_[pos++] = topicLen & 0xff;
+  memcpy(buffer_ + pos, topic, topicLen);
+  pos += topicLen;
+  memcpy(buffer_ + pos, payload, plength);
+  if (shim::liveNetwork() &&
+      !writePacket(0x30 | (retained ? 1 : 0), 2 + topicLen + plength)) {
+    return false;
+  }
+
+  publishCount_++;
+  lastPublishNs_ = shim::nowNanos();
+  snprintf(lastTopic_, sizeof(lastTopic_), "%s", topic);
+  lastLength_ = plength < sizeof(lastPayload_) ? plength : sizeof(lastPayload_);
+  memcpy(lastPayload_, payload, lastLength_);
+  lastRetained_ = retained;
+  if (publishHook_) publishHook_(topic, payload, plength, retained);
+  return true;
+}
+
+bool PubSubClient::subscribe(const char* topic) { return subscribe(topic, 0); }
+
+bool PubSubClient::subscribe(const char* topic, uint8_t qos) {
+  (void)qos;
+  if (!connected() || topic == nullptr) return false;
+  if (strlen(topic) >= sizeof(subscriptions_[0])) return false;
+  for (int i = 0; i < subscriptionCount_; i++) {
+    if (strcmp(subscriptions_[i], topic) == 0) return true;
+  }
+  if (subscriptionCount_ == kMaxSubscriptions) return false;
+  if (shim::liveNetwork()) {
+    // SUBSCRIBE: message id, topic filter, requested QoS
+    unsigned int pos = MQTT_MAX_HEADER_SIZE;
+    if (bufferSize_ < pos + 2 + 2 + strlen(topic) + 1) return false;
+    nextMsgId_ = nextMsgId_ == 0xffff ? 1 : nextMsgId_ + 1;
+    buffer_[pos++] = nextMsgId_ >> 8;
+    buffer_[pos++] = nextMsgId_ & 0xff;
+    pos = writeString(topic, pos);
+    buffer_[pos++] = qos;
+    if (!writePacket(0x82, pos - MQTT_MAX_HEADER_SIZE)) return false;
+  }
+  strcpy(subscriptions_[subscriptionCount_++], topic);
+  return true;
+}
+
+bool PubSubClient::unsubscribe(const char* topic) {
+  if (shim::liveNetwork() && connected()) {
+    unsigned int pos = MQTT_MAX_HEADER_SIZE;
+    if (bufferSize_ < pos + 2 + 2 + strlen(topic)) return false;
+    nextMsgId_ = nextMsgId_ == 0xffff ? 1 : nextMsgId_ + 1;
+    buffer_[pos++] = nextMsgId_ >> 8;
+    buffer_[pos++] = nextMsgId_ & 0xff;
+    pos = writeString(topic, pos);
+    if (!writePacket(0xa2, pos - MQTT_MAX_HEADER_SIZE)) return false;
+  }
+  for (int i = 0; i < subscriptionCount_; i++) {
+    if (strcmp(subscriptions_[i], topic) == 0) {
+      subscriptionCount_--;
+      memmove(subscriptions_[i], subscriptions_[i + 1],
+              (subscriptionCount_ - i) * sizeof(subscriptions_[0]));
+      return true;
+    }
+  }
+  return false;
+}
+
+bool PubSubClient::loop() {
+  if (!connected()) return false;
+  if (shim::liveNetwork()) return loopLive();
+
+  // like the real client, handle at most one inbound packet per call
+  WiFiClient* socket = dynamic_cast<WiFiClient*>(client_);
+  const ShimInbound* m = socket ? socket->peekArrived() : nullptr;
+  if (m) {
+    deliver(m->topic, m->payload, m->length);
+    socket->pop();
+  }
+  return true;
+}
+
+bool PubSubClient::connected() {
+  if (state_ != MQTT_CONNECTED) return false;
+  if (client_ && !client_->connected()) {
+    state_ = MQTT_CONNECTION_LOST;
+    return false;
+  }
+  return true;
+}
+
+bool PubSubClient::deliver(const char* topic, const uint8_t* payload,
+                           unsigned int length) {
+  if (!connected()) return false;
+  unsigned int topicLen = strlen(topic);
+  unsigned int remaining = 2 + topicLen + length;
+  unsigned int llen = remainingLengthBytes(remaining);
+  if (1 + llen + remaining > bufferSize_) {
+    // the real client reads and discards packets larger than its buffer
+    return false;
+  }
+
+  // wire layout: header, remaining length, topic length, topic, payload
+  buffer_[0] = 0x30;
+  unsigned int pos = 1 + llen;
+  buffer_[pos] = (topicLen >> 8) & 0xff;
+  buffer_[pos + 1] = topicLen & 0xff;
+  memcpy(buffer_ + pos + 2, topic, topicLen);
+  memcpy(buffer_ + pos + 2 + topicLen, payload, length);
+  callbackFromBuffer(llen, remaining);
+  return true;
+}
+
+// Hands the PUBLISH packet in the buffer to the callback.
+void PubSubClient::callbackFromBuffer(unsigned int llen,
+                                      unsigned int remaining) {
+  unsigned int topicLen = (buffer_[llen + 1] << 8) + buffer_[llen + 2];
+  // PubSubClient::loop() shifts the topic down one byte to NUL-terminate
+  // it in place; the payload is left un-terminated
+  memmove(buffer_ + llen + 2, buffer_ + llen + 3, topicLen);
+  buffer_[llen + 2 + topicLen] = 0;
+  char* topicInBuffer = (char*)buffer_ + llen + 2;
+  unsigned int payloadAt = llen + 3 + topicLen;
+  unsigned int length = remaining - 2 - topicLen;
+  if ((buffer_[0] & 0x06) != 0) {
+    // QoS 1/2: a message id precedes the payload; acknowledge QoS 1
+    uint16_t msgId = (buffer_[payloadAt] << 8) + buffer_[payloadAt + 1];
+    payloadAt += 2;
+    length -= 2;
+    if ((buffer_[0] & 0x06) == 0x02 && shim::liveNetwork()) {
+      uint8_t puback[4] = {0x40, 0x02, (uint8_t)(msgId >> 8),
+                           (uint8_t)(msgId & 0xff)};
+      client_->write(puback, sizeof(puback));
+      lastOutActivity_ = millis();
+    }
+  }
+  if (callback) callback(topicInBuffer, buffer_ + payloadAt, length);
+}
+
+// ---- live network ------------------------------------------------------
+
+bool PubSubClient::connectLive(const char* id, const char* user,
+                               const char* pass, const char* willTopic,
+                               uint8_t willQos, bool willRetain,
+                               const char* willMessage, bool cleanSession) {
+  if (!client_ || !client_->connect(domain_, port_)) {
+    state_ = MQTT_CONNECT_FAILED;
+    return false;
+  }
+
+  // CONNECT: protocol name and level, flags, keep-alive, then the
+  // client id, will, user name and password as present
+  unsigned int pos = MQTT_MAX_HEADER_SIZE;
+  const uint8_t protocol[] = {0x00, 0x04, 'M', 'Q', 'T', 'T',
+                              MQTT_VERSION_3_1_1};
+  memcpy(buffer_ + pos, protocol, sizeof(protocol));
+  pos += sizeof(protocol);
+  uint8_t flags = cleanSession ? 0x02 : 0;
+  if (willTopic) {
+    flags |= 0x04 | (willQos << 3) | (willRetain ? 0x20 : 0);
+  }
+  if (user) flags |= 0x80;
+  if (user && pass) flags |= 0x40;
+  buffer_[pos++] = flags;
+  buffer_[pos++] = keepAlive_ >> 8;
+  buffer_[pos++] = keepAlive_ & 0xff;
+  size_t needed = pos + 2 + strlen(id ? id : "");
+  if (willTopic) needed += 4 + strlen(willTopic) + strlen(willMessage);
+  if (user) needed += 2 + strlen(user);
+  if (user && pass) needed += 2 + strlen(pass);
+  if (needed > bufferSize_) {
+    client_->stop();
+    state_ = MQTT_CONNECT_FAILED;
+    return false;
+  }
+  pos = writeString(id ? id : "", pos);
+  if (willTopic) {
+    pos = writeString(willTopic, pos);
+    pos = writeString(willMessage ? willMessage : "", pos);
+  }
+  if (user) pos = writeString(user, pos);
+  if (user && pass) pos = writeString(pass, pos);
+  if (!writePacket(0x10, pos - MQTT_MAX_HEADER_SIZE)) {
+    state_ = MQTT_CONNECT_FAILED;
+    return false;
+  }
+
+  // the socket's read timeout bounds the wait for CONNACK
+  unsigned int llen;
+  unsigned int length = readPacket(&llen);
+  if (length == 0) {
+    client_->stop();
+    state_ = MQTT_CONNECTION_TIMEOUT;
+    return false;
+  }
+  if ((buffer_[0] & 0xf0) != 0x20 || length < 4 || buffer_[3] != 0) {
+    client_->stop();
+    state_ = (buffer_[0] & 0xf0) == 0x20 ? buffer_[3] : MQTT_CONNECT_FAILED;
+    return false;
+  }
+  lastInActivity_ = lastOutActivity_ = millis();
+  pingOutstanding_ = false;
+  state_ = MQTT_CONNECTED;
+  return true;
+}
+
+bool PubSubClient::loopLive() {
+  // keep-alive: ping when either direction has been quiet a whole
+  // interval, and give up if the last ping went unanswered
+  unsigned long now = millis();
+  unsigned long interval = keepAlive_ * 1000UL;
+  if (interval > 0 && (now - lastInActivity_ > interval ||
+                       now - lastOutActivity_ > interval)) {
+    if (pingOutstanding_) {
+      state_ = MQTT_CONNECTION_TIMEOUT;
+      client_->stop();
+      return false;
+    }
+    uint8_t ping[2] = {0xc0, 0x00};
+    client_->write(ping, sizeof(ping));
+    lastOutActivity_ = lastInActivity_ = now;
+    pingOutstanding_ = true;
+  }
+
+  if (client_->available() <= 0) return connected();
+  unsigned int llen;
+  unsigned int length = readPacket(&llen);
+  if (length == 0) return connected();
+  lastInActivity_ = now;
+  switch (buffer_[0] & 0xf0) {
+    case 0x30:  // PUBLISH
+      callbackFromBuffer(llen, length - 1 - llen);
+      break;
+    case 0xc0: {  // PINGREQ
+      uint8_t pong[2] = {0xd0, 0x00};
+      client_->write(pong, sizeof(pong));
+      lastOutActivity_ = now;
+      break;
+    }
+    case 0xd0:  // PINGRESP
+      pingOutstanding_ = false;
+      break;
+    default:  // SUBACK, UNSUBACK: nothing to do
+      break;
+  }
+  return connected();
+}
+
+// Sends the packet whose variable part sits at MQTT_MAX_HEADER_SIZE in
+// the buffer, building the fixed header just in front of it.
+bool PubSubClient::writePacket(uint8_t header, unsigned int length) {
+  uint8_t lenBytes[4];
+  unsigned int llen = 0;
+  unsigned int len = length;
+  do {
+    uint8_t digit = len % 128;
+    len /= 128;
+    if (len > 0) digit |= 0x80;
+    lenBytes[llen++] = digit;
+  } while (len > 0);
+
+  unsigned int start = MQTT_MAX_HEADER_SIZE - 1 - llen;
+  buffer_[start] = header;
+  memcpy(buffer_ + start + 1, lenBytes, llen);
+  unsigned int total = 1 + llen + length;
+  if (client_->write(buffer_ + start, total) != total) {
+    state_ = MQTT_CONNECTION_LOST;
+    return false;
+  }
+  lastOutActivity_ = millis();
+  return true;
+}
+
+// Reads one whole packet into the buffer. Returns its length (0 on a
+// timeout or a closed connection, and for a packet too big for the
+// buffer, which is read and discarded as the real client does).
+unsigned int PubSubClient::readPacket(unsigned int* llen) {
+  int header = client_->read();
+  if (header < 0) return 0;
+  buffer_[0] = header;
+
+  unsigned int remaining = 0;
+  unsigned int multiplier = 1;
+  *llen = 0;
+  int digit;
+  do {
+    digit = client_->read();
+    if (digit < 0 || *llen == 4) return 0;
+    buffer_[1 + *llen] = digit;
+    (*llen)++;
+    remaining += (digit & 127) * multiplier;
+    multiplier *= 128;
+  } while (digit & 128);
+
+  unsigned int total = 1 + *llen + remaining;
+  bool fits = total <= bufferSize_;
+  unsigned int pos = 1 + *llen;
+  while (pos < total) {
+    uint8_t scratch[64];
+    uint8_t* to = fits ? buffer_ + pos : scratch;
+    unsigned int want = total - pos;
+    if (!fits && want > sizeof(scratch)) want = sizeof(scratch);
+    int n = client_->read(to, want);
+    if (n <= 0) return 0;
+    pos += n;
+  }
+  return fits ? total : 0;
+}
+
+unsigned int PubSubClient::writeString(const char* string, unsigned int pos) {
+  unsigned int length = strlen(string);
+  buffer_[pos++] = length >> 8;
+  buffer_[pos++] = length & 0xff;
+  memcpy(buffer_ + pos, string, length);
+  return pos + length;
+}
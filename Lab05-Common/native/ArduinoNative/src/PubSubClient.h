@@ -0,0 +1,156 @@
+// Host-side stand-in for knolleary/PubSubClient 2.8.
+//
+// Keeps the real client's public API and its single packet buffer: inbound
+// messages are laid out in the buffer exactly as PubSubClient::loop() does
+// (NUL-terminated topic, un-terminated payload) and publish() writes its
+// outgoing packet into the same buffer. There is no broker; instead the
+// benchmarks push messages in with deliver() and read back what the node
+// published through the inspection methods at the bottom of the class.
+// Messages queued on a WiFiClient with WiFiClient::inject() are delivered
+// by loop(), one per call, once their arrival time has passed.
+//
+// On a live network (shim::setLiveBroker()) it talks to a real broker
+// instead, like the real client: MQTT 3.1.1 over the WiFiClient's socket,
+// QoS 0 publishes and subscriptions, keep-alive pings, and loop() reading
+// at most one packet per call into the same buffer.
+#pragma once
+
+#include <Arduino.h>
+
+#include <functional>
+
+#include "Client.h"
+#include "IPAddress.h"
+
+#define MQTT_VERSION_3_1_1 4
+#define MQTT_MAX_PACKET_SIZE 256
+#define MQTT_KEEPALIVE 15
+#define MQTT_SOCKET_TIMEOUT 15
+#define MQTT_MAX_HEADER_SIZE 5
+
+#define MQTT_CONNECTION_TIMEOUT -4
+#define MQTT_CONNECTION_LOST -3
+#define MQTT_CONNECT_FAILED -2
+#define MQTT_DISCONNECTED -1
+#define MQTT_CONNECTED 0
+
+#define MQTT_CALLBACK_SIGNATURE \
+  std::function<void(char*, uint8_t*, unsigned int)> callback
+
+class PubSubClient : public Print {
+ public:
+  PubSubClient();
+  explicit PubSubClient(Client& client);
+  ~PubSubClient();
+
+  PubSubClient& setServer(IPAddress ip, uint16_t port);
+  PubSubClient& setServer(const char* domain, uint16_t port);
+  PubSubClient& setCallback(MQTT_CALLBACK_SIGNATURE);
+  PubSubClient& setClient(Client& client);
+  PubSubClient& setKeepAlive(uint16_t keepAlive);
+  PubSubClient& setSocketTimeout(uint16_t timeout);
+
+  bool setBufferSize(uint16_t size);
+  uint16_t getBufferSize() { return bufferSize_; }
+
+  bool connect(const char* id);
+  bool connect(const char* id, const char* user, const char* pass);
+  bool connect(const char* id, const char* willTopic, uint8_t willQos,
+               bool willRetain, const char* willMessage);
+  bool connect(const char* id, const char* user, const char* pass,
+               const char* willTopic, uint8_t willQos, bool willRetain,
+               const char* willMessage, bool cleanSession = true);
+  void disconnect();
+
+  bool publish(const char* topic, const char* payload);
+  bool publish(const char* topic, const char* payload, bool retained);
+  bool publish(const char* topic, const uint8_t* payload,
+               unsigned int plength);
+  bool publish(const char* topic, const uint8_t* payload,
+               unsigned int plength, bool retained);
+
+  bool subscribe(const char* topic);
+  bool subscribe(const char* topic, uint8_t qos);
+  bool unsubscribe(const char* topic);
+
+  bool loop();
+  bool connected();
+  int state() { return state_; }
+
+  size_t write(uint8_t c) override { return 0; }
+  size_t write(const uint8_t* buffer, size_t size) override { return 0; }
+
+  // ---- native-only inspection and injection ----------------------------
+
+  // Emulates an inbound PUBLISH on a subscribed topic: builds the packet
+  // in the client buffer and invokes the callback, as loop() would.
+  // Returns false (and drops the message, like the real client) when the
+  // packet does not fit in the buffer or the client is not connected.
+  bool deliver(const char* topic, const uint8_t* payload,
+               unsigned int length);
+
+  uint64_t publishCount() const { return publishCount_; }
+  const char* lastTopic() const { return lastTopic_; }
+  const uint8_t* lastPayload() const { return lastPayload_; }
+  unsigned int lastLength() const { return lastLength_; }
+  bool lastRetained() const { return lastRetained_; }
+  uint64_t lastPublishNanos() const { return lastPublishNs_; }
+
+  typedef void (*PublishHook)(const char* topic, const uint8_t* payload,
+                              unsigned int length, bool retained);
+  void setPublishHook(PublishHook hook) { publishHook_ = hook; }
+
+  static const int kMaxSubscriptions = 16;
+  int subscriptionCount() const { return subscriptionCount_; }
+  const char* subscription(int i) const { return subscriptions_[i]; }
+
+  uint64_t connectAttempts() const { return connectAttempts_; }
+  const char* clientId() const { return clientId_; }
+  // the last will given to the last connect() ("" if none)
+  const char* willTopic() const { return willTopic_; }
+  const char* willMessage() const { return willMessage_; }
+  bool willRetained() const { return willRetain_; }
+
+ private:
+  // live network
+  bool connectLive(const char* id, const char* user, const char* pass,
+                   const char* willTopic, uint8_t willQos, bool willRetain,
+                   const char* willMessage, bool cleanSession);
+  bool loopLive();
+  bool writePacket(uint8_t header, unsigned int length);
+  unsigned int readPacket(unsigned int* llen);
+  unsigned int writeString(const char* string, unsigned int pos);
+  void callbackFromBuffer(unsigned int llen, unsigned int remaining);
+
+  Client* client_ = nullptr;
+  char domain_[128] = "";
+  uint16_t port_ = 0;
+  MQTT_CALLBACK_SIGNATURE;
+  uint8_t* buffer_ = nullptr;
+  uint16_t bufferSize_ = 0;
+  uint16_t keepAlive_ = MQTT_KEEPALIVE;
+  uint16_t socketTimeout_ = MQTT_SOCKET_TIMEOUT;
+  int state_ = MQTT_DISCONNECTED;
+
+  uint64_t publishCount_ = 0;
+  char lastTopic_[128] = "";
+  uint8_t lastPayload_[1024];
+  unsigned int lastLength_ = 0;
+  bool lastRetained_ = false;
+  uint64_t lastPublishNs_ = 0;
+  PublishHook publishHook_ = nullptr;
+
+  char subscriptions_[kMaxSubscriptions][128];
+  int subscriptionCount_ = 0;
+
+  uint64_t connectAttempts_ = 0;
+  char clientId_[64] = "";
+  char willTopic_[128] = "";
+  char willMessage_[64] = "";
+  bool willRetain_ = false;
+
+  unsigned long lastOutActivity_ = 0;
+  unsigned long lastInActivity_ = 0;
+  bool pingOutstanding_ = false;
+  uint16_t nextMsgId_ = 0;
+};
@@ -0,0 +1,199 @@
+// Host-side stand-in for the Arduino String class.
+#include "WString.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+String::String(const char* cstr) {
+  if (cstr) copy(cstr, strlen(cstr));
+}
+
+String::String(const char* cstr, unsigned int length) {
+  if (cstr) copy(cstr, length);
+}
+
+String::String(const String& str) { *this = str; }
+
+String::String(String&& rval) noexcept
+    : buffer_(rval.buffer_), capacity_(rval.capacity_), len_(rval.len_) {
+  rval.buffer_ = nullptr;
+  rval.capacity_ = 0;
+  rval.len_ = 0;
+}
+
+String::String(char c) {
+  char buf[2] = {c, '\0'};
+  copy(buf, 1);
+}
+
+String::String(int value, unsigned char base) : String((long)value, base) {}
+
+String::String(unsigned int value, unsigned char base)
+    : String((unsigned long)value, base) {}
+
+String::String(long value, unsigned char base) {
+  char buf[2 + 8 * sizeof(long)];
+  if (base == 10) {
+    snprintf(buf, sizeof(buf), "%ld", value);
+  } else {
+    snprintf(buf, sizeof(buf), "%lx", (unsigned long)value);
+  }
+  copy(buf, strlen(buf));
+}
+
+String::String(unsigned long value, unsigned char base) {
+  char buf[1 + 8 * sizeof(unsigned long)];
+  snprintf(buf, sizeof(buf), base == 16 ? "%lx" : "%lu", value);
+  copy(buf, strlen(buf));
+}
+
+String::~String() { free(buffer_); }
+
+String& String::operator=(const String& rhs) {
+  if (this == &rhs) return *this;
+  if (rhs.buffer_) {
+    copy(rhs.buffer_, rhs.len_);
+  } else {
+    invalidate();
+  }
+  return *this;
+}
+
+String& String::operator=(String&& rval) noexcept {
+  if (this != &rval) {
+    free(buffer_);
+    buffer_ = rval.buffer_;
+    capacity_ = rval.capacity_;
+    len_ = rval.len_;
+    rval.buffer_ = nullptr;
+    rval.capacity_ = 0;
+    rval.len_ = 0;
+  }
+  return *this;
+}
+
+String& String::operator=(const char* cstr) {
+  if (cstr) {
+    copy(cstr, strlen(cstr));
+  } else {
+    invalidate();
+  }
+  return *this;
+}
+
+void String::invalidate() {
+  free(buffer_);
+  buffer_ = nullptr;
+  capacity_ = 0;
+  len_ = 0;
+}
+
+bool String::reserve(unsigned int size) {
+  if (!ensureCapacity(size)) return false;
+  if (len_ == 0) buffer_[0] = '\0';
+  return true;
+}
+
+bool String::ensureCapacity(unsigned int size) {
+  if (buffer_ && capacity_ >= size) return true;
+  char* grown = (char*)realloc(buffer_, size + 1);
+  if (!grown) return false;
+  buffer_ = grown;
+  capacity_ = size;
+  return true;
+}
+
+bool String::copy(const char* cstr, unsigned int length) {
+  if (!ensureCapacity(length)) {
+    invalidate();
+    return false;
+  }
+  len_ = length;
+  memmove(buffer_, cstr, length);
+  buffer_[len_] = '\0';
+  return true;
+}
+
+bool String::concat(const char* cstr, unsigned int length) {
+  if (!cstr) return false;
+  if (length == 0) return reserve(len_);
+  unsigned int newLen = len_ + length;
+  if (!ensureCapacity(newLen)) return false;
+  memmove(buffer_ + len_, cstr, length);
+  len_ = newLen;
+  buffer_[len_] = '\0';
+  return true;
+}
+
+bool String::concat(const String& str) { return concat(str.c_str(), str.len_); }
+bool String::concat(const char* cstr) {
+  return cstr ? concat(cstr, strlen(cstr)) : false;
+}
+bool String::concat(char c) { return concat(&c, 1); }
+bool String::concat(int num) { return concat(String(num)); }
+bool String::concat(unsigned int num) { return concat(String(num)); }
+bool String::concat(long num) { return concat(String(num)); }
+bool String::concat(unsigned long num) { return concat(String(num)); }
+
+bool String::equals(const String& s) const {
+  return len_ == s.len_ && strcmp(c_str(), s.c_str()) == 0;
+}
+
+bool String::equals(const char* cstr) const {
+  if (!cstr) return len_ == 0;
+  return strcmp(c_str(), cstr) == 0;
+}
+
+char String::operator[](unsigned int index) const {
+  return index < len_ ? buffer_[index] : '\0';
+}
+
+char& String::operator[](unsigned int index) {
+  static char dummy;
+  if (index >= len_) {
+    dummy = '\0';
+    return dummy;
+  }
+  return buffer_[index];
+}
+
+int String::indexOf(char ch) const {
+  const char* p = strchr(c_str(), ch);
+  return p ? (int)(p - c_str()) : -1;
+}
+
+String String::substring(unsigned int from) const {
+  return substring(from, len_);
+}
+
+String String::substring(unsigned int from, unsigned int to) const {
+  if (from > to) {
+    unsigned int t = from;
+    from = to;
+    to = t;
+  }
+  if (from > len_) return String();
+  if (to > len_) to = len_;
+  return String(c_str() + from, to - from);
+}
+
+int String::toInt() const { return atoi(c_str()); }
+
+String operator+(const String& lhs, const String& rhs) {
+  String result(lhs);
+  result.concat(rhs);
+  return result;
+}
+
+String operator+(const String& lhs, const char* rhs) {
+  String result(lhs);
+  result.concat(rhs);
+  return result;
+}
+
+String operator+(const char* lhs, const String& rhs) {
+  String result(lhs);
+  result.concat(rhs);
+  return result;
+}
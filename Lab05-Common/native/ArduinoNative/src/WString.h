@@ -0,0 +1,76 @@
+// Host-side stand-in for the Arduino String class.
+//
+// Like the real one it keeps its text in a malloc()ed buffer, so String
+// construction, copies and concatenation show up in the benchmarks'
+// allocation counts the same way they cost heap on the ESP32.
+#pragma once
+
+#include <stddef.h>
+
+class String {
+ public:
+  String(const char* cstr = "");
+  String(const char* cstr, unsigned int length);
+  String(const String& str);
+  String(String&& rval) noexcept;
+  explicit String(char c);
+  explicit String(int value, unsigned char base = 10);
+  explicit String(unsigned int value, unsigned char base = 10);
+  explicit String(long value, unsigned char base = 10);
+  explicit String(unsigned long value, unsigned char base = 10);
+  ~String();
+
+  String& operator=(const String& rhs);
+  String& operator=(String&& rval) noexcept;
+  String& operator=(const char* cstr);
+
+  bool concat(const String& str);
+  bool concat(const char* cstr);
+  bool concat(const char* cstr, unsigned int length);
+  bool concat(char c);
+  bool concat(int num);
+  bool concat(unsigned int num);
+  bool concat(long num);
+  bool concat(unsigned long num);
+
+  String& operator+=(const String& rhs) { concat(rhs); return *this; }
+  String& operator+=(const char* cstr) { concat(cstr); return *this; }
+  String& operator+=(char c) { concat(c); return *this; }
+  String& operator+=(int num) { concat(num); return *this; }
+  String& operator+=(unsigned int num) { concat(num); return *this; }
+  String& operator+=(long num) { concat(num); return *this; }
+  String& operator+=(unsigned long num) { concat(num); return *this; }
+
+  bool reserve(unsigned int size);
+  unsigned int length() const { return len_; }
+  const char* c_str() const { return buffer_ ? buffer_ : ""; }
+  char* begin() { return buffer_; }
+  explicit operator bool() const { return buffer_ != nullptr; }
+
+  bool equals(const String& s) const;
+  bool equals(const char* cstr) const;
+  bool operator==(const String& rhs) const { return equals(rhs); }
+  bool operator==(const char* cstr) const { return equals(cstr); }
+  bool operator!=(const String& rhs) const { return !equals(rhs); }
+  bool operator!=(const char* cstr) const { return !equals(cstr); }
+
+  char operator[](unsigned int index) const;
+  char& operator[](unsigned int index);
+  int indexOf(char ch) const;
+  String substring(unsigned int from) const;
+  String substring(unsigned int from, unsigned int to) const;
+  int toInt() const;
+
+ private:
+  bool ensureCapacity(unsigned int size);
+  void invalidate();
+  bool copy(const char* cstr, unsigned int length);
+
+  char* buffer_ = nullptr;
+  unsigned int capacity_ = 0;
+  unsigned int len_ = 0;
+};
+
+String operator+(const String& lhs, const String& rhs);
+String operator+(const String& lhs, const char* rhs);
+String operator+(const char* lhs, const String& rhs);
@@ -0,0 +1,275 @@
+// Host-side stand-in for the ESP32 WiFi library.
+#include "WiFi.h"
+
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "NativeShim.h"
+
+WiFiClass WiFi;
+
+namespace {
+
+char liveHost[128] = "";
+uint16_t livePort = 0;
+
+// how long a blocking read() waits for the broker, as the ESP32
+// WiFiClient's default timeout
+const int kLiveTimeoutSec = 3;
+
+// Opens a TCP connection to the live broker, or returns -1.
+int openLive() {
+  char port[8];
+  snprintf(port, sizeof(port), "%u", livePort);
+  struct addrinfo hints = {};
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  struct addrinfo* found = nullptr;
+  if (getaddrinfo(liveHost, port, &hints, &found) != 0) return -1;
+
+  int fd = -1;
+  for (struct addrinfo* a = found; a != nullptr && fd < 0; a = a->ai_next) {
+    fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+    if (fd >= 0 && connect(fd, a->ai_addr, a->ai_addrlen) != 0) {
+      close(fd);
+      fd = -1;
+    }
+  }
+  freeaddrinfo(found);
+  if (fd < 0) return -1;
+
+  // MQTT packets are small: send each at once, as lwIP does by default
+  int on = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+  struct timeval timeout = {kLiveTimeoutSec, 0};
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  return fd;
+}
+
+}  // namespace
+
+namespace shim {
+
+void setLiveBroker(const char* host, uint16_t port) {
+  snprintf(liveHost, sizeof(liveHost), "%s", host ? host : "");
+  livePort = port;
+}
+
+bool liveNetwork() { return liveHost[0] != '\0'; }
+
+}  // namespace shim
+
+int WiFiClient::connect(IPAddress ip, uint16_t port) {
+  return connect("", port);
+}
+
+int WiFiClient::connect(const char* host, uint16_t port) {
+  (void)host;
+  (void)port;
+  if (shim::liveNetwork()) {
+    stop();
+    fd_ = openLive();
+    if (fd_ < 0) return 0;
+  }
+  connected_ = true;
+  return 1;
+}
+
+size_t WiFiClient::write(const uint8_t* buf, size_t size) {
+  if (fd_ < 0) return size;
+  size_t sent = 0;
+  while (sent < size) {
+    ssize_t n = send(fd_, buf + sent, size - sent, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) {
+      stop();
+      return sent;
+    }
+    sent += n;
+  }
+  return sent;
+}
+
+int WiFiClient::available() {
+  if (fd_ >= 0) {
+    int waiting = 0;
+    if (ioctl(fd_, FIONREAD, &waiting) == 0 && waiting > 0) return waiting;
+    // nothing waiting: notice a connection the broker has closed
+    char c;
+    ssize_t n = recv(fd_, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) stop();
+    return 0;
+  }
+  const ShimInbound* m = peekArrived();
+  return m ? (int)(strlen(m->topic) + m->length + 4) : 0;
+}
+
+int WiFiClient::read() {
+  uint8_t c;
+  return read(&c, 1) == 1 ? c : -1;
+}
+
+int WiFiClient::read(uint8_t* buf, size_t size) {
+  if (fd_ < 0) return 0;
+  ssize_t n;
+  do {
+    n = recv(fd_, buf, size, 0);
+  } while (n < 0 && errno == EINTR);
+  // a timeout leaves the connection up; anything else ends it
+  if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) stop();
+  return n > 0 ? (int)n : -1;
+}
+
+int WiFiClient::peek() {
+  uint8_t c;
+  if (fd_ < 0 || recv(fd_, &c, 1, MSG_PEEK | MSG_DONTWAIT) != 1) return -1;
+  return c;
+}
+
+void WiFiClient::stop() {
+  if (fd_ >= 0) close(fd_);
+  fd_ = -1;
+  connected_ = false;
+}
+
+bool WiFiClient::inject(const char* topic, const uint8_t* payload,
+                        unsigned int length, uint64_t arrivalNs) {
+  uint32_t tail = tail_.load(std::memory_order_relaxed);
+  if (tail - head_.load(std::memory_order_acquire) == kQueueSize) return false;
+  ShimInbound& m = queue_[tail % kQueueSize];
+  if (strlen(topic) >= sizeof(m.topic) || length > sizeof(m.payload)) {
+    return false;
+  }
+  strcpy(m.topic, topic);
+  memcpy(m.payload, payload, length);
+  m.length = length;
+  m.arrivalNs = arrivalNs;
+  tail_.store(tail + 1, std::memory_order_release);
+  return true;
+}
+
+const ShimInbound* WiFiClient::peekArrived() const {
+  uint32_t head = head_.load(std::memory_order_relaxed);
+  if (tail_.load(std::memory_order_acquire) == head ||
+      queue_[head % kQueueSize].arrivalNs > shim::nowNanos()) {
+    return nullptr;
+  }
+  return &queue_[head % kQueueSize];
+}
+
+void WiFiClient::pop() {
+  uint32_t head = head_.load(std::memory_order_relaxed);
+  if (tail_.load(std::memory_order_acquire) == head) return;
+  head_.store(head + 1, std::memory_order_release);
+}
+
+namespace {
+
+shim::WifiModel model = {6, {0x24, 0x0a, 0xc4, 0x00, 0x00, 0xa1}, 0, 0, 0, 0};
+
+// the lease the simulated DHCP server hands out
+const IPAddress kLeaseIP(127, 0, 0, 1);
+const IPAddress kLeaseGateway(127, 0, 0, 1);
+const IPAddress kLeaseSubnet(255, 0, 0, 0);
+
+}  // namespace
+
+namespace shim {
+
+WifiModel& wifiModel() { return model; }
+
+}  // namespace shim
+
+wl_status_t WiFiClass::begin(const char* ssid, const char* passphrase,
+                             int32_t channel, const uint8_t* bssid,
+                             bool connect) {
+  (void)ssid;
+  (void)passphrase;
+  if (shim::liveNetwork()) return WL_CONNECTED;
+  if (!connect) {
+    status_ = WL_DISCONNECTED;
+    return status_;
+  }
+  // given a channel and BSSID the ESP32 skips the scan and goes straight
+  // to that AP, failing if it is not there
+  bool targeted = channel != 0 && bssid != nullptr;
+  willFail_ = targeted && (channel != model.channel ||
+                           memcmp(bssid, model.bssid, 6) != 0);
+  uint32_t ms;
+  if (willFail_) {
+    ms = model.failMs;
+  } else {
+    ms = (targeted ? 0 : model.scanMs) + model.assocMs +
+         ((uint32_t)staticIP_ == 0 ? model.dhcpMs : 0);
+  }
+  doneNs_ = shim::nowNanos() + ms * 1000000ULL;
+  status_ = WL_DISCONNECTED;
+  return status();
+}
+
+bool WiFiClass::config(IPAddress localIP, IPAddress gateway, IPAddress subnet,
+                       IPAddress dns1, IPAddress dns2) {
+  (void)dns2;
+  if (shim::liveNetwork()) return true;
+  // 0.0.0.0 switches back to DHCP, as on the ESP32
+  staticIP_ = localIP;
+  gateway_ = gateway;
+  subnet_ = subnet;
+  dns_ = dns1;
+  return true;
+}
+
+bool WiFiClass::disconnect(bool wifioff) {
+  (void)wifioff;
+  if (shim::liveNetwork()) return true;
+  status_ = WL_DISCONNECTED;
+  doneNs_ = 0;
+  return true;
+}
+
+wl_status_t WiFiClass::status() {
+  if (shim::liveNetwork()) return WL_CONNECTED;
+  if (status_ == WL_DISCONNECTED && doneNs_ != 0 &&
+      shim::nowNanos() >= doneNs_) {
+    status_ = willFail_ ? WL_NO_SSID_AVAIL : WL_CONNECTED;
+    doneNs_ = 0;
+  }
+  return status_;
+}
+
+String WiFiClass::macAddress() { return String("24:0A:C4:00:00:01"); }
+
+IPAddress WiFiClass::localIP() {
+  if (status() != WL_CONNECTED) return IPAddress();
+  return (uint32_t)staticIP_ != 0 ? staticIP_ : kLeaseIP;
+}
+
+IPAddress WiFiClass::gatewayIP() {
+  if (status() != WL_CONNECTED) return IPAddress();
+  return (uint32_t)staticIP_ != 0 ? gateway_ : kLeaseGateway;
+}
+
+IPAddress WiFiClass::subnetMask() {
+  if (status() != WL_CONNECTED) return IPAddress();
+  return (uint32_t)staticIP_ != 0 ? subnet_ : kLeaseSubnet;
+}
+
+IPAddress WiFiClass::dnsIP(uint8_t index) {
+  if (status() != WL_CONNECTED || index != 0) return IPAddress();
+  return (uint32_t)staticIP_ != 0 ? dns_ : kLeaseGateway;
+}
+
+int32_t WiFiClass::channel() {
+  return status() == WL_CONNECTED ? model.channel : 0;
+}
+
+uint8_t* WiFiClass::BSSID() {
+  return status() == WL_CONNECTED ? model.bssid : nullptr;
+}
+
+int8_t WiFiClass::RSSI() { return status() == WL_CONNECTED ? -55 : 0; }
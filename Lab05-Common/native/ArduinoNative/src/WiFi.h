@@ -0,0 +1,108 @@
+// Host-side stand-in for the ESP32 WiFi library. The "network" is always
+// reachable; how long WiFi.begin() takes to connect (scan, association,
+// DHCP) is set with shim::wifiModel() and is zero by default.
+//
+// WiFiClient has no real socket. Benchmarks queue simulated inbound MQTT
+// messages on it with inject(), each with an arrival time on the shim
+// clock; available() reports a message once its arrival time has passed
+// and the PubSubClient stand-in's loop() then delivers it. The queue is
+// single-producer/single-consumer, so a benchmark thread may inject while
+// a network task (dual-core mode) consumes.
+//
+// On a live network (shim::setLiveBroker()) WiFiClient is instead a real
+// TCP socket to the broker, and fd() lets waitForWork() select() on it.
+// WiFi is then always WL_CONNECTED: the host is already on the network,
+// and WiFi.begin()/disconnect() change nothing, so nodes on several
+// threads (the fleet simulator) can all call them.
+#pragma once
+
+#include <Arduino.h>
+
+#include <atomic>
+
+#include "Client.h"
+
+typedef enum {
+  WL_NO_SHIELD = 255,
+  WL_IDLE_STATUS = 0,
+  WL_NO_SSID_AVAIL = 1,
+  WL_SCAN_COMPLETED = 2,
+  WL_CONNECTED = 3,
+  WL_CONNECT_FAILED = 4,
+  WL_CONNECTION_LOST = 5,
+  WL_DISCONNECTED = 6
+} wl_status_t;
+
+// one simulated inbound PUBLISH
+struct ShimInbound {
+  char topic[128];
+  uint8_t payload[512];
+  unsigned int length;
+  uint64_t arrivalNs;
+};
+
+class WiFiClient : public Client {
+ public:
+  int connect(IPAddress ip, uint16_t port) override;
+  int connect(const char* host, uint16_t port) override;
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t* buf, size_t size) override;
+  int available() override;
+  int read() override;
+  int read(uint8_t* buf, size_t size) override;
+  int peek() override;
+  void stop() override;
+  uint8_t connected() override { return connected_; }
+  operator bool() override { return connected_; }
+  int fd() const { return fd_; }
+
+  // ---- native-only simulated traffic ------------------------------------
+
+  // Queues a message that "arrives" at arrivalNs (shim::nowNanos() clock).
+  // Messages must be injected in arrival order. Returns false if full.
+  bool inject(const char* topic, const uint8_t* payload, unsigned int length,
+              uint64_t arrivalNs);
+
+  // The oldest message that has arrived, or nullptr. pop() discards it.
+  const ShimInbound* peekArrived() const;
+  void pop();
+  int pending() const { return (int)(tail_ - head_); }
+
+ private:
+  static const uint32_t kQueueSize = 64;
+
+  std::atomic<bool> connected_{false};
+  int fd_ = -1;  // live network only
+  ShimInbound queue_[kQueueSize];
+  std::atomic<uint32_t> head_{0};  // next message to deliver
+  std::atomic<uint32_t> tail_{0};  // next free slot
+};
+
+class WiFiClass {
+ public:
+  wl_status_t begin(const char* ssid, const char* passphrase = nullptr,
+                    int32_t channel = 0, const uint8_t* bssid = nullptr,
+                    bool connect = true);
+  bool config(IPAddress localIP, IPAddress gateway, IPAddress subnet,
+              IPAddress dns1 = IPAddress(), IPAddress dns2 = IPAddress());
+  bool disconnect(bool wifioff = false);
+  wl_status_t status();
+  bool isConnected() { return status() == WL_CONNECTED; }
+
+  String macAddress();
+  IPAddress localIP();
+  IPAddress gatewayIP();
+  IPAddress subnetMask();
+  IPAddress dnsIP(uint8_t index = 0);
+  int32_t channel();
+  uint8_t* BSSID();
+  int8_t RSSI();
+
+ private:
+  wl_status_t status_ = WL_IDLE_STATUS;
+  uint64_t doneNs_ = 0;  // when the pending begin() connects (or fails)
+  bool willFail_ = false;
+  IPAddress staticIP_, gateway_, subnet_, dns_;
+};
+
+extern WiFiClass WiFi;
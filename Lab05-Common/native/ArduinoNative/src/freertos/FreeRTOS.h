@@ -0,0 +1,20 @@
+// Host-side stand-in for the FreeRTOS types and macros the nodes use.
+// Tasks are std::threads; see task.h.
+#pragma once
+
+#include <stdint.h>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdPASS 1
+#define pdFAIL 0
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+
+// a real ISR would ask the scheduler to switch to the woken task
+#define portYIELD_FROM_ISR(woken) ((void)(woken))
@@ -0,0 +1,28 @@
+// Host-side stand-in for the FreeRTOS task API the nodes use.
+//
+// Each task is a std::thread (the core number is only recorded, since the
+// host schedules threads where it likes), and the thread that calls
+// setup()/loop() counts as the Arduino loop task on core 1. Direct task
+// notifications work as on FreeRTOS: a counting semaphore per task that
+// another task (or an ISR) gives and the task itself takes, blocking in
+// real time up to the timeout. Tasks are never deleted; benchmarks end
+// with _exit() rather than tearing down globals under a running task.
+#pragma once
+
+#include "FreeRTOS.h"
+
+struct ShimTask;
+typedef ShimTask* TaskHandle_t;
+typedef void (*TaskFunction_t)(void* arg);
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t code, const char* name,
+                                   uint32_t stackDepth, void* arg,
+                                   UBaseType_t priority, TaskHandle_t* created,
+                                   BaseType_t core);
+TaskHandle_t xTaskGetCurrentTaskHandle();
+BaseType_t xPortGetCoreID();
+void vTaskDelay(TickType_t ticks);
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t* higherPriorityWoken);
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticksToWait);
@@ -0,0 +1,84 @@
+// The fleet simulator's button nodes: the ButtonNode class from
+// ../Lab05-BUTTON, with its pushbuttons pressed by the simulator. The
+// edges go straight into the node's buttonEdges queue, as its interrupt
+// handlers would put them; the pins themselves are shared by every node
+// in the process and are left alone. See FleetSim.h.
+#include "ButtonNode.h"
+#include "FleetSim.h"
+
+namespace {
+
+class FleetButton : public VirtualNode {
+ public:
+  FleetButton(const char* clientID, const char* ledID,
+              double pressesPerSecond, FleetTally* tally)
+      : node_(clientID, ledID), tally_(tally) {
+    intervalUs_ = pressesPerSecond > 0 ? (uint32_t)(1e6 / pressesPerSecond)
+                                       : 0;
+    node_.rttAlso = &tally->rtt;
+  }
+
+  void setup() override {
+    node_.setup();
+    // spread the first presses over one interval, so the fleet does not
+    // press in step
+    if (intervalUs_) nextEdgeAt_ = micros() + random(intervalUs_);
+  }
+
+  uint32_t pass() override {
+    if (intervalUs_) press_buttons();
+    uint32_t waitMs = node_.network_pass();
+    if (node_.wfClient.available() > 0) return 0;
+    if (intervalUs_) {
+      int32_t untilEdge = (int32_t)(nextEdgeAt_ - micros());
+      uint32_t edgeMs = untilEdge > 0 ? (uint32_t)untilEdge / 1000 : 0;
+      if (edgeMs < waitMs) waitMs = edgeMs;
+    }
+    return waitMs;
+  }
+
+  int fd() const override { return node_.wfClient.fd(); }
+  bool up() const override { return node_.netLink.isUp(); }
+  void drop() override { node_.wfClient.stop(); }
+  uint32_t connectAttempts() const override {
+    return node_.netLink.connectAttempts();
+  }
+
+ private:
+  void press_buttons() {
+    uint32_t now = micros();
+    if ((int32_t)(now - nextEdgeAt_) < 0) return;
+    if (!pressed_) {
+      // no presses while disconnected: their commands would be lost, and
+      // the fleet would look slower than it is once the link is back
+      if (!node_.netLink.isUp()) {
+        nextEdgeAt_ = now + intervalUs_;
+        return;
+      }
+      node_.buttonEdges.push(pin_, LOW, now);
+      tally_->presses++;
+      pressed_ = true;
+      nextEdgeAt_ = now + FLEET_PRESS_MS * 1000UL;
+    } else {
+      node_.buttonEdges.push(pin_, HIGH, now);
+      pressed_ = false;
+      pin_ = pin_ == PB_ON ? PB_OFF : PB_ON;
+      uint32_t heldUs = FLEET_PRESS_MS * 1000UL;
+      nextEdgeAt_ = now + (intervalUs_ > heldUs ? intervalUs_ - heldUs : 0);
+    }
+  }
+
+  ButtonNode node_;
+  FleetTally* tally_;
+  uint32_t intervalUs_;  // between presses; 0 = never press
+  uint32_t nextEdgeAt_ = 0;
+  uint8_t pin_ = PB_ON;
+  bool pressed_ = false;
+};
+
+}  // namespace
+
+VirtualNode* newButtonNode(const char* clientID, const char* ledID,
+                           double pressesPerSecond, FleetTally* tally) {
+  return new FleetButton(clientID, ledID, pressesPerSecond, tally);
+}
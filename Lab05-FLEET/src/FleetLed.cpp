@@ -0,0 +1,52 @@
+// The fleet simulator's LED nodes: the LedNode class from ../Lab05-LED,
+// unchanged. See FleetSim.h.
+#include "FleetSim.h"
+#include "LedNode.h"
+
+namespace {
+
+class FleetLed : public VirtualNode {
+ public:
+  FleetLed(const char* clientID, const char* group, FleetSwitch* sw)
+      : node_(clientID, group), switch_(sw) {}
+
+  void setup() override { node_.setup(); }
+  uint32_t pass() override {
+    uint32_t waitMs = node_.network_pass();
+    note_switch();
+    // more packets than one pass handles: come straight back
+    return node_.wfClient.available() > 0 ? 0 : waitMs;
+  }
+  int fd() const override { return node_.wfClient.fd(); }
+  bool up() const override { return node_.netLink.isUp(); }
+  void drop() override { node_.wfClient.stop(); }
+  uint32_t connectAttempts() const override {
+    return node_.netLink.connectAttempts();
+  }
+
+ private:
+  // once per switch round, when the LED reaches the round's level
+  void note_switch() {
+    uint32_t round = switch_->round.load(std::memory_order_acquire);
+    if (round == seenRound_) return;
+    if (node_.ledLevel != (switch_->on ? ON : OFF)) return;
+    seenRound_ = round;
+    uint32_t tookUs = micros() - switch_->startUs;
+    uint32_t slowest = switch_->slowestUs;
+    while (tookUs > slowest &&
+           !switch_->slowestUs.compare_exchange_weak(slowest, tookUs)) {
+    }
+    switch_->switched++;
+  }
+
+  LedNode node_;
+  FleetSwitch* switch_;
+  uint32_t seenRound_ = 0;
+};
+
+}  // namespace
+
+VirtualNode* newLedNode(const char* clientID, const char* group,
+                        FleetSwitch* fleetSwitch) {
+  return new FleetLed(clientID, group, fleetSwitch);
+}
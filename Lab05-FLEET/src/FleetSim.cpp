@@ -0,0 +1,627 @@
+/*******************************************************************************
+ * FleetSim.cpp -- runs a fleet of LED and button nodes in one process
+ *
+ *   pio run -e native && .pio/build/native/program [options]
+ *
+ * Builds the node code from ../Lab05-LED and ../Lab05-BUTTON unchanged
+ * (NATIVE_FLEET only leaves out their sketch objects) and creates
+ * --pairs button nodes and --leds LED nodes (one per button node unless
+ * given), all connected to one real MQTT broker. Button node i commands
+ * LED node i % leds, so --leds 1 has the whole fleet commanding a single
+ * LED node. Each button node presses its on and off buttons in turn,
+ * --rate times a second, and times the ledCommand -> ledStatus round trip
+ * of every press as it would on the bench (see ButtonNode::
+ * record_round_trip()).
+ *
+ *   mosquitto -p 1883 &
+ *   .pio/build/native/program --pairs 500 --rate 1 --storm-every 10
+ *
+ * The nodes are spread round robin over --threads worker threads (one per
+ * CPU by default). A worker passes a node (network_pass()) only when the
+ * node asked to be passed by now or its broker socket is readable, and
+ * otherwise sleeps in poll() on all its nodes' sockets, so an idle fleet
+ * costs next to nothing and a busy one shows what the broker and the node
+ * code can handle together.
+ *
+ * --storm-every S closes every node's broker connection at once every S
+ * seconds, as a broker restart would, and reports how long the fleet
+ * takes to be connected and subscribed again. The nodes reconnect on
+ * their own LinkManager backoff, so this also shows how well the jitter
+ * spreads the reconnects out.
+ *
+ * --switch-every S has a controller client turn every LED node on, then
+ * off, and so on, every S seconds, alternating between one publish per
+ * node (<prefix>-ledNNNN/ledCommand) and one publish to the group all
+ * the LED nodes are in (ledGroup/<prefix>/ledCommand). It reports, for
+ * each way, the time from the first publish until the last LED node's
+ * LED had switched, and the replies the controller got per round and the
+ * most of them in any 10 ms. Run it with --rate 0, so the button nodes
+ * leave the LEDs alone:
+ *
+ *   .pio/build/native/program --pairs 1 --leds 200 --rate 0 --switch-every 2
+ *
+ * A progress line per --report-every seconds shows the nodes up, the
+ * presses and replies per second and the connections lost. The summary
+ * has the time until the whole fleet was first up, the connect and
+ * reconnect times per node, and the round trips.
+ *
+ * Exits 0, or 1 if the broker cannot be reached, or 2 if not every node
+ * is up at the end, the fleet took longer than --max-up-ms to come up
+ * (at the start or after a storm), the p99 round trip exceeds --max-p99
+ * (ms), or a switch round did not reach every LED node within
+ * FLEET_SWITCH_TIMEOUT_MS.
+ ******************************************************************************/
+#include <Arduino.h>
+#include <LatencyHistogram.h>
+#include <NativeShim.h>
+#include <NodeLog.h>
+#include <PubSubClient.h>
+#include <WiFi.h>
+#include <getopt.h>
+#include <poll.h>
+#include <sys/resource.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "FleetSim.h"
+
+namespace {
+
+struct Options {
+  char broker[128] = FLEET_BROKER;
+  uint16_t port = FLEET_PORT;
+  char prefix[FLEET_ID_SIZE - 8] = FLEET_PREFIX;  // room for -led0000
+  int pairs = FLEET_PAIRS;
+  int leds = 0;     // 0 = one per button node
+  int threads = 0;  // 0 = one per CPU
+  double rate = FLEET_RATE;
+  double duration = FLEET_DURATION_S;
+  double stormEvery = 0;  // 0 = no storms
+  double switchEvery = 0;  // 0 = no switch test
+  double reportEvery = FLEET_REPORT_S;
+  double maxUpMs = -1;  // < 0 = no limit
+  double maxP99 = -1;   // ms
+};
+
+// A node and what its worker knows about it.
+struct Slot {
+  VirtualNode* node;
+  uint32_t dueAt = 0;  // millis() of its next pass
+  bool wasUp = false;
+  bool everUp = false;
+  uint32_t downSince = 0;
+};
+
+struct Worker {
+  std::vector<Slot> slots;
+  FleetTally tally;
+  std::thread thread;
+};
+
+Options options;
+std::vector<Worker*> workers;
+uint32_t startMs;
+std::atomic<bool> stopping{false};
+std::atomic<uint32_t> storms{0};  // storms started so far
+FleetSwitch fleetSwitch;
+
+void usage() {
+  printf(
+      "usage: program [options]\n"
+      "  --broker HOST[:PORT]  MQTT broker (%s:%d)\n"
+      "  --prefix NAME         client id prefix (%s)\n"
+      "  --pairs N             button nodes (%d, up to %d)\n"
+      "  --leds N              LED nodes (one per button node)\n"
+      "  --threads N           worker threads (one per CPU)\n"
+      "  --rate R              presses per second per button node (%.1f,\n"
+      "                        up to %d; 0 = no presses)\n"
+      "  --duration S          seconds to run (%d)\n"
+      "  --storm-every S       drop every connection every S seconds\n"
+      "  --switch-every S      switch every LED node every S seconds, by\n"
+      "                        group and by node in turn\n"
+      "  --report-every S      progress line interval (%d)\n"
+      "  --max-up-ms MS        exit 2 if the fleet takes longer to be up\n"
+      "  --max-p99 MS          exit 2 if the p99 round trip is longer\n",
+      FLEET_BROKER, FLEET_PORT, FLEET_PREFIX, FLEET_PAIRS, FLEET_MAX_PAIRS,
+      FLEET_RATE, FLEET_MAX_RATE, FLEET_DURATION_S, FLEET_REPORT_S);
+}
+
+bool parseOptions(int argc, char** argv) {
+  static const struct option longOptions[] = {
+      {"broker", required_argument, nullptr, 'b'},
+      {"prefix", required_argument, nullptr, 'P'},
+      {"pairs", required_argument, nullptr, 'n'},
+      {"leds", required_argument, nullptr, 'L'},
+      {"threads", required_argument, nullptr, 't'},
+      {"rate", required_argument, nullptr, 'r'},
+      {"duration", required_argument, nullptr, 'd'},
+      {"storm-every", required_argument, nullptr, 's'},
+      {"switch-every", required_argument, nullptr, 'w'},
+      {"report-every", required_argument, nullptr, 'i'},
+      {"max-up-ms", required_argument, nullptr, 'u'},
+      {"max-p99", required_argument, nullptr, 'p'},
+      {"help", no_argument, nullptr, 'h'},
+      {nullptr, 0, nullptr, 0}};
+
+  int c;
+  while ((c = getopt_long(argc, argv, "", longOptions, nullptr)) != -1) {
+    switch (c) {
+      case 'b': {
+        snprintf(options.broker, sizeof(options.broker), "%s", optarg);
+        char* colon = strrchr(options.broker, ':');
+        if (colon) {
+          *colon = '\0';
+          options.port = (uint16_t)atoi(colon + 1);
+        }
+        break;
+      }
+      case 'P':
+        snprintf(options.prefix, sizeof(options.prefix), "%s", optarg);
+        break;
+      case 'n':
+        options.pairs = atoi(optarg);
+        break;
+      case 'L':
+        options.leds = atoi(optarg);
+        break;
+      case 't':
+        options.threads = atoi(optarg);
+        break;
+      case 'r':
+        options.rate = atof(optarg);
+        break;
+      case 'd':
+        options.duration = atof(optarg);
+        break;
+      case 's':
+        options.stormEvery = atof(optarg);
+        break;
+      case 'w':
+        options.switchEvery = atof(optarg);
+        break;
+      case 'i':
+        options.reportEvery = atof(optarg);
+        break;
+      case 'u':
+        options.maxUpMs = atof(optarg);
+        break;
+      case 'p':
+        options.maxP99 = atof(optarg);
+        break;
+      default:
+        return false;
+    }
+  }
+  if (options.leds == 0) options.leds = options.pairs;
+  if (options.threads == 0) {
+    options.threads = (int)std::thread::hardware_concurrency();
+    if (options.threads < 1) options.threads = 1;
+  }
+  if (options.pairs < 1 || options.pairs > FLEET_MAX_PAIRS ||
+      options.leds < 1 || options.leds > FLEET_MAX_PAIRS ||
+      options.threads < 1 || options.rate < 0 ||
+      options.rate > FLEET_MAX_RATE || options.duration <= 0 ||
+      options.stormEvery < 0 || options.switchEvery < 0 ||
+      options.reportEvery <= 0) {
+    printf("bad option value\n");
+    return false;
+  }
+  return true;
+}
+
+// ---- workers -------------------------------------------------------------
+
+// Notes a node coming up or going down after a pass.
+void track(Slot& slot, FleetTally& tally, uint32_t now) {
+  bool up = slot.node->up();
+  if (up == slot.wasUp) return;
+  slot.wasUp = up;
+  if (up) {
+    if (slot.everUp) {
+      tally.reconnectMs.record(now - slot.downSince);
+    } else {
+      tally.connectMs.record(now - startMs);
+      slot.everUp = true;
+    }
+    tally.up++;
+  } else {
+    slot.downSince = now;
+    tally.up--;
+    tally.drops++;
+  }
+}
+
+void runWorker(Worker* worker) {
+  std::vector<Slot>& slots = worker->slots;
+  FleetTally& tally = worker->tally;
+  for (Slot& slot : slots) {
+    slot.node->setup();
+    slot.dueAt = millis();
+  }
+
+  // one pollfd per slot, in step with slots; -1 while disconnected
+  std::vector<struct pollfd> fds(slots.size());
+  uint32_t stormsSeen = 0;
+  while (!stopping) {
+    if (storms != stormsSeen) {
+      stormsSeen = storms;
+      for (Slot& slot : slots) {
+        slot.node->drop();
+        slot.dueAt = millis();
+      }
+    }
+
+    uint32_t now = millis();
+    uint32_t waitMs = FLEET_MAX_WAIT_MS;
+    for (size_t i = 0; i < slots.size(); i++) {
+      Slot& slot = slots[i];
+      bool readable = fds[i].revents != 0;
+      if (readable || (int32_t)(now - slot.dueAt) >= 0) {
+        uint32_t idleMs = slot.node->pass();
+        now = millis();
+        slot.dueAt = now + idleMs;
+        track(slot, tally, now);
+      }
+      uint32_t untilDue = (int32_t)(slot.dueAt - now) > 0 ? slot.dueAt - now
+                                                           : 0;
+      if (untilDue < waitMs) waitMs = untilDue;
+      fds[i].fd = slot.node->fd();
+      fds[i].events = POLLIN;
+      fds[i].revents = 0;
+    }
+    tally.replies = tally.rtt.count();
+
+    // poll() skips the negative fds
+    if (poll(fds.data(), fds.size(), (int)waitMs) <= 0) {
+      for (struct pollfd& fd : fds) fd.revents = 0;
+    }
+  }
+}
+
+// ---- main thread ---------------------------------------------------------
+
+int nodesUp() {
+  int up = 0;
+  for (Worker* w : workers) up += w->tally.up;
+  return up;
+}
+
+void totals(uint64_t* presses, uint64_t* replies, uint32_t* drops) {
+  *presses = *replies = *drops = 0;
+  for (Worker* w : workers) {
+    *presses += w->tally.presses;
+    *replies += w->tally.replies;
+    *drops += w->tally.drops;
+  }
+}
+
+bool brokerReachable() {
+  WiFiClient probe;
+  if (!probe.connect(options.broker, options.port)) {
+    printf("could not connect to %s:%u\n", options.broker, options.port);
+    return false;
+  }
+  probe.stop();
+  return true;
+}
+
+// More sockets than the usual 1024 descriptors for a large fleet.
+void raiseFileLimit() {
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0 &&
+      limit.rlim_cur < limit.rlim_max) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+}
+
+void createNodes() {
+  for (int i = 0; i < options.threads; i++) workers.push_back(new Worker);
+  // LED nodes first, so they are subscribed by the time the commands come
+  int next = 0;
+  char id[FLEET_ID_SIZE];
+  for (int i = 0; i < options.leds; i++) {
+    snprintf(id, sizeof(id), "%s-led%04d", options.prefix, i);
+    Slot slot;
+    slot.node = newLedNode(id, options.prefix, &fleetSwitch);
+    workers[next++ % options.threads]->slots.push_back(slot);
+  }
+  char ledID[FLEET_ID_SIZE];
+  for (int i = 0; i < options.pairs; i++) {
+    snprintf(id, sizeof(id), "%s-btn%04d", options.prefix, i);
+    snprintf(ledID, sizeof(ledID), "%s-led%04d", options.prefix,
+             i % options.leds);
+    Worker* worker = workers[next++ % options.threads];
+    Slot slot;
+    slot.node = newButtonNode(id, ledID, options.rate, &worker->tally);
+    worker->slots.push_back(slot);
+  }
+}
+
+// ---- switch test ---------------------------------------------------------
+
+// What the controller saw, for each way of switching the fleet.
+struct SwitchTally {
+  const char* name;
+  LatencyHistogram switchUs;  // first publish -> last LED switched
+  uint32_t rounds = 0;
+  uint32_t timeouts = 0;  // rounds that did not reach every node
+  uint64_t publishes = 0;
+  uint64_t replies = 0;
+  uint32_t peakPer10Ms = 0;
+};
+
+SwitchTally byNode{"per-node"};
+SwitchTally byGroup{"group"};
+
+WiFiClient controllerWifi;
+PubSubClient controller(controllerWifi);
+char controllerID[FLEET_ID_SIZE];
+std::vector<uint32_t> replyAtMs;  // this round's replies, ms after start
+
+bool controllerUp() {
+  if (controller.connected()) return true;
+  snprintf(controllerID, sizeof(controllerID), "%s-ctrl", options.prefix);
+  controller.setServer(options.broker, options.port);
+  controller.setCallback([](char* topic, uint8_t* payload,
+                            unsigned int length) {
+    replyAtMs.push_back((micros() - fleetSwitch.startUs) / 1000);
+  });
+  char topic[FLEET_ID_SIZE + 16];
+  snprintf(topic, sizeof(topic), "%s" TOPIC_LED_STATUS, controllerID);
+  return controller.connect(controllerID) && controller.subscribe(topic);
+}
+
+// Handles whatever the controller has been sent, for up to ms.
+void pumpController(uint32_t ms) {
+  uint32_t until = millis() + ms;
+  do {
+    controller.loop();
+    if (controllerWifi.available() == 0) {
+      std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+  } while ((int32_t)(until - millis()) > 0);
+}
+
+// One switch of every LED node to on (or off), by group or one publish
+// per node. Blocks until they have all switched and replied, or given up.
+void switchFleet(SwitchTally& tally, bool on) {
+  if (!controllerUp()) {
+    printf("switch: controller could not connect\n");
+    tally.timeouts++;
+    return;
+  }
+  char payload[64];
+  int length = snprintf(payload, sizeof(payload),
+                        "{\"senderID\":\"%s\",\"cmd\":\"%s\"}",
+                        controllerID, on ? "on" : "off");
+  char topic[FLEET_ID_SIZE + 32];
+  replyAtMs.clear();
+  fleetSwitch.on = on;
+  fleetSwitch.switched = 0;
+  fleetSwitch.slowestUs = 0;
+  fleetSwitch.startUs = micros();
+  fleetSwitch.round++;
+  if (&tally == &byGroup) {
+    snprintf(topic, sizeof(topic), GROUP_TOPIC_PREFIX "%s" TOPIC_LED_COMMAND,
+             options.prefix);
+    controller.publish(topic, (const uint8_t*)payload, length);
+    tally.publishes++;
+  } else {
+    for (int i = 0; i < options.leds; i++) {
+      snprintf(topic, sizeof(topic), "%s-led%04d" TOPIC_LED_COMMAND,
+               options.prefix, i);
+      controller.publish(topic, (const uint8_t*)payload, length);
+      tally.publishes++;
+    }
+  }
+
+  uint32_t startMs = millis();
+  while (fleetSwitch.switched < options.leds &&
+         millis() - startMs < FLEET_SWITCH_TIMEOUT_MS) {
+    pumpController(1);
+  }
+  tally.rounds++;
+  if (fleetSwitch.switched < options.leds) {
+    printf("switch %s: only %d of %d LED nodes switched\n", tally.name,
+           (int)fleetSwitch.switched, options.leds);
+    tally.timeouts++;
+  } else {
+    tally.switchUs.record(fleetSwitch.slowestUs);
+  }
+  uint32_t repliedMs = millis();
+  while (replyAtMs.size() < (size_t)options.leds &&
+         millis() - repliedMs < FLEET_REPLY_WAIT_MS) {
+    pumpController(1);
+  }
+
+  // the busiest 10 ms of replies
+  tally.replies += replyAtMs.size();
+  std::vector<uint32_t> per10Ms;
+  for (uint32_t ms : replyAtMs) {
+    if (ms / 10 >= per10Ms.size()) per10Ms.resize(ms / 10 + 1);
+    if (++per10Ms[ms / 10] > tally.peakPer10Ms) {
+      tally.peakPer10Ms = per10Ms[ms / 10];
+    }
+  }
+}
+
+void printSwitch(const SwitchTally& tally) {
+  if (tally.rounds == 0) return;
+  printf("  switch %-8s %d LED nodes, %u rounds: ms p50 %.1f max %.1f, "
+         "%.0f publishes and %.0f replies a round, peak %u replies in "
+         "10 ms\n",
+         tally.name, options.leds, (unsigned)tally.rounds,
+         tally.switchUs.percentile(50) / 1000.0,
+         tally.switchUs.max() / 1000.0,
+         (double)tally.publishes / tally.rounds,
+         (double)tally.replies / tally.rounds,
+         (unsigned)tally.peakPer10Ms);
+}
+
+void printProgress(double seconds, double interval) {
+  static uint64_t lastPresses = 0, lastReplies = 0;
+  uint64_t presses, replies;
+  uint32_t drops;
+  totals(&presses, &replies, &drops);
+  printf("%7.1fs  up %5d/%-5d  presses %7.0f/s  replies %7.0f/s  "
+         "dropped %u\n",
+         seconds, nodesUp(), options.pairs + options.leds,
+         (presses - lastPresses) / interval,
+         (replies - lastReplies) / interval, (unsigned)drops);
+  lastPresses = presses;
+  lastReplies = replies;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  if (!parseOptions(argc, argv)) {
+    usage();
+    return 1;
+  }
+  setvbuf(stdout, nullptr, _IOLBF, 0);
+  raiseFileLimit();
+  shim::setLiveBroker(options.broker, options.port);
+  // the nodes' console output goes nowhere here; don't format it either,
+  // or hundreds of nodes keep the shared log ring full
+  logSetLevel(LOG_LEVEL_NONE);
+  if (!brokerReachable()) return 1;
+
+  int total = options.pairs + options.leds;
+  createNodes();
+  printf("%d button node(s) -> %d LED node(s) on %s:%u, %d thread(s), "
+         "%.1f presses/s each, %.0f s\n",
+         options.pairs, options.leds, options.broker, options.port,
+         options.threads, options.rate, options.duration);
+
+  startMs = millis();
+  for (Worker* w : workers) w->thread = std::thread(runWorker, w);
+
+  // all times in ms from the start
+  uint32_t reportMs = (uint32_t)(options.reportEvery * 1000);
+  uint32_t stormMs = (uint32_t)(options.stormEvery * 1000);
+  uint32_t switchMs = (uint32_t)(options.switchEvery * 1000);
+  uint32_t nextSwitch = switchMs;
+  uint32_t switches = 0;
+  uint32_t endMs = (uint32_t)(options.duration * 1000);
+  uint32_t nextReport = reportMs;
+  uint32_t nextStorm = stormMs ? stormMs : endMs;
+  int32_t firstUpMs = -1;
+  uint32_t stormAt = 0;
+  bool recovering = false;
+  LatencyHistogram recoveryMs;
+  for (;;) {
+    uint32_t elapsed = millis() - startMs;
+    if (elapsed >= endMs) break;
+
+    int up = nodesUp();
+    if (firstUpMs < 0 && up == total) {
+      firstUpMs = elapsed;
+      printf("all %d nodes up after %u ms\n", total, (unsigned)elapsed);
+    }
+    if (recovering && up == total) {
+      recovering = false;
+      recoveryMs.record(elapsed - stormAt);
+      printf("all %d nodes back up %u ms after the storm\n", total,
+             (unsigned)(elapsed - stormAt));
+    }
+    if (stormMs && elapsed >= nextStorm) {
+      printf("storm %u: dropping every connection\n", (unsigned)storms + 1);
+      storms++;
+      stormAt = elapsed;
+      recovering = true;
+      nextStorm += stormMs;
+    }
+    if (switchMs && elapsed >= nextSwitch && up == total) {
+      // by node, then by group, each switching on and then off
+      switchFleet(switches / 2 % 2 ? byGroup : byNode, switches % 2 == 0);
+      switches++;
+      nextSwitch = millis() - startMs + switchMs;
+    }
+    if (elapsed >= nextReport) {
+      printProgress(nextReport / 1000.0, options.reportEvery);
+      nextReport += reportMs;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  stopping = true;
+  for (Worker* w : workers) w->thread.join();
+
+  // the workers have stopped: their histograms can be merged
+  LatencyHistogram rtt, connectMs, reconnectMs;
+  uint64_t presses, replies;
+  uint32_t drops, attempts = 0;
+  totals(&presses, &replies, &drops);
+  for (Worker* w : workers) {
+    rtt.merge(w->tally.rtt);
+    connectMs.merge(w->tally.connectMs);
+    reconnectMs.merge(w->tally.reconnectMs);
+    for (Slot& slot : w->slots) attempts += slot.node->connectAttempts();
+  }
+  int up = nodesUp();
+
+  printf("\n%d/%d nodes up at the end, %u connect attempts, %u "
+         "connections dropped\n",
+         up, total, (unsigned)attempts, (unsigned)drops);
+  if (firstUpMs >= 0) {
+    printf("  fleet up   %d ms\n", (int)firstUpMs);
+  } else {
+    printf("  fleet up   never\n");
+  }
+  printf("  connect ms    p50 %u p99 %u max %u\n",
+         (unsigned)connectMs.percentile(50),
+         (unsigned)connectMs.percentile(99), (unsigned)connectMs.max());
+  if (reconnectMs.count()) {
+    printf("  reconnect ms  p50 %u p99 %u max %u  (%u storm(s), back up "
+           "in max %u ms)\n",
+           (unsigned)reconnectMs.percentile(50),
+           (unsigned)reconnectMs.percentile(99), (unsigned)reconnectMs.max(),
+           (unsigned)storms, (unsigned)recoveryMs.max());
+  }
+  printf("  %llu presses, %llu timed replies (%.2f%%)\n",
+         (unsigned long long)presses, (unsigned long long)replies,
+         presses ? 100.0 * replies / presses : 0);
+  printf("  rtt ms     min %.2f p50 %.2f p99 %.2f p99.9 %.2f max %.2f "
+         "mean %.2f\n",
+         rtt.min() / 1000.0, rtt.percentile(50) / 1000.0,
+         rtt.percentile(99) / 1000.0, rtt.percentile(99.9) / 1000.0,
+         rtt.max() / 1000.0, rtt.mean() / 1000.0);
+  printSwitch(byNode);
+  printSwitch(byGroup);
+
+  bool failed = false;
+  if (up != total) {
+    printf("FAIL: %d of %d nodes not up\n", total - up, total);
+    failed = true;
+  }
+  if (options.maxUpMs >= 0) {
+    double worst = firstUpMs < 0 ? 1e12 : firstUpMs;
+    if (storms && (recovering || recoveryMs.max() > worst)) {
+      worst = recovering ? 1e12 : recoveryMs.max();
+    }
+    if (worst > options.maxUpMs) {
+      printf("FAIL: fleet took %.0f ms to be up (limit %.0f ms)\n", worst,
+             options.maxUpMs);
+      failed = true;
+    }
+  }
+  if (options.maxP99 >= 0 && rtt.percentile(99) / 1000.0 > options.maxP99) {
+    printf("FAIL: p99 round trip %.2f ms (limit %.2f ms)\n",
+           rtt.percentile(99) / 1000.0, options.maxP99);
+    failed = true;
+  }
+  if (byNode.timeouts || byGroup.timeouts) {
+    printf("FAIL: %u switch round(s) did not reach every LED node\n",
+           (unsigned)(byNode.timeouts + byGroup.timeouts));
+    failed = true;
+  }
+  return failed ? 2 : 0;
+}
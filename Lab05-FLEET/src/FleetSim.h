@@ -0,0 +1,84 @@
+/*******************************************************************************
+ * FleetSim.h -- defaults for the fleet simulator (FleetSim.cpp), and how it
+ * drives each virtual node. Every default can be changed on the command
+ * line; run with --help.
+ ******************************************************************************/
+#pragma once
+
+#include <LatencyHistogram.h>
+#include <NodeConfig.h>  // the nodes' CLIENT_ID_SIZE and topics
+#include <stdint.h>
+
+#include <atomic>
+
+#ifdef DUAL_CORE
+#error "the fleet simulator runs the single-core nodes (no DUAL_CORE)"
+#endif
+
+#define FLEET_BROKER "localhost"
+#define FLEET_PORT 1883
+#define FLEET_PREFIX "fleet"  // nodes are fleet-led0000, fleet-btn0000...
+#define FLEET_PAIRS 100       // button nodes, each with an LED node
+#define FLEET_RATE 0.5        // presses per second per button node
+#define FLEET_MAX_RATE 10     // each press holds the button FLEET_PRESS_MS
+#define FLEET_DURATION_S 30
+#define FLEET_REPORT_S 1
+#define FLEET_MAX_PAIRS 2000
+#define FLEET_ID_SIZE CLIENT_ID_SIZE
+#define FLEET_PRESS_MS 50      // from press to release
+#define FLEET_MAX_WAIT_MS 100  // longest poll() in a worker
+#define FLEET_SWITCH_TIMEOUT_MS 10000  // a switch round gives up after this
+#define FLEET_REPLY_WAIT_MS 2000       // ...and waits this long for replies
+
+// What the nodes on one worker thread add up to. The worker updates it;
+// the main thread reads the atomics for its progress lines and the
+// histograms once the workers have stopped.
+struct FleetTally {
+  std::atomic<int> up{0};             // nodes connected and subscribed
+  std::atomic<uint32_t> drops{0};     // connections lost
+  std::atomic<uint64_t> presses{0};   // button presses made
+  std::atomic<uint64_t> replies{0};   // timed ledStatus replies (rtt)
+  LatencyHistogram rtt;               // ledCommand -> ledStatus (us)
+  LatencyHistogram connectMs;         // start -> first link up
+  LatencyHistogram reconnectMs;       // link lost -> link up again
+};
+
+// The switch test (--switch-every): the controller turns every LED node
+// on or off at once, and each LED node's worker notes when its LED got
+// there. The controller sets level and startUs, clears the counts, then
+// bumps round.
+struct FleetSwitch {
+  std::atomic<uint32_t> round{0};
+  std::atomic<bool> on{false};         // the level this round switches to
+  std::atomic<uint32_t> startUs{0};    // micros() at the first publish
+  std::atomic<int> switched{0};        // LED nodes at the level
+  std::atomic<uint32_t> slowestUs{0};  // startUs -> the last of them
+};
+
+// One LedNode or ButtonNode as a worker thread sees it. Each is owned by
+// a single worker and only ever touched from that thread.
+class VirtualNode {
+ public:
+  virtual ~VirtualNode() {}
+
+  virtual void setup() = 0;
+  // network_pass() (plus any button edges due); returns the ms the
+  // worker may wait before the next pass, unless fd() becomes readable
+  virtual uint32_t pass() = 0;
+  virtual int fd() const = 0;  // broker socket, -1 while disconnected
+  virtual bool up() const = 0;
+  // closes the broker connection at once, as a broker restart would
+  virtual void drop() = 0;
+  virtual uint32_t connectAttempts() const = 0;
+};
+
+// One per file (FleetLed.cpp, FleetButton.cpp): LedNode.h and ButtonNode.h
+// give the same configuration macros different values.
+// An LED node in group (see LED_GROUPS), reporting to fleetSwitch.
+VirtualNode* newLedNode(const char* clientID, const char* group,
+                        FleetSwitch* fleetSwitch);
+// A button node commanding ledID, pressing its on and off buttons in
+// turn pressesPerSecond times a second (while connected). Its presses and
+// round trips are counted in tally.
+VirtualNode* newButtonNode(const char* clientID, const char* ledID,
+                           double pressesPerSecond, FleetTally* tally);
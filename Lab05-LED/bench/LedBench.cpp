@@ -0,0 +1,1746 @@
+/*******************************************************************************
+ * LedBench.cpp -- host benchmarks for LedNode.cpp ([env:native] only)
+ *
+ *   pio run -e native && .pio/build/native/program [messages]
+ *
+ * Runs the node's setup() against the Arduino/WiFi/PubSubClient stand-ins
+ * in Lab05-Common/native, then pushes synthetic ledCommand messages through
+ * processMQTTMessage() (via the stand-in client, so the payload sits in the
+ * client buffer exactly as it would on the ESP32) and reports ns/message,
+ * heap allocations per message and p50/p99/p99.9 latency.
+ *
+ * The ledCommand rows cover the callback and then the outbox drain that
+ * loop() does, so they include the ledStatus publish (and the retained
+ * state publish, since every command flips the LED); one with JSON
+ * commands, one with MessagePack (answered in MessagePack) and one with
+ * JSON commands carrying the round-trip "seq"/"ts" fields. Each is
+ * followed by the bytes on the wire for a command and its reply: payload
+ * and whole MQTT PUBLISH packet. The node's log is drained after each
+ * command, outside the timing, as loop() does when idle. ledCommand-log-off
+ * and -log-on repeat the JSON row with logging off at run time and with
+ * every level compiled in (LOG_LEVEL) on, and show the log bytes per
+ * command and what sending them would have cost at 115200 baud had the
+ * node printed straight to Serial. log-drain logs a line longer than the
+ * UART FIFO takes and more lines than the ring holds, and checks that
+ * draining kLogFifoBytes at a time, as loop() does, gets every line kept
+ * out whole and in order. trace-echo checks that the reply carries a
+ * command's seq/ts back unchanged, in both formats, and that a command
+ * without them gets a reply without them. retained-state checks that a
+ * command that changes the LED writes the pin and publishes the retained
+ * <node>/state once, that repeating it is answered without either, and
+ * that the node connects with "offline" as its retained last will.
+ * unanswered sends commands without a senderID and with one too long for
+ * its reply topic: each must drive the LED and publish nothing else.
+ *
+ * pattern-* send one blink, fade and seq command each and run the
+ * simulated clock on, with the hardware timer stand-in firing the pattern
+ * ticks. They count the PWM changes one command produced and check that
+ * every timer-driven change landed exactly on its tick, that the retained
+ * state goes to "pattern" and then to where the pattern left the LED, and
+ * that an on/off command takes the LED back from PWM.
+ *
+ * channels checks the multi-channel set command: only the channels whose
+ * brightness changes are written (0/255 by GPIO, in between by PWM), the
+ * reply and retained state list every channel, a repeat writes nothing,
+ * malformed or out-of-range commands are refused, and on/off still drive
+ * channel 0. set-per-channel and set-batched then time updating all the
+ * channels, alternating even on/odd off and the reverse, with one set
+ * command per channel versus one set command carrying both bitmasks, and
+ * report per update the messages each way (commands, ledStatus replies,
+ * retained states), their bytes on the wire, and channel updates/s.
+ *
+ * group-command sends three commands on the node's first LED_GROUPS
+ * topic: each must drive the LED and the retained state at once, and the
+ * sender must get one reply, naming the node, after the node's share of
+ * GROUP_REPLY_SPREAD_MS, and no more.
+ *
+ * metrics sends a run of commands and one unparseable payload and checks
+ * the node's counters and the <node>/metrics message they publish, which
+ * must then start over. It times the counter updates a command makes on
+ * their own, and with a network_pass() timed too, against the command
+ * path as a whole, and reports the overhead per command.
+ *
+ * dedup sends one sender's numbered commands twice and out of order: a
+ * repeat, or a command a newer one overtook, must be dropped with no pin
+ * write and no reply, a refused command (unknown cmd) must leave its seq
+ * to be carried out when it comes again, and a seq far below the last (a
+ * restarted sender) served. (The ledCommand-traced row gives every
+ * command a new seq.) The window-* rows time the per-sender window's
+ * lookup with 8 to 512 senders sending in random order, each on a table
+ * sized for it and then the node's own table overfilled, and report its
+ * bytes in all and per sender and the senders evicted for lack of room.
+ *
+ * The parse-* rows time the payload parse alone: ArduinoJson copying the
+ * payload into a document versus JsonScan parsing it in place, and
+ * msgpackScan parsing the MessagePack form in place. The encode-* rows
+ * time serializing a ledStatus (as the node sends it) in each format.
+ *
+ * flood sends bursts of 64 commands that all arrive at once, alternating
+ * on/off from kSenders button nodes, through the real loop(), and reports
+ * ledStatus messages per command and the outbox counters. Coalescing
+ * should leave well under one status per command, and the last status
+ * each sender gets must match its last command.
+ *
+ * cmd->gpio runs the real loop() and measures, on the simulated clock,
+ * from the moment a command reaches the socket to the digitalWrite() of
+ * the LED, with commands arriving at random 1-200 ms intervals.
+ *
+ * broker-flap simulates a fleet of kFlapNodes LinkManagers (no sockets,
+ * just the state machine on a simulated clock) losing the broker for
+ * kFlapOutageMs. The broker accepts at most kFlapAcceptsPerStep connects
+ * per 10 ms step and refuses the rest. It reports how long after the
+ * broker returns the nodes are back (min/p50/p99/max), the peak connect
+ * attempts per second and the total, for the jittered exponential backoff
+ * and for the old fixed 5 s retry, whose synchronised retries keep
+ * overrunning the broker.
+ *
+ * The boot-* rows power-cycle the node (each boot is a fresh child
+ * process, with NVS kept in a temporary file) on a simulated network where
+ * a full WiFi scan takes kScanMs, association kAssocMs and DHCP kDhcpMs,
+ * with a ledCommand already waiting at the broker. They report when WiFi,
+ * MQTT and the first publish (the retained state, sent as soon as the
+ * link is up) were reached, in ms after setup() started:
+ * cold (empty NVS), warm (cached channel/BSSID/IP), stale (the AP moved
+ * channel since the cache was saved) and warm again after that.
+ *
+ * Exits non-zero if the ledCommand path allocates from the heap, if
+ * log-drain fails, if seq/ts are not echoed exactly, if retained-state, a
+ * pattern check or the channels, group-command or metrics check fails
+ * (metrics included if collecting costs kMaxMetricsShare of a command or
+ * more, or kMaxMetricsTimedShare with the pass timing), if dedup fails,
+ * if the window refuses a new command or its lookups get kMaxWindowGrowth
+ * times slower from 8 senders to 512, if a flood leaves a sender with a
+ * stale ledStatus, if the p99 command-to-GPIO latency is 10 ms or more,
+ * or if any node using the jittered backoff is still disconnected a
+ * minute after the broker comes back, or if a warm boot takes
+ * kMaxWarmBootMs or more to its first publish (or any boot fails to get
+ * there).
+ *
+ * Built with DUAL_CORE (pio run -e native_dualcore) it runs a single
+ * scenario instead, handoff: the network task runs on its own thread as
+ * it would on core 0, a bench thread injects commands 1-5 ms apart (in
+ * real time) and wakes it, and the main thread runs loop(), the GPIO
+ * executor. It reports inject-to-digitalWrite() latency and the per-task
+ * counters, and exits non-zero unless every command reaches the LED in
+ * order with a p99 under 10 ms and the last ledStatus matches the last
+ * command. handoff pattern then sends a blink, which the executor plays
+ * on its timer; the retained state must go to "pattern" and back to off.
+ ******************************************************************************/
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <BootTimeline.h>
+#include <EventLoop.h>
+#include <JsonArena.h>
+#include <JsonScan.h>
+#include <LinkManager.h>
+#include <MsgPackScan.h>
+#include <NativeBench.h>
+#include <NativeShim.h>
+#include <NodeLog.h>
+#include <NodeMetrics.h>
+#include <PubSubClient.h>
+#include <PublishQueue.h>
+#include <WiFi.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "LedNode.h"
+
+// the sketch's node and entry points (LedNode.cpp)
+extern LedNode ledNode;
+void setup();
+void loop();
+
+namespace {
+
+// the parts of the node the benchmarks drive
+WiFiClient& wfClient = ledNode.wfClient;
+PubSubClient& psClient = ledNode.psClient;
+PublishQueue& outbox = ledNode.outbox;
+const char* const ledClientID = ledNode.ledClientID;
+
+const int kSenders = 8;
+const uint8_t kLedPin = 21;  // LED in LedNode.h
+const uint32_t kMaxP99LatencyNs = 10000000;
+// the most a command's metrics counters may cost, as a share of the
+// command, and the most with the timing of a network_pass() added (two
+// micros() calls, which are dearer on the host than on the ESP32)
+const double kMaxMetricsShare = 0.02;
+const double kMaxMetricsTimedShare = 0.10;
+// what Serial.availableForWrite() gives the log drain at most, and a log
+// line longer than that
+const size_t kLogFifoBytes = 128;
+const int kLogLongLine = 220;
+const char kLongText[] =
+    "{\"senderID\":\"btnNode00\",\"cmd\":\"seq\",\"steps\":\"0:10,32:10,"
+    "64:10,96:10,128:10,160:10,192:10,224:10,255:10,224:10,192:10,160:10,"
+    "128:10,96:10,64:10,32:10,0:10,255:10,0:10,255:10,0:10,255:10,0:10,"
+    "255:10\",\"count\":3,\"seq\":1234567}";
+static_assert(sizeof(kLongText) - 1 >= kLogLongLine, "kLongText too short");
+// how much slower a command-window lookup may get from 8 senders to 512
+const double kMaxWindowGrowth = 4.0;
+// loop()'s outbox budget (PUBLISH_BUDGET_* in LedNode.h)
+const int kBudgetMessages = 4;
+const size_t kBudgetBytes = 1024;
+
+struct Payload {
+  char text[96];
+  unsigned int length;
+};
+
+// on/off commands from kSenders different button nodes, as JSON and as
+// MessagePack, and as JSON with round-trip tracing
+Payload payloads[2 * kSenders];
+Payload msgpackPayloads[2 * kSenders];
+Payload tracedPayloads[2 * kSenders];
+
+void buildPayloads() {
+  JsonDocument doc;
+  for (int i = 0; i < 2 * kSenders; i++) {
+    int len = snprintf(payloads[i].text, sizeof(payloads[i].text),
+                       "{\"senderID\":\"btnNode%02d\",\"cmd\":\"%s\"}", i / 2,
+                       (i & 1) ? "off" : "on");
+    payloads[i].length = len;
+
+    char sender[16];
+    snprintf(sender, sizeof(sender), "btnNode%02d", i / 2);
+    doc.clear();
+    doc["senderID"] = sender;
+    doc["cmd"] = (i & 1) ? "off" : "on";
+    msgpackPayloads[i].length =
+        serializeMsgPack(doc, msgpackPayloads[i].text);
+
+    tracedPayloads[i].length = snprintf(
+        tracedPayloads[i].text, sizeof(tracedPayloads[i].text),
+        "{\"senderID\":\"btnNode%02d\",\"cmd\":\"%s\",\"seq\":%d,"
+        "\"ts\":%u}",
+        i / 2, (i & 1) ? "off" : "on", 100000 + i, 4000000000u + i);
+  }
+}
+
+#ifndef DUAL_CORE
+// ---- single-core scenarios (the DUAL_CORE build runs handoff only) -------
+
+// Size of a QoS 0 MQTT PUBLISH packet: fixed header, remaining length,
+// topic length, topic, payload.
+unsigned publishBytes(size_t topicLength, size_t payloadLength) {
+  size_t remaining = 2 + topicLength + payloadLength;
+  return 1 + (remaining < 128 ? 1 : 2) + remaining;
+}
+
+// Where the benchmarks drain the node's log to: counted, not printed.
+class LogSink : public Print {
+ public:
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t* buffer, size_t size) override {
+    bytes += size;
+    return size;
+  }
+  uint64_t bytes = 0;
+} logSink;
+
+// the next seq for a renumbered traced command: above any the payloads
+// were built with
+uint32_t nextSeq = 1000000;
+
+// p with its "seq" value replaced by the next one, in out: a sender's
+// seqs must keep rising, or the node drops its commands as repeats.
+const Payload& renumbered(const Payload& p, Payload& out) {
+  const char* at = strstr(p.text, "\"seq\":") + 6;
+  const char* end = at + strspn(at, "0123456789");
+  out.length = snprintf(out.text, sizeof(out.text), "%.*s%u%s",
+                        (int)(at - p.text), p.text, (unsigned)nextSeq++, end);
+  return out;
+}
+
+// Returns the number of heap allocations made on the command path. With
+// renumber, every command gets a fresh seq (outside the timing).
+uint64_t benchLedCommand(const char* name, const Payload* payloads,
+                         long messages, bool renumber = false) {
+  char topic[64];
+  snprintf(topic, sizeof(topic), "%s/ledCommand", ledClientID);
+
+  // warm up caches and any lazily-grown buffers
+  Payload numbered;
+  for (int i = 0; i < 1000; i++) {
+    const Payload& p =
+        renumber ? renumbered(payloads[i % (2 * kSenders)], numbered)
+                 : payloads[i % (2 * kSenders)];
+    psClient.deliver(topic, (const uint8_t*)p.text, p.length);
+    outbox.drain(psClient, kBudgetMessages, kBudgetBytes);
+    logDrain(logSink, SIZE_MAX);
+  }
+
+  bench::LatencyStats stats(messages);
+  uint64_t published = psClient.publishCount();
+  uint64_t allocsBefore = bench::allocCount();
+  for (long i = 0; i < messages; i++) {
+    const Payload& p =
+        renumber ? renumbered(payloads[i % (2 * kSenders)], numbered)
+                 : payloads[i % (2 * kSenders)];
+    uint64_t start = bench::nowNanos();
+    psClient.deliver(topic, (const uint8_t*)p.text, p.length);
+    outbox.drain(psClient, kBudgetMessages, kBudgetBytes);
+    stats.add(bench::nowNanos() - start);
+    // as loop() would once idle; not part of the command's time
+    logDrain(logSink, SIZE_MAX);
+  }
+  uint64_t allocs = bench::allocCount() - allocsBefore;
+  published = psClient.publishCount() - published;
+
+  bench::printRow(name, stats, allocs);
+  const Payload& last = payloads[(messages - 1) % (2 * kSenders)];
+  printf("  wire bytes: ledCommand %u (packet %u), ledStatus %u (packet %u)\n",
+         last.length, publishBytes(strlen(topic), last.length),
+         psClient.lastLength(),
+         publishBytes(strlen(psClient.lastTopic()), psClient.lastLength()));
+  // a ledStatus and a retained state for each: the commands alternate
+  // on/off, so every one changes the LED
+  if (published != 2 * (uint64_t)messages) {
+    printf("  WARNING: %llu messages published for %ld commands\n",
+           (unsigned long long)published, messages);
+  }
+  return allocs;
+}
+
+// The ledCommand row again with the node's logging switched off at run
+// time, and with every level compiled in switched on, with the log
+// drained (uncounted) after each command. Also shows the log bytes per
+// command, and how long the UART would take to send them at 115200 baud:
+// the time each command would have spent blocked in Serial.print().
+uint64_t benchLogging(long messages) {
+  uint8_t level = logLevel();
+  uint64_t allocs = 0;
+  const char* names[] = {"ledCommand-log-off", "ledCommand-log-on"};
+  const uint8_t levels[] = {LOG_LEVEL_NONE, LOG_LEVEL};
+  for (int i = 0; i < 2; i++) {
+    logSetLevel(levels[i]);
+    uint64_t bytes = logSink.bytes;
+    uint32_t dropped = logDropped();
+    allocs += benchLedCommand(names[i], payloads, messages);
+    double perCommand = (double)(logSink.bytes - bytes) / messages;
+    printf("  log: %.1f bytes/command (%.0f us at 115200 baud), "
+           "%u lines dropped\n",
+           perCommand, perCommand * 10 * 1e6 / 115200,
+           (unsigned)(logDropped() - dropped));
+  }
+  logSetLevel(level);
+  return allocs;
+}
+
+// Where checkLogDrain() drains the log to: kept, to compare.
+class LogCapture : public Print {
+ public:
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t* buffer, size_t size) override {
+    text.append((const char*)buffer, size);
+    return size;
+  }
+  std::string text;
+};
+
+// Logs a line longer than the UART FIFO takes (a MAX_CMD_PAYLOAD dump)
+// and then more than the ring holds, and drains it kLogFifoBytes at a
+// time, as loop() does. Returns true if every line kept came out whole
+// and in order, after the dropped-lines note, without a drain writing
+// more than it was allowed.
+bool checkLogDrain() {
+  logDrain(logSink, SIZE_MAX);  // start from an empty ring
+  const int kShortLines = 40;
+  uint32_t dropped = logDropped();
+  logPrintf("%.*s", kLogLongLine, kLongText);
+  for (int i = 0; i < kShortLines; i++) logPrintf("line %d", i);
+  dropped = logDropped() - dropped;
+
+  std::string expect;
+  char line[48];
+  if (dropped > 0) {
+    snprintf(line, sizeof(line), "(%u log lines dropped)\r\n",
+             (unsigned)dropped);
+    expect += line;
+  }
+  expect.append(kLongText, kLogLongLine);
+  expect += "\r\n";
+  for (int i = 0; i < kShortLines - (int)dropped; i++) {
+    snprintf(line, sizeof(line), "line %d\r\n", i);
+    expect += line;
+  }
+
+  LogCapture capture;
+  bool boundOk = true;
+  int drains = 0;
+  for (; drains < 100 && logQueued() > 0; drains++) {
+    boundOk = logDrain(capture, kLogFifoBytes) <= kLogFifoBytes && boundOk;
+  }
+  bool ok = logQueued() == 0 && boundOk && capture.text == expect;
+  printf("log-drain       %d-byte line + %d, %u dropped, %d drains of %u "
+         "bytes  %s\n",
+         kLogLongLine, kShortLines, (unsigned)dropped, drains,
+         (unsigned)kLogFifoBytes, ok ? "ok" : "FAIL");
+  return ok;
+}
+
+// Sends one command and checks the seq/ts its ledStatus carries back.
+bool checkEcho(const char* format, bool msgpack, bool traced) {
+  const uint32_t seq = nextSeq++, ts = 4000000001u;
+  char topic[64];
+  snprintf(topic, sizeof(topic), "%s/ledCommand", ledClientID);
+
+  static JsonArena<1024> arena;
+  static JsonDocument doc(&arena);
+  doc.clear();
+  doc["senderID"] = "btnNode01";
+  doc["cmd"] = "on";
+  if (traced) {
+    doc["seq"] = seq;
+    doc["ts"] = ts;
+  }
+  char command[96];
+  size_t length = msgpack ? serializeMsgPack(doc, command)
+                          : serializeJson(doc, command);
+  psClient.deliver(topic, (const uint8_t*)command, length);
+  outbox.drain(psClient, kBudgetMessages, kBudgetBytes);
+
+  char reply[200];
+  unsigned int replyLength = psClient.lastLength();
+  memcpy(reply, psClient.lastPayload(), replyLength);
+  JsonField fields[8];
+  int n = msgpack ? msgpackScan((uint8_t*)reply, replyLength, fields, 8)
+                  : jsonScan(reply, replyLength, fields, 8);
+  uint32_t gotSeq = 0, gotTs = 0;
+  bool hasSeq = jsonFieldUint(fields, n, "seq", &gotSeq);
+  bool hasTs = jsonFieldUint(fields, n, "ts", &gotTs);
+  bool ok = n > 0 && (traced ? hasSeq && hasTs && gotSeq == seq && gotTs == ts
+                             : !hasSeq && !hasTs);
+  printf("trace-echo %-8s %-9s %s\n", format,
+         traced ? "traced" : "untraced", ok ? "ok" : "FAIL");
+  return ok;
+}
+
+// what a command published: retained state messages and ledStatus replies
+int statePublished;
+char stateSeen[128];
+int repliesPublished;
+int ledWrites;
+
+void recordRetained(const char* topic, const uint8_t* payload,
+                    unsigned int length, bool retained) {
+  if (strstr(topic, "/state") && retained) {
+    statePublished++;
+    if (length >= sizeof(stateSeen)) length = sizeof(stateSeen) - 1;
+    memcpy(stateSeen, payload, length);
+    stateSeen[length] = '\0';
+  } else if (strstr(topic, "/ledStatus")) {
+    repliesPublished++;
+  }
+}
+
+void countLedWrites(uint8_t pin, uint8_t val, uint64_t ns) {
+  if (pin == kLedPin) ledWrites++;
+}
+
+// true if the last retained state seen has this ledStatus (it may carry
+// the channels after it)
+bool stateIs(const char* status) {
+  char expect[32];
+  int length = snprintf(expect, sizeof(expect), "{\"ledStatus\":\"%s\"",
+                        status);
+  return strncmp(stateSeen, expect, length) == 0;
+}
+
+// Sends payload and drains the outbox; returns true if it wrote the pin
+// writes times, published the retained state states times (ending with
+// ledStatus expectState) and replied once.
+bool sendAndCount(const Payload& p, int writes, int states,
+                  const char* expectState) {
+  char topic[64];
+  snprintf(topic, sizeof(topic), "%s/ledCommand", ledClientID);
+  statePublished = repliesPublished = ledWrites = 0;
+  stateSeen[0] = '\0';
+  psClient.deliver(topic, (const uint8_t*)p.text, p.length);
+  outbox.drain(psClient, kBudgetMessages, kBudgetBytes);
+  return ledWrites == writes && statePublished == states &&
+         repliesPublished == 1 &&
+         (states == 0 || stateIs(expectState));
+}
+
+bool checkRetainedState() {
+  char willTopic[64];
+  snprintf(willTopic, sizeof(willTopic), "%s/availability", ledClientID);
+  bool willOk = strcmp(psClient.willTopic(), willTopic) == 0 &&
+                strcmp(psClient.willMessage(), "offline") == 0 &&
+                psClient.willRetained();
+#ifndef LED_LAST_WILL
+  willOk = psClient.willTopic()[0] == '\0';
+#endif
+
+  shim::setGpioHook(countLedWrites);
+  psClient.setPublishHook(recordRetained);
+  // payloads[0] is "on" and [1] "off", both from btnNode00
+  (void)sendAndCount(payloads[1], 0, 0, "");  // start from off, whatever it was
+  bool changeOk = sendAndCount(payloads[0], 1, 1, "on");
+  bool repeatOk = sendAndCount(payloads[0], 0, 0, "");
+  changeOk = sendAndCount(payloads[1], 1, 1, "off") &&
+             changeOk;
+  shim::setGpioHook(nullptr);
+  psClient.setPublishHook(nullptr);
+
+  bool ok = willOk && changeOk && repeatOk;
+  printf("retained-state  change %s, repeat %s, last will %s  %s\n",
+         changeOk ? "ok" : "FAIL", repeatOk ? "ok" : "FAIL",
+         willOk ? "ok" : "FAIL", ok ? "ok" : "FAIL");
+  return ok;
+}
+
+// Sends payload (a command no reply can go back for); returns true if it
+// wrote the pin writes times and published nothing but the retained
+// state, once.
+bool sendUnanswered(const char* payload, int writes) {
+  char topic[64];
+  snprintf(topic, sizeof(topic), "%s/ledCommand", ledClientID);
+  statePublished = repliesPublished = ledWrites = 0;
+  uint64_t published = psClient.publishCount();
+  psClient.deliver(topic, (const uint8_t*)payload, strlen(payload));
+  outbox.drain(psClient, kBudgetMessages, kBudgetBytes);
+  published = psClient.publishCount() - published;
+  return ledWrites == writes && statePublished == 1 && published == 1;
+}
+
+// A command with no senderID, or one too long for its reply topic, is
+// carried out but not answered: not on an empty topic (which the broker
+// disconnects for), and not on a cut-short one (another client's).
+bool checkUnanswered() {
+  char longID[SENDER_ID_SIZE + 16];
+  memset(longID, 'x', sizeof(longID) - 1);
+  longID[sizeof(longID) - 1] = '\0';
+  char longCommand[128];
+  snprintf(longCommand, sizeof(longCommand),
+           "{\"senderID\":\"%s\",\"cmd\":\"off\"}", longID);
+
+  shim::setGpioHook(countLedWrites);
+  psClient.setPublishHook(recordRetained);
+  (void)sendAndCount(payloads[0], 0, 0, "");  // start from on
+  bool noIdOk = sendUnanswered("{\"cmd\":\"off\"}", 1);
+  noIdOk = sendUnanswered("{\"senderID\":\"\",\"cmd\":\"on\"}", 1) && noIdOk;
+  bool longIdOk = sendUnanswered(longCommand, 1);
+  shim::setGpioHook(nullptr);
+  psClient.setPublishHook(nullptr);
+
+  bool ok = noIdOk && longIdOk;
+  printf("unanswered      no senderID %s, %u-char senderID %s  %s\n",
+         noIdOk ? "ok" : "FAIL", (unsigned)strlen(longID),
+         longIdOk ? "ok" : "FAIL", ok ? "ok" : "FAIL");
+  return ok;
+}
+
+// PWM duty changes the pattern makes, on the simulated clock
+const int kMaxPwmChanges = 512;
+uint32_t pwmDuties[kMaxPwmChanges];
+uint64_t pwmTimes[kMaxPwmChanges];
+int pwmChanges;
+
+void recordPwm(uint8_t pin, uint32_t duty, uint64_t ns) {
+  if (pin == kLedPin && pwmChanges < kMaxPwmChanges) {
+    pwmDuties[pwmChanges] = duty;
+    pwmTimes[pwmChanges] = ns;
+    pwmChanges++;
+  }
+}
+
+// Sends one pattern command, then runs the clock on for runMs in uneven
+// steps (the timer catches up whatever the step), and finally one
+// network_pass() to notice the end. Returns true if the reply and the
+// retained state said "pattern" and the state's ledStatus then became
+// endState.
+bool playPattern(const char* command, uint32_t runMs, const char* endState) {
+  char topic[64];
+  snprintf(topic, sizeof(topic), "%s/ledCommand", ledClientID);
+  char payload[MAX_CMD_PAYLOAD];
+  unsigned int length =
+      snprintf(payload, sizeof(payload), "{\"senderID\":\"btnNode00\",%s}",
+               command);
+  statePublished = repliesPublished = 0;
+  stateSeen[0] = '\0';
+  pwmChanges = 0;
+  psClient.deliver(topic, (const uint8_t*)payload, length);
+  outbox.drain(psClient, kBudgetMessages, kBudgetBytes);
+  bool started = repliesPublished == 1 && statePublished == 1 &&
+                 stateIs("pattern") &&
+                 strstr((const char*)psClient.lastPayload(), "\"pattern\"");
+
+  for (uint32_t ms = 0; ms < runMs; ms += 7) {
+    shim::advance(7000000);
+    shim::runTimers();
+  }
+  statePublished = 0;
+  ledNode.network_pass();
+  outbox.drain(psClient, kBudgetMessages, kBudgetBytes);
+  return started && statePublished == 1 && stateIs(endState);
+}
+
+// The largest difference, in ns, between when the timer-driven changes
+// happened and when they were due: offsetsMs[i] after the first of them.
+uint64_t patternError(const uint32_t* offsetsMs, int n) {
+  uint64_t worst = 0;
+  for (int i = 0; i < n && i + 1 < pwmChanges; i++) {
+    uint64_t due = pwmTimes[1] + offsetsMs[i] * 1000000ULL;
+    uint64_t at = pwmTimes[i + 1];
+    uint64_t error = at > due ? at - due : due - at;
+    if (error > worst) worst = error;
+  }
+  return worst;
+}
+
+bool checkPatterns() {
+  shim::setPwmHook(recordPwm);
+  psClient.setPublishHook(recordRetained);
+
+  // 5 blinks of 30 ms on, 70 ms off: the first on from the callback, the
+  // other 9 changes from the timer
+  bool blinkOk = playPattern(
+      "\"cmd\":\"blink\",\"period\":100,\"duty\":30,\"count\":5", 600, "off");
+  const uint32_t blinkOffsets[] = {0, 70, 100, 170, 200, 270, 300, 370, 400};
+  uint64_t blinkError = patternError(blinkOffsets, 9);
+  int blinkChanges = pwmChanges;
+  blinkOk = blinkOk && blinkChanges == 10 && blinkError == 0;
+  for (int i = 0; i < pwmChanges; i++) {
+    if (pwmDuties[i] != (i % 2 == 0 ? 255u : 0u)) blinkOk = false;
+  }
+
+  // a 255 ms fade up: one step of brightness per tick, ending on
+  bool fadeOk = playPattern(
+      "\"cmd\":\"fade\",\"from\":0,\"to\":255,\"ms\":255", 300, "on");
+  int fadeChanges = pwmChanges;
+  fadeOk = fadeOk && fadeChanges == 256 && pwmDuties[255] == 255 &&
+           pwmTimes[255] - pwmTimes[1] == 254 * 1000000ULL;
+  for (int i = 1; i < pwmChanges; i++) {
+    if (pwmDuties[i] != pwmDuties[i - 1] + 1) fadeOk = false;
+  }
+
+  // a sequence, and an on/off command taking the LED back
+  bool seqOk = playPattern(
+      "\"cmd\":\"seq\",\"steps\":\"0:10,128:10\",\"count\":3", 100, "on");
+  seqOk = seqOk && pwmChanges == 6 && pwmDuties[5] == 128;
+  shim::setGpioHook(countLedWrites);
+  bool handBackOk = sendAndCount(payloads[1], 1, 1, "off") &&
+                    shim::pwmDuty(kLedPin) == -1 &&
+                    shim::pinLevel(kLedPin) == OFF;
+  shim::setGpioHook(nullptr);
+  shim::setPwmHook(nullptr);
+  psClient.setPublishHook(nullptr);
+
+  bool ok = blinkOk && fadeOk && seqOk && handBackOk;
+  printf("pattern-blink   1 command, %d changes, timing error max %llu ns  "
+         "%s\n",
+         blinkChanges, (unsigned long long)blinkError,
+         blinkOk ? "ok" : "FAIL");
+  printf("pattern-fade    1 command, %d changes  %s\n", fadeChanges,
+         fadeOk ? "ok" : "FAIL");
+  printf("pattern-seq     %s, back to on/off %s\n", seqOk ? "ok" : "FAIL",
+         handBackOk ? "ok" : "FAIL");
+  return ok;
+}
+
+// ---- multi-channel set command ----------------------------------------
+
+const int kChannels = ledChannelCount;
+static_assert(kChannels >= 2,
+              "build with the LED_CHANNEL_PINS of [env:native] (eight pins)");
+
+// every message either way, and its MQTT packet bytes
+uint64_t channelPublishes;
+uint64_t channelWireBytes;
+
+void countChannelPublish(const char* topic, const uint8_t* payload,
+                         unsigned int length, bool retained) {
+  channelPublishes++;
+  channelWireBytes += publishBytes(strlen(topic), length);
+}
+
+// Updates all kChannels channels, alternating between even channels on
+// with odd ones off and the reverse, once per sample: a set command per
+// channel ("on" or "off" with one bit), or one set command with both
+// bitmasks. Reports ns per update (all channels), and per update the
+// messages each way and their bytes on the wire. Returns the heap
+// allocations.
+uint64_t benchChannels(const char* name, bool batched, long updates) {
+  char topic[64];
+  snprintf(topic, sizeof(topic), "%s/ledCommand", ledClientID);
+  // [update parity][channel], or [update parity][0] batched
+  Payload commands[2][kChannels];
+  for (int parity = 0; parity < 2; parity++) {
+    uint32_t even = 0x55555555UL & ((1UL << kChannels) - 1);
+    uint32_t on = parity ? even ^ ((1UL << kChannels) - 1) : even;
+    uint32_t off = on ^ ((1UL << kChannels) - 1);
+    for (int channel = 0; channel < kChannels; channel++) {
+      Payload& p = commands[parity][channel];
+      if (batched) {
+        p.length = snprintf(p.text, sizeof(p.text),
+                            "{\"senderID\":\"btnNode00\",\"cmd\":\"set\","
+                            "\"on\":%u,\"off\":%u}",
+                            (unsigned)on, (unsigned)off);
+      } else {
+        p.length = snprintf(p.text, sizeof(p.text),
+                            "{\"senderID\":\"btnNode00\",\"cmd\":\"set\","
+                            "\"%s\":%u}",
+                            (on >> channel) & 1 ? "on" : "off",
+                            1u << channel);
+      }
+    }
+  }
+  int perUpdate = batched ? 1 : kChannels;
+
+  auto update = [&](long i) {
+    for (int c = 0; c < perUpdate; c++) {
+      const Payload& p = commands[i & 1][c];
+      psClient.deliver(topic, (const uint8_t*)p.text, p.length);
+      channelPublishes++;  // the command, to the node
+      channelWireBytes += publishBytes(strlen(topic), p.length);
+      outbox.drain(psClient, kBudgetMessages, kBudgetBytes);
+    }
+  };
+  for (int i = 0; i < 1000; i++) {
+    update(i);
+    logDrain(logSink, SIZE_MAX);
+  }
+
+  psClient.setPublishHook(countChannelPublish);
+  channelPublishes = channelWireBytes = 0;
+  bench::LatencyStats stats(updates);
+  uint64_t allocsBefore = bench::allocCount();
+  for (long i = 0; i < updates; i++) {
+    uint64_t start = bench::nowNanos();
+    update(i);
+    stats.add(bench::nowNanos() - start);
+    logDrain(logSink, SIZE_MAX);
+  }
+  uint64_t allocs = bench::allocCount() - allocsBefore;
+  psClient.setPublishHook(nullptr);
+
+  bench::printRow(name, stats, allocs);
+  printf("  %d channels/update: %.1f messages, %.0f wire bytes, "
+         "%.0f channel updates/s\n",
+         kChannels, (double)channelPublishes / updates,
+         (double)channelWireBytes / updates,
+         kChannels * 1e9 / stats.mean());
+  return allocs;
+}
+
+// pin writes on the channel pins, by channel
+int channelWrites[kChannels];
+
+void countChannelWrites(uint8_t pin, uint8_t val, uint64_t ns) {
+  for (int channel = 0; channel < kChannels; channel++) {
+    if (ledChannelPins[channel] == pin) channelWrites[channel]++;
+  }
+}
+
+// Sends one set command; returns true if it published the retained state
+// states times, replied once with "channels":expect, and wrote pins
+// writes times in all.
+bool sendSet(const char* fields, int states, int writes, const char* expect) {
+  char topic[64];
+  snprintf(topic, sizeof(topic), "%s/ledCommand", ledClientID);
+  char payload[MAX_CMD_PAYLOAD];
+  unsigned int length = snprintf(
+      payload, sizeof(payload),
+      "{\"senderID\":\"btnNode00\",\"cmd\":\"set\",%s}", fields);
+  statePublished = repliesPublished = 0;
+  memset(channelWrites, 0, sizeof(channelWrites));
+  psClient.deliver(topic, (const uint8_t*)payload, length);
+  outbox.drain(psClient, kBudgetMessages, kBudgetBytes);
+  int total = 0;
+  for (int channel = 0; channel < kChannels; channel++) {
+    total += channelWrites[channel];
+  }
+  char reply[96];
+  snprintf(reply, sizeof(reply), "\"channels\":\"%s\"", expect);
+  return statePublished == states && repliesPublished == 1 &&
+         total == writes &&
+         strstr((const char*)psClient.lastPayload(), reply) != nullptr;
+}
+
+// A set command changes only the channels whose brightness changes, at
+// full brightness by GPIO and in between by PWM; the reply and retained
+// state list every channel. Repeating it writes nothing, an out-of-range
+// channel is refused, and an on/off command still drives channel 0.
+bool checkChannels() {
+  shim::setGpioHook(countChannelWrites);
+  psClient.setPublishHook(recordRetained);
+  (void)sendSet("\"off\":255", 1, 0, "");  // from all off, whatever it was
+
+  bool setOk =
+      sendSet("\"on\":5,\"off\":2,\"levels\":\"3:128,7:0\"", 1, 2,
+              "255,0,255,128,0,0,0,0") &&
+      stateIs("on") && strstr(stateSeen, "255,0,255,128,0,0,0,0") &&
+      shim::pinLevel(ledChannelPins[0]) == HIGH &&
+      shim::pinLevel(ledChannelPins[2]) == HIGH &&
+      shim::pwmDuty(ledChannelPins[3]) == 128;
+  bool repeatOk = sendSet("\"on\":5,\"levels\":\"3:128\"", 0, 0,
+                          "255,0,255,128,0,0,0,0");
+  bool backToGpioOk = sendSet("\"levels\":\"3:255,0:64\"", 1, 1,
+                              "64,0,255,255,0,0,0,0") &&
+                      stateIs("on") &&
+                      shim::pwmDuty(ledChannelPins[3]) == -1 &&
+                      shim::pinLevel(ledChannelPins[3]) == HIGH &&
+                      shim::pwmDuty(ledChannelPins[0]) == 64;
+  // nothing out of range, nor on and off at once
+  uint64_t replies = psClient.publishCount();
+  char topic[64];
+  snprintf(topic, sizeof(topic), "%s/ledCommand", ledClientID);
+  const char* bad[] = {
+      "{\"senderID\":\"btnNode00\",\"cmd\":\"set\",\"on\":256}",
+      "{\"senderID\":\"btnNode00\",\"cmd\":\"set\",\"on\":1,\"off\":1}",
+      "{\"senderID\":\"btnNode00\",\"cmd\":\"set\",\"levels\":\"8:1\"}",
+      "{\"senderID\":\"btnNode00\",\"cmd\":\"set\",\"levels\":\"1:256\"}",
+      "{\"senderID\":\"btnNode00\",\"cmd\":\"set\"}",
+  };
+  for (const char* payload : bad) {
+    psClient.deliver(topic, (const uint8_t*)payload, strlen(payload));
+    outbox.drain(psClient, kBudgetMessages, kBudgetBytes);
+  }
+  bool refusedOk = psClient.publishCount() == replies;
+  shim::setGpioHook(countLedWrites);
+  bool onOffOk = sendAndCount(payloads[1], 1, 1, "off") &&
+                 strstr(stateSeen, "0,0,255,255,0,0,0,0") &&
+                 shim::pwmDuty(kLedPin) == -1;
+  shim::setGpioHook(nullptr);
+  psClient.setPublishHook(nullptr);
+  logDrain(logSink, SIZE_MAX);
+
+  bool ok = setOk && repeatOk && backToGpioOk && refusedOk && onOffOk;
+  printf("channels        set %s, repeat %s, pwm->gpio %s, refused %s, "
+         "on/off %s  %s\n",
+         setOk ? "ok" : "FAIL", repeatOk ? "ok" : "FAIL",
+         backToGpioOk ? "ok" : "FAIL", refusedOk ? "ok" : "FAIL",
+         onOffOk ? "ok" : "FAIL", ok ? "ok" : "FAIL");
+  return ok;
+}
+
+// ---- group commands ----------------------------------------------------
+
+// ledStatus replies to btnNode00 that name this node
+int groupReplies;
+
+void countGroupReplies(const char* topic, const uint8_t* payload,
+                       unsigned int length, bool retained) {
+  recordRetained(topic, payload, length, retained);
+  if (strcmp(topic, "btnNode00/ledStatus") == 0 &&
+      memmem(payload, length, ledClientID, strlen(ledClientID))) {
+    groupReplies++;
+  }
+}
+
+// Two commands on the node's group topic in quick succession: the LED
+// and the retained state follow each at once, but the sender hears back
+// once, within GROUP_REPLY_SPREAD_MS, with the final state and the node's
+// ID. The node's own topic still answers straight away.
+bool checkGroups() {
+  char topic[64];
+  snprintf(topic, sizeof(topic), GROUP_TOPIC_PREFIX "%.*s/ledCommand",
+           (int)strcspn(LED_GROUPS, ","), LED_GROUPS);
+  psClient.setPublishHook(countGroupReplies);
+  shim::setGpioHook(countLedWrites);
+  (void)sendAndCount(payloads[1], 0, 0, "");  // start from off
+  statePublished = repliesPublished = ledWrites = groupReplies = 0;
+
+  for (int i = 0; i < 3; i++) {
+    const Payload& p = payloads[i & 1];  // on, off, on
+    psClient.deliver(topic, (const uint8_t*)p.text, p.length);
+    outbox.drain(psClient, kBudgetMessages, kBudgetBytes);
+  }
+  bool heldOk = ledWrites == 3 && statePublished == 3 && stateIs("on") &&
+                repliesPublished == 0;
+
+  // the reply, once this node's share of the window is up
+  uint32_t waitedMs = 0;
+  while (groupReplies == 0 && waitedMs <= GROUP_REPLY_SPREAD_MS) {
+    shim::advance(1000000);
+    waitedMs++;
+    ledNode.network_pass();
+    outbox.drain(psClient, kBudgetMessages, kBudgetBytes);
+  }
+  bool replyOk = groupReplies == 1 && repliesPublished == 1 &&
+                 waitedMs >= ledNode.groupReplyDelayMs &&
+                 waitedMs <= ledNode.groupReplyDelayMs + 1 &&
+                 strstr((const char*)psClient.lastPayload(),
+                        "\"ledStatus\":\"on\"");
+  // nothing more after it
+  for (int i = 0; i < GROUP_REPLY_SPREAD_MS; i++) {
+    shim::advance(1000000);
+    ledNode.network_pass();
+    outbox.drain(psClient, kBudgetMessages, kBudgetBytes);
+  }
+  replyOk = replyOk && repliesPublished == 1;
+  bool directOk = sendAndCount(payloads[1], 1, 1, "off") && groupReplies == 1;
+  shim::setGpioHook(nullptr);
+  psClient.setPublishHook(nullptr);
+  logDrain(logSink, SIZE_MAX);
+
+  bool ok = heldOk && replyOk && directOk;
+  printf("group-command   3 commands, LED/state %s, 1 reply after %u ms %s, "
+         "direct %s  %s\n",
+         heldOk ? "ok" : "FAIL", (unsigned)waitedMs,
+         replyOk ? "ok" : "FAIL", directOk ? "ok" : "FAIL",
+         ok ? "ok" : "FAIL");
+  return ok;
+}
+
+// ---- metrics ---------------------------------------------------------------
+
+// the last message published on the node's metrics topic
+char metricsPayload[METRICS_PAYLOAD_SIZE];
+
+void recordMetrics(const char* topic, const uint8_t* payload,
+                   unsigned int length, bool retained) {
+  if (strcmp(topic, ledNode.metricsTopic) == 0 &&
+      length < sizeof(metricsPayload)) {
+    memcpy(metricsPayload, payload, length);
+    metricsPayload[length] = '\0';
+  }
+}
+
+// A known mix of messages must show up in the counters and the metrics
+// message, which must then start over. Then what collecting costs: the
+// counter updates one command makes (a command received, a ledStatus and
+// a state queued) in a loop of their own, and again with a
+// network_pass() timed as well (one per command, though a pass may take
+// several), against the whole ledCommand path. Returns false if a count
+// is off or collecting costs kMaxMetricsShare (kMaxMetricsTimedShare) of
+// a command or more.
+bool checkMetrics(long messages) {
+  char topic[64];
+  snprintf(topic, sizeof(topic), "%s/ledCommand", ledClientID);
+  const char bad[] = "{\"senderID\":\"btnNode00\",\"cmd\":";
+  NodeMetrics& metrics = ledNode.metrics;
+
+  // the commands alternate on/off: a ledStatus and a state each
+  metrics.reset(millis());
+  uint64_t start = bench::nowNanos();
+  for (long i = 0; i < messages; i++) {
+    const Payload& p = payloads[i % (2 * kSenders)];
+    psClient.deliver(topic, (const uint8_t*)p.text, p.length);
+    outbox.drain(psClient, kBudgetMessages, kBudgetBytes);
+  }
+  double commandNs = (double)(bench::nowNanos() - start) / messages;
+  psClient.deliver(topic, (const uint8_t*)bad, sizeof(bad) - 1);
+  logDrain(logSink, SIZE_MAX);
+  ledNode.network_pass();
+  bool countsOk =
+      metrics.receivedCount(LedNode::METRIC_IN_COMMAND) == messages + 1 &&
+      metrics.receivedCount(LedNode::METRIC_IN_GROUP) == 0 &&
+      metrics.sentCount(LedNode::METRIC_OUT_STATUS) == messages &&
+      metrics.sentCount(LedNode::METRIC_OUT_STATE) == messages &&
+      metrics.parseFailures() == 1 && metrics.loops() >= 1;
+
+  char expected[96];
+  snprintf(expected, sizeof(expected),
+           "\"in\":{\"cmd\":%ld,\"grp\":0},"
+           "\"out\":{\"status\":%ld,\"state\":%ld,\"avail\":0},\"bad\":1,",
+           messages + 1, messages, messages);
+  metricsPayload[0] = '\0';
+  psClient.setPublishHook(recordMetrics);
+  ledNode.publish_metrics();
+  psClient.setPublishHook(nullptr);
+  char expectedOutbox[80];
+  snprintf(expectedOutbox, sizeof(expectedOutbox),
+           "\"outbox\":{\"depth\":%d,\"high\":%d,\"drops\":%lu},",
+           outbox.depth(), outbox.highWater(), (unsigned long)outbox.drops());
+  bool messageOk = strstr(metricsPayload, expected) != nullptr &&
+                   strstr(metricsPayload, expectedOutbox) != nullptr &&
+                   strstr(metricsPayload, "\"rssi\":") != nullptr &&
+                   metrics.receivedCount(LedNode::METRIC_IN_COMMAND) == 0;
+
+  // the same counter updates on their own; the fence keeps the compiler
+  // from folding the loop into one add per counter
+  start = bench::nowNanos();
+  for (long i = 0; i < messages; i++) {
+    metrics.received(LedNode::METRIC_IN_COMMAND);
+    metrics.sent(LedNode::METRIC_OUT_STATUS);
+    metrics.sent(LedNode::METRIC_OUT_STATE);
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+  }
+  double countNs = (double)(bench::nowNanos() - start) / messages;
+  start = bench::nowNanos();
+  for (long i = 0; i < messages; i++) {
+    uint32_t passStart = micros();
+    metrics.received(LedNode::METRIC_IN_COMMAND);
+    metrics.sent(LedNode::METRIC_OUT_STATUS);
+    metrics.sent(LedNode::METRIC_OUT_STATE);
+    metrics.loopTime(micros() - passStart);
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+  }
+  double timedNs = (double)(bench::nowNanos() - start) / messages;
+  metrics.reset(millis());
+  bool costOk = countNs < commandNs * kMaxMetricsShare &&
+                timedNs < commandNs * kMaxMetricsTimedShare;
+
+  bool ok = countsOk && messageOk && costOk;
+  printf("metrics         counts %s, message %s (%u bytes)  %s\n",
+         countsOk ? "ok" : "FAIL", messageOk ? "ok" : "FAIL",
+         (unsigned)strlen(metricsPayload), ok ? "ok" : "FAIL");
+  printf("  per %.0f ns command: counters %.1f ns (%.2f%%), with the pass "
+         "timed %.1f ns (%.2f%%)\n",
+         commandNs, countNs, 100 * countNs / commandNs, timedNs,
+         100 * timedNs / commandNs);
+  if (!messageOk) printf("  %s\n", metricsPayload);
+  return ok;
+}
+
+// ---- repeated and out-of-order commands ----------------------------------
+
+// Sends cmd numbered seq from btnNode07; returns true if it wrote the pin
+// writes times and was answered replies times.
+bool sendSeq(const char* cmd, uint32_t seq, int writes, int replies) {
+  char topic[64];
+  snprintf(topic, sizeof(topic), "%s/ledCommand", ledClientID);
+  Payload p;
+  p.length = snprintf(p.text, sizeof(p.text),
+                      "{\"senderID\":\"btnNode07\",\"cmd\":\"%s\",\"seq\":%u,"
+                      "\"ts\":1}",
+                      cmd, (unsigned)seq);
+  statePublished = repliesPublished = ledWrites = 0;
+  psClient.deliver(topic, (const uint8_t*)p.text, p.length);
+  outbox.drain(psClient, kBudgetMessages, kBudgetBytes);
+  return ledWrites == writes && repliesPublished == replies;
+}
+
+// A command delivered twice, and one overtaken by a newer command from the
+// same sender (as QoS 1 redelivery may do), must be dropped before the pin
+// or a reply; a refused command must not use up its seq, and a sender far
+// below its old seqs (restarted) is served.
+bool checkDuplicates() {
+  const CommandWindow<CMD_WINDOW_SENDERS>& window = ledNode.commandWindow;
+  uint32_t duplicates = window.duplicates(), stale = window.stale(),
+           restarts = window.restarts();
+  uint32_t seq = nextSeq;
+  nextSeq += 8;
+
+  shim::setGpioHook(countLedWrites);
+  psClient.setPublishHook(recordRetained);
+  (void)sendAndCount(payloads[1], 0, 0, "");  // start from off
+  bool newOk = sendSeq("on", seq, 1, 1);
+  bool repeatOk = sendSeq("on", seq, 0, 0);
+  newOk = sendSeq("off", seq + 2, 1, 1) && newOk;
+  // seq + 1 was overtaken: carried out now it would undo the off
+  bool staleOk = sendSeq("on", seq + 1, 0, 0);
+  repeatOk = sendSeq("off", seq + 2, 0, 0) && repeatOk;
+  // refused, so not seen: the same seq carried out next time
+  bool refusedOk = sendSeq("toggle", seq + 3, 0, 0);
+  refusedOk = sendSeq("on", seq + 3, 1, 1) && refusedOk;
+  refusedOk = sendSeq("off", seq + 4, 1, 1) && refusedOk;
+  bool restartOk = sendSeq("on", seq - COMMAND_WINDOW_SPAN - 1, 1, 1);
+  restartOk = sendSeq("off", seq - COMMAND_WINDOW_SPAN, 1, 1) && restartOk;
+  shim::setGpioHook(nullptr);
+  psClient.setPublishHook(nullptr);
+
+  bool countsOk = window.duplicates() - duplicates == 2 &&
+                  window.stale() - stale == 1 &&
+                  window.restarts() - restarts == 1;
+  bool ok = newOk && repeatOk && staleOk && refusedOk && restartOk &&
+            countsOk;
+  printf("dedup           new %s, repeat %s, stale %s, refused %s, "
+         "restart %s, counts %s  %s\n",
+         newOk ? "ok" : "FAIL", repeatOk ? "ok" : "FAIL",
+         staleOk ? "ok" : "FAIL", refusedOk ? "ok" : "FAIL",
+         restartOk ? "ok" : "FAIL", countsOk ? "ok" : "FAIL",
+         ok ? "ok" : "FAIL");
+  return ok;
+}
+
+// Times accept() for senders button nodes sending in random order, each
+// with rising seqs, on a window of N entries. Returns ns per lookup, or
+// a negative value if a new command was refused.
+template <uint32_t N>
+double benchWindow(int senders, long lookups) {
+  static CommandWindow<N> window;  // up to 16 KB: not on the stack
+  window.clear();
+  std::vector<std::array<char, 16>> ids(senders);
+  std::vector<uint32_t> seqs(senders, 1000);
+  for (int i = 0; i < senders; i++)
+    snprintf(ids[i].data(), ids[i].size(), "btnNode%04d", i);
+  // each sender once, so the timed loop does not count arrivals
+  for (int i = 0; i < senders; i++) window.accept(ids[i].data(), seqs[i]);
+
+  uint32_t pick = 1;  // a fixed LCG: the same order every run
+  long accepted = 0;
+  uint64_t start = bench::nowNanos();
+  for (long i = 0; i < lookups; i++) {
+    pick = pick * 1103515245u + 12345u;
+    int s = (pick >> 8) % senders;
+    accepted += window.accept(ids[s].data(), ++seqs[s]);
+  }
+  double ns = (double)(bench::nowNanos() - start) / lookups;
+  printf("window-%-8d %5u entries %6u bytes (%5.1f per sender)  "
+         "%5.1f ns/lookup, %u evictions\n",
+         senders, (unsigned)N, (unsigned)sizeof(window),
+         (double)sizeof(window) / senders, ns, (unsigned)window.evictions());
+  return accepted == lookups ? ns : -1;
+}
+
+// The window sized for each fleet (twice the senders), then the
+// node's CMD_WINDOW_SENDERS table past its size. Returns false if a new
+// command was refused or lookups got more than kMaxWindowGrowth times
+// slower from the smallest fleet to the largest.
+bool benchWindows(long lookups) {
+  double small = benchWindow<16>(8, lookups);
+  double mid = benchWindow<128>(64, lookups);
+  double node = benchWindow<CMD_WINDOW_SENDERS>(CMD_WINDOW_SENDERS / 2,
+                                                lookups);
+  double large = benchWindow<1024>(512, lookups);
+  double over = benchWindow<CMD_WINDOW_SENDERS>(CMD_WINDOW_SENDERS * 3 / 2,
+                                                lookups);
+  return small > 0 && mid > 0 && node > 0 && large > 0 && over > 0 &&
+         large < small * kMaxWindowGrowth;
+}
+
+// Both parsers get a fresh copy of the payload each time, since jsonScan()
+// rewrites the buffer it parses.
+void benchParse(long messages) {
+  static JsonArena<3072> arena;
+  static JsonDocument doc(&arena);
+  char scratch[64];
+  size_t found = 0;
+
+  bench::LatencyStats copyStats(messages);
+  uint64_t allocsBefore = bench::allocCount();
+  for (long i = 0; i < messages; i++) {
+    const Payload& p = payloads[i % (2 * kSenders)];
+    memcpy(scratch, p.text, p.length);
+    uint64_t start = bench::nowNanos();
+    deserializeJson(doc, scratch, p.length);
+    const char* cmd = doc["cmd"];
+    copyStats.add(bench::nowNanos() - start);
+    found += cmd != nullptr;
+  }
+  bench::printRow("parse-copy", copyStats,
+                  bench::allocCount() - allocsBefore);
+
+  bench::LatencyStats inPlaceStats(messages);
+  allocsBefore = bench::allocCount();
+  for (long i = 0; i < messages; i++) {
+    const Payload& p = payloads[i % (2 * kSenders)];
+    memcpy(scratch, p.text, p.length);
+    uint64_t start = bench::nowNanos();
+    JsonField fields[4];
+    int n = jsonScan(scratch, p.length, fields, 4);
+    const char* cmd = jsonFieldString(fields, n, "cmd");
+    inPlaceStats.add(bench::nowNanos() - start);
+    found += cmd != nullptr;
+  }
+  bench::printRow("parse-inplace", inPlaceStats,
+                  bench::allocCount() - allocsBefore);
+
+  bench::LatencyStats msgpackStats(messages);
+  allocsBefore = bench::allocCount();
+  for (long i = 0; i < messages; i++) {
+    const Payload& p = msgpackPayloads[i % (2 * kSenders)];
+    memcpy(scratch, p.text, p.length);
+    uint64_t start = bench::nowNanos();
+    JsonField fields[4];
+    int n = msgpackScan((uint8_t*)scratch, p.length, fields, 4);
+    const char* cmd = jsonFieldString(fields, n, "cmd");
+    msgpackStats.add(bench::nowNanos() - start);
+    found += cmd != nullptr;
+  }
+  bench::printRow("parse-msgpack", msgpackStats,
+                  bench::allocCount() - allocsBefore);
+
+  if (found != 3 * (size_t)messages) printf("  WARNING: parse failures\n");
+}
+
+// A ledStatus as the node builds it: with the msg text for JSON, without
+// it for MessagePack.
+void benchEncode(long messages) {
+  static JsonArena<3072> arena;
+  static JsonDocument doc(&arena);
+  char out[200];
+  size_t bytes = 0;
+
+  for (int format = 0; format < 2; format++) {
+    bool msgpack = format == 1;
+    bench::LatencyStats stats(messages);
+    uint64_t allocsBefore = bench::allocCount();
+    for (long i = 0; i < messages; i++) {
+      uint64_t start = bench::nowNanos();
+      doc.clear();
+      doc["ledStatus"] = (i & 1) ? "off" : "on";
+      if (!msgpack) doc["msg"] = "I've seen the light!";
+      bytes += msgpack ? serializeMsgPack(doc, out) : serializeJson(doc, out);
+      stats.add(bench::nowNanos() - start);
+    }
+    bench::printRow(msgpack ? "encode-msgpack" : "encode-json", stats,
+                    bench::allocCount() - allocsBefore);
+  }
+  if (bytes == 0) printf("  WARNING: nothing encoded\n");
+}
+
+// last ledStatus state ('n' = on, 'f' = off) each sender received, and
+// the retained state messages among the publishes
+char lastStatus[kSenders];
+uint64_t floodStates;
+
+void recordStatus(const char* topic, const uint8_t* payload,
+                  unsigned int length, bool retained) {
+  if (retained) floodStates++;
+  int sender;
+  if (sscanf(topic, "btnNode%2d/ledStatus", &sender) != 1 || sender < 0 ||
+      sender >= kSenders) {
+    return;
+  }
+  const char* state = strstr((const char*)payload, "\"ledStatus\":\"o");
+  if (state && state + 14 < (const char*)payload + length) {
+    lastStatus[sender] = state[14];
+  }
+}
+
+// Returns false if a sender's last ledStatus does not match its last
+// command.
+bool benchFlood(int bursts) {
+  const int kBurst = 64;
+  char topic[64];
+  snprintf(topic, sizeof(topic), "%s/ledCommand", ledClientID);
+
+  PublishQueue before = outbox;
+  uint64_t published = psClient.publishCount();
+  floodStates = 0;
+  psClient.setPublishHook(recordStatus);
+  bench::LatencyStats stats(bursts);
+  bool ok = true;
+  for (int b = 0; b < bursts; b++) {
+    char expected[kSenders];
+    uint64_t arrival = shim::nowNanos();
+    for (int i = 0; i < kBurst; i++) {
+      // each sender alternates on/off; which one it ends on varies
+      int sender = i % kSenders;
+      bool on = ((i / kSenders) + b + sender) & 1;
+      const Payload& p = payloads[2 * sender + (on ? 0 : 1)];
+      wfClient.inject(topic, (const uint8_t*)p.text, p.length, arrival);
+      expected[sender] = on ? 'n' : 'f';
+    }
+    memset(lastStatus, 0, sizeof(lastStatus));
+    uint64_t start = bench::nowNanos();
+    while (wfClient.pending() > 0 || outbox.depth() > 0) loop();
+    stats.add(bench::nowNanos() - start);
+    ok = ok && memcmp(lastStatus, expected, kSenders) == 0;
+  }
+  psClient.setPublishHook(nullptr);
+  published = psClient.publishCount() - published - floodStates;
+
+  bench::printRow("flood (per burst)", stats, 0);
+  printf("  %d commands, %llu ledStatus (%.2f/command), %llu state, "
+         "coalesced %u, dropped %u, max depth %d\n",
+         bursts * kBurst, (unsigned long long)published,
+         (double)published / (bursts * kBurst),
+         (unsigned long long)floodStates,
+         outbox.coalesced() - before.coalesced(),
+         outbox.drops() - before.drops(), outbox.highWater());
+  if (!ok) printf("  WARNING: a sender's last ledStatus is stale\n");
+  return ok;
+}
+
+uint64_t ledWriteNs;
+
+void recordLedWrite(uint8_t pin, uint8_t val, uint64_t ns) {
+  (void)val;
+  if (pin == kLedPin) ledWriteNs = ns;
+}
+
+// Returns the p99 latency in ns.
+uint32_t benchCommandLatency(long commands) {
+  char topic[64];
+  snprintf(topic, sizeof(topic), "%s/ledCommand", ledClientID);
+
+  shim::setGpioHook(recordLedWrite);
+  randomSeed(1);
+  bench::LatencyStats stats(commands);
+  // the payloads alternate on/off: start with whichever changes the LED,
+  // since a command that does not is never written to the pin
+  int first = ledNode.ledLevel == ON ? 1 : 0;
+  for (long i = 0; i < commands; i++) {
+    const Payload& p = payloads[(i + first) % (2 * kSenders)];
+    uint64_t gapNs = (1 + random(200)) * 1000000ULL + random(1000000);
+    uint64_t arrival = shim::nowNanos() + gapNs;
+    ledWriteNs = 0;
+    wfClient.inject(topic, (const uint8_t*)p.text, p.length, arrival);
+    while (ledWriteNs == 0) loop();
+    stats.add(ledWriteNs - arrival);
+  }
+  shim::setGpioHook(nullptr);
+
+  bench::printRow("cmd->gpio", stats, 0);
+  return stats.percentile(99);
+}
+
+#else
+// ---- dual-core hand-off ------------------------------------------------
+
+const int kHandoffCommands = 1000;
+uint64_t handoffArrival[kHandoffCommands];
+std::atomic<int> handoffWrites{0};
+bench::LatencyStats handoffStats(kHandoffCommands);
+bool handoffInOrder = true;
+
+// on the executor: commands reach the LED in the order they were injected
+void recordHandoff(uint8_t pin, uint8_t val, uint64_t ns) {
+  if (pin != kLedPin) return;
+  int i = handoffWrites.load();
+  if (i >= kHandoffCommands) return;
+  // the payloads alternate on/off
+  if (val != ((i & 1) ? 0 : 1)) handoffInOrder = false;
+  handoffStats.add(ns - handoffArrival[i]);
+  handoffWrites = i + 1;
+}
+
+// on the network task
+char lastReplyTopic[64];
+char lastReply[128];
+std::atomic<int> handoffReplies{0};
+
+void recordReply(const char* topic, const uint8_t* payload,
+                 unsigned int length, bool retained) {
+  if (retained) return;  // the LED's retained state
+  snprintf(lastReplyTopic, sizeof(lastReplyTopic), "%s", topic);
+  if (length >= sizeof(lastReply)) length = sizeof(lastReply) - 1;
+  memcpy(lastReply, payload, length);
+  lastReply[length] = '\0';
+  handoffReplies++;
+}
+
+bool benchHandoff() {
+  char topic[64];
+  snprintf(topic, sizeof(topic), "%s/ledCommand", ledClientID);
+  shim::setGpioHook(recordHandoff);
+  psClient.setPublishHook(recordReply);
+
+  std::atomic<bool> injected{false};
+  std::thread injector([&] {
+    uint32_t seed = 4242;
+    for (int i = 0; i < kHandoffCommands; i++) {
+      const Payload& p = payloads[i % (2 * kSenders)];
+      handoffArrival[i] = shim::nowNanos();
+      while (!wfClient.inject(topic, (const uint8_t*)p.text, p.length,
+                              handoffArrival[i])) {
+        std::this_thread::yield();
+      }
+      ledNode.networkWaker.wake();
+      seed = seed * 1103515245u + 12345u;
+      std::this_thread::sleep_for(
+          std::chrono::microseconds(1000 + (seed >> 8) % 4000));
+    }
+    injected = true;
+  });
+
+  uint64_t deadline = bench::nowNanos() + 30000000000ULL;
+  while ((!injected || handoffWrites < kHandoffCommands) &&
+         bench::nowNanos() < deadline) {
+    loop();
+  }
+  injector.join();
+  // the last reply goes out from the network task after the last write
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  shim::setGpioHook(nullptr);
+  psClient.setPublishHook(nullptr);
+
+  bench::printRow("handoff cmd->gpio", handoffStats, 0);
+
+  const Payload& last = payloads[(kHandoffCommands - 1) % (2 * kSenders)];
+  // jsonScan() works in place
+  char command[sizeof(last.text)];
+  memcpy(command, last.text, last.length);
+  JsonField fields[8];
+  int n = jsonScan(command, last.length, fields, 8);
+  char expectedTopic[64];
+  snprintf(expectedTopic, sizeof(expectedTopic), "%s/ledStatus",
+           jsonFieldString(fields, n, "senderID"));
+  n = jsonScan(lastReply, strlen(lastReply), fields, 8);
+  bool replyOk = strcmp(lastReplyTopic, expectedTopic) == 0 &&
+                 strcmp(jsonFieldString(fields, n, "ledStatus"),
+                        (kHandoffCommands - 1) & 1 ? "off" : "on") == 0;
+
+  bool ok = handoffWrites == kHandoffCommands && handoffInOrder &&
+            replyOk && handoffStats.percentile(99) < kMaxP99LatencyNs;
+  printf("  %d commands, %d reached the LED%s, %d ledStatus, last %s  %s\n",
+         kHandoffCommands, handoffWrites.load(),
+         handoffInOrder ? " in order" : " OUT OF ORDER",
+         handoffReplies.load(), replyOk ? "matches" : "STALE",
+         ok ? "ok" : "FAIL");
+  return ok;
+}
+
+// retained states seen: "pattern", then "off" once it has played out
+std::atomic<bool> patternStateSeen{false};
+std::atomic<bool> patternEndSeen{false};
+
+void recordPatternState(const char* topic, const uint8_t* payload,
+                        unsigned int length, bool retained) {
+  if (!retained || !strstr(topic, "/state")) return;
+  if (memmem(payload, length, "\"pattern\"", 9)) {
+    patternStateSeen = true;
+  } else if (patternStateSeen && memmem(payload, length, "\"off\"", 5)) {
+    patternEndSeen = true;
+  }
+}
+
+// A blink handed over to the executor, played by the timer on its side,
+// and its end reported back to the network task for the retained state.
+bool checkPatternHandoff() {
+  char topic[64];
+  snprintf(topic, sizeof(topic), "%s/ledCommand", ledClientID);
+  const char* command =
+      "{\"senderID\":\"btnNode00\",\"cmd\":\"blink\",\"period\":20,"
+      "\"duty\":50,\"count\":3}";
+  psClient.setPublishHook(recordPatternState);
+  uint64_t pwmBefore = shim::pwmWrites();
+  while (!wfClient.inject(topic, (const uint8_t*)command, strlen(command),
+                          shim::nowNanos())) {
+    std::this_thread::yield();
+  }
+  ledNode.networkWaker.wake();
+
+  uint64_t deadline = bench::nowNanos() + 5000000000ULL;
+  while (!patternEndSeen && bench::nowNanos() < deadline) {
+    loop();
+    shim::advance(5000000);
+    shim::runTimers();
+  }
+  psClient.setPublishHook(nullptr);
+  uint64_t changes = shim::pwmWrites() - pwmBefore;
+  bool ok = patternStateSeen && patternEndSeen && changes == 6;
+  printf("handoff pattern  %llu changes, state pattern -> off  %s\n",
+         (unsigned long long)changes, ok ? "ok" : "FAIL");
+  return ok;
+}
+#endif
+
+#ifndef DUAL_CORE
+// ---- broker-flap simulation -------------------------------------------
+
+const int kFlapNodes = 500;
+const uint32_t kFlapStepMs = 10;
+const uint32_t kFlapOutageMs = 30000;
+const uint32_t kFlapGiveUpMs = 60000;  // after the broker returns
+const int kFlapAcceptsPerStep = 20;
+
+struct FlapBroker {
+  bool up;
+  int acceptsLeft;  // this step
+  uint64_t attempts;
+  uint32_t attemptsThisSecond;
+  uint32_t peakPerSecond;
+};
+
+struct FlapNode {
+  FlapBroker* broker;
+  bool connected;
+  uint32_t upAt;
+};
+
+FlapBroker flapBroker;
+
+void flapStartWifi(void* context) {}
+bool flapWifiReady(void* context) { return true; }
+
+bool flapConnect(void* context) {
+  FlapNode* node = (FlapNode*)context;
+  FlapBroker* broker = node->broker;
+  broker->attempts++;
+  broker->attemptsThisSecond++;
+  if (!broker->up || broker->acceptsLeft == 0) return false;
+  broker->acceptsLeft--;
+  node->connected = true;
+  return true;
+}
+
+bool flapReady(void* context) { return ((FlapNode*)context)->connected; }
+
+// Returns the number of nodes still down kFlapGiveUpMs after the broker
+// came back.
+int benchBrokerFlap(const char* label, uint32_t baseMs, uint32_t capMs,
+                    uint32_t minMs) {
+  static FlapNode nodes[kFlapNodes];
+  static LinkManager* links[kFlapNodes];
+  static uint8_t storage[kFlapNodes][sizeof(LinkManager)];
+
+  flapBroker = {true, kFlapAcceptsPerStep, 0, 0, 0};
+  for (int i = 0; i < kFlapNodes; i++) {
+    nodes[i] = {&flapBroker, false, 0};
+    LinkHooks hooks = {flapStartWifi, flapWifiReady, nullptr,   flapConnect,
+                       flapReady,     nullptr,       nullptr,   &nodes[i]};
+    links[i] = new (storage[i]) LinkManager(hooks);
+    links[i]->backoff() = Backoff(baseMs, capMs, minMs);
+    links[i]->backoff().seed(0x9e3779b9u * (i + 1));
+  }
+
+  // bring everyone up, then pull the broker out from under them
+  uint32_t now = 0;
+  for (; now < 1000; now += kFlapStepMs) {
+    flapBroker.acceptsLeft = kFlapNodes;
+    for (int i = 0; i < kFlapNodes; i++) links[i]->tick(now);
+  }
+  flapBroker.up = false;
+  flapBroker.attempts = 0;
+  for (int i = 0; i < kFlapNodes; i++) nodes[i].connected = false;
+
+  uint32_t returnAt = now + kFlapOutageMs;
+  uint32_t endAt = returnAt + kFlapGiveUpMs;
+  int down = kFlapNodes;
+  for (; now < endAt && down > 0; now += kFlapStepMs) {
+    if (now >= returnAt) flapBroker.up = true;
+    flapBroker.acceptsLeft = kFlapAcceptsPerStep;
+    for (int i = 0; i < kFlapNodes; i++) {
+      bool wasUp = nodes[i].connected;
+      links[i]->tick(now);
+      if (!wasUp && nodes[i].connected) {
+        nodes[i].upAt = now;
+        down--;
+      }
+    }
+    if (now % 1000 == 0) {
+      if (flapBroker.attemptsThisSecond > flapBroker.peakPerSecond)
+        flapBroker.peakPerSecond = flapBroker.attemptsThisSecond;
+      flapBroker.attemptsThisSecond = 0;
+    }
+  }
+
+  bench::LatencyStats stats(kFlapNodes);  // in ms, not ns
+  for (int i = 0; i < kFlapNodes; i++) {
+    if (nodes[i].connected) stats.add(nodes[i].upAt - returnAt);
+  }
+  printf("%-24s %5d nodes, back after (ms) min %u p50 %u p99 %u max %u, "
+         "peak %u attempts/s, %llu attempts\n",
+         label, kFlapNodes, stats.percentile(0),
+         stats.percentile(50),
+         stats.percentile(99),
+         stats.percentile(100),
+         flapBroker.peakPerSecond, (unsigned long long)flapBroker.attempts);
+  for (int i = 0; i < kFlapNodes; i++) links[i]->~LinkManager();
+  return down;
+}
+
+// ---- boot time ---------------------------------------------------------
+
+const uint32_t kScanMs = 2200;   // active scan of all 13 channels
+const uint32_t kAssocMs = 250;   // auth + assoc + WPA handshake
+const uint32_t kDhcpMs = 900;    // DHCP discover/offer/request/ack
+const uint32_t kFailMs = 300;    // no beacon on the cached channel
+const uint32_t kMaxWarmBootMs = 1000;
+const uint32_t kMaxBootMs = 60000;  // give up on a boot after this
+
+// Boots the node in a child process and returns the phase times, in us
+// since reset (0 = never reached). apChannel is the access point's
+// channel for this boot.
+bool bootOnce(const char* nvsFile, uint8_t apChannel,
+              uint32_t micros[BOOT_PHASES]) {
+  int fds[2];
+  if (pipe(fds) != 0) return false;
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid < 0) return false;
+  if (pid == 0) {
+    close(fds[0]);
+    shim::setSerialEcho(false);
+    shim::setNvsFile(nvsFile);
+    shim::WifiModel& model = shim::wifiModel();
+    model.channel = apChannel;
+    model.scanMs = kScanMs;
+    model.assocMs = kAssocMs;
+    model.dhcpMs = kDhcpMs;
+    model.failMs = kFailMs;
+
+    // a button node's command is already waiting at the broker
+    char topic[64];
+    snprintf(topic, sizeof(topic), "%s/ledCommand", ledClientID);
+    wfClient.inject(topic, (const uint8_t*)payloads[0].text,
+                    payloads[0].length, 0);
+
+    setup();
+    uint32_t giveUp = millis() + kMaxBootMs;
+    while (psClient.publishCount() == 0 && (int32_t)(millis() - giveUp) < 0)
+      loop();
+
+    uint32_t times[BOOT_PHASES];
+    for (int i = 0; i < BOOT_PHASES; i++) times[i] = bootMicros((BootPhase)i);
+    ssize_t written = write(fds[1], times, sizeof(times));
+    _exit(written == sizeof(times) ? 0 : 1);
+  }
+  close(fds[1]);
+  ssize_t got = read(fds[0], micros, sizeof(uint32_t) * BOOT_PHASES);
+  close(fds[0]);
+  int status;
+  waitpid(pid, &status, 0);
+  return got == (ssize_t)(sizeof(uint32_t) * BOOT_PHASES) &&
+         WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// Returns ms from setup() to the first publish, or UINT32_MAX.
+uint32_t benchBoot(const char* label, const char* nvsFile,
+                   uint8_t apChannel) {
+  uint32_t us[BOOT_PHASES];
+  if (!bootOnce(nvsFile, apChannel, us) || us[BOOT_FIRST_MESSAGE] == 0) {
+    printf("%-24s boot failed\n", label);
+    return UINT32_MAX;
+  }
+  uint32_t start = us[BOOT_SETUP];
+  uint32_t firstMs = (us[BOOT_FIRST_MESSAGE] - start) / 1000;
+  printf("%-24s wifi up %5u ms, mqtt up %5u ms, first publish %5u ms\n",
+         label, (us[BOOT_WIFI_UP] - start) / 1000,
+         (us[BOOT_MQTT_UP] - start) / 1000, firstMs);
+  return firstMs;
+}
+
+// Returns false if any boot failed or the warm boots were too slow.
+bool benchBoots() {
+  char nvsFile[] = "/tmp/ledbench-nvs-XXXXXX";
+  int fd = mkstemp(nvsFile);
+  if (fd < 0) return false;
+  close(fd);
+
+  uint32_t cold = benchBoot("boot-cold", nvsFile, 6);
+  uint32_t warm = benchBoot("boot-warm", nvsFile, 6);
+  uint32_t stale = benchBoot("boot-stale-cache", nvsFile, 11);
+  uint32_t rewarm = benchBoot("boot-warm-again", nvsFile, 11);
+  unlink(nvsFile);
+
+  return cold != UINT32_MAX && stale != UINT32_MAX &&
+         warm < kMaxWarmBootMs && rewarm < kMaxWarmBootMs;
+}
+#endif
+
+}  // namespace
+
+#ifdef DUAL_CORE
+int main(int argc, char** argv) {
+  shim::setSerialEcho(false);
+  buildPayloads();
+  setup();
+  // the network task connects; loop() is the GPIO executor
+  while (!psClient.connected()) loop();
+
+  bench::printHeader();
+  bool ok = benchHandoff();
+  ok = checkPatternHandoff() && ok;
+  shim::setSerialEcho(true);
+  ledNode.report_tasks();
+  // the network task never returns: leave without running destructors
+  // under it
+  fflush(stdout);
+  _exit(ok ? 0 : 1);
+}
+#else
+int main(int argc, char** argv) {
+  long messages = argc > 1 ? atol(argv[1]) : 1000000;
+
+  shim::setSerialEcho(false);
+  buildPayloads();
+  // before this process runs setup() itself: the boots run in children
+  bool bootsOk = benchBoots();
+
+  setup();
+  // setup() only starts connecting; loop() finishes the job
+  while (!psClient.connected()) loop();
+
+  bench::printHeader();
+  uint64_t allocs = benchLedCommand("ledCommand", payloads, messages);
+  allocs += benchLedCommand("ledCommand-msgpack", msgpackPayloads, messages);
+  allocs += benchLedCommand("ledCommand-traced", tracedPayloads, messages,
+                            true);
+  allocs += benchLogging(messages);
+  bool drainOk = checkLogDrain();
+  bool echoOk = checkEcho("json", false, true);
+  echoOk = checkEcho("msgpack", true, true) && echoOk;
+  echoOk = checkEcho("json", false, false) && echoOk;
+  bool retainedOk = checkRetainedState();
+  retainedOk = checkUnanswered() && retainedOk;
+  bool patternsOk = checkPatterns();
+  bool channelsOk = checkChannels();
+  bool groupsOk = checkGroups();
+  bool metricsOk = checkMetrics(messages);
+  bool dedupOk = checkDuplicates();
+  bool windowOk = benchWindows(messages);
+  allocs += benchChannels("set-per-channel", false, messages / 8);
+  allocs += benchChannels("set-batched", true, messages / 8);
+  benchParse(messages);
+  benchEncode(messages);
+  bool floodOk = benchFlood(messages / 1000 > 100 ? messages / 1000 : 100);
+  uint32_t p99 = benchCommandLatency(messages / 100 > 1000 ? messages / 100
+                                                            : 1000);
+  int stranded = benchBrokerFlap("flap-jittered", 500, 16000, 1000);
+  // the old reconnect(): retry every 5 s, all in step (for comparison)
+  benchBrokerFlap("flap-fixed-5s", 0, 0, 5000);
+
+  // the ledCommand path, callback entry through psClient.publish(), must
+  // run entirely out of static memory
+  if (allocs != 0) {
+    printf("FAIL: ledCommand path made %llu heap allocations\n",
+           (unsigned long long)allocs);
+    return 1;
+  }
+  if (!drainOk) {
+    printf("FAIL: a log line longer than a drain takes held up the log\n");
+    return 1;
+  }
+  if (!echoOk) {
+    printf("FAIL: ledStatus did not echo seq/ts exactly\n");
+    return 1;
+  }
+  if (!retainedOk) {
+    printf("FAIL: retained state, last will or an unanswered command not "
+           "as expected\n");
+    return 1;
+  }
+  if (!patternsOk) {
+    printf("FAIL: a pattern did not play as commanded\n");
+    return 1;
+  }
+  if (!channelsOk) {
+    printf("FAIL: a set command did not drive the channels as commanded\n");
+    return 1;
+  }
+  if (!groupsOk) {
+    printf("FAIL: group commands not answered as expected\n");
+    return 1;
+  }
+  if (!metricsOk) {
+    printf("FAIL: metrics miscounted, or collecting them costs %.0f%% "
+           "(%.0f%% timed) or more of a command\n",
+           kMaxMetricsShare * 100, kMaxMetricsTimedShare * 100);
+    return 1;
+  }
+  if (!dedupOk) {
+    printf("FAIL: a repeated or out-of-order command was not dropped\n");
+    return 1;
+  }
+  if (!windowOk) {
+    printf("FAIL: the command window refused a new command, or its lookups "
+           "got %.0fx slower or more from 8 senders to 512\n",
+           kMaxWindowGrowth);
+    return 1;
+  }
+  if (!floodOk) {
+    printf("FAIL: flood left a sender with a stale ledStatus\n");
+    return 1;
+  }
+  if (p99 >= kMaxP99LatencyNs) {
+    printf("FAIL: p99 command-to-GPIO latency %u ns\n", p99);
+    return 1;
+  }
+  if (!bootsOk) {
+    printf("FAIL: a boot failed, or a warm boot took %u ms or more\n",
+           kMaxWarmBootMs);
+    return 1;
+  }
+  if (stranded != 0) {
+    printf("FAIL: %d simulated nodes never reconnected\n", stranded);
+    return 1;
+  }
+  return 0;
+}
+#endif
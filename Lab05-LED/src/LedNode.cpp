@@ -36,6 +36,25 @@
  *           actual Client ID of the sender is extracted from the message and
  *           used to send an ledStatus message back to the sender (see below).
  *  Payload: {"senderID":"btnNodeXX","cmd":"on" | "off"}
+ *           optionally with "seq" and "ts" (unsigned integers) for
+ *           round-trip tracing; they are echoed in the ledStatus reply.
+ *           A sender's seqs must rise by one per command (from any
+ *           start): a command with a seq it has already used, or below
+ *           one since carried out, is dropped unanswered (note 13).
+ *           Patterns, played by the node itself until the next command
+ *           (times in ms, brightness 0-255, count 0 = for ever):
+ *           {"senderID":..,"cmd":"blink","period":1000,"duty":50,
+ *            "count":0,"level":255}   (duty in % of period; defaults shown)
+ *           {"senderID":..,"cmd":"fade","from":0,"to":255,"ms":1000}
+ *            (from defaults to the current brightness)
+ *           {"senderID":..,"cmd":"seq","steps":"255:200,0:200,~255:1000",
+ *            "count":1}   (brightness:ms steps; '~' ramps to it)
+ *           Several output channels at once (LED_CHANNEL_PINS, channel 0
+ *           is the LED), by bitmask and/or channel:brightness pairs:
+ *           {"senderID":..,"cmd":"set","on":5,"off":2,"levels":"3:128,7:0"}
+ *
+ *    Topic: ledGroup/<name>/ledCommand, for each group in LED_GROUPS
+ *    Usage: The same commands, for every node in the group at once.
  *
  * MQTT messages this node can send:
  * ------------------------------------
@@ -44,7 +63,37 @@
  *           that sent the ledCommand message (btnNodeXX). Note that this
  *           program extracts the sender's Client ID from the ledCommand message
  *           (see above) to ensure that only the sender gets the status message.
- *  Payload: {"ledStatus":"on" | "off", "msg":"some message text"}
+ *  Payload: {"ledStatus":"on" | "off" | "pattern", "msg":"some message text"}
+ *           plus "seq" and "ts" exactly as the ledCommand carried them.
+ *           A set command's reply also has every channel's brightness:
+ *           "channels":"255,0,255,128,0,0,0,0".
+ *           A group command's reply comes up to GROUP_REPLY_SPREAD_MS
+ *           later, with the state then, "channels" (with more than one)
+ *           and "node":"ledNodeXX"; one per node for the last group
+ *           command in that time.
+ *
+ *    Topic: ledNodeXX/state (retained)
+ *    Usage: The LED's current status, for any node that wants it without
+ *           sending a command. Published when the LED changes and whenever
+ *           the broker connection comes up; the broker keeps the last one
+ *           and hands it to every new subscriber straight away.
+ *  Payload: {"ledStatus":"on" | "off" | "pattern", "channels":"255,0,.."}
+ *           ("pattern" while one plays; then on or off as it ends;
+ *           "channels" only with more than one channel)
+ *
+ *    Topic: ledNodeXX/availability (retained, with LED_LAST_WILL)
+ *    Usage: "online" once connected. The node registers "offline" here as
+ *           its MQTT last will, so the broker publishes that if the node
+ *           disappears without disconnecting.
+ *  Payload: online | offline
+ *
+ *    Topic: ledNodeXX/metrics
+ *    Usage: The node's health, every METRICS_INTERVAL_MS (see note 12)
+ *  Payload: {"up":s,"ms":60000,"in":{"cmd":n,"grp":n},
+ *            "out":{"status":n,"state":n,"avail":n},"bad":n,"conn":n,
+ *            "loops":n,"loopMax":us,"loopAvg":us,
+ *            "outbox":{"depth":n,"high":n,"drops":n},"heap":bytes,
+ *            "heapMin":bytes,"block":bytes,"rssi":dBm}
  *
  * This program also displays status messages on a serial monitor (115200N81).
  *
@@ -55,37 +104,127 @@
  * DEVELOPER NOTES:
  * This program uses the public domain PubSubClient library to perform MQTT
  * messaging functions, and all message payloads are encoded in JSON format.
- *  1. Default message size, including header, is only 128 bytes (rather small).
- *  2. Increase/decrease by changing MQTT_MAX_PACKET_SIZE inside PubSubClient.h.
+ *  1. Default message size, including header, is only 256 bytes (rather small).
+ *  2. Increase/decrease by changing mqttBufferSize in LedNode.h; setup()
+ *     applies it at runtime with psClient.setBufferSize().
  *  3. Recommended size is 512 bytes.
+ *  4. ledCommand payloads are parsed in place in PubSubClient's buffer (see
+ *     JsonScan.h), and payloads over MAX_CMD_PAYLOAD bytes are dropped
+ *     unparsed.
+ *  5. ledCommand payloads may also be MessagePack (a map with the same
+ *     keys) for compact, high-rate links. The format is detected from the
+ *     first byte, and the ledStatus reply goes back in the same format;
+ *     MessagePack replies omit the "msg" text. See MsgPackScan.h.
+ *  6. With DUAL_CORE (LedNode.h) the network runs in a FreeRTOS task on
+ *     core 0 and loop() on core 1 only drives the LED: set_led() hands
+ *     each command over through an SpscQueue, and the executor reports
+ *     back through another before the ledStatus is sent. CPU time per
+ *     task and queue latency are printed every TASK_STATS_INTERVAL_MS.
+ *
+ *  7. All of the node's state lives in a LedNode object (LedNode.h) with
+ *     its own client ID, and setup()/loop() below run the one the sketch
+ *     needs. The fleet simulator (../Lab05-FLEET) runs hundreds of them in
+ *     one process.
+ *  8. A command for the state the LED is already in is still answered
+ *     (the sender is waiting for its reply, and may be timing it), but
+ *     the pin is not written and the retained state is not republished.
+ *  9. blink/fade/seq commands are played by a hardware timer interrupt
+ *     (PATTERN_TIMER, one tick every PATTERN_TICK_US) stepping a
+ *     LedPattern and setting the LED's PWM duty, so one message replaces
+ *     one per change and the timing does not depend on the network. The
+ *     LED stays on LEDC until the next on/off command. The core 2.x timer
+ *     API passes the interrupt no context, so only one LedNode per
+ *     program can play patterns: the first to be sent one claims the
+ *     timer, and any other refuses them (the fleet simulator's nodes
+ *     do). The interrupt handler, LedPattern::tick() and ledcWrite() are
+ *     in flash, not IRAM.
+ * 10. The set command changes any number of channels with one message,
+ *     one parse, one pass over the pins and one reply, where per-LED
+ *     messages cost a broker round trip, a parse and a reply each. Only
+ *     channels whose brightness changes are written. 0 and 255 are plain
+ *     GPIO writes; anything between puts the channel on LEDC PWM.
+ * 11. Group topics let one publish command many nodes. Every node would
+ *     otherwise answer the sender at the same moment; instead each waits
+ *     its own fixed share of GROUP_REPLY_SPREAD_MS and answers the last
+ *     group command once, so the sender and the broker see the replies
+ *     spread evenly over the window.
+ * 12. The metrics message lets a sluggish node be spotted from the broker
+ *     rather than the serial console. Collecting costs a counter
+ *     increment per message and two micros() calls per network_pass();
+ *     the text is built only when it is published, straight from the
+ *     timer (it is larger than an outbox slot). in counts commands
+ *     handled per topic, out messages queued per topic, bad payloads
+ *     too large or unparseable, conn broker connection attempts, and
+ *     loops the passes of network_pass() (the network task's, with
+ *     DUAL_CORE), with their longest and mean time. outbox is the
+ *     publish queue: the messages waiting now, and the most that have
+ *     waited and the number dropped since boot, so a queue filling up is
+ *     seen before its drops are. See NodeMetrics.h.
+ * 13. Ahead of QoS 1, which may deliver a command twice or late, each
+ *     command with a seq is checked against its sender's entry in
+ *     commandWindow as soon as it is parsed. Only a seq newer than any
+ *     carried out from that sender goes on to the LED and a reply, and
+ *     it is recorded only once carried out (a set or pattern refused, an
+ *     unknown cmd or, with DUAL_CORE, a full executor queue leave the
+ *     window as it was, so a redelivery is tried afresh); the
+ *     window also remembers the 32 below the newest to tell duplicates
+ *     from stale commands in its counters. The table is fixed at
+ *     CMD_WINDOW_SENDERS entries with a bounded probe, so a lookup costs
+ *     the same with 5 senders or 200. See CommandWindow.h.
  *
  ******************************************************************************/
 // included configuration file and support libraries
-#include <ArduinoJson.h>   // MQTT payloads are in JSON format
+#include <BootTimeline.h>  // when each boot stage was reached
 #include <Esp.h>           // Esp32 support
-#include <PubSubClient.h>  // MQTT client
-#include <WiFi.h>          // wi-fi support
-#include "LedNode.h"  // this project's .h file
+#include <JsonScan.h>      // in-place parsing of incoming payloads
+#include <MsgPackScan.h>   // in-place parsing of MessagePack payloads
+#include <atomic>          // the pattern timer's owner, read by its interrupt
+#include "LedNode.h"  // this project's .h file (and the LedNode class)
+
+#ifndef NATIVE_FLEET  // the fleet simulator creates its own nodes
+// this sketch's one LED node
+LedNode ledNode(LED_CLIENT_ID);
 
-WiFiClient wfClient;              // create a wifi client
-PubSubClient psClient(wfClient);  // create a pub-sub object (must be
-                                  // associated with a wifi client)
+void setup() { ledNode.setup(); }
 
-// char buffer to store incoming/outgoing messages
-char json_msgBuffer[200];
+void loop() { ledNode.loop(); }
+#endif
 
-// buffer to store sprintf formatted strings for printing
-char sbuf[80];
+// the node whose pattern the timer interrupt plays, once one has claimed
+// the timer (see note 9)
+static std::atomic<LedNode*> patternNode{nullptr};
 
-/* Prototype functions */
-void connect_wifi();
-void reconnect();
-void register_myself();
-void processMQTTMessage(char* topic, byte* json_payload, unsigned int length);
-void sendLedStatusMessage(String senderID, String ledStatus,
-                          String ledStatusMessage);
+// names of the topics in the metrics message (LedNode::MetricIn/Out)
+static const char* const metricsIn[LedNode::METRIC_IN_TOPICS] = {"cmd",
+                                                                 "grp"};
+static const char* const metricsOut[LedNode::METRIC_OUT_TOPICS] = {
+    "status", "state", "avail"};
 
-void setup() {
+static void pattern_tick() {
+  LedNode* node = patternNode.load(std::memory_order_acquire);
+  if (node && node->pattern.tick()) {
+    ledcWrite(LEDC_FIRST_CHANNEL, node->pattern.duty());
+  }
+}
+
+LedNode::LedNode(const char* clientID, const char* groups)
+    : psClient(wfClient),
+      statusDoc(&statusArena),
+      topicRouter(this),
+      netLink(LinkHooks{call<void, &LedNode::start_wifi>,
+                        call<bool, &LedNode::wifi_ready>,
+                        call<void, &LedNode::report_wifi>,
+                        call<bool, &LedNode::connect_mqtt>,
+                        call<bool, &LedNode::mqtt_ready>,
+                        call<void, &LedNode::link_up>,
+                        call<void, &LedNode::link_down>, this}),
+      metrics(metricsIn, METRIC_IN_TOPICS, metricsOut, METRIC_OUT_TOPICS) {
+  snprintf(ledClientID, sizeof(ledClientID), "%s", clientID);
+  snprintf(ledGroups, sizeof(ledGroups), "%s", groups);
+}
+
+void LedNode::setup() {
+  bootMark(BOOT_SETUP);
   Serial.begin(115200);
   while (!Serial) {
     // wait for serial connection
@@ -93,97 +232,208 @@ void setup() {
   }
   Serial.println("Serial ready!");
 
-  // setup Wifi connection
+  // in an attempt to remove the annoying garbled text on
+  // startup, print a couple of blank lines
+  Serial.println();
+  Serial.println();
   Serial.print("\nSetting up network for IP => ");
   Serial.println(mqttBroker);
-  connect_wifi();
 
-  // initialize port pin and turn off LED
-  pinMode(LED, OUTPUT);
-  digitalWrite(LED, OFF);
+  // initialize the output pins and turn off every LED
+  for (int channel = 0; channel < ledChannelCount; channel++) {
+    pinMode(ledChannelPins[channel], OUTPUT);
+    digitalWrite(ledChannelPins[channel], LOW);
+  }
+  note_channels(channelLevels, 0);
 
   // specify MQTT broker's domain name (or IP address) and port number
   psClient.setServer(mqttBroker, mqttPort);
 
-  // Specify callback function to process messages from broker
-  psClient.setCallback(processMQTTMessage);
-
-  // connect to MQTT broker
-  if (!psClient.connected()) {
-    Serial.println(
-        "In Setup and appear to have lost connection...reconnecting");
-    reconnect();
+  // size the client's packet buffer (largest message in or out)
+  if (!psClient.setBufferSize(mqttBufferSize)) {
+    Serial.println("Could not allocate MQTT buffer, keeping default size");
   }
 
+  // Specify callback function to process messages from broker, and the
+  // topics it routes to handlers
+  psClient.setCallback([this](char* topic, byte* payload,
+                               unsigned int length) {
+    processMQTTMessage(topic, payload, length);
+  });
+  build_routes();
+
+  // start connecting to WiFi and then the MQTT broker. This carries on in
+  // the background: loop() calls netLink.tick(), which never blocks. Seed
+  // the retry jitter from the hardware RNG so nodes spread out.
+  netLink.backoff().seed(random(1, 0x7fffffff));
+  netLink.tick(millis());
+
   // finally, flash the on-board LED five times to let user know
-  // that the NodeMCU board has been initialized and ready to go
+  // that the NodeMCU board has been initialized. The flashes are run by
+  // timers from loop(), so they no longer hold up the first message.
   pinMode(LED_BUILTIN, OUTPUT);
-  for (int i = 0; i < 5; i++) {
-    digitalWrite(LED_BUILTIN, 0);  // active low
-    delay(200);
-    digitalWrite(LED_BUILTIN, 1);
-    delay(150);
-  }
-  Serial.println("Network initialization complete");
+  blinkStepsLeft = 10;
+  blink_step();
+
+  // report the node's health every METRICS_INTERVAL_MS
+  metrics.reset(millis());
+  timers.schedule(millis(), METRICS_INTERVAL_MS,
+                  call<void, &LedNode::publish_metrics>, this,
+                  METRICS_INTERVAL_MS);
+
+#ifdef DUAL_CORE
+  // hand the network over to its own task on core 0 (timers included);
+  // loop() keeps core 1 for the LED
+  executorTask = xTaskGetCurrentTaskHandle();
+  timers.schedule(millis(), TASK_STATS_INTERVAL_MS,
+                  call<void, &LedNode::report_tasks>, this,
+                  TASK_STATS_INTERVAL_MS);
+  xTaskCreatePinnedToCore(network_task, "network", NETWORK_TASK_STACK, this,
+                          NETWORK_TASK_PRIORITY, &networkTask,
+                          NETWORK_TASK_CORE);
+#endif
+  Serial.println("Setup complete, connecting in the background");
 }
 
-void loop() {
+void LedNode::loop() {
+#ifdef DUAL_CORE
+  // core 1: carry out the LED commands the network task hands over
+  run_led_actions();
+#else
+  // nothing left to do after a pass: yield the CPU until a packet
+  // arrives, the next timer is due or the link needs attention
+  waitForWork(wfClient, network_pass());
+#endif
+}
+
+uint32_t LedNode::network_pass() {
   // This is largely a reactive program, and as such only uses
-  // the main loop to maintain the MQTT broker connection and
-  // periodically call the psClient.loop() code to ensure the
-  // client stays active
+  // the main loop to maintain the MQTT broker connection, service the
+  // psClient as soon as messages arrive, and run timers. There is no
+  // fixed delay(): the caller only sleeps, for as long as this returns,
+  // when there is nothing to do.
+  uint32_t passStart = micros();
+
+  // keep the WiFi/MQTT link up (or bring it back); returns immediately
+  netLink.tick(millis());
+
+  // service the MQTT client as soon as data is waiting. psClient.loop()
+  // handles at most one packet per call (and keeps the connection alive),
+  // so drain whatever has arrived, up to MAX_PACKETS_PER_LOOP so timers
+  // still get a turn during a flood
+  if (netLink.isUp()) {
+    int packets = 0;
+    do {
+      psClient.loop();
+    } while (wfClient.available() > 0 && ++packets < MAX_PACKETS_PER_LOOP);
+  }
+
+#ifdef DUAL_CORE
+  // queue the ledStatus for commands the executor has carried out
+  collect_led_reports();
+#else
+  // a pattern that has played out: publish where it left the LED
+  uint8_t endDuty;
+  if (pattern_ended(&endDuty)) {
+    note_channels(&endDuty, 1);
+    publish_state(ledLevel);
+  }
+#endif
 
-  // reconnect to MQTT server if connection lost
-  if (!psClient.connected()) {
-    Serial.print("psClient.connected() returns => ");  // Debugging
-    Serial.println(psClient.connected());              // Debugging
-    Serial.println(
-        "In Loop and appear to have lost connection...reconnecting");  // Debugging
-    reconnect();
+  if (netLink.isUp()) {
+    // send queued ledStatus replies, up to the per-pass budget
+    if (outbox.drain(psClient, PUBLISH_BUDGET_MESSAGES, PUBLISH_BUDGET_BYTES) >
+            0 &&
+        bootMark(BOOT_FIRST_MESSAGE)) {
+      // time from reset to the first ledStatus, printed once
+      bootReport(Serial);
+    }
   }
 
-  delay(1000);      // TBD changed from 10ms.
-  psClient.loop();  // call periodically to keep client alive and well
+  // run any timers whose deadline has passed; these keep running while
+  // the link is down
+  timers.runDue(millis());
+
+  // how long the caller may sleep: until the next timer is due or the
+  // link needs attention (whichever comes first)
+  uint32_t idleMs = timers.msUntilNext(millis());
+  if (outbox.depth() > 0 && netLink.isUp()) idleMs = 0;  // more to send
+  uint32_t linkMs = netLink.msUntilNextAction(millis());
+  if (linkMs < idleMs) idleMs = linkMs;
+  if (idleMs > IDLE_MAX_WAIT_MS) idleMs = IDLE_MAX_WAIT_MS;
+
+  // nothing else to do: print what has been logged, as much as the UART
+  // takes without blocking, and come back soon if some is left
+  if (idleMs > 0) logDrain(Serial, Serial.availableForWrite());
+  if (logQueued() > 0 && idleMs > LOG_DRAIN_INTERVAL_MS) {
+    idleMs = LOG_DRAIN_INTERVAL_MS;
+  }
+  metrics.loopTime(micros() - passStart);
+  return idleMs;
 }
 
 /**********************************************************
  * Helper functions
  *********************************************************/
-void connect_wifi() {
-  // in an attempt to remove the annoying garbled text on
-  // startup, print a couple of blank lines (with delay)
-  Serial.println();
-  delay(100);
-  Serial.println();
-  delay(100);
-
-  // attempt to connect to the WiFi network
-  Serial.print("Connecting to ");
-  Serial.print(ssid);
-  Serial.print(" network");
-  delay(10);
-#ifdef LIPSCOMB
-  WiFi.begin(ssid);  // Lipscomb WiFi does NOT require a password
-#elif defined(ETHERNET)
-  WiFi.begin(ssid);
-#else
-  WiFi.begin(ssid, password);  // For WiFi networks that DO require a password
+void LedNode::start_wifi() {
+  // start associating with the WiFi network; netLink.tick() polls
+  // wifi_ready() until it is up (or times out and calls this again)
+  bootMark(BOOT_WIFI_START);
+  WiFi.disconnect();
+#ifdef FAST_BOOT
+  // try the channel, BSSID and IP that worked last time first: no scan
+  // and no DHCP
+  wifiFromCache = wifiCacheLoad(wifiCache, ssid);
 #endif
+  LOG_INFO("Connecting to %s network%s", ssid,
+           wifiFromCache ? " (cached settings)" : "");
+  begin_wifi(wifiFromCache ? &wifiCache : nullptr);
+}
 
-  // advance a "dot-dot-dot" indicator until connected to WiFi network
-  while (WiFi.status() != WL_CONNECTED) {
-    delay(300);
-    Serial.print(".");
+void LedNode::begin_wifi(const WifiCache* cache) {
+  // with a cache: static IP and straight to the known AP; without: DHCP
+  // and a full scan
+  wifiCacheApply(cache);
+  const int32_t channel = cache ? cache->channel : 0;
+  const uint8_t* bssid = cache ? cache->bssid : nullptr;
+  wifiStartedAt = millis();
+  // password is nullptr for an open network (Lipscomb's)
+  WiFi.begin(ssid, password, channel, bssid);
+}
+
+bool LedNode::wifi_ready() {
+  wl_status_t status = WiFi.status();
+  if (status == WL_CONNECTED) return true;
+
+  // the cached AP is gone (moved channel, replaced, out of range):
+  // forget it and fall back to a full scan with DHCP
+  if (wifiFromCache &&
+      (status == WL_NO_SSID_AVAIL ||
+       millis() - wifiStartedAt >= FAST_BOOT_WIFI_TIMEOUT_MS)) {
+    LOG_WARN("Cached WiFi settings failed, scanning");
+    wifiFromCache = false;
+    wifiCacheClear();
+    WiFi.disconnect();
+    begin_wifi(nullptr);
   }
+  return false;
+}
+
+void LedNode::report_wifi() {
+  bootMark(BOOT_WIFI_UP);
+#ifdef FAST_BOOT
+  // remember this connection for the next boot (writes flash only if
+  // something changed)
+  wifiCacheStore(ssid);
+#endif
 
   // report to console that WiFi is connected and print IP address
-  Serial.print("MAC address = ");
-  Serial.print(WiFi.macAddress());
-  Serial.print(", connected as ");
-  Serial.println(WiFi.localIP());
+  LOG_INFO("MAC address = %s, connected as %s", WiFi.macAddress().c_str(),
+           WiFi.localIP().toString().c_str());
 }
 
-void processMQTTMessage(char* topic, byte* json_payload, unsigned int length) {
+void LedNode::processMQTTMessage(char* topic, byte* json_payload,
+                                 unsigned int length) {
   // This code is called whenever a message previously registered for is
   // RECEIVED from the broker. Incoming messages are selected by topic,
   // then the payload is parsed and appropriate action taken. (NB: If only
@@ -193,117 +443,717 @@ void processMQTTMessage(char* topic, byte* json_payload, unsigned int length) {
   // For info on sending MQTT messages inside the callback handler, see
   // https://github.com/bblanchon/ArduinoJson/wiki/Memory-model.
   //
-  // NB: for guidance on creating proper jsonBuffer size for the json object
-  // tree, see https://github.com/bblanchon/ArduinoJson/wiki/Memory-model
+  // The topics this node handles, and the handler for each, are listed
+  // once in build_routes().
 
   // process messages by topic
-  sprintf(sbuf, "%s/ledCommand", ledClientID);
-  if (strcmp(topic, sbuf) == 0) {
-    // received "ledCommand" message, so parse payload into an object tree
-    // example payload: {"senderID":"btnNode14","cmd":"on"}
-
-    // create a parse tree buffer and get a pointer to the buffer's root
-    // NB: See https://github.com/bblanchon/ArduinoJson/wiki/Memory-model
-    // for guidance on selecting proper jsonBuffer size
-    JsonDocument jsonDoc;
-    auto error = deserializeJson(jsonDoc, (char*)json_payload);
-    Serial.println("Parse message packet is ...");
-    serializeJsonPretty(jsonDoc, Serial);
-
-    if (!error) {
-      // JSON name-value pairs have been parsed into the parse tree, so
-      // extract values associated with the names "senderID" and "cmd"
-      // and store values in string variables
-      String senderID = jsonDoc["senderID"];
-      String cmd = jsonDoc["cmd"];
-      Serial.println();
-      Serial.print("cmd = ");
-      Serial.println(cmd);
-
-      // take action based on the command value
-      if (cmd == cmdOn) {
-        // turn the LED on
-        digitalWrite(LED, ON);
-        Serial.println("Turning LED ON.");
-
-        // send an MQTT ledStatus message back to sending node
-        sendLedStatusMessage(senderID, "on", "I've seen the light!");
-      } else if (cmd == cmdOff) {
-        // turn the LED off
-        digitalWrite(LED, OFF);
-        Serial.println("Turning LED OFF.");
-
-        // send an MQTT ledStatus message back to sending node
-        sendLedStatusMessage(senderID, "off",
-                             "And darkness fell upon the land...");
+  if (!topicRouter.dispatch(topic, json_payload, length)) {
+    // topic was registered with broker, but no processing code in place... :(
+    LOG_WARN("Topic: \"%s\" unhandled", topic);
+  }
+}
+
+void LedNode::handleLedCommand(char* topic, byte* json_payload,
+                               unsigned int length) {
+  // received "ledCommand" message, so parse its payload
+  // example payload: {"senderID":"btnNode14","cmd":"on"}
+  bool viaGroup = strncmp(topic, GROUP_TOPIC_PREFIX,
+                          sizeof(GROUP_TOPIC_PREFIX) - 1) == 0;
+  metrics.received(viaGroup ? METRIC_IN_GROUP : METRIC_IN_COMMAND);
+
+  // no valid command is this long, so don't spend time parsing it
+  if (length > MAX_CMD_PAYLOAD) {
+    LOG_WARN("ledCommand payload too large (%u bytes)", length);
+    metrics.parseFailed();
+    return;
+  }
+
+  // commands come as JSON (MQTT-Spy, most nodes) or MessagePack (compact
+  // nodes); the reply goes back in the same format
+  bool msgpack = isMsgPack(json_payload, length);
+
+  // print the payload before it is parsed in place (which modifies it)
+  if (msgpack) {
+    LOG_DEBUG("Parse message packet is ... (%u bytes of MessagePack)", length);
+  } else {
+    LOG_DEBUG("Parse message packet is ... %.*s", (int)length,
+              (const char*)json_payload);
+  }
+
+  // parse exactly length bytes of the client's buffer; the payload is
+  // not NUL-terminated
+  JsonField fields[CMD_MAX_FIELDS];
+  int nFields =
+      msgpack ? msgpackScan(json_payload, length, fields, CMD_MAX_FIELDS)
+              : jsonScan((char*)json_payload, length, fields, CMD_MAX_FIELDS);
+
+  if (nFields >= 0) {
+    // extract values associated with the names "senderID" and "cmd".
+    // These point into PubSubClient's buffer; nothing is copied, and
+    // they are only valid until the next publish (which reuses it).
+    const char* senderID = jsonFieldString(fields, nFields, "senderID");
+    const char* cmd = jsonFieldString(fields, nFields, "cmd");
+    if (senderID == nullptr) senderID = "";
+    if (cmd == nullptr) cmd = "";
+    CommandTrace trace;
+    trace.hasSeq = jsonFieldUint(fields, nFields, "seq", &trace.seq);
+    trace.hasTs = jsonFieldUint(fields, nFields, "ts", &trace.ts);
+    trace.viaGroup = viaGroup;
+    LOG_DEBUG("cmd = %s", cmd);
+
+    // a command already carried out (redelivered) or overtaken by a newer
+    // one from the same sender: nothing to do, not even a reply
+    CommandWindow<CMD_WINDOW_SENDERS>::Ticket ticket = {};
+    if (trace.hasSeq && !commandWindow.check(senderID, trace.seq, ticket)) {
+      LOG_DEBUG("Dropped ledCommand %u from %s (repeated or out of order)",
+                (unsigned)trace.seq, senderID);
+      return;
+    }
+    // a sender that cannot be answered still has its command carried
+    // out; "" tells sendLedStatusMessage() to send no reply
+    if (senderID[0] == '\0' || strlen(senderID) >= SENDER_ID_SIZE) {
+      LOG_WARN("ledCommand senderID empty or too long, no reply");
+      senderID = "";
+    }
+
+    // take action based on the command value: set the LED, then send an
+    // MQTT ledStatus message back to sending node
+    bool done = false;
+    if (strcmp(cmd, cmdOn) == 0) {
+      done = set_led(senderID, ON, msgpack, trace);
+    } else if (strcmp(cmd, cmdOff) == 0) {
+      done = set_led(senderID, OFF, msgpack, trace);
+    } else if (strcmp(cmd, cmdSet) == 0) {
+      uint8_t duties[ledChannelCount];
+      uint32_t mask;
+      if (parse_channels(fields, nFields, duties, &mask)) {
+        done = set_channels(senderID, duties, mask, msgpack, trace);
+      } else {
+        LOG_WARN("Bad set command, no channels changed");
+      }
+    } else if (strcmp(cmd, cmdBlink) == 0 || strcmp(cmd, cmdFade) == 0 ||
+               strcmp(cmd, cmdSeq) == 0) {
+      // played from here on by the timer
+      if (parse_pattern(cmd, fields, nFields, nextPattern)) {
+        done = start_pattern(senderID, nextPattern, msgpack, trace);
       } else {
-        // print console message that an unknown command value received
-        Serial.print("Unknown command received (");
-        Serial.print(cmd);
-        Serial.println(")");
+        LOG_WARN("Bad %s command, not played", cmd);
       }
     } else {
-      // parse failed so print a console message and return to caller
-      sprintf(sbuf, "failed to parse JSON payload (topic: %s)\r\n", topic);
-      Serial.print(sbuf);
-      return;
+      // print console message that an unknown command value received
+      LOG_WARN("Unknown command received (%s)", cmd);
     }
+    // only a command carried out counts as seen: one refused, or dropped
+    // for want of room in the executor queue, is tried again when it is
+    // redelivered
+    if (done && trace.hasSeq) commandWindow.commit(ticket);
   } else {
-    // topic was registered with broker, but no processing code in place... :(
-    sprintf(sbuf, "Topic: \"%s\" unhandled\r\n", topic);
-    Serial.print(sbuf);
+    // parse failed so print a console message and return to caller
+    LOG_WARN("failed to parse JSON payload (topic: %s)", topic);
+    metrics.parseFailed();
+    return;
+  }
+}
+
+bool LedNode::set_led(const char* senderID, uint8_t level, bool msgpack,
+                      const CommandTrace& trace) {
+#ifdef DUAL_CORE
+  // hand the command to the executor on core 1; report_led() runs when it
+  // comes back done. At most LED_QUEUE_SLOTS are out at once, so there is
+  // always room for the reports. Commands that change nothing go the same
+  // way (the executor leaves the pin alone), so the replies stay in order.
+  LedAction action;
+  action.kind = LED_SET;
+  action.level = level;
+  action.changed = level != ledLevel;
+  action.msgpack = msgpack;
+  action.trace = trace;
+  snprintf(action.senderID, sizeof(action.senderID), "%s", senderID);
+  if (actionsInFlight == LED_QUEUE_SLOTS || !ledActions.push(action)) {
+    LOG_ERROR("LED command dropped, executor queue full");
+    return false;
+  }
+  uint8_t duty = level == ON ? 255 : 0;
+  note_channels(&duty, 1);  // as it will be once the executor gets to it
+  actionsInFlight++;
+  xTaskNotifyGive(executorTask);
+#else
+  if (level != ledLevel) {
+    write_led(level);
+    uint8_t duty = level == ON ? 255 : 0;
+    note_channels(&duty, 1);
+    publish_state(level);
+  }
+  report_led(senderID, level, msgpack, trace);
+#endif
+  return true;
+}
+
+bool LedNode::parse_channels(const JsonField* fields, int nFields,
+                             uint8_t* duties, uint32_t* mask) {
+  // "on"/"off" bitmasks of channels to turn fully on/off, and "levels",
+  // channel:brightness pairs; true if they name at least one channel and
+  // nothing out of range
+  const uint32_t all = ledChannelCount >= 32 ? UINT32_MAX
+                                              : (1UL << ledChannelCount) - 1;
+  uint32_t on = 0, off = 0;
+  jsonFieldUint(fields, nFields, "on", &on);
+  jsonFieldUint(fields, nFields, "off", &off);
+  if (((on | off) & ~all) != 0 || (on & off) != 0) return false;
+  *mask = on | off;
+  for (int channel = 0; channel < ledChannelCount; channel++) {
+    if (on & (1UL << channel)) duties[channel] = 255;
+    if (off & (1UL << channel)) duties[channel] = 0;
+  }
+
+  const char* levels = jsonFieldString(fields, nFields, "levels");
+  for (const char* p = levels; p && *p;) {
+    char* end;
+    unsigned long channel = strtoul(p, &end, 10);
+    if (end == p || *end != ':' || channel >= (unsigned)ledChannelCount) {
+      return false;
+    }
+    p = end + 1;
+    unsigned long duty = strtoul(p, &end, 10);
+    if (end == p || duty > 255 || (*end != ',' && *end != '\0')) {
+      return false;
+    }
+    duties[channel] = (uint8_t)duty;
+    *mask |= 1UL << channel;
+    p = *end == ',' ? end + 1 : end;
+  }
+  return *mask != 0;
+}
+
+bool LedNode::set_channels(const char* senderID, const uint8_t* duties,
+                           uint32_t mask, bool msgpack,
+                           const CommandTrace& trace) {
+  // only the channels that change are written, and only then is the
+  // retained state republished (channel 0 always changes if a pattern
+  // has it)
+  uint32_t changed = 0;
+  for (int channel = 0; channel < ledChannelCount; channel++) {
+    uint32_t bit = 1UL << channel;
+    if ((mask & bit) && (channelLevels[channel] != duties[channel] ||
+                         (channel == 0 && ledLevel == PATTERN))) {
+      changed |= bit;
+    }
+  }
+#ifdef DUAL_CORE
+  LedAction action;
+  action.kind = LED_SET_CHANNELS;
+  action.level = ledLevel;  // unused: the report reads ledLevel
+  action.changed = changed != 0;
+  action.msgpack = msgpack;
+  action.trace = trace;
+  action.mask = changed;
+  memcpy(action.duties, duties, sizeof(action.duties));
+  snprintf(action.senderID, sizeof(action.senderID), "%s", senderID);
+  if (actionsInFlight == LED_QUEUE_SLOTS || !ledActions.push(action)) {
+    LOG_ERROR("LED channels dropped, executor queue full");
+    return false;
+  }
+  // only now: had the push failed, a repeat of this command must still
+  // see the channels as they are and write them
+  if (changed) note_channels(duties, changed);
+  actionsInFlight++;
+  xTaskNotifyGive(executorTask);
+#else
+  if (changed) {
+    note_channels(duties, changed);
+    write_channels(duties, changed);
+    publish_state(ledLevel);
+  }
+  report_channels(senderID, msgpack, trace);
+#endif
+  return true;
+}
+
+void LedNode::note_channels(const uint8_t* duties, uint32_t mask) {
+  // the network side's record of the channels, and its text form
+  for (int channel = 0; channel < ledChannelCount; channel++) {
+    if (mask & (1UL << channel)) channelLevels[channel] = duties[channel];
+  }
+  if (mask & 1) {
+    uint8_t duty = channelLevels[0];
+    ledLevel = duty == 0 ? OFF : duty == 255 ? ON : DIMMED;
+  }
+  char* text = channelText;
+  for (int channel = 0; channel < ledChannelCount; channel++) {
+    text += sprintf(text, channel ? ",%u" : "%u", channelLevels[channel]);
+  }
+}
+
+void LedNode::report_channels(const char* senderID, bool msgpack,
+                              const CommandTrace& trace) {
+  LOG_INFO("LED channels now %s", channelText);
+  if (trace.viaGroup) {
+    defer_group_reply(senderID, msgpack, trace);
+    return;
+  }
+  sendLedStatusMessage(senderID, level_name(ledLevel), "Channels set!",
+                       msgpack, trace, channelText);
+}
+
+bool LedNode::parse_pattern(const char* cmd, const JsonField* fields,
+                            int nFields, LedPattern& out) {
+  // times are in ms, and a tick is PATTERN_TICK_US
+  const uint32_t ticksPerMs = 1000 / PATTERN_TICK_US;
+  uint32_t count = 0;
+  if (strcmp(cmd, cmdBlink) == 0) {
+    uint32_t period = 1000, duty = 50, level = 255;
+    jsonFieldUint(fields, nFields, "period", &period);
+    jsonFieldUint(fields, nFields, "duty", &duty);
+    jsonFieldUint(fields, nFields, "count", &count);
+    jsonFieldUint(fields, nFields, "level", &level);
+    return duty <= 100 && level <= 255 &&
+           out.blink(period * ticksPerMs, duty, count, level);
+  }
+  if (strcmp(cmd, cmdFade) == 0) {
+    // without "from" the ramp starts wherever the LED is
+    uint32_t from, to = 255, ms = 1000;
+    int start = jsonFieldUint(fields, nFields, "from", &from) ? (int)from : -1;
+    jsonFieldUint(fields, nFields, "to", &to);
+    jsonFieldUint(fields, nFields, "ms", &ms);
+    return start <= 255 && to <= 255 && out.fade(start, to, ms * ticksPerMs);
+  }
+  // seq
+  const char* steps = jsonFieldString(fields, nFields, "steps");
+  count = 1;
+  jsonFieldUint(fields, nFields, "count", &count);
+  if (steps == nullptr || !out.parseSteps(steps)) return false;
+  out.setRepeat(count);
+  return true;
+}
+
+bool LedNode::start_pattern(const char* senderID, const LedPattern& next,
+                            bool msgpack, const CommandTrace& trace) {
+  if (!claim_pattern_timer()) {
+    LOG_WARN("Pattern refused, another node has the pattern timer");
+    return false;
+  }
+  // a new pattern always starts over, even if it is the same one
+#ifdef DUAL_CORE
+  LedAction action;
+  action.kind = LED_PLAY;
+  action.level = PATTERN;
+  action.changed = true;
+  action.msgpack = msgpack;
+  action.trace = trace;
+  action.serial = patternSerial + 1;
+  action.pattern = next;
+  snprintf(action.senderID, sizeof(action.senderID), "%s", senderID);
+  if (actionsInFlight == LED_QUEUE_SLOTS || !ledActions.push(action)) {
+    LOG_ERROR("LED pattern dropped, executor queue full");
+    return false;
+  }
+  // only once the executor has it, so a dropped pattern does not leave
+  // the retained state saying "pattern"
+  patternSerial++;
+  ledLevel = PATTERN;
+  publish_state(PATTERN);
+  actionsInFlight++;
+  xTaskNotifyGive(executorTask);
+#else
+  patternSerial++;
+  ledLevel = PATTERN;
+  publish_state(PATTERN);
+  play_pattern(next);
+  report_led(senderID, PATTERN, msgpack, trace);
+#endif
+  return true;
+}
+
+void LedNode::write_led(uint8_t level) {
+  write_channel(0, level == ON ? 255 : 0);
+}
+
+void LedNode::write_channels(const uint8_t* duties, uint32_t mask) {
+  // one pass over the pins, writing those in mask
+  for (int channel = 0; channel < ledChannelCount; channel++) {
+    if (mask & (1UL << channel)) write_channel(channel, duties[channel]);
+  }
+}
+
+void LedNode::write_channel(int channel, uint8_t duty) {
+  // the LED (channel 0): take it back from a pattern first
+  if (channel == 0 && patternTicking) {
+    timerAlarmDisable(patternTimer);
+    patternTicking = false;
+  }
+  uint8_t pin = ledChannelPins[channel];
+  if (duty == 0 || duty == 255) {
+    // fully on or off: plain GPIO
+    if (channelOnPwm[channel]) {
+      ledcDetachPin(pin);
+      pinMode(pin, OUTPUT);
+      channelOnPwm[channel] = false;
+    }
+    digitalWrite(pin, duty ? HIGH : LOW);
+  } else {
+    attach_pwm(channel);
+    ledcWrite(LEDC_FIRST_CHANNEL + channel, duty);
+  }
+  channelDuty[channel] = duty;
+}
+
+void LedNode::attach_pwm(int channel) {
+  if (!channelPwmReady[channel]) {
+    ledcSetup(LEDC_FIRST_CHANNEL + channel, LED_PWM_FREQ, LED_PWM_BITS);
+    channelPwmReady[channel] = true;
+  }
+  if (!channelOnPwm[channel]) {
+    ledcAttachPin(ledChannelPins[channel], LEDC_FIRST_CHANNEL + channel);
+    channelOnPwm[channel] = true;
+  }
+}
+
+void LedNode::play_pattern(const LedPattern& next) {
+  if (patternTimer == nullptr) {
+    // 80 MHz / 80: the timer counts microseconds
+    patternTimer = timerBegin(PATTERN_TIMER, 80, true);
+    timerAttachInterrupt(patternTimer, pattern_tick, true);
+    timerAlarmWrite(patternTimer, PATTERN_TICK_US, true);
+  }
+  // the interrupt leaves the pattern alone while the timer is stopped
+  if (patternTicking) {
+    timerAlarmDisable(patternTimer);
+    channelDuty[0] = pattern.duty();
+  }
+  pattern = next;
+  pattern.start(channelDuty[0]);
+  attach_pwm(0);
+  ledcWrite(LEDC_FIRST_CHANNEL, pattern.duty());
+  timerAlarmEnable(patternTimer);
+  patternTicking = true;
+}
+
+bool LedNode::claim_pattern_timer() {
+  // true if this node has the timer, taking it if no node has yet; it is
+  // never given back (see note 9)
+  LedNode* none = nullptr;
+  return patternNode.load(std::memory_order_acquire) == this ||
+         patternNode.compare_exchange_strong(none, this,
+                                             std::memory_order_acq_rel);
+}
+
+bool LedNode::pattern_ended(uint8_t* duty) {
+  // true once, when a pattern has played out; duty is the brightness it
+  // left the LED at. The LED stays on LEDC.
+  if (!patternTicking || !pattern.finished()) return false;
+  timerAlarmDisable(patternTimer);
+  patternTicking = false;
+  channelDuty[0] = pattern.duty();
+  *duty = channelDuty[0];
+  return true;
+}
+
+void LedNode::publish_state(uint8_t level) {
+  // queue the retained state ahead of the reply, so the state topic is up
+  // to date by the time the sender hears back. A newer state replaces one
+  // still waiting in the outbox.
+  statusDoc.clear();
+  statusDoc["ledStatus"] = level_name(level);
+  if (ledChannelCount > 1) statusDoc["channels"] = channelText;
+  size_t length = serializeJson(statusDoc, json_msgBuffer);
+  if (!outbox.enqueue(stateTopic, (const uint8_t*)json_msgBuffer, length,
+                      true)) {
+    LOG_ERROR("LED state dropped, outbound queue full");
+    return;
+  }
+  metrics.sent(METRIC_OUT_STATE);
+}
+
+const char* LedNode::level_name(uint8_t level) {
+  // a dimmed LED is on, as far as the status messages go
+  return level == OFF ? "off" : level == PATTERN ? "pattern" : "on";
+}
+
+void LedNode::report_led(const char* senderID, uint8_t level, bool msgpack,
+                         const CommandTrace& trace) {
+  if (trace.viaGroup) {
+    LOG_INFO("Group command: LED %s.", level_name(level));
+    defer_group_reply(senderID, msgpack, trace);
+    return;
+  }
+  if (level == ON) {
+    LOG_INFO("Turning LED ON.");
+    sendLedStatusMessage(senderID, "on", "I've seen the light!", msgpack,
+                         trace);
+  } else if (level == PATTERN) {
+    LOG_INFO("Playing LED pattern.");
+    sendLedStatusMessage(senderID, "pattern", "Let there be blinking!",
+                         msgpack, trace);
+  } else {
+    LOG_INFO("Turning LED OFF.");
+    sendLedStatusMessage(senderID, "off", "And darkness fell upon the land...",
+                         msgpack, trace);
+  }
+}
+
+void LedNode::defer_group_reply(const char* senderID, bool msgpack,
+                                const CommandTrace& trace) {
+  // keep the sender and trace (they are in PubSubClient's buffer) for
+  // send_group_reply(); one already waiting is replaced, not repeated,
+  // unless this sender cannot be answered
+  if (senderID[0] == '\0') return;
+  snprintf(groupReplySender, sizeof(groupReplySender), "%s", senderID);
+  groupReplyMsgpack = msgpack;
+  groupReplyTrace = trace;
+  if (groupReplyTimer == 0) {
+    groupReplyTimer =
+        timers.schedule(millis(), groupReplyDelayMs,
+                        call<void, &LedNode::send_group_reply>, this);
+    if (groupReplyTimer == 0) send_group_reply();  // no timer free: now
+  }
+}
+
+void LedNode::send_group_reply() {
+  // the state now, which covers every group command since the first
+  groupReplyTimer = 0;
+  sendLedStatusMessage(groupReplySender, level_name(ledLevel),
+                       "Group command done!", groupReplyMsgpack,
+                       groupReplyTrace,
+                       ledChannelCount > 1 ? channelText : nullptr);
+}
+
+void LedNode::sendLedStatusMessage(const char* senderID,
+                                   const char* ledStatus,
+                                   const char* ledStatusMessage, bool msgpack,
+                                   const CommandTrace& trace,
+                                   const char* channels) {
+  // handleLedCommand() has made an unanswerable senderID (empty, or too
+  // long for replySender) "": an empty topic is a protocol error the
+  // broker disconnects for
+  if (senderID[0] == '\0') return;
+
+  // fill the reusable status document with message data. The msg text is
+  // for people watching in MQTT-Spy, so compact (MessagePack) replies
+  // leave it out.
+  statusDoc.clear();
+  statusDoc["ledStatus"] = ledStatus;
+  if (!msgpack) statusDoc["msg"] = ledStatusMessage;
+  if (channels) statusDoc["channels"] = channels;
+  if (trace.viaGroup) statusDoc["node"] = ledClientID;
+  if (trace.hasSeq) statusDoc["seq"] = trace.seq;
+  if (trace.hasTs) statusDoc["ts"] = trace.ts;
+
+  // the reply topic only needs building when the sender changes. This
+  // also copies senderID out of PubSubClient's buffer before publish()
+  // overwrites it.
+  if (replyTopic.empty() || strcmp(senderID, replySender) != 0) {
+    snprintf(replySender, sizeof(replySender), "%s", senderID);
+    if (!replyTopic.set(replySender, TOPIC_LED_STATUS)) return;
+  }
+
+  // queue the message; loop() sends it. Replaces a status for the same
+  // sender that has not gone out yet.
+  size_t length = msgpack ? serializeMsgPack(statusDoc, json_msgBuffer)
+                          : serializeJson(statusDoc, json_msgBuffer);
+  if (!outbox.enqueue(replyTopic, (const uint8_t*)json_msgBuffer, length)) {
+    LOG_ERROR("ledStatus dropped, outbound queue full");
+    return;
   }
+  metrics.sent(METRIC_OUT_STATUS);
 }
 
-void sendLedStatusMessage(String senderID, String ledStatus,
-                          String ledStatusMessage) {
-  // create a parse tree buffer and point to the root of the buffer
-  JsonDocument root;
+void LedNode::build_routes() {
+  // list every topic this node handles, once; register_myself()
+  // subscribes from this table and processMQTTMessage() dispatches
+  // through it
+  topicRouter.clear();
+  TopicName<TOPIC_SIZE(TOPIC_LED_COMMAND)> commandTopic;
+  commandTopic.set(ledClientID, TOPIC_LED_COMMAND);
+  topicRouter.add(commandTopic, route<&LedNode::handleLedCommand>);
 
-  // fill tree with message data
-  root["ledStatus"] = ledStatus;
-  root["msg"] = ledStatusMessage;
+  // each group's command topic goes to the same handler, which tells
+  // them apart by the prefix
+  TopicName<sizeof(GROUP_TOPIC_PREFIX) + LED_GROUPS_SIZE +
+            sizeof(TOPIC_LED_COMMAND)>
+      groupTopic;
+  for (const char* name = ledGroups; *name;) {
+    size_t length = strcspn(name, ",");
+    if (length > 0) {
+      if (!groupTopic.set(GROUP_TOPIC_PREFIX, name, length,
+                          TOPIC_LED_COMMAND) ||
+          !topicRouter.add(groupTopic, route<&LedNode::handleLedCommand>)) {
+        LOG_ERROR("Cannot route group %.*s", (int)length, name);
+      }
+    }
+    name += length;
+    if (*name == ',') name++;
+  }
 
-  // Send message
-  serializeJson(root, json_msgBuffer);
-  String msgTopic = senderID + "/ledStatus";
-  const char* msg = msgTopic.c_str();  // put into char array form (zero copy!!)
-  psClient.publish(msg, json_msgBuffer);
+  // this node's share of the group reply window: fixed, and spread
+  // evenly over the fleet by hashing the client ID (FNV-1a)
+  uint32_t hash = 2166136261u;
+  for (const char* c = ledClientID; *c; c++) {
+    hash = (hash ^ (uint8_t)*c) * 16777619u;
+  }
+  groupReplyDelayMs = GROUP_REPLY_SPREAD_MS ? hash % GROUP_REPLY_SPREAD_MS
+                                            : 0;
+
+  // and the retained topics it keeps up to date
+  stateTopic.set(ledClientID, TOPIC_STATE);
+  availabilityTopic.set(ledClientID, TOPIC_AVAILABILITY);
+  metricsTopic.set(ledClientID, TOPIC_METRICS);
 }
 
-void register_myself() {
+void LedNode::register_myself() {
   // register with MQTT broker for topics of interest to this node
-  Serial.print("Registering for topics...");
-  sprintf(sbuf, "%s/ledCommand", ledClientID);
-  psClient.subscribe(sbuf);
-  Serial.println(" done");
-}
-
-void reconnect() {
-  // Loop until the pub-sub client connects to the MQTT broker
-  while (!psClient.connected()) {
-    // attempt to connect to MQTT broker
-    Serial.print("Connecting to MQTT broker (");
-    Serial.print(mqttBroker);
-    Serial.print(") as ");
-    Serial.print(ledClientID);
-    Serial.print("...");
-    if (psClient.connect(ledClientID.c_str())) {
-      Serial.println(" connected");
-      // clientID MUST BE UNIQUE for all connected clients
-      // can also include username, password if broker requires it
-      // (e.g. psClient.connect(clientID, username, password)
-
-      // once connected, register for topics of interest
-      register_myself();
-      sprintf(sbuf, "MQTT initialization complete\r\nReady!\r\n\r\n");
-      Serial.print(sbuf);
-    } else {
-      // reconnect failed so print a console message, wait, and try again
-      Serial.println(" failed.");
-      Serial.println("Trying again in 5 sec. (Is processor whitelisted?)");
-      // wait 5 seconds before retrying
-      delay(5000);
+  topicRouter.subscribeAll(psClient);
+  LOG_INFO("Registered for topics");
+}
+
+bool LedNode::connect_mqtt() {
+  // make ONE attempt to connect to the MQTT broker; on failure
+  // netLink.tick() waits out a jittered, growing backoff and calls again
+  // clientID MUST BE UNIQUE for all connected clients
+  // can also include username, password if broker requires it
+  // (e.g. psClient.connect(clientID, username, password)
+  metrics.connectAttempt();
+#ifdef LED_LAST_WILL
+  // if the connection dies without a DISCONNECT, the broker publishes
+  // (and keeps) "offline" on our availability topic
+  bool connected =
+      psClient.connect(ledClientID, availabilityTopic, 0, true, "offline");
+#else
+  bool connected = psClient.connect(ledClientID);
+#endif
+  if (connected) {
+    LOG_INFO("Connected to MQTT broker (%s) as %s", mqttBroker, ledClientID);
+    return true;
+  }
+  LOG_WARN("Connecting to MQTT broker (%s) as %s failed. "
+           "(Is processor whitelisted?)",
+           mqttBroker, ledClientID);
+  return false;
+}
+
+bool LedNode::mqtt_ready() { return psClient.connected(); }
+
+void LedNode::link_up() {
+  // once connected, register for topics of interest
+  register_myself();
+  // and bring the retained topics up to date (the LED may have changed
+  // while the link was down, and the will may have fired)
+#ifdef LED_LAST_WILL
+  if (outbox.enqueue(availabilityTopic, "online", true)) {
+    metrics.sent(METRIC_OUT_AVAILABILITY);
+  }
+#endif
+  publish_state(ledLevel);
+  bootMark(BOOT_MQTT_UP);
+  LOG_INFO("MQTT initialization complete");
+  LOG_INFO("Ready!");
+}
+
+void LedNode::link_down() {
+  LOG_WARN("Lost connection to MQTT broker...reconnecting");
+}
+
+void LedNode::publish_metrics() {
+  // Keep counting while the link is down; the next message covers it.
+  // Published here rather than queued: it is larger than an outbox slot.
+  if (!netLink.isUp()) return;
+  metrics.outbox(outbox.depth(), outbox.highWater(), outbox.drops());
+  size_t length = metrics.format(metricsBuffer, sizeof(metricsBuffer),
+                                 millis());
+  if (length == 0 ||
+      !psClient.publish(metricsTopic, (const uint8_t*)metricsBuffer,
+                        length)) {
+    LOG_WARN("Metrics not published");
+    return;
+  }
+  // start the next interval
+  metrics.reset(millis());
+}
+
+void LedNode::blink_step() {
+  // one half of a boot flash: on for 200 ms, off for 150 ms
+  bool lit = blinkStepsLeft % 2 == 0;
+  digitalWrite(LED_BUILTIN, lit ? 0 : 1);  // active low
+  if (--blinkStepsLeft > 0) {
+    timers.schedule(millis(), lit ? 200 : 150,
+                    call<void, &LedNode::blink_step>, this);
+  }
+}
+
+#ifdef DUAL_CORE
+void LedNode::network_task(void* node) {
+  // core 0: the network side of loop(), waking for a packet, a timer, the
+  // link, or the executor reporting back (through networkWaker)
+  LedNode* self = (LedNode*)node;
+  for (;;) {
+    self->networkClock.start();
+    if (self->networkWaker.fd() < 0) {
+      self->networkWaker.begin();  // once the stack is up
+    }
+    uint32_t idleMs = self->network_pass();
+    self->networkClock.stop();
+    waitForWork(self->wfClient, idleMs, &self->networkWaker);
+  }
+}
+
+void LedNode::run_led_actions() {
+  // sleep until the network task hands over a command
+  ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(EXECUTOR_MAX_WAIT_MS));
+  executorClock.start();
+  LedAction action;
+  bool done = false;
+  // a pattern that has played out; it goes back ahead of the commands
+  // that follow it, and playingSerial tells the network task which one
+  if (ledReports.depth() < LED_QUEUE_SLOTS &&
+      pattern_ended(&action.duties[0])) {
+    action.kind = LED_PATTERN_DONE;
+    action.serial = playingSerial;
+    done = ledReports.push(action);
+  }
+  while (ledActions.pop(action)) {
+    if (action.kind == LED_PLAY) {
+      play_pattern(action.pattern);
+      playingSerial = action.serial;
+    } else if (action.kind == LED_SET_CHANNELS) {
+      write_channels(action.duties, action.mask);
+    } else if (action.changed) {
+      write_led(action.level);
+    }
+    ledReports.push(action);
+    done = true;
+  }
+  if (done) networkWaker.wake();
+  executorClock.stop();
+}
+
+void LedNode::collect_led_reports() {
+  LedAction action;
+  while (ledReports.pop(action)) {
+    if (action.kind == LED_PATTERN_DONE) {
+      // unless a newer command has taken over since
+      if (ledLevel == PATTERN && action.serial == patternSerial) {
+        note_channels(action.duties, 1);
+        publish_state(ledLevel);
+      }
+      continue;
     }
+    actionsInFlight--;
+    if (action.kind == LED_SET_CHANNELS) {
+      if (action.changed) publish_state(ledLevel);
+      report_channels(action.senderID, action.msgpack, action.trace);
+      continue;
+    }
+    if (action.kind == LED_SET && action.changed) {
+      publish_state(action.level);
+    }
+    report_led(action.senderID, action.level, action.msgpack, action.trace);
   }
-}
\ No newline at end of file
+}
+
+void LedNode::report_tasks() {
+  Serial.println("Task CPU time and hand-off latency:");
+  networkClock.report(Serial);
+  executorClock.report(Serial);
+  ledActions.report(Serial, "ledActions");
+  ledReports.report(Serial, "ledReports");
+}
+#endif
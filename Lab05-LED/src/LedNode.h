@@ -1,41 +1,386 @@
 // This .h file accompanies the mqtt_ledNode.ino v2.1 program.
+#pragma once
+
+#include <NodeConfig.h>  // network, client IDs, topics, command tokens
 
 // system defines
 #define LED 21  // active high LED, needs current limiting resistor
 #define ON 1
 #define OFF 0
+#define PATTERN 2  // ledLevel while a blink/fade/seq command is in charge
+#define DIMMED 3   // ledLevel when a set command left it part lit (PWM)
+
+// Output channels, by GPIO pin. Channel 0 is LED, the one the on/off and
+// pattern commands drive; the batched "set" command drives any of them,
+// fully on or off (GPIO) or at a PWM brightness (LEDC channel
+// LEDC_FIRST_CHANNEL + channel, taken when first needed). List only pins
+// wired to an LED; at most 16 (LEDC's channels) and 32 (the bitmasks).
+// setup() makes every one an output. The lab board wires LED alone; add
+// more with a build flag, e.g. '-DLED_CHANNEL_PINS=LED,19,18' (the host
+// benchmarks use eight).
+#ifndef LED_CHANNEL_PINS
+#define LED_CHANNEL_PINS LED
+#endif
+#define LEDC_FIRST_CHANNEL 0
+const uint8_t ledChannelPins[] = {LED_CHANNEL_PINS};
+const int ledChannelCount = sizeof(ledChannelPins);
+
+// LED patterns (the blink, fade and seq commands, see LedPattern.h) are
+// played by a hardware timer interrupt every PATTERN_TICK_US, which sets
+// the LED's brightness through channel 0's LEDC channel. The timing comes
+// from the timer alone, so it does not drift or jitter with the network.
+#define PATTERN_TIMER 0       // hardware timer (0-3)
+#define PATTERN_TICK_US 1000  // one step of a pattern: 1 ms
+#define LED_PWM_FREQ 5000     // Hz, for every channel on PWM
+#define LED_PWM_BITS 8        // duty 0-255
+
+// main loop tuning
+#define MAX_PACKETS_PER_LOOP 8      // MQTT packets handled before timers run
+#define IDLE_MAX_WAIT_MS 100        // longest single sleep when idle
+#define PUBLISH_BUDGET_MESSAGES 4   // queued messages sent per loop() pass
+#define PUBLISH_BUDGET_BYTES 1024   // ...and at most this many payload bytes
+#define LOG_DRAIN_INTERVAL_MS 5     // longest sleep while log lines wait
+
+// Console logging. Messages go into a ring (NodeLog) and reach Serial only
+// when loop() is idle, so printing never holds up a reply. Levels above
+// LOG_LEVEL are compiled out: LOG_LEVEL_NONE, _ERROR, _WARN, _INFO (the
+// LED on/off and connection messages) or _DEBUG (adds every payload).
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+// FreeRTOS dual-core mode: WiFi, MQTT, parsing and replies run in their
+// own task on core 0 (next to the WiFi stack), and loop() on core 1 only
+// carries out LED commands, handed over through lock-free queues. A slow
+// broker or a reconnect then never holds up a GPIO action. Uncomment to
+// enable; the native_dualcore env defines it for the host build.
+// #define DUAL_CORE
+#define NETWORK_TASK_CORE 0
+#define NETWORK_TASK_STACK 8192       // bytes
+#define NETWORK_TASK_PRIORITY 1       // same as loop()
+#define LED_QUEUE_SLOTS 8             // LED commands in flight between tasks
+#define EXECUTOR_MAX_WAIT_MS 100      // longest loop() sleep between checks
+#define TASK_STATS_INTERVAL_MS 60000  // CPU/queue counters printed this often
+
+// The network, broker, client IDs, topics and command tokens are in
+// NodeConfig.h (Lab05-Common), shared with the other node: set them with
+// build flags (NODE_NETWORK, LED_CLIENT_ID, BUTTON_CLIENT_ID).
+
+// fast boot: reconnect with the WiFi channel, BSSID and IP saved in NVS
+// after the last good connection, falling back to a full scan and DHCP
+// if they stop working. Comment out to always scan.
+#define FAST_BOOT
+
+// PubSubClient packet buffer size in bytes (header + topic + payload).
+// Applied at runtime in setup() with psClient.setBufferSize().
+const int mqttBufferSize = 512;
+
+// ledCommand payloads longer than this are rejected without parsing
+#define MAX_CMD_PAYLOAD 192  // room for a seq command's steps
+#define CMD_MAX_FIELDS 10
+// A command is answered on <senderID>/ledStatus; one whose senderID is
+// empty or this long or longer is carried out but not answered (cut
+// short, the topic would be another client's)
+#define SENDER_ID_SIZE 48
+
+// The LED's state is also published, retained, on <ledClientID>/state
+// ({"ledStatus":"on" | "off"}) whenever it changes and each time the
+// broker connection comes up, so a button node learns it as soon as it
+// subscribes. With LED_LAST_WILL the node also keeps a retained "online"
+// on <ledClientID>/availability, which the broker replaces with
+// "offline" (the last will) if the node drops off without saying so.
+// Comment out to connect without a will.
+#define LED_LAST_WILL
+
+// Groups: besides <ledClientID>/ledCommand the node takes the same
+// commands on ledGroup/<name>/ledCommand for each name in LED_GROUPS
+// (comma separated; the fleet simulator gives its nodes their own), so
+// one publish switches every node in a group. Replies to group commands
+// are held back by a delay between 0 and GROUP_REPLY_SPREAD_MS that is
+// fixed per node (from its client ID), and a group command arriving
+// while one is waiting replaces it, so a group answers its sender spread
+// out over that window and at most once per node per window.
+#define LED_GROUPS "all"
+#define LED_GROUPS_SIZE 64       // longest LED_GROUPS + 1
+#define GROUP_REPLY_SPREAD_MS 500
+
+// Commands that carry a seq are checked against the newest one from
+// their sender (see CommandWindow.h): a repeat (a QoS 1 redelivery) or one
+// overtaken by a newer command is dropped before it touches the LED or
+// sends anything. CMD_WINDOW_SENDERS entries track the senders (a power
+// of two, 16 bytes each; keep it twice the senders expected), the least
+// recently heard from making way when they run out.
+#define CMD_WINDOW_SENDERS 512
+
+// Health metrics (see NodeMetrics.h): messages in and out per topic, parse
+// failures, broker connection attempts, network_pass() times, heap and
+// RSSI, published to <ledClientID>/metrics this often and then counted
+// afresh.
+#define METRICS_INTERVAL_MS 60000
+
+// Bytes reserved for the ledStatus JSON document.
+#define JSON_ARENA_SIZE 3072
+/**********************************************************
+ * The node itself
+ *********************************************************/
+#include <ArduinoJson.h>    // MQTT payloads are in JSON format
+#include <CommandWindow.h>  // drops repeated/out-of-order commands
+#include <EventLoop.h>      // sleep until a packet or timer is due
+#include <JsonArena.h>      // fixed-size memory for the JSON documents
+#include <JsonScan.h>       // in-place parsing of incoming payloads
+#include <LedPattern.h>     // blink/fade/seq patterns, run by a timer
+#include <LinkManager.h>    // non-blocking WiFi/MQTT (re)connection
+#include <NodeLog.h>        // console output, printed when idle
+#include <NodeMetrics.h>    // health counters, published now and then
+#include <PublishQueue.h>   // outgoing messages, sent from loop()
+#include <PubSubClient.h>   // MQTT client
+#include <TopicRouter.h>    // topic -> handler table
+#include <TimerQueue.h>     // deadline-ordered timers run from loop()
+#include <WiFi.h>           // wi-fi support
+#include <WifiCache.h>      // last good WiFi channel/BSSID/IP (NVS)
+#ifdef DUAL_CORE
+#include <SpscQueue.h>  // lock-free hand-off between the two tasks
+#include <TaskClock.h>  // CPU time per task
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#endif
+
+// Round-trip tracing fields a ledCommand may carry: the sender's sequence
+// number and send time (in its own clock), returned untouched in the
+// ledStatus so the sender can measure the round trip. viaGroup marks a
+// command that came on a group topic; its reply is deferred and names
+// the node.
+struct CommandTrace {
+  bool hasSeq;
+  uint32_t seq;
+  bool hasTs;
+  uint32_t ts;
+  bool viaGroup;
+};
+
+#ifdef DUAL_CORE
+// An LED command on its way from the network task to the executor
+// (loop(), core 1), and back again once done so the network task can
+// send the ledStatus. Carries its own copy of the sender ID, since the
+// one in PubSubClient's buffer is gone by then.
+enum LedActionKind {
+  LED_SET,           // network -> executor: set the LED to level
+  LED_PLAY,          // network -> executor: play pattern
+  LED_SET_CHANNELS,  // network -> executor: set the channels in mask
+  LED_PATTERN_DONE,  // executor -> network: pattern serial ended at duties[0]
+};
+struct LedAction {
+  uint8_t kind;  // LedActionKind
+  uint8_t level;
+  bool changed;  // false: the LED is already at level, leave it
+  bool msgpack;
+  CommandTrace trace;
+  uint32_t serial;     // which pattern (LED_PLAY, LED_PATTERN_DONE)
+  LedPattern pattern;  // LED_PLAY only
+  uint32_t mask;       // LED_SET_CHANNELS: the channels to set...
+  uint8_t duties[ledChannelCount];  // ...to these (also the pattern's end)
+  char senderID[SENDER_ID_SIZE];
+};
+#endif
+
+// Everything one LED node owns: its client ID, connection, buffers and
+// timers. The sketch runs one (ledNode, in LedNode.cpp); the fleet
+// simulator runs hundreds in one process. The state is public so the
+// benchmarks and the simulator can inspect it.
+class LedNode {
+ public:
+  // groups: comma-separated group names (see LED_GROUPS)
+  explicit LedNode(const char* clientID, const char* groups = LED_GROUPS);
+
+  void setup();  // called from the sketch's setup()
+  void loop();   // called from the sketch's loop()
 
-// uncomment for Lipscomb broker, comment out for "brokerX"
-// #define LIPSCOMB
-#define ETHERNET
-// #define HUTTONHOME
-
-// Network and MQTT broker credentials
-#ifdef LIPSCOMB
-const char* mqttBroker = "10.51.97.101";  // ECE mosquitto server (wlan0)
-const char* ssid = "LipscombGuest";  // no PW needed for Lipscomb guest wifi
-#elif defined(ETHERNET)
-const char* mqttBroker = "10.200.97.100";  // Wired ECE mosquitto server (eth0)
-const char* ssid = "LipscombGuest";        // same as straight WiFi
-#elif defined(HUTTONHOME)
-const char* mqttBroker = "192.168.0.251";  // address of brokerX
-const char* ssid = "HuttonWireless2-4G";   // ssid of brokerX's network
-const char* password = "Testing01";        // password for brokerX's network
-#else
-const char* mqttBroker = "1.1.1.1";
-const char* ssid = "";
-const char* password = "password";  // password for brokerX's network
+  // The network side of loop(), without the wait: returns how long the
+  // caller may sleep (ms) before calling again, unless wfClient has data.
+  uint32_t network_pass();
+
+  // the metrics message timer
+  void publish_metrics();
+
+#ifdef DUAL_CORE
+  void report_tasks();
 #endif
 
-int mqttPort = 1883;
+  // the topics metrics counts messages on (their names are in LedNode.cpp)
+  enum MetricIn { METRIC_IN_COMMAND, METRIC_IN_GROUP, METRIC_IN_TOPICS };
+  enum MetricOut {
+    METRIC_OUT_STATUS,
+    METRIC_OUT_STATE,
+    METRIC_OUT_AVAILABILITY,
+    METRIC_OUT_TOPICS
+  };
+
+  char ledClientID[CLIENT_ID_SIZE];
+  char ledGroups[LED_GROUPS_SIZE];
+
+  WiFiClient wfClient;   // create a wifi client
+  PubSubClient psClient;  // create a pub-sub object (must be
+                          // associated with a wifi client)
+
+  // char buffer to store incoming/outgoing messages
+  char json_msgBuffer[200];
+
+  // JSON document for outgoing ledStatus messages. It is reused for every
+  // message and takes its memory from a fixed arena rather than the heap,
+  // so the path from the MQTT callback to psClient.publish() does not
+  // allocate (see JsonArena.h). Incoming commands are parsed in place.
+  JsonArena<JSON_ARENA_SIZE> statusArena;
+  JsonDocument statusDoc;
+
+  // topics this node subscribes to, and the function that handles each
+  TopicRouter topicRouter;
+
+  // the newest seq each sender's commands have reached
+  CommandWindow<CMD_WINDOW_SENDERS> commandWindow;
+
+  // work scheduled for later, run from loop() when due
+  TimerQueue timers;
+
+  // WiFi settings saved after the last good connection (fast boot), and
+  // whether the current attempt is using them
+  WifiCache wifiCache;
+  bool wifiFromCache = false;
+  uint32_t wifiStartedAt = 0;
+
+  // on-board LED flashes still to go after reset (run from timers)
+  int blinkStepsLeft = 0;
+
+  // ledStatus replies waiting to be sent. The callback queues them and
+  // loop() publishes them; a newer status for the same sender replaces one
+  // still waiting, so a burst of commands gets one reply with the final
+  // state.
+  PublishQueue outbox;
 
-// Client ID of this LED controller
-String buttonClientID = "btnNodeXX";  // Change XX to your two-digit ID
+  // the reply to the last group command, while it waits out this node's
+  // share of GROUP_REPLY_SPREAD_MS (groupReplyTimer is 0 when none is)
+  uint32_t groupReplyDelayMs = 0;
+  uint16_t groupReplyTimer = 0;
+  char groupReplySender[SENDER_ID_SIZE];
+  bool groupReplyMsgpack = false;
+  CommandTrace groupReplyTrace;
 
-// ID of the remote LED node
-String ledClientID = "ledNodeXX";  // Change XX to your two-digit ID
-compileErrorHere();                // Remove this when Node names fixed.
+  // ledStatus reply topic, rebuilt only when the sender changes (it is
+  // empty until the first reply)
+  char replySender[SENDER_ID_SIZE] = "";
+  TopicName<sizeof(replySender) - 1 + sizeof(TOPIC_LED_STATUS)> replyTopic;
+
+  // the LED level last commanded (ON/OFF, PATTERN or DIMMED); a command
+  // that asks for it again is answered without touching the pin or the
+  // retained state
+  uint8_t ledLevel = OFF;
+
+  // every channel's brightness as last commanded (channel 0 too, unless
+  // a pattern is playing), and the same as text for the status messages
+  uint8_t channelLevels[ledChannelCount] = {};
+  char channelText[4 * ledChannelCount];
+
+  // the pattern the LED is playing, or last played. Only the task that
+  // drives the LED (loop(), the executor with DUAL_CORE) touches these,
+  // and the timer interrupt ticks the pattern.
+  LedPattern pattern;
+  hw_timer_t* patternTimer = nullptr;  // set up by the first pattern
+  bool patternTicking = false;  // the timer is running pattern
+  uint32_t patternSerial = 0;   // patterns started (network side)
+  // a pattern command parsed, before it is handed over (network side; too
+  // big to be comfortable on the callback's stack)
+  LedPattern nextPattern;
+
+  // what each channel's pin is doing (the LED-driving task only)
+  uint8_t channelDuty[ledChannelCount] = {};  // brightness, 0-255
+  bool channelOnPwm[ledChannelCount] = {};    // driven by LEDC, not GPIO
+  bool channelPwmReady[ledChannelCount] = {}; // its LEDC channel is set up
+
+  // retained state and availability topics (see LED_LAST_WILL)
+  TopicName<TOPIC_SIZE(TOPIC_STATE)> stateTopic;
+  TopicName<TOPIC_SIZE(TOPIC_AVAILABILITY)> availabilityTopic;
+
+  // brings WiFi and the broker connection up, and back up, without blocking
+  LinkManager netLink;
+
+  // health counters, and where they go every METRICS_INTERVAL_MS
+  NodeMetrics metrics;
+  TopicName<TOPIC_SIZE(TOPIC_METRICS)> metricsTopic;
+  char metricsBuffer[METRICS_PAYLOAD_SIZE];
+
+#ifdef DUAL_CORE
+  SpscQueue<LedAction, LED_QUEUE_SLOTS> ledActions;  // network -> executor
+  // executor -> network: the reports, and room for as many pattern ends
+  SpscQueue<LedAction, 2 * LED_QUEUE_SLOTS> ledReports;
+  uint32_t actionsInFlight = 0;  // handed over, not yet reported back
+  uint32_t playingSerial = 0;    // the pattern the executor is playing
+  TaskHandle_t networkTask = nullptr;
+  TaskHandle_t executorTask = nullptr;
+  LoopWaker networkWaker;  // lets the executor wake the network's select()
+  TaskClock networkClock{"network"};
+  TaskClock executorClock{"executor"};
+#endif
+
+ private:
+  void start_wifi();
+  void begin_wifi(const WifiCache* cache);
+  bool wifi_ready();
+  void report_wifi();
+  bool connect_mqtt();
+  bool mqtt_ready();
+  void link_up();
+  void link_down();
+  void blink_step();
+  void register_myself();
+  void build_routes();
+  void processMQTTMessage(char* topic, byte* json_payload,
+                          unsigned int length);
+  void handleLedCommand(char* topic, byte* json_payload, unsigned int length);
+  void sendLedStatusMessage(const char* senderID, const char* ledStatus,
+                            const char* ledStatusMessage, bool msgpack,
+                            const CommandTrace& trace,
+                            const char* channels = nullptr);
+  bool set_led(const char* senderID, uint8_t level, bool msgpack,
+               const CommandTrace& trace);
+  void report_led(const char* senderID, uint8_t level, bool msgpack,
+                  const CommandTrace& trace);
+  void publish_state(uint8_t level);
+  void defer_group_reply(const char* senderID, bool msgpack,
+                         const CommandTrace& trace);
+  void send_group_reply();
+  static const char* level_name(uint8_t level);
+  bool parse_pattern(const char* cmd, const JsonField* fields, int nFields,
+                     LedPattern& out);
+  bool start_pattern(const char* senderID, const LedPattern& next,
+                     bool msgpack, const CommandTrace& trace);
+  bool parse_channels(const JsonField* fields, int nFields, uint8_t* duties,
+                      uint32_t* mask);
+  bool set_channels(const char* senderID, const uint8_t* duties,
+                    uint32_t mask, bool msgpack, const CommandTrace& trace);
+  void note_channels(const uint8_t* duties, uint32_t mask);
+  void report_channels(const char* senderID, bool msgpack,
+                       const CommandTrace& trace);
+  void write_channels(const uint8_t* duties, uint32_t mask);
+  void write_channel(int channel, uint8_t duty);
+  void attach_pwm(int channel);
+  void write_led(uint8_t level);
+  void play_pattern(const LedPattern& next);
+  bool claim_pattern_timer();
+  bool pattern_ended(uint8_t* duty);
+#ifdef DUAL_CORE
+  static void network_task(void* node);
+  void run_led_actions();
+  void collect_led_reports();
+#endif
 
-// Commands
-String cmdOn = "on";
-String cmdOff = "off";
\ No newline at end of file
+  // LinkManager, TimerQueue and TopicRouter call plain functions with a
+  // context pointer; these pass the call on to the node it points at
+  template <typename R, R (LedNode::*method)()>
+  static R call(void* node) {
+    return (((LedNode*)node)->*method)();
+  }
+  template <void (LedNode::*handler)(char*, byte*, unsigned int)>
+  static void route(void* node, char* topic, uint8_t* payload,
+                    unsigned int length) {
+    (((LedNode*)node)->*handler)(topic, payload, length);
+  }
+};
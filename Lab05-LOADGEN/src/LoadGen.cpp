@@ -0,0 +1,553 @@
+/*******************************************************************************
+ * LoadGen.cpp -- ledCommand load generator and soak test for an LED node
+ *
+ *   pio run -e native && .pio/build/native/program [options]
+ *
+ * Connects to an MQTT broker (a local mosquitto, say) as a set of
+ * simulated button nodes, drives <node>/ledCommand at a configurable rate
+ * and burst shape, and listens on each sender's <sender>/ledStatus for the
+ * node's replies. Run the node itself on the same machine with the LED
+ * project's [env:native_live] build to soak-test the whole pipeline:
+ *
+ *   mosquitto -p 1883 &
+ *   (cd ../Lab05-LED && pio run -e native_live &&
+ *    .pio/build/native_live/program localhost) &
+ *   .pio/build/native/program --rate 2000 --duration 60
+ *
+ * Every command carries the round-trip tracing fields the LED node echoes
+ * back ("seq", per sender, and "ts", the send time in microseconds), so
+ * each reply tells which command it answers and how long the trip took.
+ * Each sender numbers its commands from a random start, as a button node
+ * does, so the node's duplicate filter (CommandWindow.h) does not take a
+ * second run's commands for repeats of the first's.
+ * The LED node may fold several queued replies to one sender into the
+ * newest (see PublishQueue.h), so a command without its own reply is
+ * counted as:
+ *   superseded  a later command from the same sender was answered: the
+ *               node acted on it and reported the newer state instead
+ *   lost        nothing from that sender was answered after it by the end
+ *               of the drain period
+ * Replies with a lower seq than one already seen from that sender are
+ * counted as reordered, repeats as duplicates.
+ *
+ * Shapes: steady (evenly spaced), burst (--burst commands back to back,
+ * spaced to keep the average rate) and ramp (the rate rising linearly
+ * from --rate to --ramp-to over the run, to find where the node falls
+ * behind). A progress line per --report-every seconds shows the rate
+ * reached, the replies and the commands still unanswered.
+ *
+ * Exits 0, or 1 if the broker cannot be reached, or 2 if the run exceeds
+ * --max-loss (percent of commands lost) or --max-p99 (ms).
+ ******************************************************************************/
+#include <Arduino.h>
+#include <EventLoop.h>
+#include <JsonScan.h>
+#include <LatencyHistogram.h>
+#include <MsgPackScan.h>
+#include <NativeShim.h>
+#include <PubSubClient.h>
+#include <WiFi.h>
+#include <getopt.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "LoadGen.h"
+
+namespace {
+
+enum Shape { SHAPE_STEADY, SHAPE_BURST, SHAPE_RAMP };
+
+struct Options {
+  char broker[128] = LOADGEN_BROKER;
+  uint16_t port = LOADGEN_PORT;
+  char node[CLIENT_ID_SIZE] = LOADGEN_NODE;
+  int senders = LOADGEN_SENDERS;
+  double rate = LOADGEN_RATE;
+  double rampTo = 0;
+  Shape shape = SHAPE_STEADY;
+  int burst = LOADGEN_BURST;
+  unsigned size = 0;  // payload bytes; 0 = no padding
+  bool msgpack = false;
+  double duration = LOADGEN_DURATION_S;
+  double drain = LOADGEN_DRAIN_S;
+  double reportEvery = LOADGEN_REPORT_S;
+  double maxLoss = -1;  // percent; < 0 = no limit
+  double maxP99 = -1;   // ms
+};
+
+// What one simulated button node sent and got back.
+struct Sender {
+  char id[CLIENT_ID_SIZE];
+  TopicName<TOPIC_SIZE(TOPIC_LED_STATUS)> statusTopic;
+  uint32_t seqBase = 0;        // command n carries seq seqBase + n
+  uint32_t sent = 0;           // n of the last command (from 1)
+  uint32_t highestReply = 0;   // highest seq answered so far
+  std::vector<bool> answered;  // by seq
+};
+
+Options options;
+WiFiClient wfClient;
+PubSubClient psClient(wfClient);
+std::vector<Sender> senders;
+TopicName<TOPIC_SIZE(TOPIC_LED_COMMAND)> commandTopic;
+char padding[LOADGEN_BUFFER_SIZE];
+
+// whole run, and the current progress interval
+LatencyHistogram rtt;
+LatencyHistogram intervalRtt;
+uint64_t commandsSent = 0;
+uint64_t repliesTimed = 0;
+uint64_t reordered = 0;
+uint64_t duplicates = 0;
+uint64_t unknownReplies = 0;
+uint64_t sendFailures = 0;
+uint64_t intervalSent = 0;
+uint64_t intervalReplies = 0;
+
+void usage() {
+  printf(
+      "usage: program [options]\n"
+      "  --broker HOST[:PORT]  MQTT broker (%s:%d)\n"
+      "  --node ID             LED node's client id (%s)\n"
+      "  --senders N           simulated button nodes, round robin (%d)\n"
+      "  --rate R              commands per second (%d)\n"
+      "  --shape S             steady, burst or ramp (steady)\n"
+      "  --burst N             commands per burst (%d)\n"
+      "  --ramp-to R           final rate for --shape ramp (2 x --rate)\n"
+      "  --size BYTES          pad each command payload to BYTES (the\n"
+      "                        node ignores any over MAX_CMD_PAYLOAD)\n"
+      "  --msgpack             send MessagePack commands\n"
+      "  --duration S          seconds of sending (%d)\n"
+      "  --drain S             seconds to wait for late replies (%d)\n"
+      "  --report-every S      progress line interval (%d)\n"
+      "  --max-loss PCT        exit 2 if more commands are lost\n"
+      "  --max-p99 MS          exit 2 if the p99 round trip is longer\n",
+      LOADGEN_BROKER, LOADGEN_PORT, LOADGEN_NODE, LOADGEN_SENDERS,
+      LOADGEN_RATE, LOADGEN_BURST, LOADGEN_DURATION_S, LOADGEN_DRAIN_S,
+      LOADGEN_REPORT_S);
+}
+
+bool parseOptions(int argc, char** argv) {
+  static const struct option longOptions[] = {
+      {"broker", required_argument, nullptr, 'b'},
+      {"node", required_argument, nullptr, 'n'},
+      {"senders", required_argument, nullptr, 'S'},
+      {"rate", required_argument, nullptr, 'r'},
+      {"shape", required_argument, nullptr, 's'},
+      {"burst", required_argument, nullptr, 'B'},
+      {"ramp-to", required_argument, nullptr, 'R'},
+      {"size", required_argument, nullptr, 'z'},
+      {"msgpack", no_argument, nullptr, 'm'},
+      {"duration", required_argument, nullptr, 'd'},
+      {"drain", required_argument, nullptr, 'D'},
+      {"report-every", required_argument, nullptr, 'i'},
+      {"max-loss", required_argument, nullptr, 'l'},
+      {"max-p99", required_argument, nullptr, 'p'},
+      {"help", no_argument, nullptr, 'h'},
+      {nullptr, 0, nullptr, 0}};
+
+  int c;
+  while ((c = getopt_long(argc, argv, "", longOptions, nullptr)) != -1) {
+    switch (c) {
+      case 'b': {
+        snprintf(options.broker, sizeof(options.broker), "%s", optarg);
+        char* colon = strrchr(options.broker, ':');
+        if (colon) {
+          *colon = '\0';
+          options.port = (uint16_t)atoi(colon + 1);
+        }
+        break;
+      }
+      case 'n':
+        snprintf(options.node, sizeof(options.node), "%s", optarg);
+        break;
+      case 'S':
+        options.senders = atoi(optarg);
+        break;
+      case 'r':
+        options.rate = atof(optarg);
+        break;
+      case 's':
+        if (strcmp(optarg, "steady") == 0) {
+          options.shape = SHAPE_STEADY;
+        } else if (strcmp(optarg, "burst") == 0) {
+          options.shape = SHAPE_BURST;
+        } else if (strcmp(optarg, "ramp") == 0) {
+          options.shape = SHAPE_RAMP;
+        } else {
+          printf("unknown shape: %s\n", optarg);
+          return false;
+        }
+        break;
+      case 'B':
+        options.burst = atoi(optarg);
+        break;
+      case 'R':
+        options.rampTo = atof(optarg);
+        break;
+      case 'z':
+        options.size = (unsigned)atoi(optarg);
+        break;
+      case 'm':
+        options.msgpack = true;
+        break;
+      case 'd':
+        options.duration = atof(optarg);
+        break;
+      case 'D':
+        options.drain = atof(optarg);
+        break;
+      case 'i':
+        options.reportEvery = atof(optarg);
+        break;
+      case 'l':
+        options.maxLoss = atof(optarg);
+        break;
+      case 'p':
+        options.maxP99 = atof(optarg);
+        break;
+      default:
+        return false;
+    }
+  }
+  if (options.rampTo <= 0) options.rampTo = 2 * options.rate;
+  if (options.senders < 1 || options.senders > LOADGEN_MAX_SENDERS ||
+      options.rate <= 0 || options.burst < 1 || options.duration <= 0 ||
+      options.reportEvery <= 0) {
+    printf("bad option value\n");
+    return false;
+  }
+  if (options.size > LOADGEN_BUFFER_SIZE - 128) {
+    printf("--size is limited to %d bytes\n", LOADGEN_BUFFER_SIZE - 128);
+    return false;
+  }
+  return true;
+}
+
+// the shim clock in microseconds; unlike micros() it does not wrap during
+// a long soak
+uint64_t nowMicros() { return shim::nowNanos() / 1000; }
+
+// ---- commands ------------------------------------------------------------
+
+// MessagePack pieces, for the handful of types a command needs
+unsigned packString(uint8_t* out, const char* s, unsigned length) {
+  unsigned pos = 0;
+  if (length < 32) {
+    out[pos++] = 0xa0 | length;
+  } else if (length < 256) {
+    out[pos++] = 0xd9;
+    out[pos++] = length;
+  } else {
+    out[pos++] = 0xda;
+    out[pos++] = length >> 8;
+    out[pos++] = length & 0xff;
+  }
+  memcpy(out + pos, s, length);
+  return pos + length;
+}
+
+unsigned packUint32(uint8_t* out, uint32_t value) {
+  out[0] = 0xce;
+  out[1] = value >> 24;
+  out[2] = value >> 16;
+  out[3] = value >> 8;
+  out[4] = value;
+  return 5;
+}
+
+// Builds the next command from sender into out; returns its length.
+unsigned buildCommand(Sender& sender, uint8_t* out, unsigned capacity) {
+  uint32_t n = ++sender.sent;
+  uint32_t seq = sender.seqBase + n;
+  uint32_t ts = (uint32_t)nowMicros();
+  const char* cmd = (n & 1) ? "on" : "off";
+
+  if (options.msgpack) {
+    unsigned pos = 0;
+    out[pos++] = 0x85;  // map of 5
+    pos += packString(out + pos, "senderID", 8);
+    pos += packString(out + pos, sender.id, strlen(sender.id));
+    pos += packString(out + pos, "cmd", 3);
+    pos += packString(out + pos, cmd, strlen(cmd));
+    pos += packString(out + pos, "seq", 3);
+    pos += packUint32(out + pos, seq);
+    pos += packString(out + pos, "ts", 2);
+    pos += packUint32(out + pos, ts);
+    pos += packString(out + pos, "pad", 3);
+    // the pad string's own header (1-3 bytes) comes out of the room left
+    unsigned room = options.size > pos ? options.size - pos : 0;
+    unsigned pad = room <= 32 ? (room ? room - 1 : 0)
+                   : room <= 257 ? room - 2
+                                 : room - 3;
+    pos += packString(out + pos, padding, pad);
+    return pos;
+  }
+
+  int length = snprintf((char*)out, capacity,
+                        "{\"senderID\":\"%s\",\"cmd\":\"%s\",\"seq\":%u,"
+                        "\"ts\":%u}",
+                        sender.id, cmd, seq, ts);
+  if (options.size > (unsigned)length + 9) {
+    // ,"pad":"xxx..." before the closing brace
+    unsigned pad = options.size - length - 9;
+    length--;
+    length += snprintf((char*)out + length, capacity - length,
+                       ",\"pad\":\"%.*s\"}", (int)pad, padding);
+  }
+  return length;
+}
+
+void sendCommand() {
+  Sender& sender = senders[commandsSent % senders.size()];
+  uint8_t payload[LOADGEN_BUFFER_SIZE];
+  unsigned length = buildCommand(sender, payload, sizeof(payload));
+  sender.answered.push_back(false);
+  if (!psClient.publish(commandTopic, payload, length)) sendFailures++;
+  commandsSent++;
+  intervalSent++;
+}
+
+// ---- replies -------------------------------------------------------------
+
+void onStatus(char* topic, uint8_t* payload, unsigned int length) {
+  uint32_t now = (uint32_t)nowMicros();
+  Sender* sender = nullptr;
+  for (Sender& s : senders) {
+    if (strcmp(topic, s.statusTopic) == 0) {
+      sender = &s;
+      break;
+    }
+  }
+
+  JsonField fields[8];
+  int n = isMsgPack(payload, length)
+              ? msgpackScan(payload, length, fields, 8)
+              : jsonScan((char*)payload, length, fields, 8);
+  uint32_t seq = 0, ts = 0;
+  if (sender == nullptr || n < 0 ||
+      !jsonFieldUint(fields, n, "seq", &seq) ||
+      !jsonFieldUint(fields, n, "ts", &ts)) {
+    unknownReplies++;
+    return;
+  }
+  seq -= sender->seqBase;  // which of this sender's commands, from 1
+  if (seq == 0 || seq > sender->sent) {
+    unknownReplies++;
+    return;
+  }
+
+  if (sender->answered[seq - 1]) {
+    duplicates++;
+    return;
+  }
+  sender->answered[seq - 1] = true;
+  if (seq < sender->highestReply) {
+    reordered++;
+  } else {
+    sender->highestReply = seq;
+  }
+  rtt.record(now - ts);
+  intervalRtt.record(now - ts);
+  repliesTimed++;
+  intervalReplies++;
+}
+
+// ---- schedule ------------------------------------------------------------
+
+// The time (us from the start) at which command number `index` is due.
+double dueMicros(uint64_t index) {
+  switch (options.shape) {
+    case SHAPE_BURST:
+      return (double)(index / options.burst) * options.burst / options.rate *
+             1e6;
+    case SHAPE_RAMP: {
+      // rate(t) = r0 + k t, so commands(t) = r0 t + k t^2 / 2
+      double r0 = options.rate;
+      double k = (options.rampTo - r0) / options.duration;
+      if (k == 0) return index / r0 * 1e6;
+      double t = (-r0 + sqrt(r0 * r0 + 2 * k * index)) / k;
+      return t * 1e6;
+    }
+    default:
+      return index / options.rate * 1e6;
+  }
+}
+
+double rateAt(double seconds) {
+  if (seconds > options.duration) return 0;  // draining
+  if (options.shape != SHAPE_RAMP) return options.rate;
+  return options.rate +
+         (options.rampTo - options.rate) * seconds / options.duration;
+}
+
+uint64_t unanswered() {
+  uint64_t pending = 0;
+  for (const Sender& s : senders) pending += s.sent - s.highestReply;
+  return pending;
+}
+
+void printProgress(double seconds, double interval) {
+  printf("%7.1fs  target %7.0f/s  sent %7.0f/s  replies %7.0f/s  "
+         "unanswered %6llu  rtt p50 %6.2f ms p99 %6.2f ms\n",
+         seconds, rateAt(seconds - interval / 2), intervalSent / interval,
+         intervalReplies / interval, (unsigned long long)unanswered(),
+         intervalRtt.percentile(50) / 1000.0,
+         intervalRtt.percentile(99) / 1000.0);
+  intervalSent = 0;
+  intervalReplies = 0;
+  intervalRtt.reset();
+}
+
+bool connectBroker() {
+  shim::setLiveBroker(options.broker, options.port);
+  psClient.setServer(options.broker, options.port);
+  psClient.setBufferSize(LOADGEN_BUFFER_SIZE);
+  psClient.setCallback(onStatus);
+
+  char clientId[64];
+  snprintf(clientId, sizeof(clientId), "%s-%d", LOADGEN_SENDER, (int)getpid());
+  if (!psClient.connect(clientId)) {
+    printf("could not connect to %s:%u (state %d)\n", options.broker,
+           options.port, psClient.state());
+    return false;
+  }
+  for (Sender& s : senders) {
+    if (!psClient.subscribe(s.statusTopic)) {
+      printf("could not subscribe to %s\n", s.statusTopic.c_str());
+      return false;
+    }
+  }
+  return true;
+}
+
+// Services the connection until untilMicros, handling every reply that
+// has arrived and sleeping in select() when there is nothing to do.
+void serviceUntil(uint64_t untilMicros) {
+  for (;;) {
+    while (wfClient.available() > 0) psClient.loop();
+    psClient.loop();  // keep-alive
+    uint64_t now = nowMicros();
+    if (now >= untilMicros || !psClient.connected()) return;
+    // whole milliseconds only; the last one is spent polling
+    if (untilMicros - now >= 1000) {
+      waitForWork(wfClient, (untilMicros - now) / 1000);
+    }
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  if (!parseOptions(argc, argv)) {
+    usage();
+    return 1;
+  }
+  setvbuf(stdout, nullptr, _IOLBF, 0);
+  memset(padding, 'x', sizeof(padding));
+
+  commandTopic.set(options.node, TOPIC_LED_COMMAND);
+  randomSeed((unsigned long)time(nullptr) ^ (unsigned long)getpid());
+  senders.resize(options.senders);
+  for (int i = 0; i < options.senders; i++) {
+    snprintf(senders[i].id, sizeof(senders[i].id), "%s%02d", LOADGEN_SENDER,
+             i);
+    senders[i].statusTopic.set(senders[i].id, TOPIC_LED_STATUS);
+    senders[i].seqBase = (uint32_t)random(0, 0x7fffffff);
+  }
+  if (!connectBroker()) return 1;
+
+  const char* shapes[] = {"steady", "burst", "ramp"};
+  printf("%s -> %s:%u %s, %s at %.0f/s", options.node, options.broker,
+         options.port, options.msgpack ? "MessagePack" : "JSON",
+         shapes[options.shape], options.rate);
+  if (options.shape == SHAPE_RAMP) printf(" to %.0f/s", options.rampTo);
+  if (options.shape == SHAPE_BURST) printf(" in bursts of %d", options.burst);
+  printf(", %d sender(s), %.0f s\n", options.senders, options.duration);
+
+  // all times in us from the start
+  uint64_t start = nowMicros();
+  uint64_t reportUs = (uint64_t)(options.reportEvery * 1e6);
+  uint64_t nextReport = reportUs;
+  uint64_t sendUs = (uint64_t)(options.duration * 1e6);
+  uint64_t endUs = sendUs + (uint64_t)(options.drain * 1e6);
+  for (;;) {
+    uint64_t elapsed = nowMicros() - start;
+    if (elapsed >= endUs || !psClient.connected()) break;
+
+    // everything due by now, then wait for the next command or report
+    while (elapsed < sendUs && dueMicros(commandsSent) <= elapsed) {
+      sendCommand();
+    }
+    uint64_t next = nextReport < endUs ? nextReport : endUs;
+    if (elapsed < sendUs) {
+      uint64_t due = (uint64_t)dueMicros(commandsSent);
+      if (due > sendUs) due = sendUs;
+      if (due < next) next = due;
+    }
+    serviceUntil(start + next);
+
+    if (nowMicros() - start >= nextReport) {
+      printProgress(nextReport / 1e6, options.reportEvery);
+      nextReport += reportUs;
+    }
+  }
+  double seconds = (nowMicros() - start) / 1e6;
+  bool dropped = !psClient.connected();
+  psClient.disconnect();
+
+  uint64_t superseded = 0, lost = 0;
+  for (const Sender& s : senders) {
+    for (uint32_t seq = 1; seq <= s.sent; seq++) {
+      if (s.answered[seq - 1]) continue;
+      if (seq < s.highestReply) {
+        superseded++;
+      } else {
+        lost++;
+      }
+    }
+  }
+  double sendSeconds = options.duration < seconds ? options.duration : seconds;
+  double lossPercent = commandsSent ? 100.0 * lost / commandsSent : 0;
+
+  printf("\n%llu commands in %.1f s (%.0f/s)%s, %llu send failures\n",
+         (unsigned long long)commandsSent, sendSeconds,
+         commandsSent / sendSeconds,
+         dropped ? ", BROKER CONNECTION LOST" : "",
+         (unsigned long long)sendFailures);
+  printf("  answered   %10llu  %6.2f%%\n", (unsigned long long)repliesTimed,
+         commandsSent ? 100.0 * repliesTimed / commandsSent : 0);
+  printf("  superseded %10llu  %6.2f%%  (reply folded into a later one)\n",
+         (unsigned long long)superseded,
+         commandsSent ? 100.0 * superseded / commandsSent : 0);
+  printf("  lost       %10llu  %6.2f%%\n", (unsigned long long)lost,
+         lossPercent);
+  printf("  reordered  %10llu, duplicates %llu, unrecognised %llu\n",
+         (unsigned long long)reordered, (unsigned long long)duplicates,
+         (unsigned long long)unknownReplies);
+  printf("  rtt ms     min %.2f p50 %.2f p99 %.2f p99.9 %.2f max %.2f "
+         "mean %.2f\n",
+         rtt.min() / 1000.0, rtt.percentile(50) / 1000.0,
+         rtt.percentile(99) / 1000.0, rtt.percentile(99.9) / 1000.0,
+         rtt.max() / 1000.0, rtt.mean() / 1000.0);
+
+  bool failed = false;
+  if (options.maxLoss >= 0 && lossPercent > options.maxLoss) {
+    printf("FAIL: %.2f%% lost (limit %.2f%%)\n", lossPercent,
+           options.maxLoss);
+    failed = true;
+  }
+  if (options.maxP99 >= 0 && rtt.percentile(99) / 1000.0 > options.maxP99) {
+    printf("FAIL: p99 round trip %.2f ms (limit %.2f ms)\n",
+           rtt.percentile(99) / 1000.0, options.maxP99);
+    failed = true;
+  }
+  return failed || dropped ? 2 : 0;
+}
@@ -0,0 +1,23 @@
+/*******************************************************************************
+ * LoadGen.h -- defaults for the ledCommand load generator (LoadGen.cpp).
+ * Every one of them can be changed on the command line; run with --help.
+ ******************************************************************************/
+#pragma once
+
+#include <NodeConfig.h>  // the nodes' client IDs and topics
+
+#define LOADGEN_BROKER "localhost"
+#define LOADGEN_PORT 1883
+#define LOADGEN_NODE LED_CLIENT_ID   // ledClientID of the node under test
+#define LOADGEN_SENDER "loadGen"     // senders are loadGen00, loadGen01...
+#define LOADGEN_SENDERS 1
+#define LOADGEN_RATE 100             // commands per second
+#define LOADGEN_DURATION_S 10
+#define LOADGEN_DRAIN_S 2            // wait for late replies after sending
+#define LOADGEN_BURST 10             // commands per burst (--shape burst)
+#define LOADGEN_REPORT_S 1           // progress line interval
+#define LOADGEN_MAX_SENDERS 100
+
+// MQTT buffer: the largest command or ledStatus, with room for the
+// topic and header. --size beyond this is refused.
+#define LOADGEN_BUFFER_SIZE 2048
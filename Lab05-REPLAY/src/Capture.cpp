@@ -0,0 +1,297 @@
+// Capture files for the replay tool. See Capture.h.
+#include "Capture.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+namespace {
+
+const char kBase64[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+bool readFile(const char* path, std::string& data) {
+  FILE* file = fopen(path, "rb");
+  if (!file) return false;
+  char chunk[65536];
+  size_t n;
+  data.clear();
+  while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0) data.append(chunk, n);
+  bool ok = !ferror(file);
+  fclose(file);
+  return ok;
+}
+
+// ---- MQTT-Spy -------------------------------------------------------------
+
+// The value of name="..." in the element's attributes, still XML-escaped;
+// false if it has none.
+bool attribute(const std::string& tag, const char* name, std::string& value) {
+  std::string key = std::string(" ") + name + "=\"";
+  size_t at = tag.find(key);
+  if (at == std::string::npos) return false;
+  at += key.size();
+  size_t end = tag.find('"', at);
+  if (end == std::string::npos) return false;
+  value.assign(tag, at, end - at);
+  return true;
+}
+
+std::string unescape(const std::string& text) {
+  static const struct {
+    const char* entity;
+    char c;
+  } entities[] = {{"&lt;", '<'}, {"&gt;", '>'}, {"&amp;", '&'},
+                  {"&quot;", '"'}, {"&apos;", '\''}};
+  std::string out;
+  out.reserve(text.size());
+  for (size_t i = 0; i < text.size(); i++) {
+    bool replaced = false;
+    if (text[i] == '&') {
+      for (const auto& e : entities) {
+        size_t len = strlen(e.entity);
+        if (text.compare(i, len, e.entity) == 0) {
+          out += e.c;
+          i += len - 1;
+          replaced = true;
+          break;
+        }
+      }
+    }
+    if (!replaced) out += text[i];
+  }
+  return out;
+}
+
+std::string escape(const std::string& text) {
+  std::string out;
+  out.reserve(text.size());
+  for (char c : text) {
+    switch (c) {
+      case '<': out += "&lt;"; break;
+      case '>': out += "&gt;"; break;
+      case '&': out += "&amp;"; break;
+      case '"': out += "&quot;"; break;
+      default: out += c;
+    }
+  }
+  return out;
+}
+
+std::string base64Decode(const std::string& text) {
+  std::string out;
+  uint32_t bits = 0;
+  int count = 0;
+  for (char c : text) {
+    const char* at = c ? strchr(kBase64, c) : nullptr;
+    if (!at) continue;  // padding, line breaks
+    bits = (bits << 6) | (uint32_t)(at - kBase64);
+    count += 6;
+    if (count >= 8) {
+      count -= 8;
+      out += (char)((bits >> count) & 0xff);
+    }
+  }
+  return out;
+}
+
+std::string base64Encode(const std::string& data) {
+  std::string out;
+  size_t i = 0;
+  for (; i + 2 < data.size(); i += 3) {
+    uint32_t v = (uint8_t)data[i] << 16 | (uint8_t)data[i + 1] << 8 |
+                 (uint8_t)data[i + 2];
+    out += kBase64[v >> 18];
+    out += kBase64[(v >> 12) & 63];
+    out += kBase64[(v >> 6) & 63];
+    out += kBase64[v & 63];
+  }
+  if (i < data.size()) {
+    uint32_t v = (uint8_t)data[i] << 16;
+    if (i + 1 < data.size()) v |= (uint8_t)data[i + 1] << 8;
+    out += kBase64[v >> 18];
+    out += kBase64[(v >> 12) & 63];
+    out += i + 1 < data.size() ? kBase64[(v >> 6) & 63] : '=';
+    out += '=';
+  }
+  return out;
+}
+
+// Printable text goes into the log as it is; anything else (MessagePack)
+// as Base64.
+bool isText(const std::string& payload) {
+  for (unsigned char c : payload) {
+    if (c < 0x20 && c != '\t' && c != '\n' && c != '\r') return false;
+    if (c == 0x7f) return false;
+  }
+  return true;
+}
+
+bool parseSpy(const std::string& data, Capture& capture, std::string& error) {
+  static const char kOpen[] = "<MqttMessage";
+  static const char kClose[] = "</MqttMessage>";
+  uint64_t firstMs = 0;
+  size_t pos = 0;
+  for (;;) {
+    size_t start = data.find(kOpen, pos);
+    if (start == std::string::npos) break;
+    size_t tagEnd = data.find('>', start);
+    if (tagEnd == std::string::npos) break;
+    char after = data[start + sizeof(kOpen) - 1];
+    if (after != ' ' && after != '\n' && after != '\t' && after != '\r') {
+      pos = tagEnd;  // some other element (<MqttMessages> around the log)
+      continue;
+    }
+    std::string tag(data, start, tagEnd - start);
+    CapturedMessage message;
+    std::string received, retained, encoded, topic;
+    if (!attribute(tag, "topic", topic) ||
+        !attribute(tag, "received", received)) {
+      error = "message " + std::to_string(capture.size() + 1) +
+              " has no topic or received time";
+      return false;
+    }
+    message.topic = unescape(topic);
+    message.retained = attribute(tag, "retained", retained) &&
+                       retained == "true";
+
+    // <MqttMessage .../> has no payload
+    std::string payload;
+    if (data[tagEnd - 1] == '/') {
+      pos = tagEnd + 1;
+    } else {
+      size_t end = data.find(kClose, tagEnd);
+      if (end == std::string::npos) {
+        error = "message " + std::to_string(capture.size() + 1) +
+                " is not closed";
+        return false;
+      }
+      payload.assign(data, tagEnd + 1, end - tagEnd - 1);
+      pos = end + sizeof(kClose) - 1;
+    }
+    bool base64 = attribute(tag, "encoded", encoded) && encoded == "true";
+    message.payload = base64 ? base64Decode(payload) : unescape(payload);
+
+    uint64_t ms = strtoull(received.c_str(), nullptr, 10);
+    if (capture.empty()) firstMs = ms;
+    // MQTT-Spy logs in the order received; a clock step back is a gap of 0
+    uint64_t last = capture.empty() ? 0 : capture.back().atUs;
+    uint64_t at = ms >= firstMs ? (ms - firstMs) * 1000 : 0;
+    message.atUs = at > last ? at : last;
+    capture.push_back(std::move(message));
+  }
+  return true;
+}
+
+bool writeSpy(FILE* file, const Capture& capture) {
+  uint64_t id = 1;
+  for (const CapturedMessage& message : capture) {
+    bool text = isText(message.payload);
+    fprintf(file,
+            "<MqttMessage id=\"%llu\" received=\"%llu\" subscription=\"#\" "
+            "topic=\"%s\" qos=\"0\" retained=\"%s\"%s>%s</MqttMessage>\n",
+            (unsigned long long)id++,
+            (unsigned long long)(message.atUs / 1000),
+            escape(message.topic).c_str(),
+            message.retained ? "true" : "false",
+            text ? "" : " encoded=\"true\"",
+            text ? escape(message.payload).c_str()
+                 : base64Encode(message.payload).c_str());
+  }
+  return !ferror(file);
+}
+
+// ---- binary ---------------------------------------------------------------
+
+uint32_t readLe(const uint8_t* p, int bytes) {
+  uint32_t value = 0;
+  for (int i = bytes - 1; i >= 0; i--) value = value << 8 | p[i];
+  return value;
+}
+
+void writeLe(std::string& out, uint32_t value, int bytes) {
+  for (int i = 0; i < bytes; i++) out += (char)((value >> (8 * i)) & 0xff);
+}
+
+bool parseBinary(const std::string& data, Capture& capture,
+                 std::string& error) {
+  const uint8_t* p = (const uint8_t*)data.data() + CAPTURE_MAGIC_SIZE;
+  const uint8_t* end = (const uint8_t*)data.data() + data.size();
+  uint64_t at = 0;
+  while (p < end) {
+    if (end - p < 9) {
+      error = "truncated after message " + std::to_string(capture.size());
+      return false;
+    }
+    at += readLe(p, 4);
+    uint8_t flags = p[4];
+    uint32_t topicLength = readLe(p + 5, 2);
+    uint32_t payloadLength = readLe(p + 7, 2);
+    p += 9;
+    if ((size_t)(end - p) < topicLength + payloadLength) {
+      error = "truncated in message " + std::to_string(capture.size() + 1);
+      return false;
+    }
+    CapturedMessage message;
+    message.atUs = at;
+    message.retained = flags & 1;
+    message.topic.assign((const char*)p, topicLength);
+    message.payload.assign((const char*)p + topicLength, payloadLength);
+    p += topicLength + payloadLength;
+    capture.push_back(std::move(message));
+  }
+  return true;
+}
+
+bool writeBinary(FILE* file, const Capture& capture, std::string& error) {
+  std::string out(CAPTURE_MAGIC, CAPTURE_MAGIC_SIZE);
+  uint64_t last = 0;
+  for (const CapturedMessage& message : capture) {
+    uint64_t gap = message.atUs - last;
+    if (message.topic.size() > UINT16_MAX ||
+        message.payload.size() > UINT16_MAX || gap > UINT32_MAX) {
+      error = "message too large or too far apart for the binary format";
+      return false;
+    }
+    writeLe(out, (uint32_t)gap, 4);
+    out += (char)(message.retained ? 1 : 0);
+    writeLe(out, (uint32_t)message.topic.size(), 2);
+    writeLe(out, (uint32_t)message.payload.size(), 2);
+    out += message.topic;
+    out += message.payload;
+    last = message.atUs;
+  }
+  return fwrite(out.data(), 1, out.size(), file) == out.size();
+}
+
+}  // namespace
+
+bool loadCapture(const char* path, Capture& capture, std::string& error) {
+  std::string data;
+  capture.clear();
+  if (!readFile(path, data)) {
+    error = std::string("cannot read ") + path;
+    return false;
+  }
+  if (data.compare(0, CAPTURE_MAGIC_SIZE, CAPTURE_MAGIC) == 0) {
+    return parseBinary(data, capture, error);
+  }
+  return parseSpy(data, capture, error);
+}
+
+bool saveCapture(const char* path, const Capture& capture,
+                 std::string& error) {
+  FILE* file = fopen(path, "wb");
+  if (!file) {
+    error = std::string("cannot write ") + path;
+    return false;
+  }
+  size_t length = strlen(path);
+  size_t suffix = strlen(CAPTURE_SPY_SUFFIX);
+  bool spy = length >= suffix &&
+             strcmp(path + length - suffix, CAPTURE_SPY_SUFFIX) == 0;
+  bool ok = spy ? writeSpy(file, capture) : writeBinary(file, capture, error);
+  if (fclose(file) != 0) ok = false;
+  if (!ok && error.empty()) error = std::string("cannot write ") + path;
+  return ok;
+}
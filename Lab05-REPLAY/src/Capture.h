@@ -0,0 +1,60 @@
+/*******************************************************************************
+ * Capture.h -- MQTT message captures for the replay tool (Replay.cpp)
+ *
+ * A capture is a list of messages, each with its topic, payload, retained
+ * flag and time (us since the first message). Two file formats hold one:
+ *
+ *  - MQTT-Spy message logs (../MQTT-Spy/mqtt-spy.messages), one element
+ *    per message, the payload as XML text or, with encoded="true", as
+ *    Base64; "received" is the time in ms:
+ *
+ *      <MqttMessage id="1" received="1431010093484" subscription="#"
+ *       topic="ledNodeXX/ledCommand" qos="0" retained="false">{"cmd":"on"}
+ *      </MqttMessage>
+ *
+ *  - The compact binary format written by --save and --record: the magic
+ *    "L5CAP01\n", then per message (little-endian)
+ *
+ *      uint32 us since the previous message
+ *      uint8  flags (bit 0: retained)
+ *      uint16 topic length, uint16 payload length
+ *      topic, payload (no terminators)
+ *
+ *    which keeps payloads byte for byte (MessagePack included) and is read
+ *    without any parsing.
+ *
+ * loadCapture() tells the two apart by the magic; saveCapture() picks the
+ * format from the file name (".messages" for MQTT-Spy).
+ ******************************************************************************/
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#define CAPTURE_MAGIC "L5CAP01\n"
+#define CAPTURE_MAGIC_SIZE 8
+#define CAPTURE_SPY_SUFFIX ".messages"
+
+struct CapturedMessage {
+  uint64_t atUs;  // since the first message of the capture
+  bool retained;
+  std::string topic;
+  std::string payload;
+};
+
+typedef std::vector<CapturedMessage> Capture;
+
+// Reads a capture file in either format into capture (replacing what it
+// held). Returns false, with the reason in error, if the file cannot be
+// read or is not a capture; an empty MQTT-Spy log is a valid, empty
+// capture.
+bool loadCapture(const char* path, Capture& capture, std::string& error);
+
+// Writes capture to path, as an MQTT-Spy log if the name ends in
+// CAPTURE_SPY_SUFFIX and in the binary format otherwise. Returns false if
+// the file cannot be written, or a message does not fit the binary
+// format (a topic or payload over 65535 bytes, or a gap over 71 minutes).
+bool saveCapture(const char* path, const Capture& capture,
+                 std::string& error);
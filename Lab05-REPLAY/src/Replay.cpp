@@ -0,0 +1,450 @@
+/*******************************************************************************
+ * Replay.cpp -- replays a captured MQTT session into the LED and button
+ * node code, as a throughput and latency regression benchmark
+ *
+ *   pio run -e native && .pio/build/native/program [options] CAPTURE
+ *
+ * Builds the node code from ../Lab05-LED and ../Lab05-BUTTON unchanged
+ * (NATIVE_FLEET only leaves out their sketch objects, as for the fleet
+ * simulator) and creates one LedNode and one ButtonNode in this process,
+ * with no broker: each captured message is handed to every node
+ * subscribed to its topic through its stand-in PubSubClient (deliver(),
+ * as the bench programs do), and whatever the nodes publish is recorded.
+ * What one node publishes is not passed on to the other, so a capture of
+ * both sides of a session replays as it was captured.
+ *
+ * CAPTURE is an MQTT-Spy message log (subscribe MQTT-Spy to # and save
+ * the messages, as in ../MQTT-Spy/mqtt-spy.messages) or the compact
+ * binary format of Capture.h. --save writes the capture it read in the
+ * binary format (or as another MQTT-Spy log, given a .messages name);
+ * --record writes what the nodes published, in either format, and with
+ * their times, so a recording can be replayed in turn.
+ *
+ * --pace says when each message is delivered:
+ *   sim   at its captured time on the simulated Arduino clock (the
+ *         default): timers, patterns and the gaps between messages play
+ *         out as captured, but nothing actually waits, so the run is
+ *         quick and the same every time
+ *   real  at its captured time on the wall clock
+ *   max   back to back, as fast as the nodes take them
+ *
+ * For each node it reports, per delivered message, the time from deliver()
+ * to the end of the node's next network_pass() (the message handled and
+ * its replies published) and the heap allocations, as the bench programs
+ * do, and then the messages each node published:
+ *
+ *   .pio/build/native/program --pace max --repeat 100 session.l5cap
+ *
+ * For a regression check, record what the nodes publish once, and then
+ * compare every later run against it:
+ *
+ *   program session.l5cap --record expected.l5cap
+ *   program session.l5cap --expect expected.l5cap --max-p99-us 50
+ *
+ * --expect compares the topics (and retained flags) published, in order;
+ * payloads that differ are only counted, since some carry times.
+ *
+ * Exits 0, or 1 if a file cannot be read or written or a node does not
+ * come up, or 2 if the recording differs from --expect, a node's p99
+ * exceeds --max-p99-us, or its allocations per message exceed
+ * --max-allocs.
+ ******************************************************************************/
+#include <Arduino.h>
+#include <NativeBench.h>
+#include <NativeShim.h>
+#include <getopt.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "Capture.h"
+#include "Replay.h"
+
+namespace {
+
+enum Pace { PACE_SIM, PACE_REAL, PACE_MAX };
+
+struct Options {
+  const char* capture = nullptr;
+  char ledID[CLIENT_ID_SIZE] = REPLAY_LED_ID;
+  char buttonID[CLIENT_ID_SIZE] = REPLAY_BUTTON_ID;
+  const char* only = nullptr;  // nullptr = both nodes
+  Pace pace = PACE_SIM;
+  int repeat = REPLAY_REPEAT;
+  const char* save = nullptr;
+  const char* record = nullptr;
+  const char* expect = nullptr;
+  double maxP99Us = -1;   // < 0 = no limit
+  double maxAllocs = -1;  // per message
+  bool verbose = false;
+};
+
+// A node and what the replay measured of it.
+struct Slot {
+  explicit Slot(ReplayNode* replayNode) : node(replayNode) {}
+
+  ReplayNode* node;
+  bench::LatencyStats latency;
+  uint64_t allocs = 0;
+  uint64_t delivered = 0;
+  uint64_t tooLarge = 0;  // over its MQTT buffer: dropped, as on the ESP32
+  uint64_t published = 0;
+  uint64_t publishedBytes = 0;
+};
+
+Options options;
+std::vector<Slot*> slots;
+Slot* publishing = nullptr;  // the node whose code is running
+bool recording = false;
+Capture recorded;
+uint64_t startNs;
+uint64_t hookAllocs = 0;  // made by the recording, not the node
+
+void usage() {
+  printf(
+      "usage: program [options] CAPTURE\n"
+      "  --pace sim|real|max   deliver at the captured times on the\n"
+      "                        simulated clock (sim), or the wall clock\n"
+      "                        (real), or back to back (max)\n"
+      "  --repeat N            passes over the capture (%d)\n"
+      "  --led ID              LED node client id (%s)\n"
+      "  --button ID           button node client id (%s)\n"
+      "  --only led|button     replay into one node only\n"
+      "  --save FILE           write the capture read (.messages: MQTT-Spy)\n"
+      "  --record FILE         write what the nodes published\n"
+      "  --expect FILE         exit 2 unless they published these topics\n"
+      "  --max-p99-us US       exit 2 if a node's p99 is longer\n"
+      "  --max-allocs N        exit 2 if a node allocates more per message\n"
+      "  --verbose             show the nodes' console output\n",
+      REPLAY_REPEAT, REPLAY_LED_ID, REPLAY_BUTTON_ID);
+}
+
+bool parseOptions(int argc, char** argv) {
+  static const struct option longOptions[] = {
+      {"pace", required_argument, nullptr, 'p'},
+      {"repeat", required_argument, nullptr, 'n'},
+      {"led", required_argument, nullptr, 'L'},
+      {"button", required_argument, nullptr, 'B'},
+      {"only", required_argument, nullptr, 'o'},
+      {"save", required_argument, nullptr, 's'},
+      {"record", required_argument, nullptr, 'r'},
+      {"expect", required_argument, nullptr, 'e'},
+      {"max-p99-us", required_argument, nullptr, 'u'},
+      {"max-allocs", required_argument, nullptr, 'a'},
+      {"verbose", no_argument, nullptr, 'v'},
+      {"help", no_argument, nullptr, 'h'},
+      {nullptr, 0, nullptr, 0}};
+
+  int c;
+  while ((c = getopt_long(argc, argv, "", longOptions, nullptr)) != -1) {
+    switch (c) {
+      case 'p':
+        if (strcmp(optarg, "sim") == 0) {
+          options.pace = PACE_SIM;
+        } else if (strcmp(optarg, "real") == 0) {
+          options.pace = PACE_REAL;
+        } else if (strcmp(optarg, "max") == 0) {
+          options.pace = PACE_MAX;
+        } else {
+          return false;
+        }
+        break;
+      case 'n':
+        options.repeat = atoi(optarg);
+        break;
+      case 'L':
+        snprintf(options.ledID, sizeof(options.ledID), "%s", optarg);
+        break;
+      case 'B':
+        snprintf(options.buttonID, sizeof(options.buttonID), "%s", optarg);
+        break;
+      case 'o':
+        if (strcmp(optarg, "led") != 0 && strcmp(optarg, "button") != 0) {
+          return false;
+        }
+        options.only = optarg;
+        break;
+      case 's':
+        options.save = optarg;
+        break;
+      case 'r':
+        options.record = optarg;
+        break;
+      case 'e':
+        options.expect = optarg;
+        break;
+      case 'u':
+        options.maxP99Us = atof(optarg);
+        break;
+      case 'a':
+        options.maxAllocs = atof(optarg);
+        break;
+      case 'v':
+        options.verbose = true;
+        break;
+      default:
+        return false;
+    }
+  }
+  if (optind != argc - 1 || options.repeat < 1) return false;
+  options.capture = argv[optind];
+  return true;
+}
+
+// Every node's publishes come through here (the hook has no context, so
+// publishing says whose they are).
+void notePublish(const char* topic, const uint8_t* payload,
+                 unsigned int length, bool retained) {
+  if (publishing) {
+    publishing->published++;
+    publishing->publishedBytes += length;
+  }
+  if (!recording) return;
+  uint64_t allocs = bench::allocCount();
+  CapturedMessage message;
+  message.atUs = (shim::nowNanos() - startNs) / 1000;
+  message.retained = retained;
+  message.topic = topic;
+  message.payload.assign((const char*)payload, length);
+  recorded.push_back(std::move(message));
+  hookAllocs += bench::allocCount() - allocs;
+}
+
+// MQTT topic filter matching: '+' is one level, a trailing '#' the rest
+// (and the level above it: "a/#" matches "a").
+bool filterMatches(const char* filter, const char* topic) {
+  while (*filter) {
+    if (*filter == '#') return true;
+    if (*filter == '+') {
+      while (*topic && *topic != '/') topic++;
+      filter++;
+    } else if (*filter == *topic) {
+      filter++;
+      topic++;
+    } else {
+      return *topic == '\0' && strcmp(filter, "/#") == 0;
+    }
+  }
+  return *topic == '\0';
+}
+
+bool subscribed(ReplayNode* node, const char* topic) {
+  PubSubClient& client = node->client();
+  for (int i = 0; i < client.subscriptionCount(); i++) {
+    if (filterMatches(client.subscription(i), topic)) return true;
+  }
+  return false;
+}
+
+// Passes every node once; returns the ms until one needs another pass.
+uint32_t passNodes() {
+  uint32_t waitMs = UINT32_MAX;
+  for (Slot* slot : slots) {
+    publishing = slot;
+    uint32_t ms = slot->node->pass();
+    if (ms < waitMs) waitMs = ms;
+  }
+  publishing = nullptr;
+  shim::runTimers();
+  return waitMs;
+}
+
+// Keeps passing the nodes until the simulated clock reaches untilNs,
+// moving it on over the waits (sleeping through them for real with
+// realTime).
+void runUntil(uint64_t untilNs, bool realTime) {
+  for (;;) {
+    uint32_t waitMs = passNodes();
+    uint64_t now = shim::nowNanos();
+    if (now >= untilNs) return;
+    if (waitMs == 0) continue;
+    uint64_t step = untilNs - now;
+    if (step > waitMs * 1000000ULL) step = waitMs * 1000000ULL;
+    if (realTime) {
+      std::this_thread::sleep_for(std::chrono::nanoseconds(step));
+    } else {
+      shim::advance(step);
+    }
+  }
+}
+
+// Hands one captured message to every node subscribed to its topic.
+// Returns false if none is.
+bool deliver(const CapturedMessage& message) {
+  bool matched = false;
+  for (Slot* slot : slots) {
+    if (!subscribed(slot->node, message.topic.c_str())) continue;
+    matched = true;
+    publishing = slot;
+    uint64_t hookBefore = hookAllocs;
+    uint64_t allocs = bench::allocCount();
+    uint64_t start = bench::nowNanos();
+    bool fitted = slot->node->client().deliver(
+        message.topic.c_str(), (const uint8_t*)message.payload.data(),
+        message.payload.size());
+    slot->node->pass();
+    uint64_t elapsed = bench::nowNanos() - start;
+    slot->allocs += bench::allocCount() - allocs - (hookAllocs - hookBefore);
+    publishing = nullptr;
+    if (!fitted) {
+      slot->tooLarge++;
+      continue;
+    }
+    slot->latency.add(elapsed);
+    slot->delivered++;
+  }
+  return matched;
+}
+
+// Compares the recording with the expected one: the same topics, retained
+// flags, in the same order. Prints the first difference.
+bool compareExpected(const Capture& expected) {
+  size_t payloads = 0;
+  size_t n = recorded.size() < expected.size() ? recorded.size()
+                                               : expected.size();
+  for (size_t i = 0; i < n; i++) {
+    const CapturedMessage& got = recorded[i];
+    const CapturedMessage& want = expected[i];
+    if (got.topic != want.topic || got.retained != want.retained) {
+      printf("FAIL: publish %zu is %s%s, expected %s%s\n", i + 1,
+             got.topic.c_str(), got.retained ? " (retained)" : "",
+             want.topic.c_str(), want.retained ? " (retained)" : "");
+      return false;
+    }
+    if (got.payload != want.payload) payloads++;
+  }
+  if (recorded.size() != expected.size()) {
+    printf("FAIL: %zu publishes, expected %zu\n", recorded.size(),
+           expected.size());
+    return false;
+  }
+  printf("  matches %s: %zu publishes (%zu payloads differ)\n",
+         options.expect, n, payloads);
+  return true;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  if (!parseOptions(argc, argv)) {
+    usage();
+    return 1;
+  }
+  setvbuf(stdout, nullptr, _IOLBF, 0);
+  shim::setSerialEcho(options.verbose);
+
+  std::string error;
+  Capture capture, expected;
+  if (!loadCapture(options.capture, capture, error) ||
+      (options.expect && !loadCapture(options.expect, expected, error))) {
+    printf("%s\n", error.c_str());
+    return 1;
+  }
+  if (options.save && !saveCapture(options.save, capture, error)) {
+    printf("%s\n", error.c_str());
+    return 1;
+  }
+  uint64_t spanUs = capture.empty() ? 0 : capture.back().atUs;
+  printf("%s: %zu messages over %.3f s\n", options.capture, capture.size(),
+         spanUs / 1e6);
+
+  // the nodes, recorded from their first publish (availability, state)
+  recording = options.record || options.expect;
+  if (recording) recorded.reserve(capture.size() * options.repeat + 64);
+  startNs = shim::nowNanos();
+  if (!options.only || strcmp(options.only, "led") == 0) {
+    slots.push_back(new Slot(newLedNode(options.ledID)));
+  }
+  if (!options.only || strcmp(options.only, "button") == 0) {
+    slots.push_back(new Slot(newButtonNode(options.buttonID, options.ledID)));
+  }
+  for (Slot* slot : slots) {
+    slot->latency = bench::LatencyStats(capture.size() * options.repeat);
+    slot->node->client().setPublishHook(notePublish);
+    publishing = slot;
+    slot->node->setup();
+  }
+  publishing = nullptr;
+  uint64_t setupEnd = shim::nowNanos() + REPLAY_SETUP_MS * 1000000ULL;
+  for (Slot* slot : slots) {
+    while (!slot->node->up() && shim::nowNanos() < setupEnd) {
+      runUntil(shim::nowNanos() + 1000000ULL, false);
+    }
+    if (!slot->node->up()) {
+      printf("the %s node did not come up\n", slot->node->name());
+      return 1;
+    }
+  }
+
+  // the capture, --repeat times over, each pass starting where the last
+  // one ended (and taken as new commands, not redeliveries)
+  uint64_t unmatched = 0;
+  uint64_t wallStart = bench::nowNanos();
+  for (int pass = 0; pass < options.repeat; pass++) {
+    if (pass > 0) {
+      for (Slot* slot : slots) slot->node->newPass();
+    }
+    uint64_t passStart = shim::nowNanos();
+    for (const CapturedMessage& message : capture) {
+      if (options.pace == PACE_MAX) {
+        passNodes();
+      } else {
+        runUntil(passStart + message.atUs * 1000, options.pace == PACE_REAL);
+      }
+      if (!deliver(message)) unmatched++;
+    }
+  }
+  uint64_t wallNs = bench::nowNanos() - wallStart;
+  // late replies (a group reply's spread, the button node's retries)
+  runUntil(shim::nowNanos() + REPLAY_TAIL_MS * 1000000ULL,
+           options.pace == PACE_REAL);
+
+  uint64_t messages = capture.size() * (uint64_t)options.repeat;
+  printf("%llu messages replayed in %.3f s (%.0f messages/s), %llu with "
+         "no subscriber\n\n",
+         (unsigned long long)messages, wallNs / 1e9,
+         wallNs ? messages * 1e9 / wallNs : 0.0,
+         (unsigned long long)unmatched);
+  bench::printHeader();
+  for (Slot* slot : slots) {
+    bench::printRow(slot->node->name(), slot->latency, slot->allocs);
+  }
+  printf("\n");
+  for (Slot* slot : slots) {
+    printf("  %-8s %llu delivered, %llu too large, %llu published "
+           "(%llu bytes)\n",
+           slot->node->name(), (unsigned long long)slot->delivered,
+           (unsigned long long)slot->tooLarge,
+           (unsigned long long)slot->published,
+           (unsigned long long)slot->publishedBytes);
+  }
+
+  if (options.record && !saveCapture(options.record, recorded, error)) {
+    printf("%s\n", error.c_str());
+    return 1;
+  }
+
+  bool failed = false;
+  if (options.expect && !compareExpected(expected)) failed = true;
+  for (Slot* slot : slots) {
+    size_t n = slot->latency.count();
+    double p99Us = slot->latency.percentile(99) / 1000.0;
+    if (options.maxP99Us >= 0 && n && p99Us > options.maxP99Us) {
+      printf("FAIL: %s p99 %.1f us (limit %.1f us)\n", slot->node->name(),
+             p99Us, options.maxP99Us);
+      failed = true;
+    }
+    double allocs = n ? (double)slot->allocs / n : 0;
+    if (options.maxAllocs >= 0 && allocs > options.maxAllocs) {
+      printf("FAIL: %s %.2f allocations per message (limit %.2f)\n",
+             slot->node->name(), allocs, options.maxAllocs);
+      failed = true;
+    }
+  }
+  return failed ? 2 : 0;
+}
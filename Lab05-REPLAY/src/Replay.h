@@ -0,0 +1,44 @@
+/*******************************************************************************
+ * Replay.h -- defaults for the capture replay tool (Replay.cpp), and how it
+ * drives each node. Every default can be changed on the command line; run
+ * with --help.
+ ******************************************************************************/
+#pragma once
+
+#include <NodeConfig.h>  // the nodes' client IDs
+#include <PubSubClient.h>
+#include <stdint.h>
+
+#ifdef DUAL_CORE
+#error "the replay tool runs the single-core nodes (no DUAL_CORE)"
+#endif
+
+#define REPLAY_LED_ID LED_CLIENT_ID
+#define REPLAY_BUTTON_ID BUTTON_CLIENT_ID
+#define REPLAY_REPEAT 1       // passes over the capture
+#define REPLAY_TAIL_MS 1000   // after the last message, for late replies
+#define REPLAY_SETUP_MS 5000  // a node not up by then is a failure
+
+// One node under replay, as Replay.cpp sees it. The nodes live in
+// ReplayLed.cpp and ReplayButton.cpp (LedNode.h and ButtonNode.h give the
+// same configuration macros different values, so they cannot share a
+// file).
+class ReplayNode {
+ public:
+  virtual ~ReplayNode() {}
+
+  virtual const char* name() const = 0;  // "led", "button"
+  virtual void setup() = 0;
+  // network_pass(); returns the ms until the node next needs a pass
+  virtual uint32_t pass() = 0;
+  virtual bool up() const = 0;
+  // before every pass after the first: forget the commands the last pass
+  // carried out, whose seqs the next one repeats
+  virtual void newPass() {}
+  // its stand-in MQTT client: deliver() the captured messages into it,
+  // its publish hook and its subscriptions
+  virtual PubSubClient& client() = 0;
+};
+
+ReplayNode* newLedNode(const char* clientID);
+ReplayNode* newButtonNode(const char* clientID, const char* ledID);
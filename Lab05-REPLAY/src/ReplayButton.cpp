@@ -0,0 +1,32 @@
+// The replay tool's button node: the ButtonNode class from
+// ../Lab05-BUTTON, unchanged. Its buttons are never pressed; it only
+// hears the captured ledStatus, state and availability messages. See
+// Replay.h.
+#include "ButtonNode.h"
+#include "Replay.h"
+
+namespace {
+
+class ReplayButton : public ReplayNode {
+ public:
+  ReplayButton(const char* clientID, const char* ledID)
+      : node_(clientID, ledID) {}
+
+  const char* name() const override { return "button"; }
+  void setup() override { node_.setup(); }
+  uint32_t pass() override {
+    uint32_t waitMs = node_.network_pass();
+    return node_.wfClient.available() > 0 ? 0 : waitMs;
+  }
+  bool up() const override { return node_.netLink.isUp(); }
+  PubSubClient& client() override { return node_.psClient; }
+
+ private:
+  ButtonNode node_;
+};
+
+}  // namespace
+
+ReplayNode* newButtonNode(const char* clientID, const char* ledID) {
+  return new ReplayButton(clientID, ledID);
+}
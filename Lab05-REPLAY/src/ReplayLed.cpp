@@ -0,0 +1,31 @@
+// The replay tool's LED node: the LedNode class from ../Lab05-LED,
+// unchanged. See Replay.h.
+#include "Replay.h"
+#include "LedNode.h"
+
+namespace {
+
+class ReplayLed : public ReplayNode {
+ public:
+  explicit ReplayLed(const char* clientID) : node_(clientID) {}
+
+  const char* name() const override { return "led"; }
+  void setup() override { node_.setup(); }
+  uint32_t pass() override {
+    uint32_t waitMs = node_.network_pass();
+    return node_.wfClient.available() > 0 ? 0 : waitMs;
+  }
+  bool up() const override { return node_.netLink.isUp(); }
+  // or the command window drops every command as a duplicate
+  void newPass() override { node_.commandWindow.clear(); }
+  PubSubClient& client() override { return node_.psClient; }
+
+ private:
+  LedNode node_;
+};
+
+}  // namespace
+
+ReplayNode* newLedNode(const char* clientID) {
+  return new ReplayLed(clientID);
+}